@@ -18,8 +18,15 @@ set(CMAKE_SIZE			    size)
 # common build settings
 set(STACK_USAGE "-fstack-usage -Wstack-usage=2048")
 set(WARNING_FLAGS "-Wall -Werror -Wextra -Wdouble-promotion -Wformat=2 -Wformat-overflow -Wundef -Wformat-truncation -Wfloat-equal -Wshadow")
-set(COMMON_FLAGS "${OPTIM_LVL} ${DEBUG_LVL} ${WARNING_FLAGS} ${STACK_USAGE} --coverage -pedantic  -fmessage-length=0 -ffunction-sections -fdata-sections -ffreestanding -fno-builtin")
-set(CMAKE_EXE_LINKER_FLAGS  " --coverage " CACHE INTERNAL "exe link flags")
+# build with AddressSanitizer and UndefinedBehaviorSanitizer, e.g. for the input path fuzz tests.
+# The sanitizers make the stack frames much bigger, so the stack usage warning is left out
+option(HOST_SANITIZERS "build the host tests with the address and undefined behaviour sanitizers" OFF)
+if(HOST_SANITIZERS)
+    set(STACK_USAGE "-fstack-usage")
+    set(SANITIZER_FLAGS "-fsanitize=address,undefined -fno-sanitize-recover=all -fno-omit-frame-pointer")
+endif()
+set(COMMON_FLAGS "${OPTIM_LVL} ${DEBUG_LVL} ${WARNING_FLAGS} ${STACK_USAGE} ${SANITIZER_FLAGS} --coverage -pedantic  -fmessage-length=0 -ffunction-sections -fdata-sections -ffreestanding -fno-builtin")
+set(CMAKE_EXE_LINKER_FLAGS  " --coverage ${SANITIZER_FLAGS} " CACHE INTERNAL "exe link flags")
 
 # C compiler settings
 set(C_FLAGS "")
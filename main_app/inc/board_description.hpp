@@ -0,0 +1,268 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __BOARD_DESCRIPTION_HPP__
+#define __BOARD_DESCRIPTION_HPP__
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <keypad_manager.hpp>
+#include <note.hpp>
+#include <step.hpp>
+#include <utility>
+
+namespace bass_station
+{
+
+/// @brief The wiring of the sequencer PCB. The step, sweep and note tables used by the firmware are generated from it
+/// at compile time (and checked by the static_asserts at the end of this file), so a wiring change is made here once.
+namespace board
+{
+
+/// @brief Step buttons on each row of the sequencer
+constexpr std::size_t steps_per_row{16};
+constexpr std::size_t step_count{2 * steps_per_row};
+
+/// @brief The step buttons are on ADP5587 keypad rows R0-R7. The left eight buttons of a sequencer row are on one keypad
+/// column and the right eight on the next.
+constexpr uint8_t keypad_rows{8};
+constexpr uint8_t keypad_columns{4};
+
+/// @brief The ADP5587 key event number of the key at a keypad row and column (datasheet: row * 10 + column + 1)
+constexpr uint8_t adp5587_key_event(uint8_t row, uint8_t column) { return static_cast<uint8_t>(row * 10 + column + 1); }
+
+/// @brief The wiring of one row of step buttons and LEDs
+struct RowWiring
+{
+  /// @brief The TLC5955 that drives the row
+  SequencerRow m_row;
+  /// @brief The keypad column of the left eight buttons, the right eight are on the next column
+  uint8_t m_first_keypad_column;
+  /// @brief The TLC5955 output of each LED, left to right
+  std::array<uint8_t, steps_per_row> m_tlc5955_pins;
+};
+
+/// @brief The two rows, in step map order. LedManager sends the first half of the step map to the lower row TLC5955.
+constexpr std::array<RowWiring, 2> step_rows{{
+    {SequencerRow::lower, 0, {4, 0, 5, 1, 2, 6, 3, 7, 11, 15, 10, 14, 13, 9, 12, 8}},
+    {SequencerRow::upper, 2, {7, 3, 6, 2, 1, 5, 0, 4, 8, 12, 9, 13, 14, 10, 15, 11}},
+}};
+
+/// @brief The sequence begins on this row and ends on the other one, sweeping left to right
+constexpr SequencerRow first_played_row{SequencerRow::upper};
+
+/// @brief The ADG2188 poles of the crosspoint, by Y line (Y0, Y2, Y4, Y6) and X line. A contact number counts along the
+/// X lines of each Y line in turn.
+constexpr std::size_t crosspoint_x_lines{8};
+// clang-format off
+constexpr std::array<std::array<adg2188::Driver::Pole, crosspoint_x_lines>, 4> crosspoint_poles{{
+    {adg2188::Driver::Pole::x0_to_y0, adg2188::Driver::Pole::x1_to_y0, adg2188::Driver::Pole::x2_to_y0, adg2188::Driver::Pole::x3_to_y0,
+     adg2188::Driver::Pole::x4_to_y0, adg2188::Driver::Pole::x5_to_y0, adg2188::Driver::Pole::x6_to_y0, adg2188::Driver::Pole::x7_to_y0},
+    {adg2188::Driver::Pole::x0_to_y2, adg2188::Driver::Pole::x1_to_y2, adg2188::Driver::Pole::x2_to_y2, adg2188::Driver::Pole::x3_to_y2,
+     adg2188::Driver::Pole::x4_to_y2, adg2188::Driver::Pole::x5_to_y2, adg2188::Driver::Pole::x6_to_y2, adg2188::Driver::Pole::x7_to_y2},
+    {adg2188::Driver::Pole::x0_to_y4, adg2188::Driver::Pole::x1_to_y4, adg2188::Driver::Pole::x2_to_y4, adg2188::Driver::Pole::x3_to_y4,
+     adg2188::Driver::Pole::x4_to_y4, adg2188::Driver::Pole::x5_to_y4, adg2188::Driver::Pole::x6_to_y4, adg2188::Driver::Pole::x7_to_y4},
+    {adg2188::Driver::Pole::x0_to_y6, adg2188::Driver::Pole::x1_to_y6, adg2188::Driver::Pole::x2_to_y6, adg2188::Driver::Pole::x3_to_y6,
+     adg2188::Driver::Pole::x4_to_y6, adg2188::Driver::Pole::x5_to_y6, adg2188::Driver::Pole::x6_to_y6, adg2188::Driver::Pole::x7_to_y6},
+}};
+// clang-format on
+
+/// @brief The BassStation keyboard contacts are wired from contact 4 (X4/Y0) upwards, one per key from C0
+constexpr std::size_t first_note_contact{4};
+
+/// @brief The names of the keyboard keys, from C0
+constexpr std::array<const char *, Note::none> note_names{"C0 ", "C0#", "D0 ", "D0#", "E0 ", "F0 ", "F0#", "G0 ", "G0#",
+                                                          "A1 ", "A1#", "B1 ", "C1 ", "C1#", "D1 ", "D1#", "E1 ", "F1 ",
+                                                          "F1#", "G1 ", "G1#", "A2 ", "A2#", "B2 ", "C2 "};
+
+/// @brief The state and note of a step in a default pattern
+struct DefaultStep
+{
+  StepState m_state;
+  Note m_note;
+};
+using DefaultPattern = std::array<DefaultStep, step_count>;
+
+/// @brief Get the press event of a key from its release event
+constexpr SequencerKeyEventIndex pressed(uint8_t event)
+{
+  return static_cast<SequencerKeyEventIndex>(event | static_cast<uint8_t>(SequencerKeyEventIndex::ON));
+}
+
+/// @brief Get the key event (press) of a step, by its step map index
+constexpr SequencerKeyEventIndex key_event(std::size_t step)
+{
+  const RowWiring &wiring = step_rows[step / steps_per_row];
+  const std::size_t button = step % steps_per_row;
+  const uint8_t event =
+      adp5587_key_event(static_cast<uint8_t>(button % keypad_rows), static_cast<uint8_t>(wiring.m_first_keypad_column + button / keypad_rows));
+  return pressed(event);
+}
+
+/// @brief Get the TLC5955 output of the LED of a step, by its step map index
+constexpr uint8_t tlc5955_pin(std::size_t step) { return step_rows[step / steps_per_row].m_tlc5955_pins[step % steps_per_row]; }
+
+/// @brief Generate the step map entry of a step, by its step map index
+constexpr std::pair<SequencerKeyEventIndex, Step> make_step(std::size_t step, const DefaultStep &default_step)
+{
+  return {key_event(step), Step(default_step.m_state, default_step.m_note, default_colour, static_cast<uint8_t>(step))};
+}
+
+template <std::size_t... STEP>
+constexpr std::array<std::pair<SequencerKeyEventIndex, Step>, step_count> make_step_data(const DefaultPattern &pattern, std::index_sequence<STEP...>)
+{
+  return {{make_step(STEP, pattern[STEP])...}};
+}
+
+/// @brief Generate the step map data for a default pattern
+constexpr std::array<std::pair<SequencerKeyEventIndex, Step>, step_count> make_step_data(const DefaultPattern &pattern)
+{
+  return make_step_data(pattern, std::make_index_sequence<step_count>());
+}
+
+/// @brief Generate the order in which the cursor sweeps the step map
+constexpr std::array<uint8_t, step_count> make_sweep_order()
+{
+  const std::size_t first_half = (step_rows[0].m_row == first_played_row) ? 0 : 1;
+  std::array<uint8_t, step_count> order{};
+  for (std::size_t position = 0; position < step_count; position++)
+  {
+    const std::size_t half = (position < steps_per_row) ? first_half : (1 - first_half);
+    order[position]        = static_cast<uint8_t>(half * steps_per_row + position % steps_per_row);
+  }
+  return order;
+}
+
+template <std::size_t... NOTE> constexpr std::array<NoteData, Note::none> make_note_data(std::index_sequence<NOTE...>)
+{
+  return {{NoteData(note_names[NOTE],
+                    crosspoint_poles[(first_note_contact + NOTE) / crosspoint_x_lines][(first_note_contact + NOTE) % crosspoint_x_lines])...}};
+}
+
+/// @brief Generate the name and crosspoint pole of each note, indexed by Note
+constexpr std::array<NoteData, Note::none> make_note_data() { return make_note_data(std::make_index_sequence<Note::none>()); }
+
+/// @brief Check that the first COUNT values of a table are COUNT different values below COUNT
+template <typename TABLE> constexpr bool is_permutation(const TABLE &table, std::size_t count)
+{
+  for (std::size_t idx = 0; idx < count; idx++)
+  {
+    if (static_cast<std::size_t>(table[idx]) >= count)
+    {
+      return false;
+    }
+    for (std::size_t other = 0; other < idx; other++)
+    {
+      if (table[other] == table[idx])
+      {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+constexpr bool key_events_valid()
+{
+  for (std::size_t step = 0; step < step_count; step++)
+  {
+    for (std::size_t other = 0; other < step; other++)
+    {
+      if (key_event(other) == key_event(step))
+      {
+        return false;
+      }
+    }
+  }
+  for (const RowWiring &wiring : step_rows)
+  {
+    if (wiring.m_first_keypad_column + (steps_per_row - 1) / keypad_rows >= keypad_columns)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// @brief The release events of the step buttons, by step map index, as the ADP5587 reports them:
+///              1       2       3       4       5       6       7       8       9       10      11      12      13      14      15      16
+///  UpperRow    131/3   141/13  151/23  161/33  171/43  181/53  191/63  201/73  132/4   142/14  152/24  162/34  172/44  182/54  192/64  202/74
+///  LowerRow    129/1   139/11  149/21  159/31  169/41  179/51  189/61  199/71  130/2   140/12  150/22  160/32  170/42  180/52  190/62  200/72
+// clang-format off
+constexpr std::array<SequencerKeyEventIndex, step_count> wired_key_events{
+    SequencerKeyEventIndex::A0_OFF, SequencerKeyEventIndex::A1_OFF, SequencerKeyEventIndex::A2_OFF, SequencerKeyEventIndex::A3_OFF,
+    SequencerKeyEventIndex::A4_OFF, SequencerKeyEventIndex::A5_OFF, SequencerKeyEventIndex::A6_OFF, SequencerKeyEventIndex::A7_OFF,
+    SequencerKeyEventIndex::B0_OFF, SequencerKeyEventIndex::B1_OFF, SequencerKeyEventIndex::B2_OFF, SequencerKeyEventIndex::B3_OFF,
+    SequencerKeyEventIndex::B4_OFF, SequencerKeyEventIndex::B5_OFF, SequencerKeyEventIndex::B6_OFF, SequencerKeyEventIndex::B7_OFF,
+    SequencerKeyEventIndex::C0_OFF, SequencerKeyEventIndex::C1_OFF, SequencerKeyEventIndex::C2_OFF, SequencerKeyEventIndex::C3_OFF,
+    SequencerKeyEventIndex::C4_OFF, SequencerKeyEventIndex::C5_OFF, SequencerKeyEventIndex::C6_OFF, SequencerKeyEventIndex::C7_OFF,
+    SequencerKeyEventIndex::D0_OFF, SequencerKeyEventIndex::D1_OFF, SequencerKeyEventIndex::D2_OFF, SequencerKeyEventIndex::D3_OFF,
+    SequencerKeyEventIndex::D4_OFF, SequencerKeyEventIndex::D5_OFF, SequencerKeyEventIndex::D6_OFF, SequencerKeyEventIndex::D7_OFF,
+};
+// clang-format on
+
+/// @brief Check the generated key event of every step against the ADP5587 events of the buttons
+constexpr bool key_events_wired()
+{
+  for (std::size_t step = 0; step < step_count; step++)
+  {
+    if (key_event(step) != pressed(static_cast<uint8_t>(wired_key_events[step])))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+constexpr bool note_poles_valid()
+{
+  const std::array<NoteData, Note::none> notes = make_note_data();
+  for (std::size_t note = 0; note < notes.size(); note++)
+  {
+    for (std::size_t other = 0; other < note; other++)
+    {
+      if (notes[other].m_sw == notes[note].m_sw)
+      {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static_assert(steps_per_row == 2 * keypad_rows, "each row of buttons is on two keypad columns");
+static_assert(step_rows[0].m_row == SequencerRow::lower && step_rows[1].m_row == SequencerRow::upper,
+              "LedManager sends the first half of the step map to the lower row");
+static_assert(key_events_valid(), "every step button needs its own keypad key");
+static_assert(key_events_wired(), "the keypad wiring does not match the ADP5587 key events");
+static_assert(is_permutation(step_rows[0].m_tlc5955_pins, steps_per_row) && is_permutation(step_rows[1].m_tlc5955_pins, steps_per_row),
+              "every LED of a row needs its own TLC5955 output");
+static_assert(is_permutation(make_sweep_order(), step_count), "the sweep must visit every step once");
+static_assert(first_note_contact + Note::none <= crosspoint_poles.size() * crosspoint_x_lines, "the keyboard needs more crosspoint contacts");
+static_assert(note_poles_valid(), "every note needs its own crosspoint pole");
+
+} // namespace board
+
+} // namespace bass_station
+
+#endif // __BOARD_DESCRIPTION_HPP__
@@ -0,0 +1,70 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __CRITICAL_SECTION_HPP__
+#define __CRITICAL_SECTION_HPP__
+
+#include <cstdint>
+
+#if defined(X86_UNIT_TESTING_ONLY)
+  // only used when unit testing on x86
+  #include <mock_cmsis.hpp>
+#else
+  #pragma GCC diagnostic push
+  #pragma GCC diagnostic ignored "-Wvolatile"
+  #include <stm32g0xx.h>
+  #pragma GCC diagnostic pop
+#endif
+
+namespace bass_station
+{
+
+/// @brief Masks interrupts for the lifetime of the object and restores the previous PRIMASK state when it goes out of scope.
+/// Safe to nest and safe to use from within an ISR. Keep the guarded code to a handful of instructions.
+class CriticalSection
+{
+public:
+  CriticalSection()
+  {
+#if not defined(X86_UNIT_TESTING_ONLY)
+    m_primask = __get_PRIMASK();
+    __disable_irq();
+#endif
+  }
+
+  ~CriticalSection()
+  {
+#if not defined(X86_UNIT_TESTING_ONLY)
+    __set_PRIMASK(m_primask);
+#endif
+  }
+
+  CriticalSection(const CriticalSection &)            = delete;
+  CriticalSection &operator=(const CriticalSection &) = delete;
+
+private:
+  uint32_t m_primask{0};
+};
+
+} // namespace bass_station
+
+#endif // __CRITICAL_SECTION_HPP__
@@ -0,0 +1,90 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __DEFERRED_WORK_HPP__
+#define __DEFERRED_WORK_HPP__
+
+#include <event_queue.hpp>
+
+namespace bass_station
+{
+
+/// @brief Bottom half for interrupt handlers.
+/// An ISR (the top half) only captures a timestamp, clears its flag and calls schedule(). The work item is then run by
+/// run_pending() from PendSV_Handler, which has the lowest NVIC priority, so the other interrupts are never held off by it.
+class DeferredWork
+{
+public:
+  /// @brief The bottom half function
+  /// @param context The pointer given to schedule()
+  /// @param timestamp_us The timestamp captured by the top half
+  using Handler = void (*)(void *context, uint32_t timestamp_us);
+
+  /// @brief A queued bottom half
+  struct WorkItem
+  {
+    Handler m_handler;
+    void *m_context;
+    uint32_t m_timestamp_us;
+  };
+
+  /// @brief Timing figures, all in microseconds
+  struct Stats
+  {
+    /// @brief longest time from the top half timestamp to the work item being queued
+    uint32_t m_max_top_half_us;
+    /// @brief time from the top half timestamp to the start of the bottom half
+    uint32_t m_last_dispatch_latency_us;
+    uint32_t m_max_dispatch_latency_us;
+    /// @brief longest run time of a single bottom half
+    uint32_t m_max_bottom_half_us;
+    /// @brief number of bottom halves run
+    uint32_t m_run_count;
+  };
+
+  /// @brief Set PendSV to the lowest priority. Call once before any interrupt can call schedule().
+  static void initialise();
+
+  /// @brief Queue a bottom half and pend PendSV. Call from the top half.
+  /// @param handler The bottom half function
+  /// @param context Passed to handler
+  /// @param timestamp_us The timestamp captured on entry to the top half
+  /// @return false if the queue was full and the work was dropped
+  static bool schedule(Handler handler, void *context, uint32_t timestamp_us);
+
+  /// @brief Run all queued bottom halves in order. Called from PendSV_Handler (or directly by host tests).
+  static void run_pending();
+
+  /// @brief Get the timing figures
+  static const Stats &stats() { return m_stats; }
+
+private:
+  /// @brief Filled by the top halves, emptied by PendSV. Pushes are serialised with a CriticalSection
+  /// because top halves at different priorities may share it.
+  static inline SpscQueue<WorkItem, 16> m_work_queue;
+
+  static inline Stats m_stats{0, 0, 0, 0, 0};
+};
+
+} // namespace bass_station
+
+#endif // __DEFERRED_WORK_HPP__
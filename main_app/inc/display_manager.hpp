@@ -24,6 +24,7 @@
 #define __DISPLAY_MANAGER_HPP__
 
 #include <isr_manager_stm32g0.hpp>
+#include <pattern_grid.hpp>
 #include <ssd1306.hpp>
 
 namespace bass_station
@@ -54,10 +55,47 @@ public:
   // @param msg The text to write
   template <std::size_t MSG_SIZE> void set_display_line(DisplayLine line, noarch::containers::StaticString<MSG_SIZE> &msg);
 
+  // @brief The available display layouts
+  enum class View
+  {
+    TEXT,    // @brief six lines of text set by set_display_line()
+    PATTERN, // @brief 32-step grid, piano roll and LINE_SIX as a status line
+  };
+
+  // @brief Select the display layout. The whole display is cleared and redrawn on the next update.
+  // @param view The layout to use
+  void set_view(View view);
+
   // @brief redraw the display
   void update_oled();
 
+  // @brief Incrementally redraw the pattern view. Only cells that changed since the last call are written.
+  // @param sequencer_map The step map holding the pattern data
+  // @param cursor_idx The step map index of the current sequencer position
+  // @param selected_idx The step map index of the last user selected key
+  void update_pattern_view(SequencerStepMap &sequencer_map, uint8_t cursor_idx, uint8_t selected_idx);
+
 private:
+  // @brief The current display layout
+  View m_view{View::TEXT};
+
+  // @brief Frame state of the pattern view, used to find the cells that need redrawing
+  PatternGrid m_pattern_grid;
+
+  // @brief list of changed cells, filled by PatternGrid::update()
+  std::array<PatternGrid::DirtyCell, PatternGrid::max_dirty_cells> m_dirty_cells;
+
+  // @brief LINE_SIX has been set since it was last drawn in the pattern view
+  bool m_status_line_dirty{true};
+
+  // @brief pixel pitch of a pattern view cell
+  static constexpr uint8_t m_cell_pitch_x{7};
+  static constexpr uint8_t m_cell_pitch_y{10};
+  // @brief first text line of each pattern view area
+  static constexpr uint8_t m_grid_first_line{0};
+  static constexpr uint8_t m_roll_first_line{2};
+  static constexpr uint8_t m_status_line{5};
+
   noarch::containers::StaticString<20> m_display_line1;
   noarch::containers::StaticString<20> m_display_line2;
   noarch::containers::StaticString<20> m_display_line3;
@@ -93,6 +131,7 @@ template <std::size_t MSG_SIZE> void DisplayManager::set_display_line(DisplayLin
       break;
     case DisplayLine::LINE_SIX:
       m_display_line6.concat(0, msg);
+      m_status_line_dirty = true;
       break;
   }
 }
@@ -0,0 +1,120 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __EVENT_QUEUE_HPP__
+#define __EVENT_QUEUE_HPP__
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace bass_station
+{
+
+/// @brief The types of event passed from interrupt context to the main loop
+enum class EventType : uint8_t
+{
+  StepAdvance, // @brief The tempo timer has counted a full step (12 MIDI clocks)
+  ModeToggle,  // @brief The rotary encoder switch was pressed. m_data16 holds the encoder count at the time of the press
+  KeyEvent,    // @brief A keypad event. m_data8 holds the ADP5587 KeyEventIndex
+  MidiByte,    // @brief A byte was received on MIDI IN. m_data8 holds the byte
+};
+
+/// @brief A single event. Kept to one 32-bit word so it is cheap to copy in an ISR.
+struct Event
+{
+  EventType m_type;
+  uint8_t m_data8;
+  uint16_t m_data16;
+};
+
+/// @brief Lock-free single-producer single-consumer ring buffer.
+/// The producer only writes m_head and the consumer only writes m_tail, so no read-modify-write
+/// instructions are needed (Cortex-M0+ has no LDREX/STREX). Aligned 32-bit loads/stores are single-copy atomic,
+/// and acquire/release ordering stops the compiler moving the buffer access past the index update.
+/// @note All interrupts that push to the same queue must share one NVIC priority so they cannot
+/// preempt each other, making them a single logical producer.
+/// @tparam ITEM The queued type
+/// @tparam SIZE The capacity. Must be a power of two so the indices can wrap with a mask.
+template <typename ITEM, std::size_t SIZE> class SpscQueue
+{
+  static_assert((SIZE >= 2) && ((SIZE & (SIZE - 1)) == 0), "SpscQueue SIZE must be a power of two");
+
+public:
+  /// @brief Add an item to the queue. Producer side only.
+  /// @param item The item to add
+  /// @return true if added, false if the queue was full (the item is dropped and counted)
+  bool push(const ITEM &item)
+  {
+    const uint32_t head = m_head.load(std::memory_order_relaxed);
+    if (head - m_tail.load(std::memory_order_acquire) >= SIZE)
+    {
+      m_dropped_count = m_dropped_count + 1;
+      return false;
+    }
+    m_buffer[head & m_index_mask] = item;
+    m_head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /// @brief Remove the oldest item from the queue. Consumer side only.
+  /// @param item Receives the removed item
+  /// @return true if an item was removed, false if the queue was empty
+  bool pop(ITEM &item)
+  {
+    const uint32_t tail = m_tail.load(std::memory_order_relaxed);
+    if (tail == m_head.load(std::memory_order_acquire))
+    {
+      return false;
+    }
+    item = m_buffer[tail & m_index_mask];
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /// @brief Check if there is nothing left to pop
+  bool empty() const { return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire); }
+
+  /// @brief The number of items that were dropped because the queue was full
+  uint32_t dropped_count() const { return m_dropped_count; }
+
+private:
+  static constexpr uint32_t m_index_mask{SIZE - 1};
+
+  std::array<ITEM, SIZE> m_buffer{};
+
+  /// @brief Free running write index, only written by the producer
+  std::atomic<uint32_t> m_head{0};
+  /// @brief Free running read index, only written by the consumer
+  std::atomic<uint32_t> m_tail{0};
+
+  /// @brief Only written by the producer
+  volatile uint32_t m_dropped_count{0};
+};
+
+/// @brief The queue used to pass events from the SequenceManager ISRs to the main loop
+using EventQueue = SpscQueue<Event, 32>;
+
+} // namespace bass_station
+
+#endif // __EVENT_QUEUE_HPP__
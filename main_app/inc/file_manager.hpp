@@ -25,23 +25,58 @@
 
 #include <array>
 #include <ff_driver.hpp>
+#include <input_recorder.hpp>
+#include <pattern_library.hpp>
+#include <sector_cache.hpp>
 
 namespace bass_station
 {
 
+/// @brief Owns the uSD card volume and the pattern library on it
 class FileManager
 {
 public:
+  /// @brief The MMC/SPI diskio layer with a sector cache in front of it: 8 sectors, read-ahead of 4
+  using CachedDiskio = SectorCache<fatfs::DiskioHardwareMMC<fatfs::DiskioProtocolSPI>, 8, 4>;
+  using CachedDriver = fatfs::Driver<CachedDiskio>;
+
+  /// @brief Construct a new File Manager object, mount the card and open the pattern library.
+  /// Check ready() before using the library, the card may be missing.
+  /// @param fatfs_spi_interface The SPI peripheral and pins of the uSD card
   explicit FileManager(fatfs::DiskioProtocolSPI &fatfs_spi_interface);
 
+  /// @brief Check if the card is mounted and the library is open
+  bool ready() const { return m_library.is_open(); }
+
+  /// @brief Get the pattern library
+  PatternLibrary<CachedDriver> &library() { return m_library; }
+
+  /// @brief Get the sector cache hit/miss counters
+  const CachedDiskio::Statistics &cache_statistics() const { return m_sector_cache.statistics(); }
+
+  /// @brief Write the records of an InputRecorder log to INPUTS.BIN, in the format of the RTT input channel.
+  /// An existing file is replaced.
+  /// @param log The log
+  /// @return false if the card is not ready or the write failed, see last_result()
+  bool save_input_log(const InputRecorder::Log &log);
+
+  /// @brief Get the result of the last failed FatFs call
+  fatfs::FRESULT last_result() const { return m_last_result; }
+
 private:
   fatfs::DiskioHardwareMMC<fatfs::DiskioProtocolSPI> m_diskio_mmc_spi;
-  fatfs::DriverSPI m_fat_spi_driver;
+  CachedDiskio m_sector_cache;
+  CachedDriver m_fat_spi_driver;
   fatfs::FATFS m_filesys;
-  fatfs::FRESULT m_last_result;
+  fatfs::FRESULT m_last_result{fatfs::FRESULT::FR_OK};
+  PatternLibrary<CachedDriver> m_library;
 
   // uSD device logical drive path
-  std::array<fatfs::TCHAR, 4> m_sd_path;
+  static constexpr std::array<fatfs::TCHAR, 3> m_sd_path{'0', ':', '\0'};
+  // pattern library file, 8.3 name so it does not depend on long file name support
+  static constexpr std::array<fatfs::TCHAR, 16> m_library_path{"0:/PATTERNS.BSL"};
+  // input log of the previous run, see InputRecorder
+  static constexpr std::array<fatfs::TCHAR, 14> m_input_log_path{"0:/INPUTS.BIN"};
 };
 
 } // namespace bass_station
@@ -0,0 +1,153 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __FLASH_DEVICE_HPP__
+#define __FLASH_DEVICE_HPP__
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+namespace bass_station
+{
+
+/// @brief Page-erasable flash memory with double-word (64-bit) programming, as on the STM32G0.
+/// Pages are numbered from 0 within the region owned by the implementation.
+class FlashDevice
+{
+public:
+  /// @brief Size of an erase page
+  static constexpr std::size_t page_size{2048};
+  /// @brief Size of the smallest programmable unit
+  static constexpr std::size_t double_word_size{8};
+  /// @brief The value of every byte after an erase
+  static constexpr uint8_t erased_byte{0xFF};
+
+  /// @brief Get the number of pages in the region. Zero if the region is unavailable.
+  virtual std::size_t page_count() const = 0;
+
+  /// @brief Get a read pointer to the start of a page (flash is memory mapped)
+  /// @param page The page number
+  virtual const uint8_t *read(std::size_t page) const = 0;
+
+  /// @brief Progress of an erase started with start_erase()
+  enum class EraseStatus
+  {
+    BUSY,
+    DONE,
+    FAILED,
+  };
+
+  /// @brief Start erasing a page and return without waiting for it to finish
+  /// @param page The page number
+  /// @return false on error
+  virtual bool start_erase(std::size_t page) = 0;
+
+  /// @brief Poll the erase started by start_erase()
+  virtual EraseStatus erase_status() = 0;
+
+  /// @brief Erase a page and wait for it to finish
+  /// @param page The page number
+  /// @return false on error
+  bool erase(std::size_t page)
+  {
+    if (!start_erase(page))
+    {
+      return false;
+    }
+    EraseStatus status;
+    while ((status = erase_status()) == EraseStatus::BUSY)
+    {
+    }
+    return status == EraseStatus::DONE;
+  }
+
+  /// @brief Program erased double words
+  /// @param page The page number
+  /// @param offset Byte offset in the page, double-word aligned
+  /// @param data The bytes to write
+  /// @param length Number of bytes, a multiple of double_word_size
+  /// @return false on error, including any target double word that was not erased
+  virtual bool program(std::size_t page, std::size_t offset, const uint8_t *data, std::size_t length) = 0;
+};
+
+/// @brief Host implementation of FlashDevice backed by a memory buffer, with the same programming rules as the hardware
+/// @tparam PAGE_COUNT The number of pages
+template <std::size_t PAGE_COUNT> class FlashMemory : public FlashDevice
+{
+public:
+  FlashMemory() { m_memory.fill(erased_byte); }
+
+  std::size_t page_count() const override { return PAGE_COUNT; }
+
+  const uint8_t *read(std::size_t page) const override { return &m_memory[page * page_size]; }
+
+  bool start_erase(std::size_t page) override
+  {
+    if (page >= PAGE_COUNT)
+    {
+      return false;
+    }
+    std::memset(&m_memory[page * page_size], erased_byte, page_size);
+    m_erase_counts[page]++;
+    return true;
+  }
+
+  EraseStatus erase_status() override { return EraseStatus::DONE; }
+
+  bool program(std::size_t page, std::size_t offset, const uint8_t *data, std::size_t length) override
+  {
+    if ((page >= PAGE_COUNT) || (offset % double_word_size != 0) || (length % double_word_size != 0) || (offset + length > page_size))
+    {
+      return false;
+    }
+    uint8_t *target = &m_memory[page * page_size + offset];
+    for (std::size_t idx = 0; idx < length; idx++)
+    {
+      if (target[idx] != erased_byte)
+      {
+        return false;
+      }
+    }
+    std::memcpy(target, data, length);
+    m_programmed_bytes += length;
+    return true;
+  }
+
+  /// @brief Get the number of erases of a page since construction
+  uint32_t erase_count(std::size_t page) const { return m_erase_counts[page]; }
+
+  /// @brief Get the total number of bytes programmed since construction
+  std::size_t programmed_bytes() const { return m_programmed_bytes; }
+
+  /// @brief Direct access to the contents, for corrupting them in tests
+  uint8_t *memory() { return m_memory.data(); }
+
+private:
+  alignas(double_word_size) std::array<uint8_t, PAGE_COUNT * page_size> m_memory;
+  std::array<uint32_t, PAGE_COUNT> m_erase_counts{};
+  std::size_t m_programmed_bytes{0};
+};
+
+} // namespace bass_station
+
+#endif // __FLASH_DEVICE_HPP__
@@ -0,0 +1,69 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __FLASH_STM32G0_HPP__
+#define __FLASH_STM32G0_HPP__
+
+#include <flash_device.hpp>
+
+namespace bass_station
+{
+
+/// @brief FlashDevice for a run of pages in bank 2 of the STM32G0B1 internal flash.
+/// Bank 2 can be erased and programmed while the CPU keeps executing from bank 1, so interrupts are not stalled.
+/// The region must be excluded from the FLASH memory in the linker script.
+class FlashStm32g0 : public FlashDevice
+{
+public:
+  /// @brief Construct a new FlashStm32g0
+  /// @param first_page The first page of the region within bank 2 (0-127)
+  /// @param page_count The number of pages in the region
+  FlashStm32g0(std::size_t first_page, std::size_t page_count);
+
+  std::size_t page_count() const override;
+  const uint8_t *read(std::size_t page) const override;
+  bool start_erase(std::size_t page) override;
+  EraseStatus erase_status() override;
+  bool program(std::size_t page, std::size_t offset, const uint8_t *data, std::size_t length) override;
+
+private:
+  /// @brief The address of bank 2 page 0
+  static constexpr uint32_t m_bank2_base{0x08040000};
+  /// @brief The number of pages in each bank
+  static constexpr std::size_t m_bank_page_count{128};
+
+  std::size_t m_first_page;
+  std::size_t m_page_count;
+
+  /// @brief Unlock FLASH_CR and wait for any previous operation. Returns false if the controller stays locked.
+  bool unlock();
+  /// @brief Wait for the operation to finish, clear the flags and lock FLASH_CR again
+  /// @return false if any error flag was set
+  bool finish();
+
+  /// @brief An erase started by start_erase() has not been finished yet
+  bool m_erase_pending{false};
+};
+
+} // namespace bass_station
+
+#endif // __FLASH_STM32G0_HPP__
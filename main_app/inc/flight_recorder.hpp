@@ -0,0 +1,121 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __FLIGHT_RECORDER_HPP__
+#define __FLIGHT_RECORDER_HPP__
+
+#include <array>
+#include <trace_record.hpp>
+
+namespace bass_station
+{
+
+/// @brief Post-mortem ring of the most recent trace records, kept in the .noinit RAM section so it survives a reset.
+/// HardFault_Handler and error_handler() store the fault registers and reset the MCU; the next boot picks the log up
+/// with initialise() so it can be shown on the OLED or dumped over RTT without a debugger attached.
+class FlightRecorder
+{
+public:
+  /// @brief Why the log was frozen
+  enum class Cause : uint32_t
+  {
+    NONE          = 0,
+    HARD_FAULT    = 1,
+    ERROR_HANDLER = 2,
+  };
+
+  /// @brief The exception frame stacked by the Cortex-M0+ on entry to the fault handler.
+  /// The M0+ has no fault status registers, so this is all the hardware tells us.
+  struct FaultRegisters
+  {
+    uint32_t m_r0;
+    uint32_t m_r1;
+    uint32_t m_r2;
+    uint32_t m_r3;
+    uint32_t m_r12;
+    uint32_t m_lr;
+    uint32_t m_pc;
+    uint32_t m_xpsr;
+    /// @brief address of the stacked frame, i.e. the SP when the fault was taken
+    uint32_t m_frame_address;
+  };
+
+  /// @brief Number of trace records kept
+  static constexpr std::size_t m_ring_size{32};
+
+  /// @brief The no-init contents
+  struct Log
+  {
+    uint32_t m_magic;
+    Cause m_cause;
+    FaultRegisters m_fault;
+    /// @brief ring index of the next record to write
+    uint32_t m_next;
+    /// @brief number of valid records in the ring, saturates at m_ring_size
+    uint32_t m_count;
+    std::array<TraceRecord, m_ring_size> m_ring;
+  };
+
+  /// @brief Check for a log left by a fault before the last reset and start a new one. Call once at startup,
+  /// before any trace point is hit.
+  /// @return true if the previous run ended in a fault
+  static bool initialise();
+
+  /// @brief Get the log of the previous run. Only valid if initialise() returned true.
+  static const Log &crash_log() { return m_crash_log; }
+
+  /// @brief Get a record from the crash log, oldest first
+  /// @param index 0 to crash_log().m_count - 1
+  static const TraceRecord &crash_record(std::size_t index);
+
+  /// @brief Add a record to the ring. Called by Trace::emit(), safe from any context.
+  static void record(const TraceRecord &record);
+
+  /// @brief Freeze the log with the fault registers and reset the MCU
+  /// @param cause The reason
+  /// @param exception_frame The stacked r0-r3, r12, lr, pc, xpsr, or nullptr if not called from an exception
+  /// @param return_address Saved as the LR when there is no exception frame. Take it with __builtin_return_address(0)
+  /// in the function called from the failing code, since here it would only point back into that function.
+  [[noreturn]] static void freeze_and_reset(Cause cause, const uint32_t *exception_frame, uint32_t return_address);
+
+  /// @brief Print the crash log on RTT channel 0 (Debug ARM builds only)
+  static void dump_rtt();
+
+  /// @brief Format a 32-bit value as 8 hex digits
+  /// @param value The value
+  /// @param hex_string The null terminated output
+  static void format_hex(uint32_t value, std::array<char, 9> &hex_string);
+
+private:
+  /// @brief Marks m_log as written by this firmware rather than power-on garbage
+  static constexpr uint32_t m_log_magic{0x464C5452};
+
+  /// @brief The live log, not zeroed by the startup code
+  static Log m_log;
+
+  /// @brief Copy of the log from the previous run, taken by initialise()
+  static inline Log m_crash_log{};
+};
+
+} // namespace bass_station
+
+#endif // __FLIGHT_RECORDER_HPP__
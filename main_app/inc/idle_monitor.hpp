@@ -0,0 +1,93 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __IDLE_MONITOR_HPP__
+#define __IDLE_MONITOR_HPP__
+
+#include <critical_section.hpp>
+#include <usec_clock.hpp>
+
+namespace bass_station
+{
+
+/// @brief Puts the core into Sleep mode (WFI) while the main loop has nothing to do and measures the time spent asleep.
+/// Any enabled interrupt wakes the core: the tempo timer, the ADP5587 INT and encoder switch EXTI lines, MIDI IN (once its
+/// RX interrupt is enabled) and SysTick, which is used as a 1ms poll of the encoder count while asleep.
+class IdleMonitor
+{
+public:
+  /// @brief Enable the SysTick interrupt so the core wakes every millisecond
+  void initialise();
+
+  /// @brief Sleep until work_pending() returns true.
+  /// Interrupts are masked between the check and WFI so an interrupt in that window can't be missed;
+  /// a pending interrupt still ends WFI and is taken as soon as the mask is cleared.
+  /// @tparam PREDICATE bool()
+  /// @param work_pending Returns true when the main loop needs to run
+  template <typename PREDICATE> void sleep_while_idle(PREDICATE work_pending);
+
+  /// @brief The CPU load over the last completed measurement window
+  /// @return uint8_t 0-100 percent
+  uint8_t cpu_load_percent() const { return m_cpu_load_percent; }
+
+private:
+  /// @brief Length of the CPU load measurement window
+  static constexpr uint32_t m_window_us{1000000};
+
+  /// @brief Start of the current measurement window
+  uint32_t m_window_start_us{0};
+  /// @brief Time spent asleep in the current measurement window
+  uint32_t m_window_asleep_us{0};
+  /// @brief Result of the last completed measurement window
+  uint8_t m_cpu_load_percent{100};
+
+  /// @brief Start a new window once the current one has completed
+  void update_window();
+};
+
+template <typename PREDICATE> void IdleMonitor::sleep_while_idle(PREDICATE work_pending)
+{
+#if not defined(X86_UNIT_TESTING_ONLY)
+  while (true)
+  {
+    {
+      CriticalSection critical_section;
+      if (work_pending())
+      {
+        break;
+      }
+      const uint32_t sleep_start_us = UsecClock::now();
+      __DSB();
+      __WFI();
+      m_window_asleep_us += UsecClock::now() - sleep_start_us;
+    }
+    // the interrupt that woke the core is taken here
+  }
+#else
+  static_cast<void>(work_pending);
+#endif
+  update_window();
+}
+
+} // namespace bass_station
+
+#endif // __IDLE_MONITOR_HPP__
@@ -0,0 +1,96 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#ifndef __INPUT_RECORDER_HPP__
+#define __INPUT_RECORDER_HPP__
+
+#include <array>
+#include <trace_record.hpp>
+#include <usec_clock.hpp>
+
+namespace bass_station
+{
+
+/// @brief Log of every input the sequencer acts on (InputId), timestamped by UsecClock, so a session seen live can be
+/// replayed on the host (tests/input_replayer.hpp). The ring keeps the first records after start(), the replay has to
+/// begin from the power on state, and is in the .noinit RAM section so the log of a run that crashed can still be saved
+/// to the uSD card after the reset. In Debug ARM builds (USE_RTT) every record is also streamed to RTT up-buffer 2, which
+/// has no length limit.
+class InputRecorder
+{
+public:
+  /// @brief The RTT up-buffer used for the input records. Buffer 1 is the trace channel.
+  static constexpr unsigned m_rtt_channel{2};
+
+  /// @brief Number of records kept, 3K of RAM. The tick that starts each step takes a record, and the runs of tempo
+  /// ticks between it and the other inputs take one record each.
+  static constexpr std::size_t m_ring_size{256};
+
+  /// @brief The no-init contents
+  struct Log
+  {
+    uint32_t m_magic;
+    /// @brief number of records in the ring
+    uint32_t m_count;
+    /// @brief number of records that did not fit in the ring
+    uint32_t m_dropped;
+    std::array<TraceRecord, m_ring_size> m_ring;
+  };
+
+  /// @brief Set up the RTT input buffer and check for the log of the previous run. The previous log can be read
+  /// until start() is called.
+  /// @return true if the log of the previous run is intact
+  static bool initialise();
+
+  /// @brief Clear the log and start recording
+  static void start();
+
+  /// @brief Log an input at UsecClock::now(). Safe to call from any interrupt priority.
+  /// @param id The input
+  /// @param arg0 first argument, see InputId
+  /// @param arg1 second argument, see InputId
+  static void record(InputId id, uint16_t arg0 = 0, uint32_t arg1 = 0) { record_at(UsecClock::now(), id, arg0, arg1); }
+
+  /// @brief Log an input taken at an earlier time. Safe to call from any interrupt priority. A run of tempo ticks would
+  /// fill the ring in a few seconds, so an InputId::TEMPO_TICK that doesn't start a step is added to the arg1 count of
+  /// the last record in the ring if that is one too. The replay runs those ticks at the time of the run, only the MIDI
+  /// clock depends on them. A tick that starts a step keeps a record and its time, the recorded notes are quantised
+  /// against it. RTT gets every record as it is.
+  /// @param timestamp_us UsecClock::now() when the input was taken
+  /// @param id The input
+  /// @param arg0 first argument, see InputId
+  /// @param arg1 second argument, see InputId
+  static void record_at(uint32_t timestamp_us, InputId id, uint16_t arg0, uint32_t arg1);
+
+  /// @brief Get the log
+  static const Log &log() { return m_log; }
+
+private:
+  /// @brief Marks m_log as written by this firmware rather than power-on garbage
+  static constexpr uint32_t m_log_magic{0x494E5054};
+
+  /// @brief The log, not zeroed by the startup code
+  static Log m_log;
+};
+
+} // namespace bass_station
+
+#endif // __INPUT_RECORDER_HPP__
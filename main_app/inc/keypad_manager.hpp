@@ -24,7 +24,9 @@
 #define __KEYPAD_MANAGER_HPP__
 
 #include <adp5587.hpp>
+#include <live_recorder.hpp>
 #include <step.hpp>
+#include <tap_tempo.hpp>
 
 #if defined(X86_UNIT_TESTING_ONLY)
   // only used when unit testing on x86
@@ -33,14 +35,14 @@
   #include <timer_manager.hpp>
 #endif
 
-// The ADP5587 HW maps the following values to the keys press/release events on the bass station sequencer
-//              1       2       3       4       5       6       7       8       9       10      11      12      13      14      15      16
-//  UpperRow    131/3   141/13  151/23  161/33  171/43  181/53  191/63  201/73  132/4   142/14  152/24  162/34  172/44  182/54  192/64  202/74
-//  LowerRow    129/1   139/11  149/21  159/31  169/41  179/51  189/61  199/71  130/2   140/12  150/22  160/32  170/42  180/52  190/62  200/72
+// The ADP5587 key press/release events of the bass station sequencer buttons come from the keypad wiring in
+// board_description.hpp (board::key_event())
 
 namespace bass_station
 {
 
+class UndoJournal;
+
 enum class SequencerState
 {
   STOPPED,
@@ -69,12 +71,72 @@ public:
 
   /// @brief Update sequencer map with latest Keypad events and return the latest UserKey press.
   // @param sequencer_map The map object containing current pattern data
+  // @param undo_journal Journals the edits of the steps
   // @return SequencerState Latest UserKey press
-  SequencerState update_sequencer_map(SequencerStepMap &sequencer_map);
+  SequencerState update_sequencer_map(SequencerStepMap &sequencer_map, UndoJournal &undo_journal);
 
   // store the index of the last key selected by the user. We can use this index to lookup the position in the StaticMap later on.
   uint8_t last_user_selected_key_idx{0};
 
+  // set when update_sequencer_map() changes a step of the pattern, cleared by the caller once it has been handled
+  bool pattern_changed{false};
+
+  // fill for the steps with TrigCondition::FILL and NOT_FILL, turned on and off by user button 6
+  bool fill{false};
+
+  // set by the caller in record mode: the step keys play notes into the pattern instead of switching the steps, see
+  // recorded_presses
+  bool record_mode{false};
+
+  // set by the caller in undo mode: user button 1 randomises the pattern instead of cycling the trig of the selected
+  // step, see randomise_requested
+  bool undo_mode{false};
+
+  // set when user button 1 is pressed in undo mode, cleared by the caller once it has randomised the pattern with
+  // randomise_seed (the debounce timer count of the press, so a replayed session draws the same pattern)
+  bool randomise_requested{false};
+  uint32_t randomise_seed{0};
+
+  // set by the caller in pitch mode: user buttons 1 and 2 step the scale and its root instead of cycling the trig and
+  // the ratchet of the selected step, see next_scale_requested and next_root_requested
+  bool pitch_mode{false};
+
+  // set when user button 1 (the scale) or 2 (the root) is pressed in pitch mode, cleared by the caller once it has
+  // changed the scale
+  bool next_scale_requested{false};
+  bool next_root_requested{false};
+
+  // a step key pressed in record mode, and when it was pressed (corrected with key_latency)
+  struct RecordedPress
+  {
+    uint8_t m_key_idx;
+    uint32_t m_press_us;
+  };
+
+  // the step keys pressed in record mode since the caller last cleared recorded_press_count
+  std::array<RecordedPress, 10> recorded_presses{};
+  std::size_t recorded_press_count{0};
+
+  // the measured latency of the key event FIFO reads
+  KeyLatency key_latency;
+
+  // the beat tapped on user button 3. tempo_tapped is set when its estimate changes, cleared by the caller once it has
+  // been handled
+  TapTempo tap_tempo;
+  bool tempo_tapped{false};
+
+#if defined(X86_UNIT_TESTING_ONLY)
+  /// @brief Queue a key event for the next get_key_events(), in place of the ADP5587 FIFO (host builds only)
+  /// @param key_event The event
+  /// @return false if the 10 entry FIFO is full
+  bool inject_key_event(SequencerKeyEventIndex key_event);
+
+  /// @brief Give the key events of the next get_key_events() this press time, in place of the one KeyLatency works out
+  /// from the main loop passes (host builds only)
+  /// @param press_time_us The press time, see InputId::KEY_PRESS_TIME
+  void inject_press_time(uint32_t press_time_us);
+#endif
+
 private:
   // @brief The ADP5587 keypad driver
   adp5587::Driver<STM32G0_ISR> m_keypad_driver;
@@ -88,6 +150,15 @@ private:
   /// @brief Store the last timer count for debounce
   uint32_t m_last_pattern_debounce_count_ms{0};
 
+#if defined(X86_UNIT_TESTING_ONLY)
+  /// @brief The key events returned by the next get_key_events(), unused entries are zero like the ADP5587 FIFO
+  std::array<SequencerKeyEventIndex, 10> m_injected_key_events{};
+  std::size_t m_injected_key_event_count{0};
+  /// @brief The press time of the next key events, if valid
+  uint32_t m_injected_press_time_us{0};
+  bool m_injected_press_time_valid{false};
+#endif
+
   static constexpr uint8_t UserBtn1ID =
       static_cast<uint8_t>(adp5587::Driver<STM32G0_ISR>::GPIKeyMappings::C4 | adp5587::Driver<STM32G0_ISR>::GPIKeyMappings::ON);
   static constexpr uint8_t UserBtn2ID =
@@ -23,8 +23,10 @@
 #ifndef __LEDMANAGER_HPP__
 #define __LEDMANAGER_HPP__
 
+#include <board_description.hpp>
 #include <step.hpp>
 #include <tlc5955.hpp>
+#include <trace.hpp>
 
 namespace bass_station
 {
@@ -90,25 +92,26 @@ template <std::size_t LED_NUMBER>
 void LedManager::set_both_rows_with_step_sequence_mapping(
     noarch::containers::StaticMap<adp5587::Driver<STM32G0_ISR>::KeyEventIndex, Step, LED_NUMBER> &sequence_map)
 {
-  // get the start, mid, end iterators for this input map
-  auto start_pos = sequence_map.data.begin();
-  auto mid_pos   = sequence_map.data.begin() + sequence_map.data.size() / 2;
-  auto end_pos   = sequence_map.data.end();
+  // the first half of the map is the lower row, the second half is the upper row (board::step_rows)
+  const std::size_t mid_pos = sequence_map.data.size() / 2;
+
+  // checksum of the lit steps and their colours for the trace, so a captured LED stream can be compared frame by frame
+  uint32_t frame_checksum{0};
 
   m_tlc5955_driver.clear_register();
 
   // set the TLC5955 register data for the upper row keys
-  std::for_each(mid_pos,
-                end_pos,
-                [this, &sequence_map](const std::pair<adp5587::Driver<STM32G0_ISR>::KeyEventIndex, Step> &data_pair)
-                {
-                  Step current_step = data_pair.second;
-                  if (current_step.m_state == StepState::ON)
-                  {
-                    // remap the logical array positions to the physical PCB wiring
-                    m_tlc5955_driver.set_position_and_colour(current_step.m_tlc5955_pin_index, current_step.m_colour);
-                  }
-                });
+  for (std::size_t idx = mid_pos; idx < sequence_map.data.size(); idx++)
+  {
+    /// @note don't use std::array.at(), this will force exception handling to bloat the linked .elf
+    const Step &current_step = sequence_map.data[idx].second;
+    if (current_step.m_state == StepState::ON)
+    {
+      // remap the logical array positions to the physical PCB wiring
+      m_tlc5955_driver.set_position_and_colour(board::tlc5955_pin(idx), current_step.m_colour);
+      frame_checksum = (frame_checksum * 33U) ^ static_cast<uint32_t>((idx << 8) | static_cast<uint32_t>(current_step.m_colour));
+    }
+  }
 
   m_tlc5955_driver.send_first_bit(tlc5955::Driver::DataLatchType::data);
   m_tlc5955_driver.send_spi_bytes(tlc5955::Driver::LatchPinOption::no_latch);
@@ -118,21 +121,22 @@ void LedManager::set_both_rows_with_step_sequence_mapping(
   m_tlc5955_driver.clear_register();
 
   // set the TLC5955 register data for the lower row keys
-  std::for_each(start_pos,
-                mid_pos,
-                [this, &sequence_map](const std::pair<adp5587::Driver<STM32G0_ISR>::KeyEventIndex, Step> &data_pair)
-                {
-                  Step current_step = data_pair.second;
-                  if (current_step.m_state == StepState::ON)
-                  {
-                    // remap the logical array positions to the physical PCB wiring
-                    m_tlc5955_driver.set_position_and_colour(current_step.m_tlc5955_pin_index, current_step.m_colour);
-                  }
-                });
+  for (std::size_t idx = 0; idx < mid_pos; idx++)
+  {
+    /// @note don't use std::array.at(), this will force exception handling to bloat the linked .elf
+    const Step &current_step = sequence_map.data[idx].second;
+    if (current_step.m_state == StepState::ON)
+    {
+      // remap the logical array positions to the physical PCB wiring
+      m_tlc5955_driver.set_position_and_colour(board::tlc5955_pin(idx), current_step.m_colour);
+      frame_checksum = (frame_checksum * 33U) ^ static_cast<uint32_t>((idx << 8) | static_cast<uint32_t>(current_step.m_colour));
+    }
+  }
 
   // send the lower row data with latch
   m_tlc5955_driver.send_first_bit(tlc5955::Driver::DataLatchType::data);
   m_tlc5955_driver.send_spi_bytes(tlc5955::Driver::LatchPinOption::latch_after_send);
+  Trace::emit(TraceId::LED_LATCH, static_cast<uint16_t>(TraceLedLatch::BOTH_ROWS), frame_checksum);
 }
 
 /// @brief Turn on/off each sequencer LED in turn, then repeat for next colour
@@ -154,11 +158,8 @@ void LedManager::run_led_sweep(noarch::containers::StaticMap<adp5587::Driver<STM
   {
 
     --lower_idx;
-    Step current_upper_step = sequence_map.data[upper_idx].second;
-    Step current_lower_step = sequence_map.data[lower_idx].second;
-
-    set_one_led_at(current_upper_step.m_tlc5955_pin_index, bass_station::SequencerRow::upper, 65353, colour, LatchOption::disable);
-    set_one_led_at(current_lower_step.m_tlc5955_pin_index, bass_station::SequencerRow::lower, 65353, colour, LatchOption::enable);
+    set_one_led_at(board::tlc5955_pin(upper_idx), bass_station::SequencerRow::upper, 65353, colour, LatchOption::disable);
+    set_one_led_at(board::tlc5955_pin(lower_idx), bass_station::SequencerRow::lower, 65353, colour, LatchOption::enable);
     stm32::delay_millisecond(delay_ms);
   }
 
@@ -174,11 +175,8 @@ void LedManager::run_led_sweep(noarch::containers::StaticMap<adp5587::Driver<STM
     {
       lower_idx = 0;
     }
-    Step current_upper_step = sequence_map.data[upper_idx].second;
-    Step current_lower_step = sequence_map.data[lower_idx].second;
-
-    set_one_led_at(current_upper_step.m_tlc5955_pin_index, bass_station::SequencerRow::upper, 65353, colour, LatchOption::disable);
-    set_one_led_at(current_lower_step.m_tlc5955_pin_index, bass_station::SequencerRow::lower, 65353, colour, LatchOption::enable);
+    set_one_led_at(board::tlc5955_pin(upper_idx), bass_station::SequencerRow::upper, 65353, colour, LatchOption::disable);
+    set_one_led_at(board::tlc5955_pin(lower_idx), bass_station::SequencerRow::lower, 65353, colour, LatchOption::enable);
     stm32::delay_millisecond(delay_ms);
   }
 }
@@ -0,0 +1,109 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __LIVE_RECORDER_HPP__
+#define __LIVE_RECORDER_HPP__
+
+#include <cstdint>
+
+namespace bass_station
+{
+
+/// @brief Measures how late the main loop sees a key press. The ADP5587 INT pin has no interrupt: the main loop reads
+/// the key event FIFO over I2C on each pass, so an event waits in the FIFO for part of the time between two reads
+/// (half of it on average) and is then seen at the end of the I2C read. Both times are measured with UsecClock on every
+/// read, as instrumentation and to correct the time of a recorded key press.
+class KeyLatency
+{
+public:
+  /// @brief A read of the key event FIFO has been done. Called by KeypadManager.
+  /// @param read_start_us UsecClock::now() before the I2C read
+  /// @param read_end_us UsecClock::now() after it
+  void read_done(uint32_t read_start_us, uint32_t read_end_us);
+
+  /// @brief Get the length of the last I2C read of the FIFO, and the longest since power on
+  uint32_t read_us() const { return m_read_us; }
+  uint32_t max_read_us() const { return m_max_read_us; }
+
+  /// @brief Get the time between the end of the previous read and the start of the last one, the time a key event can
+  /// wait in the FIFO, and the longest since power on
+  uint32_t poll_interval_us() const { return m_poll_interval_us; }
+  uint32_t max_poll_interval_us() const { return m_max_poll_interval_us; }
+
+  /// @brief Get the mean wait in the FIFO of a key event read by the last read
+  uint32_t fifo_wait_us() const { return m_poll_interval_us / 2; }
+
+  /// @brief Get the time to take off the end of the last read to get the time of a key press it read
+  uint32_t correction_us() const { return m_read_us + fifo_wait_us(); }
+
+  /// @brief Get the time of a key press read by the last read
+  uint32_t press_time_us() const { return m_read_end_us - correction_us(); }
+
+  /// @brief Print the figures to RTT terminal 0 (Debug ARM builds only), after Profiler::dump_rtt()
+  void dump_rtt() const;
+
+private:
+  bool m_first_read{true};
+  uint32_t m_read_end_us{0};
+  uint32_t m_read_us{0};
+  uint32_t m_max_read_us{0};
+  uint32_t m_poll_interval_us{0};
+  uint32_t m_max_poll_interval_us{0};
+};
+
+/// @brief Quantises the time of a key press in record mode to the nearest step. The start time of each step is taken
+/// from the tempo timer interrupt, and the length of the step playing is worked out from the length of the one before
+/// and the tempo timer counts of both (SwingEngine::step_counts()), so it follows the tempo and the swing.
+/// Only used from the main loop.
+class LiveRecorder
+{
+public:
+  /// @brief Forget the step times. Called when the sequencer starts from the first step.
+  void reset();
+
+  /// @brief A step has started
+  /// @param timestamp_us The time of the tempo timer interrupt that started it
+  /// @param step_counts Its length in tempo timer counts
+  void step_started(uint32_t timestamp_us, uint32_t step_counts);
+
+  /// @brief Find the step nearest to a key press
+  /// @param press_us The time of the press, corrected with KeyLatency
+  /// @param step_offset Receives -1 for the previous step, 0 for the step playing or 1 for the next step. A press more
+  /// than a step away is put on the nearer of the previous and next steps.
+  /// @return false if no step has started since reset()
+  bool quantise(uint32_t press_us, int8_t &step_offset) const;
+
+  /// @brief Get the expected length of the step playing, 0 until two steps have started
+  uint32_t step_us() const;
+
+private:
+  /// @brief the number of step_started() since reset(), up to 2
+  uint8_t m_steps{0};
+  uint32_t m_step_start_us{0};
+  uint32_t m_step_counts{0};
+  uint32_t m_previous_step_us{0};
+  uint32_t m_previous_step_counts{0};
+};
+
+} // namespace bass_station
+
+#endif // __LIVE_RECORDER_HPP__
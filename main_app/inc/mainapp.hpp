@@ -23,6 +23,8 @@
 #ifndef MAINAPP_HPP_
 #define MAINAPP_HPP_
 
+#include <stdint.h>
+
 #if defined(X86_UNIT_TESTING_ONLY)
   // only used when unit testing on x86
   #include <mock_cmsis.hpp>
@@ -36,6 +38,13 @@ extern "C"
 #endif
 
   void mainapp();
+
+  /// @brief Runs the queued interrupt bottom halves. Called from PendSV_Handler
+  void deferred_work_pendsv_handler(void);
+
+  /// @brief Saves the stacked exception frame in the flight recorder and resets. Called from HardFault_Handler
+  /// @param exception_frame The stack the fault was taken on (MSP or PSP)
+  void flight_recorder_hard_fault(const uint32_t *exception_frame);
   // void DMA1_Channel1_IRQHandler(void);
 
 #ifdef __cplusplus
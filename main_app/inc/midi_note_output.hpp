@@ -0,0 +1,79 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __MIDI_NOTE_OUTPUT_HPP__
+#define __MIDI_NOTE_OUTPUT_HPP__
+
+#include <cstdint>
+#include <note.hpp>
+
+#if defined(X86_UNIT_TESTING_ONLY)
+  // only used when unit testing on x86
+  #include <mock_cmsis.hpp>
+#else
+  #pragma GCC diagnostic push
+  #pragma GCC diagnostic ignored "-Wvolatile"
+  #include <stm32g0xx.h>
+  #pragma GCC diagnostic pop
+#endif
+
+namespace bass_station
+{
+
+/// @brief Sends MIDI note messages on the MIDI OUT USART, which midi_stm32::Driver also uses for the realtime clock.
+/// MIDI allows realtime bytes between the bytes of any other message, so the bytes are written one at a time and the
+/// clock from PendSV can go out in between. Interrupts are only masked while TDR is checked and written.
+/// A note message is three bytes, about 1ms at 31250 baud.
+class MidiNoteOutput
+{
+public:
+  /// @brief Construct a new MidiNoteOutput
+  /// @param usart The MIDI OUT USART, already set up by midi_stm32::DeviceInterface
+  explicit MidiNoteOutput(USART_TypeDef *usart);
+
+  /// @brief Send a note on
+  /// @param channel MIDI channel, 0 to 15
+  /// @param note MIDI note number
+  /// @param velocity 1 to 127
+  void note_on(uint8_t channel, uint8_t note, uint8_t velocity);
+
+  /// @brief Send a note off
+  /// @param channel MIDI channel, 0 to 15
+  /// @param note MIDI note number
+  void note_off(uint8_t channel, uint8_t note);
+
+  /// @brief Get the MIDI note number of a BassStation key. c0, the lowest key, is MIDI note 36 (C2).
+  static uint8_t midi_note(Note note) { return static_cast<uint8_t>(lowest_key_midi_note + note); }
+
+private:
+  static constexpr uint8_t lowest_key_midi_note{36};
+  static constexpr uint8_t note_on_status{0x90};
+  static constexpr uint8_t note_off_status{0x80};
+
+  USART_TypeDef &m_usart;
+
+  void send_byte(uint8_t byte);
+};
+
+} // namespace bass_station
+
+#endif // __MIDI_NOTE_OUTPUT_HPP__
@@ -31,7 +31,7 @@ namespace bass_station
 {
 
 // @brief Represent each note on the BassStation keyboard
-enum Note
+enum Note : uint8_t
 {
   c0,
   c0_sharp,
@@ -61,17 +61,37 @@ enum Note
   none,
 };
 
+/// @brief Get the note a semitone up, for the encoder. Stops at c2, the top key. Note::none goes to c0.
+constexpr Note next_note(Note note)
+{
+  if (note >= Note::none)
+  {
+    return Note::c0;
+  }
+  return (note == Note::c2) ? Note::c2 : static_cast<Note>(note + 1);
+}
+
+/// @brief Get the note a semitone down, for the encoder. Stops at c0, the bottom key. Note::none stays Note::none.
+constexpr Note previous_note(Note note)
+{
+  if (note >= Note::none)
+  {
+    return Note::none;
+  }
+  return (note == Note::c0) ? Note::c0 : static_cast<Note>(note - 1);
+}
+
 // @brief Class to hold note string text and associated adg2188 pole config
 class NoteData
 {
 public:
-  NoteData(noarch::containers::StaticString<4> note_static_string, adg2188::Driver::Pole sw)
-      : m_note_static_string(note_static_string),
+  constexpr NoteData(const char *note_name, adg2188::Driver::Pole sw)
+      : m_note_name(note_name),
         m_sw(sw)
   {
   }
 
-  noarch::containers::StaticString<4> m_note_static_string;
+  const char *m_note_name;
   adg2188::Driver::Pole m_sw;
 };
 
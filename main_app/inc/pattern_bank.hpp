@@ -0,0 +1,265 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __PATTERN_BANK_HPP__
+#define __PATTERN_BANK_HPP__
+
+#include <array>
+#include <flash_device.hpp>
+#include <keypad_manager.hpp>
+
+namespace bass_station
+{
+
+/// @brief A pattern in the packed step encoding, in m_sequencer_step_data order
+using PackedPattern = std::array<uint16_t, 32>;
+
+/// @brief Pattern lengths, in steps. A pattern has at most one step for each of the 32 keys, the steps a PackedPattern
+/// stores, and a shorter pattern plays the first length keys.
+static constexpr uint8_t default_pattern_length{32};
+static constexpr uint8_t max_pattern_length{32};
+static_assert(max_pattern_length == std::tuple_size<PackedPattern>::value, "every step of a pattern is saved");
+
+/// @brief The 16-bit packed encoding of one Step.
+/// bits 0-4: Note, bit 5: StepState::ON, bit 6: user selected colour, bits 7-8: ratchet - 1, bits 9-11: probability
+/// level, bits 12-15: TrigCondition. Patterns saved before these fields were added had them as zero, so they read back
+/// as single triggers that always play.
+/// The layout and key mapping fields of Step are fixed by the hardware, so they are not stored.
+struct PackedStep
+{
+  static constexpr uint16_t note_mask{0x001F};
+  static constexpr uint16_t on_bit{0x0020};
+  static constexpr uint16_t selected_bit{0x0040};
+  static constexpr uint16_t ratchet_mask{0x0180};
+  static constexpr uint16_t ratchet_shift{7};
+  static constexpr uint16_t probability_mask{0x0E00};
+  static constexpr uint16_t probability_shift{9};
+  static constexpr uint16_t condition_mask{0xF000};
+  static constexpr uint16_t condition_shift{12};
+
+  /// @brief Encode the stored fields of a step
+  static uint16_t pack(const Step &step);
+
+  /// @brief Apply an encoded step. Out of range notes become Note::none, out of range conditions TrigCondition::ALWAYS.
+  static void unpack(uint16_t packed, Step &step);
+};
+
+/// @brief Pack every step of the sequencer map
+void pack_pattern(const SequencerStepMap &sequencer_map, PackedPattern &pattern);
+
+/// @brief Apply a packed pattern to the sequencer map
+void unpack_pattern(const PackedPattern &pattern, SequencerStepMap &sequencer_map);
+
+/// @brief Somewhere PatternPersistence can save the live pattern to in slices between steps: the PatternBank in flash,
+/// or the PatternLibrary on the uSD card
+class PatternStore
+{
+public:
+  /// @brief Queue a save, to be written by service()
+  /// @param slot The slot
+  /// @param pattern The pattern, copied
+  /// @param length The pattern length (1 to max_pattern_length)
+  /// @return false if a save is already running or the slot or length is invalid
+  virtual bool begin_save(std::size_t slot, const PackedPattern &pattern, uint8_t length) = 0;
+
+  /// @brief Do the next slice of the queued save
+  /// @return true if there is more to do
+  virtual bool service() = 0;
+
+  /// @brief Check if a save is queued or running
+  virtual bool saving() const = 0;
+
+  /// @brief Check if the save is waiting for the device (a page erase), so service() would only poll it
+  virtual bool erasing() const = 0;
+
+  /// @brief Check if the last save completed without error
+  virtual bool last_save_succeeded() const = 0;
+};
+
+/// @brief Fixed slots of packed patterns, stored as an append-only log in flash.
+/// Every save appends a new record (with an increasing sequence number) to the active page and the newest record of a
+/// slot wins. The pages are used in turn, so the erases are spread evenly: when the active page is full the log moves
+/// on to the next page, which is always kept erased, and the page after that is reclaimed by copying its still live
+/// records forward and erasing it. A load is a copy of 64 bytes from memory mapped flash, found through a RAM index.
+///
+/// A save is a job of double word programs and at most one page erase. begin_save() queues it and each call to
+/// service() does one slice of it (one double word, or starting/polling the erase), so it can be spread between steps.
+class PatternBank : public PatternStore
+{
+public:
+  /// @brief Number of pattern slots
+  static constexpr std::size_t slot_count{16};
+
+  /// @brief Construct a new PatternBank. Call initialise() before use.
+  /// @param flash The flash region, at least three pages
+  explicit PatternBank(FlashDevice &flash);
+
+  /// @brief Scan the log, build the index and repair pages left by an interrupted erase. Formats a blank region.
+  /// @return false if the flash is unusable
+  bool initialise();
+
+  /// @brief Store a pattern and wait for it. Takes a few milliseconds, or tens when a page is reclaimed.
+  /// @param slot The slot (0 to slot_count - 1)
+  /// @param pattern The pattern
+  /// @param length The pattern length (1 to max_pattern_length)
+  /// @return false on error
+  bool save(std::size_t slot, const PackedPattern &pattern, uint8_t length = default_pattern_length);
+
+  /// @brief Queue a save, to be written by service()
+  /// @param slot The slot (0 to slot_count - 1)
+  /// @param pattern The pattern, copied
+  /// @param length The pattern length (1 to max_pattern_length)
+  /// @return false if a save is already running or the slot or length is invalid
+  bool begin_save(std::size_t slot, const PackedPattern &pattern, uint8_t length) override;
+
+  /// @brief Do the next slice of the queued save (one double word, or starting/polling the erase)
+  /// @return true if there is more to do
+  bool service() override;
+
+  bool saving() const override { return m_job_state != JobState::IDLE; }
+
+  /// @brief Check if the save is waiting for a page erase, so service() would only poll it
+  bool erasing() const override { return m_job_state == JobState::WAIT_ERASE; }
+
+  bool last_save_succeeded() const override { return m_job_succeeded; }
+
+  /// @brief Get the newest pattern of a slot. Safe while a save is running, the index only moves to a complete record.
+  /// @param slot The slot (0 to slot_count - 1)
+  /// @param pattern The output
+  /// @return false if the slot has never been saved
+  bool load(std::size_t slot, PackedPattern &pattern) const;
+
+  /// @brief Get the newest pattern of a slot and its length
+  /// @param slot The slot (0 to slot_count - 1)
+  /// @param pattern The output
+  /// @param length The output pattern length
+  /// @return false if the slot has never been saved
+  bool load(std::size_t slot, PackedPattern &pattern, uint8_t &length) const;
+
+  /// @brief Check if a slot has been saved
+  bool contains(std::size_t slot) const;
+
+  /// @brief Get the number of times a page has been erased, from its page header
+  uint32_t erase_count(std::size_t page) const;
+
+private:
+  /// @brief The first double word of each page
+  struct PageHeader
+  {
+    uint32_t m_magic;
+    uint32_t m_erase_count;
+  };
+
+  /// @brief One saved pattern
+  struct Record
+  {
+    /// @brief record_tag once programmed, erased (0xFFFF) marks the end of the log in a page
+    uint16_t m_tag;
+    uint8_t m_slot;
+    /// @brief the pattern length, records written before pattern lengths were added have the full 32 steps
+    uint8_t m_step_count;
+    uint32_t m_sequence;
+    PackedPattern m_steps;
+    /// @brief checksum of all the fields above, so torn records from a power loss are skipped
+    uint32_t m_checksum;
+    uint32_t m_reserved;
+  };
+
+  static constexpr uint32_t page_magic{0x4B4E4250};
+  static constexpr uint16_t record_tag{0x5452};
+  static constexpr uint16_t erased_tag{0xFFFF};
+  static constexpr std::size_t records_per_page{(FlashDevice::page_size - sizeof(PageHeader)) / sizeof(Record)};
+
+  static_assert(sizeof(PageHeader) % FlashDevice::double_word_size == 0, "PageHeader must be programmable in double words");
+  static_assert(sizeof(Record) % FlashDevice::double_word_size == 0, "Record must be programmable in double words");
+  static_assert(slot_count < records_per_page, "the live records of a reclaimed page must fit in the spare page");
+
+  /// @brief Where the newest record of a slot is
+  struct Location
+  {
+    uint16_t m_page;
+    uint16_t m_record;
+  };
+  static constexpr uint16_t no_page{0xFFFF};
+
+  /// @brief The steps of a save job
+  enum class JobState : uint8_t
+  {
+    IDLE,
+    COPY_FORWARD, // @brief find the next live record in m_reclaim_page and stage a copy of it
+    START_ERASE,  // @brief start erasing m_reclaim_page
+    WAIT_ERASE,   // @brief poll the erase
+    WRITE_HEADER, // @brief program the page header of m_reclaim_page
+    WRITE_RECORD, // @brief program the next double word of m_staged_record
+  };
+
+  FlashDevice &m_flash;
+  std::array<Location, slot_count> m_index;
+  /// @brief The page records are appended to
+  std::size_t m_active_page{0};
+  /// @brief The next free record in the active page
+  std::size_t m_next_record{0};
+  uint32_t m_next_sequence{1};
+
+  JobState m_job_state{JobState::IDLE};
+  bool m_job_succeeded{true};
+  /// @brief The pattern given to begin_save(), written once any reclaim is done
+  Record m_new_record;
+  bool m_new_record_pending{false};
+  /// @brief The page being reclaimed and the next slot to check for a live record in it
+  std::size_t m_reclaim_page{0};
+  std::size_t m_reclaim_slot{0};
+  PageHeader m_reclaim_header;
+  /// @brief The record being programmed, where it goes and how much of it is written
+  Record m_staged_record;
+  std::size_t m_staged_record_idx{0};
+  std::size_t m_staged_offset{0};
+  JobState m_after_record{JobState::IDLE};
+
+  /// @brief Read a page header
+  PageHeader read_header(std::size_t page) const;
+  /// @brief Read a record
+  Record read_record(std::size_t page, std::size_t record) const;
+  /// @brief Check the tag, checksum and slot of a record
+  static bool record_valid(const Record &record);
+  static uint32_t checksum(const Record &record);
+  /// @brief Check if every byte of a page is erased
+  bool page_blank(std::size_t page) const;
+  /// @brief Erase a page and write its header with the erase count incremented. Blocking, used by initialise().
+  bool format_page(std::size_t page);
+  /// @brief Get the header a page gets after its next erase
+  PageHeader next_header(std::size_t page) const;
+  /// @brief Give a record the next sequence number and free record of the active page, then program it
+  /// @param record The record
+  /// @param after_record The job state once it is written
+  void stage_record(const Record &record, JobState after_record);
+  /// @brief Start copying the live records of a page to the active page, then format it
+  void start_reclaim(std::size_t page);
+  /// @brief Abandon the job
+  void fail_job();
+  /// @brief Run the job to completion
+  bool finish_job();
+};
+
+} // namespace bass_station
+
+#endif // __PATTERN_BANK_HPP__
@@ -0,0 +1,103 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __PATTERN_GRID_HPP__
+#define __PATTERN_GRID_HPP__
+
+#include <keypad_manager.hpp>
+
+namespace bass_station
+{
+
+/// @brief Frame model for the graphical pattern view of the DisplayManager.
+/// Holds the last drawn state of every grid cell and piano roll column so that
+/// only the cells that changed since the previous frame are handed to the OLED.
+class PatternGrid
+{
+public:
+  PatternGrid() { invalidate(); }
+
+  /// @brief Number of step cells per grid row (one row for each sequencer row)
+  static constexpr uint8_t grid_columns{16};
+  /// @brief Number of text lines used to draw the piano roll
+  static constexpr uint8_t roll_lines{3};
+  /// @brief Number of glyph heights available within a single text line of the piano roll
+  static constexpr uint8_t roll_levels_per_line{3};
+  /// @brief Total number of note bands the 25 notes are quantised into
+  static constexpr uint8_t roll_bands{roll_lines * roll_levels_per_line};
+
+  /// @brief The two areas of the pattern view
+  enum class Area
+  {
+    GRID,
+    ROLL,
+  };
+
+  /// @brief A single dirty cell handed back to the renderer
+  struct DirtyCell
+  {
+    Area m_area;
+    /// @brief text line index within the area
+    uint8_t m_line;
+    /// @brief column index within the line
+    uint8_t m_column;
+    /// @brief the character to draw
+    char m_glyph;
+    /// @brief draw with inverted colours (cursor)
+    bool m_inverted;
+  };
+
+  /// @brief Worst case number of dirty cells in a single frame (all grid cells + every roll line after invalidate())
+  static constexpr uint8_t max_dirty_cells{2 * grid_columns + roll_lines * grid_columns};
+
+  /// @brief Compare the step map with the previous frame and collect the cells that need redrawing
+  /// @param sequencer_map The step map holding the pattern data
+  /// @param cursor_idx The step map index of the current sequencer position
+  /// @param selected_idx The step map index of the last user selected key
+  /// @param dirty_cells Output list of cells that changed since the last frame
+  /// @return uint8_t The number of valid entries in dirty_cells
+  uint8_t update(SequencerStepMap &sequencer_map, uint8_t cursor_idx, uint8_t selected_idx, std::array<DirtyCell, max_dirty_cells> &dirty_cells);
+
+  /// @brief Force every cell to be redrawn on the next update()
+  void invalidate();
+
+private:
+  /// @brief Cell flag bits stored in the frame buffer
+  static constexpr uint8_t cell_on{0x01};
+  static constexpr uint8_t cell_cursor{0x02};
+  static constexpr uint8_t cell_selected{0x04};
+  /// @brief Marks a cell that has never been drawn. Never a valid combination of the flags above.
+  static constexpr uint8_t cell_invalid{0x80};
+
+  /// @brief The last drawn state of each grid cell, indexed by step map index (lower row 0-15, upper row 16-31)
+  std::array<uint8_t, 2 * grid_columns> m_grid_frame;
+
+  /// @brief The last drawn note band of each piano roll column (0 = empty, otherwise band + 1)
+  std::array<uint8_t, grid_columns> m_roll_frame;
+
+  /// @brief Get the glyph used to draw a grid cell
+  static char grid_glyph(uint8_t cell);
+};
+
+} // namespace bass_station
+
+#endif // __PATTERN_GRID_HPP__
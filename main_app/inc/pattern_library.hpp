@@ -0,0 +1,531 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __PATTERN_LIBRARY_HPP__
+#define __PATTERN_LIBRARY_HPP__
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <ff_driver.hpp>
+#include <pattern_bank.hpp>
+#include <song_player.hpp>
+
+namespace bass_station
+{
+
+/// @brief The on-disk format of the pattern library file, version 1.
+/// The file is a whole number of sectors. Sector 0 is the header with the directory index, then two sectors per
+/// pattern slot, then two sectors per song slot. A slot's record is in one of its two sectors, picked by the directory
+/// entry. Every record starts on a sector boundary of the file and is one sector long, so with FatFs it always lies
+/// within one cluster and reading it is a single sector read from the card, straight into the caller's buffer. All
+/// fields are little endian, as on the STM32 and the host.
+namespace library_format
+{
+
+static constexpr std::size_t sector_size{512};
+static constexpr uint32_t header_magic{0x4C425342};  // "BSBL"
+static constexpr uint32_t pattern_magic{0x4E525450}; // "PTRN"
+static constexpr uint32_t song_magic{0x474E4F53};    // "SONG"
+/// @brief Bump when a record layout changes. Older files are left alone rather than overwritten.
+static constexpr uint16_t version{1};
+
+static constexpr std::size_t pattern_slots{48};
+static constexpr std::size_t song_slots{8};
+/// @brief Each slot has two record sectors, a save writes the one the directory is not pointing at
+static constexpr std::size_t copies{2};
+static constexpr std::size_t file_sectors{1 + (pattern_slots + song_slots) * copies};
+
+/// @brief Directory index entry, for listing the library without reading the records
+struct DirectoryEntry
+{
+  /// @brief The checksum of the record, zero if the slot is empty
+  uint32_t m_checksum;
+  /// @brief The pattern length in steps, or the number of entries in a song
+  uint16_t m_length;
+  uint8_t m_used;
+  /// @brief Which of the slot's two record sectors holds the record
+  uint8_t m_copy;
+};
+
+struct Header
+{
+  uint32_t m_magic;
+  uint16_t m_version;
+  uint16_t m_sector_size;
+  uint16_t m_pattern_slots;
+  uint16_t m_song_slots;
+  uint32_t m_reserved;
+  std::array<DirectoryEntry, pattern_slots + song_slots> m_directory;
+  /// @brief checksum of everything above
+  uint32_t m_checksum;
+  std::array<uint8_t, sector_size - 16 - (pattern_slots + song_slots) * sizeof(DirectoryEntry) - 4> m_padding;
+};
+
+/// @brief The first bytes of every record
+struct RecordHeader
+{
+  uint32_t m_magic;
+  uint16_t m_version;
+  uint16_t m_slot;
+};
+
+struct PatternRecord
+{
+  RecordHeader m_header;
+  PackedPattern m_steps;
+  /// @brief checksum of everything above
+  uint32_t m_checksum;
+  std::array<uint8_t, sector_size - sizeof(RecordHeader) - sizeof(PackedPattern) - 4> m_padding;
+};
+
+struct SongRecord
+{
+  RecordHeader m_header;
+  uint16_t m_length;
+  uint16_t m_reserved;
+  std::array<SongEntry, Song::max_entries> m_entries;
+  /// @brief checksum of everything above
+  uint32_t m_checksum;
+  std::array<uint8_t, sector_size - sizeof(RecordHeader) - 4 - sizeof(SongEntry) * Song::max_entries - 4> m_padding;
+};
+
+static_assert(sizeof(Header) == sector_size, "the header must fill one sector");
+static_assert(sizeof(PatternRecord) == sector_size, "a pattern record must fill one sector");
+static_assert(sizeof(SongRecord) == sector_size, "a song record must fill one sector");
+static_assert(offsetof(Header, m_checksum) == 16 + (pattern_slots + song_slots) * sizeof(DirectoryEntry), "unexpected Header padding");
+static_assert(offsetof(PatternRecord, m_checksum) == sizeof(RecordHeader) + sizeof(PackedPattern), "unexpected PatternRecord padding");
+static_assert(offsetof(SongRecord, m_checksum) == sizeof(RecordHeader) + 4 + sizeof(SongEntry) * Song::max_entries, "unexpected SongRecord padding");
+
+/// @brief FNV-1a over the bytes of a record before its checksum field
+inline uint32_t checksum(const void *record, std::size_t length)
+{
+  const uint8_t *bytes = static_cast<const uint8_t *>(record);
+  uint32_t hash        = 0x811C9DC5;
+  for (std::size_t idx = 0; idx < length; idx++)
+  {
+    hash = (hash ^ bytes[idx]) * 0x01000193;
+  }
+  return hash;
+}
+
+} // namespace library_format
+
+/// @brief Pattern and song library in one fixed size file on the uSD card.
+/// The header is kept in RAM, so listing the library needs no card access, and a load or save of one pattern is one
+/// sector read, or one sector write followed by a header write. A save writes the record to the slot's other sector and
+/// then switches the directory entry over to it, so a power loss part way through leaves the previous version of the
+/// slot in place. The header sector itself is rewritten in place, and relies on the card writing a sector whole.
+///
+/// A pattern save can also run as a job for PatternPersistence: begin_save() queues it and each call to service() does
+/// one of its card accesses (the record write, the header write, the sync), so it can be spread between steps. The
+/// job has its own record buffer, loads can run while it is waiting.
+/// @tparam DRIVER The FatFs driver: fatfs::Driver over the cached MMC/SPI diskio layer on the target, over a RAM disk in
+/// the host tests
+template <typename DRIVER> class PatternLibrary : public PatternStore
+{
+public:
+  /// @brief Construct a new PatternLibrary. Call open() once the volume is mounted.
+  /// @param driver The FatFs driver
+  explicit PatternLibrary(DRIVER &driver)
+      : m_driver(driver)
+  {
+  }
+
+  /// @brief Open the library file, creating and formatting it if it does not exist
+  /// @param path The file path, including the logical drive
+  /// @return false on a disk error, or if the file is from a newer version of the firmware
+  bool open(const fatfs::TCHAR *path)
+  {
+    close();
+    m_last_result = m_driver.f_open(&m_file, path, fatfs::FA_READ | fatfs::FA_WRITE | fatfs::FA_OPEN_ALWAYS);
+    if (m_last_result != fatfs::FRESULT::FR_OK)
+    {
+      return false;
+    }
+    m_open = true;
+
+    fatfs::UINT bytes_read{0};
+    if (!read_sector(0, &m_header, bytes_read))
+    {
+      close();
+      return false;
+    }
+    if (bytes_read == 0)
+    {
+      // a new file
+      if (!format())
+      {
+        close();
+        return false;
+      }
+      return true;
+    }
+    if ((bytes_read != library_format::sector_size) || !header_valid())
+    {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  /// @brief Close the library file. A save that is still running is dropped.
+  void close()
+  {
+    m_job_state = JobState::IDLE;
+    if (m_open)
+    {
+      m_driver.f_close(&m_file);
+      m_open = false;
+    }
+  }
+
+  /// @brief Check if the library file is open
+  bool is_open() const { return m_open; }
+
+  /// @brief Check if a pattern slot has been saved, without card access
+  bool contains_pattern(std::size_t slot) const { return (slot < library_format::pattern_slots) && (m_header.m_directory[slot].m_used != 0); }
+
+  /// @brief Check if a song slot has been saved, without card access
+  bool contains_song(std::size_t slot) const
+  {
+    return (slot < library_format::song_slots) && (m_header.m_directory[library_format::pattern_slots + slot].m_used != 0);
+  }
+
+  /// @brief Read a pattern with one sector read
+  /// @param slot The pattern slot
+  /// @param pattern The output
+  /// @return false if the slot is empty or the record is damaged
+  bool load_pattern(std::size_t slot, PackedPattern &pattern)
+  {
+    uint8_t length;
+    return load_pattern(slot, pattern, length);
+  }
+
+  /// @brief Read a pattern and its length with one sector read
+  /// @param slot The pattern slot
+  /// @param pattern The output
+  /// @param length The output pattern length, from the directory, at most max_pattern_length
+  /// @return false if the slot is empty or the record is damaged
+  bool load_pattern(std::size_t slot, PackedPattern &pattern, uint8_t &length)
+  {
+    if (!contains_pattern(slot))
+    {
+      return false;
+    }
+    if (!read_record(pattern_sector(slot, pattern_copy(slot)), library_format::pattern_magic, slot, offsetof(library_format::PatternRecord, m_checksum)) ||
+        (m_record.m_pattern.m_checksum != m_header.m_directory[slot].m_checksum))
+    {
+      return false;
+    }
+    pattern = m_record.m_pattern.m_steps;
+    length  = static_cast<uint8_t>(std::min<uint16_t>(m_header.m_directory[slot].m_length, max_pattern_length));
+    return true;
+  }
+
+  /// @brief Write a pattern
+  /// @param slot The pattern slot
+  /// @param pattern The pattern
+  /// @param length The pattern length (1 to max_pattern_length), kept in the directory
+  /// @return false on error
+  bool save_pattern(std::size_t slot, const PackedPattern &pattern, uint8_t length = default_pattern_length)
+  {
+    if (!begin_save(slot, pattern, length))
+    {
+      return false;
+    }
+    while (service())
+    {
+    }
+    return last_save_succeeded();
+  }
+
+  /// @brief Queue a pattern save, to be written by service()
+  /// @param slot The pattern slot
+  /// @param pattern The pattern, copied
+  /// @param length The pattern length (1 to max_pattern_length), kept in the directory
+  /// @return false if a save is already running, the library is not open or the slot or length is invalid
+  bool begin_save(std::size_t slot, const PackedPattern &pattern, uint8_t length) override
+  {
+    if (saving() || !m_open || (slot >= library_format::pattern_slots) || (length == 0) || (length > max_pattern_length))
+    {
+      return false;
+    }
+    m_job_record            = {};
+    m_job_record.m_header   = {library_format::pattern_magic, library_format::version, static_cast<uint16_t>(slot)};
+    m_job_record.m_steps    = pattern;
+    m_job_record.m_checksum = library_format::checksum(&m_job_record, offsetof(library_format::PatternRecord, m_checksum));
+    m_job_slot              = slot;
+    m_job_length            = length;
+    m_job_succeeded         = false;
+    m_job_state             = JobState::WRITE_RECORD;
+    return true;
+  }
+
+  /// @brief Do the next card access of the queued save: the record, the header or the sync
+  /// @return true if there is more to do
+  bool service() override
+  {
+    switch (m_job_state)
+    {
+      case JobState::IDLE:
+        return false;
+
+      case JobState::WRITE_RECORD:
+      {
+        // the copy that does not hold the current record
+        const library_format::DirectoryEntry &previous = m_header.m_directory[m_job_slot];
+        m_job_copy                                     = (previous.m_used != 0) ? static_cast<uint8_t>(1 - previous.m_copy) : 0;
+        if (write_sector(record_sector(m_job_slot, m_job_copy), &m_job_record))
+        {
+          m_job_state = JobState::WRITE_HEADER;
+        }
+        else
+        {
+          m_job_state = JobState::IDLE;
+        }
+        break;
+      }
+
+      case JobState::WRITE_HEADER:
+      {
+        m_job_previous                   = m_header.m_directory[m_job_slot];
+        m_header.m_directory[m_job_slot] = {m_job_record.m_checksum, m_job_length, 1, m_job_copy};
+        m_header.m_checksum              = library_format::checksum(&m_header, offsetof(library_format::Header, m_checksum));
+        if (write_sector(0, &m_header))
+        {
+          m_job_state = JobState::SYNC;
+        }
+        else
+        {
+          // the card still points at the previous copy
+          m_header.m_directory[m_job_slot] = m_job_previous;
+          m_job_state                      = JobState::IDLE;
+        }
+        break;
+      }
+
+      case JobState::SYNC:
+        m_last_result   = m_driver.f_sync(&m_file);
+        m_job_succeeded = (m_last_result == fatfs::FRESULT::FR_OK);
+        if (!m_job_succeeded)
+        {
+          m_header.m_directory[m_job_slot] = m_job_previous;
+        }
+        m_job_state = JobState::IDLE;
+        break;
+    }
+    return saving();
+  }
+
+  bool saving() const override { return m_job_state != JobState::IDLE; }
+
+  /// @brief The card has no background work to wait for, every step of a save is a card access
+  bool erasing() const override { return false; }
+
+  bool last_save_succeeded() const override { return m_job_succeeded; }
+
+  /// @brief Read a song with one sector read
+  /// @param slot The song slot
+  /// @param song The output
+  /// @return false if the slot is empty, the record is damaged or the song is not Song::valid()
+  bool load_song(std::size_t slot, Song &song)
+  {
+    if (!contains_song(slot))
+    {
+      return false;
+    }
+    const std::size_t entry = library_format::pattern_slots + slot;
+    if (!read_record(song_sector(slot, m_header.m_directory[entry].m_copy), library_format::song_magic, slot, offsetof(library_format::SongRecord, m_checksum)) ||
+        (m_record.m_song.m_checksum != m_header.m_directory[entry].m_checksum))
+    {
+      return false;
+    }
+    song.m_length  = m_record.m_song.m_length;
+    song.m_entries = m_record.m_song.m_entries;
+    return song.valid();
+  }
+
+  /// @brief Write a song
+  /// @param slot The song slot
+  /// @param song The song
+  /// @return false on error, or if the song is not Song::valid(). Songs play from the PatternBank, so their entries
+  /// are bank slots, not library pattern slots.
+  bool save_song(std::size_t slot, const Song &song)
+  {
+    if (saving() || !m_open || (slot >= library_format::song_slots) || !song.valid())
+    {
+      return false;
+    }
+    m_record                   = {};
+    m_record.m_song.m_header   = {library_format::song_magic, library_format::version, static_cast<uint16_t>(slot)};
+    m_record.m_song.m_length   = song.m_length;
+    m_record.m_song.m_entries  = song.m_entries;
+    m_record.m_song.m_checksum = library_format::checksum(&m_record, offsetof(library_format::SongRecord, m_checksum));
+    return write_record(library_format::pattern_slots + slot, m_record.m_song.m_checksum, song.m_length);
+  }
+
+  /// @brief Get the result of the last failed FatFs call
+  fatfs::FRESULT last_result() const { return m_last_result; }
+
+  /// @brief Get the sector of the file one copy of a pattern slot is stored in
+  static constexpr std::size_t pattern_sector(std::size_t slot, std::size_t copy) { return record_sector(slot, copy); }
+
+  /// @brief Get the sector of the file one copy of a song slot is stored in
+  static constexpr std::size_t song_sector(std::size_t slot, std::size_t copy) { return record_sector(library_format::pattern_slots + slot, copy); }
+
+  /// @brief Get the copy the directory points at for a pattern slot, without card access
+  uint8_t pattern_copy(std::size_t slot) const { return m_header.m_directory[slot].m_copy; }
+
+private:
+  /// @brief One record sized buffer, shared by loads and saves
+  union RecordBuffer
+  {
+    library_format::PatternRecord m_pattern;
+    library_format::SongRecord m_song;
+  };
+
+  DRIVER &m_driver;
+  fatfs::FIL m_file{};
+  bool m_open{false};
+  fatfs::FRESULT m_last_result{fatfs::FRESULT::FR_OK};
+  library_format::Header m_header{};
+  RecordBuffer m_record{};
+
+  /// @brief The steps of a pattern save started by begin_save()
+  enum class JobState
+  {
+    IDLE,
+    WRITE_RECORD,
+    WRITE_HEADER,
+    SYNC,
+  };
+  JobState m_job_state{JobState::IDLE};
+  library_format::PatternRecord m_job_record{};
+  std::size_t m_job_slot{0};
+  uint8_t m_job_length{0};
+  uint8_t m_job_copy{0};
+  /// @brief The directory entry of the slot before the save, put back if the header write or the sync fails
+  library_format::DirectoryEntry m_job_previous{};
+  bool m_job_succeeded{false};
+
+  bool read_sector(std::size_t sector, void *buffer, fatfs::UINT &bytes_read)
+  {
+    m_last_result = m_driver.f_lseek(&m_file, static_cast<fatfs::FSIZE_t>(sector * library_format::sector_size));
+    if (m_last_result == fatfs::FRESULT::FR_OK)
+    {
+      m_last_result = m_driver.f_read(&m_file, buffer, library_format::sector_size, &bytes_read);
+    }
+    return m_last_result == fatfs::FRESULT::FR_OK;
+  }
+
+  bool write_sector(std::size_t sector, const void *buffer)
+  {
+    fatfs::UINT bytes_written{0};
+    m_last_result = m_driver.f_lseek(&m_file, static_cast<fatfs::FSIZE_t>(sector * library_format::sector_size));
+    if (m_last_result == fatfs::FRESULT::FR_OK)
+    {
+      m_last_result = m_driver.f_write(&m_file, buffer, library_format::sector_size, &bytes_written);
+    }
+    return (m_last_result == fatfs::FRESULT::FR_OK) && (bytes_written == library_format::sector_size);
+  }
+
+  /// @brief Read a record into m_record and check its header and checksum
+  bool read_record(std::size_t sector, uint32_t magic, std::size_t slot, std::size_t checksum_offset)
+  {
+    fatfs::UINT bytes_read{0};
+    if (!m_open || !read_sector(sector, &m_record, bytes_read) || (bytes_read != library_format::sector_size))
+    {
+      return false;
+    }
+    const library_format::RecordHeader &header = m_record.m_pattern.m_header;
+    uint32_t stored_checksum;
+    std::memcpy(&stored_checksum, reinterpret_cast<const uint8_t *>(&m_record) + checksum_offset, sizeof(stored_checksum));
+    return (header.m_magic == magic) && (header.m_version == library_format::version) && (header.m_slot == slot) &&
+           (stored_checksum == library_format::checksum(&m_record, checksum_offset));
+  }
+
+  /// @brief Get the sector of one copy of the record of a directory entry
+  static constexpr std::size_t record_sector(std::size_t entry, std::size_t copy) { return 1 + entry * library_format::copies + copy; }
+
+  /// @brief Write m_record to the copy that does not hold the current record, then point the directory entry at it
+  bool write_record(std::size_t entry, uint32_t checksum, uint16_t length)
+  {
+    const library_format::DirectoryEntry previous = m_header.m_directory[entry];
+    const uint8_t copy                            = (previous.m_used != 0) ? static_cast<uint8_t>(1 - previous.m_copy) : 0;
+    if (!write_sector(record_sector(entry, copy), &m_record))
+    {
+      return false;
+    }
+    m_header.m_directory[entry] = {checksum, length, 1, copy};
+    if (!write_header())
+    {
+      // the card still points at the previous copy
+      m_header.m_directory[entry] = previous;
+      return false;
+    }
+    return true;
+  }
+
+  bool write_header()
+  {
+    m_header.m_checksum = library_format::checksum(&m_header, offsetof(library_format::Header, m_checksum));
+    if (!write_sector(0, &m_header))
+    {
+      return false;
+    }
+    m_last_result = m_driver.f_sync(&m_file);
+    return m_last_result == fatfs::FRESULT::FR_OK;
+  }
+
+  bool header_valid() const
+  {
+    return (m_header.m_magic == library_format::header_magic) && (m_header.m_version == library_format::version) &&
+           (m_header.m_sector_size == library_format::sector_size) && (m_header.m_pattern_slots == library_format::pattern_slots) &&
+           (m_header.m_song_slots == library_format::song_slots) &&
+           (m_header.m_checksum == library_format::checksum(&m_header, offsetof(library_format::Header, m_checksum)));
+  }
+
+  /// @brief Write an empty directory and zeroed record sectors, so the file is at its full size from the start
+  bool format()
+  {
+    m_record = {};
+    for (std::size_t sector = 1; sector < library_format::file_sectors; sector++)
+    {
+      if (!write_sector(sector, &m_record))
+      {
+        return false;
+      }
+    }
+    m_header                 = {};
+    m_header.m_magic         = library_format::header_magic;
+    m_header.m_version       = library_format::version;
+    m_header.m_sector_size   = library_format::sector_size;
+    m_header.m_pattern_slots = library_format::pattern_slots;
+    m_header.m_song_slots    = library_format::song_slots;
+    return write_header();
+  }
+};
+
+} // namespace bass_station
+
+#endif // __PATTERN_LIBRARY_HPP__
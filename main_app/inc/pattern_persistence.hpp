@@ -0,0 +1,77 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __PATTERN_PERSISTENCE_HPP__
+#define __PATTERN_PERSISTENCE_HPP__
+
+#include <pattern_bank.hpp>
+
+namespace bass_station
+{
+
+/// @brief Write-behind saving of the live pattern to a slot of a PatternStore (the PatternBank on the device).
+/// Edits only mark the pattern dirty. Once the edits have settled, service() takes a snapshot of the pattern in one go
+/// (the map is only written by the main loop, so it is consistent between iterations) and then writes it in slices of
+/// at most m_slice_budget_us per main loop iteration. Page erases run in the background and are only polled. A slice
+/// always does one step of the store, so a PatternLibrary save takes one sector access per iteration, however long the
+/// card takes over it.
+class PatternPersistence
+{
+public:
+  /// @brief Construct a new PatternPersistence
+  /// @param store The store to save to, already initialised or open
+  /// @param slot The slot the live pattern is saved to
+  PatternPersistence(PatternStore &store, std::size_t slot);
+
+  /// @brief Note that the pattern has changed. Restarts the settle time.
+  void mark_dirty();
+
+  /// @brief Start a save once the edits have settled and run slices of it. Call once per main loop iteration.
+  /// @param sequencer_map The live pattern
+  /// @param length The live pattern length
+  void service(const SequencerStepMap &sequencer_map, uint8_t length = default_pattern_length);
+
+  /// @brief Check if service() has something to do, so the main loop should stay awake
+  bool work_pending() const;
+
+  /// @brief Get the number of saves that failed or were refused by the store
+  uint32_t failed_saves() const { return m_failed_saves; }
+
+  /// @brief How long the pattern must be left alone before it is saved, to save flash wear while the user is editing
+  static constexpr uint32_t m_settle_time_us{2000000};
+  /// @brief The most time service() spends writing per call. One double word program takes ~85us.
+  static constexpr uint32_t m_slice_budget_us{150};
+
+private:
+  PatternStore &m_store;
+  std::size_t m_slot;
+
+  bool m_dirty{false};
+  uint32_t m_dirty_since_us{0};
+  /// @brief A save was started by service() and has not finished yet
+  bool m_save_running{false};
+  uint32_t m_failed_saves{0};
+};
+
+} // namespace bass_station
+
+#endif // __PATTERN_PERSISTENCE_HPP__
@@ -0,0 +1,126 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __PITCH_MAP_HPP__
+#define __PITCH_MAP_HPP__
+
+#include <array>
+#include <cstdint>
+#include <note.hpp>
+
+namespace bass_station
+{
+
+/// @brief Live transpose and scale quantisation. The patterns keep the notes they were entered with. When the scale or
+/// transpose changes, the note each of the 25 keys plays and its ADG2188 pole are worked out into tables, so playing a
+/// step costs one table load whatever the scale.
+/// A transposed note that falls off the keyboard is folded back an octave, then it moves to the nearest note of the
+/// scale (the lower one when two are as near).
+class PitchMap
+{
+public:
+  /// @brief The scales, as the semitones above the root that are in them
+  enum class Scale : uint8_t
+  {
+    CHROMATIC,
+    MAJOR,
+    MINOR,
+    HARMONIC_MINOR,
+    DORIAN,
+    MIXOLYDIAN,
+    MAJOR_PENTATONIC,
+    MINOR_PENTATONIC,
+    BLUES,
+    count
+  };
+
+  /// @brief Transpose range, in semitones
+  static constexpr int8_t max_transpose{12};
+
+  /// @brief Construct a new Pitch Map, chromatic and not transposed
+  /// @param note_data The name and crosspoint pole of each key, indexed by Note
+  explicit PitchMap(const std::array<NoteData, Note::none> &note_data);
+
+  /// @brief Change the scale and transpose, and rebuild the tables. Called from the main loop.
+  /// @param scale The scale
+  /// @param root The key of the scale, 0 (C) to 11 (B)
+  /// @param transpose -max_transpose to max_transpose semitones
+  /// @return false if any of them is out of range, the tables are left as they were
+  bool set(Scale scale, uint8_t root, int8_t transpose);
+
+  Scale scale() const { return m_scale; }
+  uint8_t root() const { return m_root; }
+  int8_t transpose() const { return m_transpose; }
+
+  /// @brief Get the pole of the key a note plays
+  /// @param note The note of the step, not Note::none
+  adg2188::Driver::Pole pole(Note note) const { return m_poles[note]; }
+
+  /// @brief Get the key a note plays, for the MIDI note and the display
+  /// @param note The note of the step, not Note::none
+  Note note(Note note) const { return m_notes[note]; }
+
+  /// @brief Check if a note is in the scale, before transposing
+  bool in_scale(Note note) const;
+
+  /// @brief Get the next note of the scale up, for the encoder. Stops at the top note of the scale. Note::none goes to
+  /// the bottom note of the scale.
+  Note next_note(Note note) const;
+
+  /// @brief Get the next note of the scale down, for the encoder. Stops at the bottom note of the scale. Note::none
+  /// stays Note::none.
+  Note previous_note(Note note) const;
+
+private:
+  /// @brief Bit n is set if the note n semitones above the root is in the scale
+  static constexpr std::array<uint16_t, static_cast<std::size_t>(Scale::count)> m_scale_masks{{
+      0x0FFF, // chromatic
+      0x0AB5, // major: 0 2 4 5 7 9 11
+      0x05AD, // natural minor: 0 2 3 5 7 8 10
+      0x09AD, // harmonic minor: 0 2 3 5 7 8 11
+      0x06AD, // dorian: 0 2 3 5 7 9 10
+      0x06B5, // mixolydian: 0 2 4 5 7 9 10
+      0x0295, // major pentatonic: 0 2 4 7 9
+      0x04A9, // minor pentatonic: 0 3 5 7 10
+      0x04E9, // blues: 0 3 5 6 7 10
+  }};
+
+  /// @brief Check if a key (0 to 24 from c0) is in the scale
+  bool in_scale(int key) const;
+
+  /// @brief Work out the tables for the current settings
+  void build();
+
+  const std::array<NoteData, Note::none> &m_note_data;
+
+  Scale m_scale{Scale::CHROMATIC};
+  uint8_t m_root{0};
+  int8_t m_transpose{0};
+
+  /// @brief The key and the pole each note plays, indexed by Note
+  std::array<Note, Note::none> m_notes;
+  std::array<adg2188::Driver::Pole, Note::none> m_poles;
+};
+
+} // namespace bass_station
+
+#endif // __PITCH_MAP_HPP__
@@ -0,0 +1,132 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __PROFILER_HPP__
+#define __PROFILER_HPP__
+
+#include <array>
+#include <static_string.hpp>
+#include <usec_clock.hpp>
+
+namespace bass_station
+{
+
+/// @brief The instrumented parts of the sequencer. Each zone has its own fixed slot.
+enum class ProfileZone : uint8_t
+{
+  DISPLAY,          // @brief SequenceManager::update_display_and_tempo() (OLED)
+  KEYPAD,           // @brief KeypadManager::update_sequencer_map() (ADP5587)
+  SEQUENCER,        // @brief SequenceManager::increment_sequencer() (TLC5955 LEDs and ADG2188 crosspoint)
+  TEMPO_ISR,        // @brief tempo timer top half (update and ratchet compare)
+  TEMPO_DEFERRED,   // @brief tempo timer bottom half (MIDI clock, step advance and ratchet gates)
+  ENCODER_ISR,      // @brief encoder switch top half
+  ENCODER_DEFERRED, // @brief encoder switch bottom half
+  COUNT,
+};
+
+/// @brief Accumulates the total, maximum and count of the time spent in each ProfileZone, timed with UsecClock.
+/// Every zone is only recorded from one context, so recording needs no locking.
+class Profiler
+{
+public:
+  /// @brief The accumulated figures of one zone
+  struct Slot
+  {
+    uint32_t m_total_us;
+    uint32_t m_max_us;
+    uint32_t m_count;
+  };
+
+  /// @brief The figures of a completed measurement window
+  struct Report
+  {
+    std::array<Slot, static_cast<std::size_t>(ProfileZone::COUNT)> m_slots;
+    /// @brief percent of the window spent in each zone
+    std::array<uint8_t, static_cast<std::size_t>(ProfileZone::COUNT)> m_load_percent;
+    uint32_t m_window_us;
+  };
+
+  /// @brief Times the enclosing scope and records it against a zone when it goes out of scope
+  class Scope
+  {
+  public:
+    explicit Scope(ProfileZone zone)
+        : m_zone(zone),
+          m_start_us(UsecClock::now())
+    {
+    }
+    ~Scope() { Profiler::record(m_zone, UsecClock::elapsed(m_start_us)); }
+
+    Scope(const Scope &)            = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    ProfileZone m_zone;
+    uint32_t m_start_us;
+  };
+
+  /// @brief Add a measurement to a zone
+  /// @param zone The zone
+  /// @param elapsed_us The time spent in the zone
+  static void record(ProfileZone zone, uint32_t elapsed_us);
+
+  /// @brief Close the measurement window if it has run for a full second. Call from the main loop.
+  /// @return true if a new report is available
+  static bool update_window();
+
+  /// @brief Get the report of the last completed window
+  static const Report &report() { return m_report; }
+
+  /// @brief Write the last report to the OLED overlay format: "D<n> K<n> S<n> I<n>" (percent, I = all ISR zones)
+  /// @param overlay_line The line to write to
+  template <std::size_t LINE_SIZE> static void format_overlay(noarch::containers::StaticString<LINE_SIZE> &overlay_line);
+
+  /// @brief Print the last report on RTT channel 0 (Debug ARM builds only)
+  /// @param cpu_load_percent The overall CPU load from the IdleMonitor
+  static void dump_rtt(uint8_t cpu_load_percent);
+
+private:
+  /// @brief Length of a measurement window
+  static constexpr uint32_t m_window_length_us{1000000};
+
+  static inline std::array<Slot, static_cast<std::size_t>(ProfileZone::COUNT)> m_slots{};
+  static inline uint32_t m_window_start_us{0};
+  static inline Report m_report{};
+};
+
+template <std::size_t LINE_SIZE> void Profiler::format_overlay(noarch::containers::StaticString<LINE_SIZE> &overlay_line)
+{
+  const uint32_t isr_percent = m_report.m_load_percent[static_cast<std::size_t>(ProfileZone::TEMPO_ISR)] +
+                               m_report.m_load_percent[static_cast<std::size_t>(ProfileZone::TEMPO_DEFERRED)] +
+                               m_report.m_load_percent[static_cast<std::size_t>(ProfileZone::ENCODER_ISR)] +
+                               m_report.m_load_percent[static_cast<std::size_t>(ProfileZone::ENCODER_DEFERRED)];
+
+  overlay_line.concat(0, "D   K   S   I      ");
+  overlay_line.concat_int(1, m_report.m_load_percent[static_cast<std::size_t>(ProfileZone::DISPLAY)]);
+  overlay_line.concat_int(5, m_report.m_load_percent[static_cast<std::size_t>(ProfileZone::KEYPAD)]);
+  overlay_line.concat_int(9, m_report.m_load_percent[static_cast<std::size_t>(ProfileZone::SEQUENCER)]);
+  overlay_line.concat_int(13, isr_percent);
+}
+
+} // namespace bass_station
+
+#endif // __PROFILER_HPP__
@@ -0,0 +1,133 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __RATCHET_SCHEDULER_HPP__
+#define __RATCHET_SCHEDULER_HPP__
+
+#include <adg2188.hpp>
+#include <event_queue.hpp>
+#include <step.hpp>
+
+#if defined(X86_UNIT_TESTING_ONLY)
+  // only used when unit testing on x86
+  #include <mock_cmsis.hpp>
+#endif
+
+namespace bass_station
+{
+
+/// @brief Plays the retriggers of a ratcheted step at sub-step times, from the tempo timer (TIM3) CC1 compare interrupt.
+/// Times are counted in tempo timer counts from the start of the step, so the retriggers follow the tempo and the swing
+/// of the step exactly. The tempo timer ISR calls timer_update() on each update, and timer_compare() on a CC1 match.
+/// Each loads CCR1 with the next event if it falls in the current timer period.
+/// The switch changes are not written from the interrupt, they are queued for a bottom half to write to the ADG2188.
+///
+/// The main loop plays the first trigger of the step and then schedule()s the others. It doesn't write the switch again
+/// until the next step, so the ADG2188 I2C bus is never used by the main loop and the bottom half at the same time.
+class RatchetScheduler
+{
+public:
+  /// @brief A switch change of a retrigger
+  struct Gate
+  {
+    adg2188::Driver::Pole m_pole;
+    bool m_close;
+  };
+
+  /// @brief Each retrigger opens the switch and closes it again
+  static constexpr std::size_t max_events{2 * (max_ratchet - 1U)};
+
+  /// @brief The note is released for this fraction (1/n) of each sub-step before it is triggered again
+  static constexpr uint32_t release_divisor{4};
+
+  /// @brief Construct a new Ratchet Scheduler
+  /// @param tempo_timer The tempo timer, its CCR1 and CC1 interrupt are used
+  explicit RatchetScheduler(TIM_TypeDef &tempo_timer);
+
+  /// @brief Start again from the first step. Call with the tempo timer stopped.
+  /// @param step_counts The length of the first step in timer counts, SwingEngine::step_counts()
+  void reset(uint32_t step_counts);
+
+  /// @brief Queue the retriggers of the step being played. Called from the main loop after the step's first trigger.
+  /// @param step_number The steps_started() value posted with the step's EventType::StepAdvance (0 after reset()). The
+  /// retriggers are not played if another step has started since.
+  /// @param pole The switch of the step's note
+  /// @param ratchet The number of triggers in the step, 2 to max_ratchet
+  /// @return false if nothing was queued
+  bool schedule(uint16_t step_number, adg2188::Driver::Pole pole, uint8_t ratchet);
+
+  /// @brief Drop the queued retriggers. Called from the main loop, e.g. when the sequencer stops.
+  void cancel();
+
+  /// @brief The tempo timer has updated and the ARR of the new period has been written. Called from the tempo timer ISR.
+  /// @param step_started The update started a step. The retriggers left from the previous step are dropped.
+  /// @param step_counts The length of the step it started, SwingEngine::step_counts()
+  /// @return true if gates were queued for the bottom half
+  bool timer_update(bool step_started, uint32_t step_counts);
+
+  /// @brief The CC1 compare has matched. Called from the tempo timer ISR.
+  /// @return true if gates were queued for the bottom half
+  bool timer_compare();
+
+  /// @brief Get the next gate queued by the interrupt. Called from the bottom half.
+  /// @return false if there are none
+  bool pop_gate(Gate &gate) { return m_fired_gates.pop(gate); }
+
+  /// @brief Get the number of steps started since reset(), as 16 bits
+  uint16_t steps_started() const { return static_cast<uint16_t>(m_steps_started); }
+
+private:
+  /// @brief A gate and its time in timer counts from the start of the step
+  struct Event
+  {
+    uint32_t m_counts;
+    bool m_close;
+  };
+
+  /// @brief Queue the events that are due at now_counts for the bottom half
+  /// @return true if any were due
+  bool fire_due(uint32_t now_counts);
+
+  /// @brief Load CCR1 with the next event if it is in the current period, else disable the compare interrupt
+  void arm();
+
+  TIM_TypeDef &m_timer;
+
+  /// @brief The retriggers of the step. Written by schedule() with interrupts masked, then read by the interrupt.
+  std::array<Event, max_events> m_events;
+  volatile std::size_t m_event_count{0};
+  volatile std::size_t m_next_event{0};
+  adg2188::Driver::Pole m_pole;
+
+  /// @brief Timing of the current period, from the start of the step. Only written by the interrupt (or with it masked).
+  volatile uint32_t m_period_start_counts{0};
+  volatile uint32_t m_period_counts{0};
+  volatile uint32_t m_step_counts{0};
+  volatile uint32_t m_steps_started{0};
+
+  /// @brief Gates passed from the interrupt to the bottom half
+  SpscQueue<Gate, 8> m_fired_gates;
+};
+
+} // namespace bass_station
+
+#endif // __RATCHET_SCHEDULER_HPP__
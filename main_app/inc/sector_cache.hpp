@@ -0,0 +1,276 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __SECTOR_CACHE_HPP__
+#define __SECTOR_CACHE_HPP__
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <ff_driver.hpp>
+
+namespace bass_station
+{
+
+/// @brief Write-through LRU sector cache with sequential read-ahead, wrapped around a FatFs diskio layer.
+/// It has the same disk_* interface as the layer it wraps, so it slots in between that layer and the fatfs::Driver.
+///
+/// Single sector reads are served from the cache. A miss that continues the previous read fetches READ_AHEAD sectors
+/// in one call, which the MMC layer turns into one CMD18 multi-block read instead of a command per sector. Runs of
+/// missed sectors in a multi-sector read (FatFs reads large aligned transfers straight into the caller's buffer) are
+/// also fetched with one call each, and are not cached so a streamed file does not flush the cache. Writes go straight
+/// to the card in one call, so a multi-sector write is one CMD25, and update any cached copy.
+/// @tparam DISKIO The diskio layer, fatfs::DiskioHardwareMMC<fatfs::DiskioProtocolSPI> on the target
+/// @tparam LINES The number of cached sectors
+/// @tparam READ_AHEAD The number of sectors fetched by a sequential miss
+template <typename DISKIO, std::size_t LINES, std::size_t READ_AHEAD> class SectorCache
+{
+public:
+  static constexpr std::size_t sector_size{512};
+
+  static_assert(LINES >= READ_AHEAD, "a read-ahead must fit in the cache");
+  static_assert(READ_AHEAD >= 1, "READ_AHEAD includes the sector that was asked for");
+
+  /// @brief Cache effectiveness counters
+  struct Statistics
+  {
+    /// @brief sectors served from the cache
+    uint32_t m_hits;
+    /// @brief sectors read from the card
+    uint32_t m_misses;
+    /// @brief sectors read from the card ahead of being asked for
+    uint32_t m_read_ahead_sectors;
+    /// @brief read calls to the diskio layer, each one command to the card
+    uint32_t m_device_reads;
+    /// @brief write calls to the diskio layer, each one command to the card
+    uint32_t m_device_writes;
+  };
+
+  /// @brief Construct a new SectorCache
+  /// @param diskio The diskio layer to cache
+  explicit SectorCache(DISKIO &diskio)
+      : m_diskio(diskio)
+  {
+  }
+
+  fatfs::DSTATUS disk_initialize(fatfs::BYTE pdrv)
+  {
+    // a new card may have been inserted
+    invalidate();
+    return m_diskio.disk_initialize(pdrv);
+  }
+
+  fatfs::DSTATUS disk_status(fatfs::BYTE pdrv) { return m_diskio.disk_status(pdrv); }
+
+  fatfs::DRESULT disk_read(fatfs::BYTE pdrv, fatfs::BYTE *buff, fatfs::LBA_t sector, fatfs::UINT count)
+  {
+    if (count == 1)
+    {
+      return read_one(pdrv, buff, sector);
+    }
+
+    // serve the cached sectors and fetch each run of missing sectors with one call
+    fatfs::UINT idx = 0;
+    while (idx < count)
+    {
+      Line *line = find(sector + idx);
+      if (line != nullptr)
+      {
+        touch(*line);
+        std::memcpy(&buff[idx * sector_size], line->m_data.data(), sector_size);
+        m_statistics.m_hits++;
+        idx++;
+        continue;
+      }
+      fatfs::UINT run = 1;
+      while ((idx + run < count) && (find(sector + idx + run) == nullptr))
+      {
+        run++;
+      }
+      const fatfs::DRESULT result = device_read(pdrv, &buff[idx * sector_size], sector + idx, run);
+      if (result != fatfs::DRESULT::RES_OK)
+      {
+        return result;
+      }
+      m_statistics.m_misses += run;
+      idx += run;
+    }
+    m_next_sequential = sector + count;
+    return fatfs::DRESULT::RES_OK;
+  }
+
+  fatfs::DRESULT disk_write(fatfs::BYTE pdrv, const fatfs::BYTE *buff, fatfs::LBA_t sector, fatfs::UINT count)
+  {
+    m_statistics.m_device_writes++;
+    const fatfs::DRESULT result = m_diskio.disk_write(pdrv, buff, sector, count);
+    for (fatfs::UINT idx = 0; idx < count; idx++)
+    {
+      Line *line = find(sector + idx);
+      if (line == nullptr)
+      {
+        continue;
+      }
+      if (result == fatfs::DRESULT::RES_OK)
+      {
+        std::memcpy(line->m_data.data(), &buff[idx * sector_size], sector_size);
+      }
+      else
+      {
+        // the card contents are unknown now
+        line->m_valid = false;
+      }
+    }
+    return result;
+  }
+
+  fatfs::DRESULT disk_ioctl(fatfs::BYTE pdrv, fatfs::BYTE cmd, void *buff) { return m_diskio.disk_ioctl(pdrv, cmd, buff); }
+
+  /// @brief Drop every cached sector
+  void invalidate()
+  {
+    for (Line &line : m_lines)
+    {
+      line.m_valid = false;
+    }
+    m_next_sequential = no_sector;
+  }
+
+  /// @brief Get the counters since construction or the last reset_statistics()
+  const Statistics &statistics() const { return m_statistics; }
+
+  void reset_statistics() { m_statistics = {}; }
+
+private:
+  struct Line
+  {
+    fatfs::LBA_t m_sector;
+    /// @brief the value of m_clock when the line was last used, the lowest is evicted first
+    uint32_t m_last_used;
+    bool m_valid;
+    std::array<fatfs::BYTE, sector_size> m_data;
+  };
+
+  static constexpr fatfs::LBA_t no_sector{static_cast<fatfs::LBA_t>(-1)};
+
+  DISKIO &m_diskio;
+  std::array<Line, LINES> m_lines{};
+  /// @brief A multi-block read lands here before it is spread over the lines it evicts
+  std::array<fatfs::BYTE, READ_AHEAD * sector_size> m_read_ahead_buffer;
+  uint32_t m_clock{0};
+  /// @brief The sector after the previous read
+  fatfs::LBA_t m_next_sequential{no_sector};
+  Statistics m_statistics{};
+
+  Line *find(fatfs::LBA_t sector)
+  {
+    for (Line &line : m_lines)
+    {
+      if (line.m_valid && (line.m_sector == sector))
+      {
+        return &line;
+      }
+    }
+    return nullptr;
+  }
+
+  void touch(Line &line) { line.m_last_used = ++m_clock; }
+
+  /// @brief Get an invalid line, or else the least recently used one
+  Line &victim()
+  {
+    Line *oldest = &m_lines[0];
+    for (Line &line : m_lines)
+    {
+      if (!line.m_valid)
+      {
+        return line;
+      }
+      if (line.m_last_used < oldest->m_last_used)
+      {
+        oldest = &line;
+      }
+    }
+    return *oldest;
+  }
+
+  fatfs::DRESULT device_read(fatfs::BYTE pdrv, fatfs::BYTE *buff, fatfs::LBA_t sector, fatfs::UINT count)
+  {
+    m_statistics.m_device_reads++;
+    return m_diskio.disk_read(pdrv, buff, sector, count);
+  }
+
+  fatfs::DRESULT read_one(fatfs::BYTE pdrv, fatfs::BYTE *buff, fatfs::LBA_t sector)
+  {
+    const bool sequential = (sector == m_next_sequential);
+    m_next_sequential     = sector + 1;
+
+    Line *line = find(sector);
+    if (line != nullptr)
+    {
+      touch(*line);
+      std::memcpy(buff, line->m_data.data(), sector_size);
+      m_statistics.m_hits++;
+      return fatfs::DRESULT::RES_OK;
+    }
+    m_statistics.m_misses++;
+
+    if (sequential && (READ_AHEAD > 1))
+    {
+      // the read-ahead can run off the end of the card, then fall back to the single sector
+      if (device_read(pdrv, m_read_ahead_buffer.data(), sector, READ_AHEAD) == fatfs::DRESULT::RES_OK)
+      {
+        for (std::size_t idx = 0; idx < READ_AHEAD; idx++)
+        {
+          // keep any cached copy, it is the same data
+          if (find(sector + idx) == nullptr)
+          {
+            Line &fill    = victim();
+            fill.m_sector = sector + idx;
+            fill.m_valid  = true;
+            std::memcpy(fill.m_data.data(), &m_read_ahead_buffer[idx * sector_size], sector_size);
+            touch(fill);
+          }
+        }
+        m_statistics.m_read_ahead_sectors += READ_AHEAD - 1;
+        std::memcpy(buff, m_read_ahead_buffer.data(), sector_size);
+        return fatfs::DRESULT::RES_OK;
+      }
+    }
+
+    Line &fill                  = victim();
+    fill.m_valid                = false;
+    const fatfs::DRESULT result = device_read(pdrv, fill.m_data.data(), sector, 1);
+    if (result != fatfs::DRESULT::RES_OK)
+    {
+      return result;
+    }
+    fill.m_sector = sector;
+    fill.m_valid  = true;
+    touch(fill);
+    std::memcpy(buff, fill.m_data.data(), sector_size);
+    return fatfs::DRESULT::RES_OK;
+  }
+};
+
+} // namespace bass_station
+
+#endif // __SECTOR_CACHE_HPP__
@@ -23,10 +23,25 @@
 #ifndef __SEQUENCE_MANAGER_HPP__
 #define __SEQUENCE_MANAGER_HPP__
 
+#include <board_description.hpp>
 #include <display_manager.hpp>
+#include <event_queue.hpp>
+#include <flash_stm32g0.hpp>
+#include <idle_monitor.hpp>
 #include <keypad_manager.hpp>
+#include <limits>
 #include <led_manager.hpp>
+#include <live_recorder.hpp>
+#include <midi_note_output.hpp>
 #include <midi_stm32.hpp>
+#include <pattern_persistence.hpp>
+#include <pitch_map.hpp>
+#include <ratchet_scheduler.hpp>
+#include <song_player.hpp>
+#include <swing_engine.hpp>
+#include <track_engine.hpp>
+#include <trig_engine.hpp>
+#include <undo_journal.hpp>
 
 namespace bass_station
 {
@@ -48,6 +63,7 @@ public:
     /// @param adg2188_control_sw_i2c The crosspoint switch I2C interface for controlling the synth notes
     /// @param led_spi_interface The LedManager SPI interface
     /// @param midi_usart_interface The MIDI USART interface
+    /// @param midi_note_usart The USART of midi_usart_interface, for the note messages of the MIDI tracks
     SequenceManager(
         tempo_timer_pair_t tempo_timer_pair,
         TIM_TypeDef *sequencer_encoder_timer,
@@ -56,40 +72,162 @@ public:
         TIM_TypeDef *debounce_timer,
         I2C_TypeDef *adg2188_control_sw_i2c,
         tlc5955::DriverSerialInterface &led_spi_interface,
-        midi_stm32::DeviceInterface<STM32G0_ISR> &midi_usart_interface);
+        midi_stm32::DeviceInterface<STM32G0_ISR> &midi_usart_interface,
+        USART_TypeDef *midi_note_usart);
   // clang-format on
   /// @brief Start the main sequencer loop. Called from mainapp.cpp
   void main_loop();
 
+  /// @brief Play a chain of patterns from the pattern bank instead of looping the live pattern
+  /// @param song The song. Its pattern ids are PatternBank slots, an entry whose slot is empty keeps the previous
+  /// pattern playing.
+  /// @return false if the song is empty or names a slot outside the bank
+  bool play_song(const Song &song);
+
+  /// @brief Set the swing: the second step of each pair is delayed to this percentage of the pair. The MIDI clock is
+  /// not moved. Takes effect at the start of the next pair.
+  /// @param percent SwingEngine::min_percent (straight) to SwingEngine::max_percent
+  /// @return false if the swing is out of range
+  bool set_swing(uint8_t percent) { return m_swing_engine.set_swing(percent); }
+
+  /// @brief Quantise the notes played to a scale. The pattern keeps its notes, the encoder edits them along the scale.
+  /// Takes effect from the next note played. In PITCH mode user button 1 steps the scale and user button 2 its root.
+  /// @param scale The scale, PitchMap::Scale::CHROMATIC plays the notes as they are
+  /// @param root The key of the scale, 0 (C) to 11 (B)
+  /// @return false if the root is out of range
+  bool set_scale(PitchMap::Scale scale, uint8_t root) { return m_pitch_map.set(scale, root, m_pitch_map.transpose()); }
+
+  /// @brief Transpose the notes played. Takes effect from the next note played. In PITCH mode the encoder transposes.
+  /// @param semitones -PitchMap::max_transpose to PitchMap::max_transpose
+  /// @return false if the transpose is out of range
+  bool set_transpose(int8_t semitones) { return m_pitch_map.set(m_pitch_map.scale(), m_pitch_map.root(), semitones); }
+
+  /// @brief Undo the last edit of the pattern: a step switched on or off, a change of ratchet, trig or note, a recorded
+  /// note or a randomise. The history is lost when the song moves on to another pattern. In UNDO mode the encoder
+  /// calls undo() and redo().
+  /// @return false if there is no edit to undo
+  bool undo();
+
+  /// @brief Redo the last undone edit of the pattern
+  /// @return false if there is no edit to redo
+  bool redo();
+
+  /// @brief Switch each step on or off at random and give it a random note. Undone as one edit. Called for user
+  /// button 1 in UNDO mode.
+  /// @param seed The seed of the xorshift32 draws, zero is replaced by TrigEngine::default_seed
+  void randomise_pattern(uint32_t seed);
+
+#if defined(X86_UNIT_TESTING_ONLY)
+  /// @brief Run one pass of the main loop (host builds only, main_loop() never returns)
+  void run_main_loop_iteration() { main_loop_iteration(); }
+
+  /// @brief Take the tempo timer interrupt. Run DeferredWork::run_pending() for the bottom half. (host builds only)
+  void simulate_tempo_interrupt() { tempo_timer_isr(); }
+
+  /// @brief Take the tempo timer CC1 compare interrupt of a ratchet retrigger. Run DeferredWork::run_pending() for the
+  /// bottom half. (host builds only)
+  void simulate_ratchet_compare_interrupt() { ratchet_compare_isr(); }
+
+  /// @brief Take the encoder switch interrupt. Run DeferredWork::run_pending() for the bottom half. (host builds only)
+  void simulate_encoder_switch_interrupt() { rotary_sw_exti_isr(); }
+
+  /// @brief Queue a key event for the next main loop pass to read (host builds only)
+  /// @return false if the keypad FIFO is full
+  bool simulate_key_event(SequencerKeyEventIndex key_event) { return m_adp5587_keypad_i2c.inject_key_event(key_event); }
+
+  /// @brief Give the key events queued for the next main loop pass the press time logged on the device (host builds
+  /// only)
+  void simulate_key_press_time(uint32_t press_time_us) { m_adp5587_keypad_i2c.inject_press_time(press_time_us); }
+
+  /// @brief Get the pattern being played and edited (host builds only)
+  const SequencerStepMap &active_step_map() const { return *m_active_step_map; }
+
+  /// @brief Get the scale and transpose the notes are played with (host builds only)
+  const PitchMap &pitch_map() const { return m_pitch_map; }
+
+  /// @brief Get the index of the step the user last selected, the step the encoder edits in NOTE_SELECT mode (host
+  /// builds only)
+  uint8_t selected_step_index() const { return m_adp5587_keypad_i2c.last_user_selected_key_idx; }
+#endif
+
 private:
+  /// @brief Puts the sizes of the members in the .size_table of the map file (target builds only, see map_report.py)
+  friend struct SequenceManagerSizes;
+
+  /// @brief One pass of the main loop: apply the queued events, read the inputs and play the current step
+  void main_loop_iteration();
+
   // @brief List of operation modes for the sequencer
   enum class Mode
   {
     TEMPO_ADJUST, // @brief User can select tempo using rotary encoder (enabled after NOTE_SELECT timeout)
     NOTE_SELECT,  // @brief User can select note using rotary encoder (enabled after selecting step key)
+    RECORD,       // @brief The step keys play notes into the pattern while the sequencer is running
+    UNDO,         // @brief User can undo and redo the pattern edits using rotary encoder, user button 1 randomises
+    PITCH,        // @brief User can transpose using rotary encoder, user buttons 1 and 2 step the scale and its root
   };
 
-  // @brief The current mode (and its default)
+  // @brief The current mode (and its default). Only accessed from the main loop.
   Mode m_current_mode{Mode::TEMPO_ADJUST};
 
-  // @brief state variable for previous note
-  NoteData *m_previous_enabled_note{nullptr};
+  // @brief state variable for previous note: the pole of the synth key it closed, if it had a note
+  bool m_previous_note_enabled{false};
+  adg2188::Driver::Pole m_previous_enabled_pole{};
 
   // @brief The previously captured rotary encoder value
   uint16_t m_last_encoder_value;
 
-  // @brief  The 32-step sequence data
-  static std::array<std::pair<SequencerKeyEventIndex, Step>, 32> m_sequencer_step_data;
+  // @brief  The 32-step sequence data of the default pattern. Generated from the board description, kept in flash.
+  static const std::array<std::pair<SequencerKeyEventIndex, Step>, board::step_count> m_sequencer_step_data;
 
   /// @brief Map of key (ADP5587 HW button index) and values (Step object)
   SequencerStepMap m_sequencer_step_map = SequencerStepMap{{m_sequencer_step_data}};
 
-  // @brief The 25-key note data of the BassStation keyboard
-  static std::array<std::pair<Note, NoteData>, 25> m_note_switch_data;
+  /// @brief Second map with the same key mapping, the next pattern of a song is decoded into it while the current one
+  /// plays
+  SequencerStepMap m_second_step_map = SequencerStepMap{{m_sequencer_step_data}};
+
+  /// @brief The map being played and edited, and the shadow map. Swapped by process_events() at the end of a bar.
+  /// Only accessed from the main loop.
+  SequencerStepMap *m_active_step_map{&m_sequencer_step_map};
+  SequencerStepMap *m_shadow_step_map{&m_second_step_map};
+
+  /// @brief The last 8 pages (16K) of flash bank 2, reserved for the pattern bank in STM32G0B1KETXN_FLASH.ld
+  FlashStm32g0 m_pattern_flash{120, 8};
+
+  /// @brief Saved patterns. Slot 0 is restored at power on.
+  PatternBank m_pattern_bank{m_pattern_flash};
+
+  /// @brief Saves the live pattern to slot 0 in the background after it has been edited
+  PatternPersistence m_pattern_persistence{m_pattern_bank, 0};
+
+  /// @brief Steps through a song, prefetching its patterns from m_pattern_bank
+  SongPlayer m_song_player{&SequenceManager::load_bank_pattern, this};
+
+  /// @brief The SongPlayer::PatternLoader for m_pattern_bank
+  static bool load_bank_pattern(void *context, std::size_t pattern_id, PackedPattern &pattern, uint8_t &length);
+
+  /// @brief Note that the live pattern has been edited, so it is saved
+  void mark_pattern_dirty();
+
+  /// @brief The history of the edits of the active map, for undo() and redo()
+  UndoJournal m_undo_journal;
+
+  // @brief The 25-key note data of the BassStation keyboard, with its ADG2188 HW crosspoint switch config. Indexed by Note.
+  static constexpr std::array<NoteData, Note::none> m_note_data = board::make_note_data();
 
-  /// @brief Map holding the note data associated with its ADG2188 HW crosspoint switch config
-  noarch::containers::StaticMap<Note, NoteData, m_note_switch_data.size()> m_note_switch_map =
-      noarch::containers::StaticMap<Note, NoteData, m_note_switch_data.size()>{{m_note_switch_data}};
+  /// @brief Get the note data of a note
+  /// @return nullptr for Note::none
+  static const NoteData *find_note_data(Note note) { return (note < Note::none) ? &m_note_data[note] : nullptr; }
+
+  /// @brief The key (and its pole) that each note of a step plays, for the transpose and scale
+  PitchMap m_pitch_map{m_note_data};
+
+  /// @brief The names of the scales and of the roots, for the display in PITCH mode
+  static constexpr std::array<const char *, static_cast<std::size_t>(PitchMap::Scale::count)> m_scale_names{
+      "CHROMATIC", "MAJOR", "MINOR", "HARM MINOR", "DORIAN", "MIXOLYDIAN", "MAJ PENTA", "MIN PENTA", "BLUES"};
+  static constexpr std::array<const char *, 12> m_root_names{"C ", "C#", "D ", "D#", "E ", "F ",
+                                                              "F#", "G ", "G#", "A ", "A#", "B "};
 
   /// @brief The timer for tempo of the sequencer
   TIM_TypeDef &m_tempo_timer_device;
@@ -97,6 +235,52 @@ private:
 
   float m_tempo_timer_freq_hz{0};
 
+  /// @brief The tempo timer reload value and actions of each update of a step pair, for swing
+  SwingEngine m_swing_engine;
+
+  /// @brief Plays the retriggers of ratcheted steps from the tempo timer CC1 compare interrupt
+  RatchetScheduler m_ratchet_scheduler{m_tempo_timer_device};
+
+  /// @brief The RatchetScheduler::steps_started() number of the step being played, from its EventType::StepAdvance
+  uint16_t m_step_number{0};
+
+  /// @brief The step has started since the last increment_sequencer(), so its retriggers can be scheduled
+  bool m_step_started{false};
+
+  /// @brief m_ratchet_scheduler is playing the retriggers of the current step, the main loop leaves the switch alone
+  bool m_ratchets_playing{false};
+
+  /// @brief Decides whether each step plays, from its probability and condition
+  TrigEngine m_trig_engine;
+
+  /// @brief The current step was ON when it started but lost its probability or condition, so it doesn't play
+  bool m_step_skipped{false};
+
+  /// @brief Take the trig decision of the step at m_sequence_position, when it starts
+  void decide_step_trig();
+
+  /// @brief Record mode is on: the step keys play notes into the pattern. Set in each main loop pass, when the
+  /// sequencer is running in Mode::RECORD.
+  bool m_live_recording{false};
+
+  /// @brief Quantises the recorded key presses to the steps
+  LiveRecorder m_live_recorder;
+
+  /// @brief The time and length of each step, from the interrupt. One is pushed by tempo_step_deferred() with each
+  /// EventType::StepAdvance (the event has no room for a timestamp) and popped by process_events().
+  struct StepTime
+  {
+    uint32_t m_timestamp_us;
+    uint32_t m_counts;
+  };
+  SpscQueue<StepTime, 8> m_step_times;
+
+  /// @brief Write the note of a step key pressed in record mode to the step nearest to the press
+  void record_note(const KeypadManager::RecordedPress &press);
+
+  /// @brief Set the tempo from the beat tapped on user button 3. While running it takes over at the next step update.
+  void apply_tapped_tempo();
+
   /// @brief reference to the hw timer register object (for memory safe access)
   TIM_TypeDef &m_sequencer_encoder_timer;
 
@@ -114,10 +298,64 @@ private:
 
   midi_stm32::Driver<STM32G0_ISR> m_midi_driver;
 
-  /// @brief counter for sequencer position, incremented in increment_and_execute_sequence_step()
+  /// @brief Note messages for the MIDI tracks
+  MidiNoteOutput m_midi_note_output;
+
+  /// @brief The step positions of the synth track (track 0, m_sequence_position) and the MIDI tracks. Ticked once per
+  /// EventType::StepAdvance by process_events(). Track 0 has the length of the live pattern and no divider.
+  TrackEngine m_track_engine;
+  static constexpr std::size_t synth_track{0};
+  static_assert(TrackEngine::max_length == max_pattern_length, "a track position is a step of the live pattern");
+
+  /// @brief Settings of the MIDI tracks (TrackEngine tracks 1 and up). They play the live pattern on their own
+  /// channel, length and clock divider, so they run polymetrically against the synth track.
+  struct MidiTrack
+  {
+    uint8_t m_channel;
+    uint8_t m_length;
+    uint8_t m_divider;
+  };
+  static constexpr std::array<MidiTrack, TrackEngine::track_count - 1> m_midi_tracks{{
+      {1, 24, 1}, // 24 steps against 32
+      {2, 16, 2}, // 16 eighth notes
+      {3, 12, 4}, // 12 quarter notes
+  }};
+  static constexpr uint8_t m_midi_velocity{100};
+  static constexpr uint8_t no_midi_note{0xFF};
+
+  /// @brief The note each MIDI track has sounding, or no_midi_note
+  std::array<uint8_t, TrackEngine::track_count> m_midi_playing_notes;
+
+  /// @brief Send the notes of the MIDI tracks that moved on a tick
+  /// @param stepped TrackEngine::Tick::m_stepped
+  void play_midi_tracks(uint8_t stepped);
+
+  /// @brief Send a note off for every sounding MIDI track note
+  void silence_midi_tracks();
+
+  /// @brief counter for sequencer position, the position of the synth track in m_track_engine. Moved on by
+  /// process_events() for each EventType::StepAdvance. 0 to the pattern length - 1, which can be more than the 32 keys.
+  /// Only accessed from the main loop.
   uint8_t m_sequence_position{0};
 
-  /// @brief Save this value so we can return to TEMPO_MODE with the expected tempo
+  /// @brief Events posted by the interrupt bottom halves (tempo_timer_deferred() and rotary_sw_exti_deferred()),
+  /// processed in order by the main loop. PendSV is the only producer.
+  EventQueue m_event_queue;
+
+  /// @brief Drain m_event_queue and apply each event to the sequencer state. Called from the main loop only.
+  void process_events();
+
+  /// @brief Sleeps the core between main loop iterations when there is nothing to do, and measures the CPU load
+  IdleMonitor m_idle_monitor;
+
+  /// @brief The encoder count read by the last update_display_and_tempo(), so encoder turns can be detected while asleep
+  uint32_t m_idle_encoder_count{0};
+
+  /// @brief Check if the main loop has anything to do. Called with interrupts masked.
+  /// @return true if there are queued events, the encoder has moved or the ADP5587 has key events waiting
+  bool work_pending();
+
+  /// @brief Save this value so we can return to TEMPO_MODE with the expected tempo. Only accessed from the main loop.
   uint16_t m_saved_tempo_setting{0};
 
   /// @brief The timer for mode button debounce
@@ -126,13 +364,27 @@ private:
   /// @brief The allowable delay between pressing keys on the sequence keypad
   /// Increasing this value will decrease bounce but also responsiveness
   const uint32_t m_mode_debounce_threshold_ms{350};
-  /// @brief Store the last timer count for debounce
+  /// @brief Store the last timer count for debounce. Only accessed from rotary_sw_exti_deferred()
   uint32_t m_last_mode_debounce_count_ms{0};
 
   void led_demo();
 
+  /// @brief If the previous run ended in a fault, show the fault registers and the last trace records from the
+  /// FlightRecorder on the OLED for a few seconds
+  void show_crash_log();
+
+  /// @brief How long show_crash_log() holds the crash log on the OLED before the sequencer starts
+  const uint32_t m_crash_log_display_ms{5000};
+
   noarch::containers::StaticString<20> m_display_direction;
 
+  /// @brief The values shown on the pattern view status line, so it is only rebuilt when one of them changes
+  uint32_t m_status_line_tempo{std::numeric_limits<uint32_t>::max()};
+  Note m_status_line_note{Note::none};
+  Mode m_status_line_mode{Mode::TEMPO_ADJUST};
+  bool m_status_line_recording{false};
+  uint8_t m_status_line_cpu_load{0};
+
   /// @brief Update the display and tempo timer
   void update_display_and_tempo();
 
@@ -144,9 +396,13 @@ private:
   SequencerState m_sequencer_state{SequencerState::STOPPED};
 
   /// @brief This determines the positional order in which the cursor sweeps the sequence
-  // This begins on the upper row and ends on the lower row, sweeping left to right
-  std::array<uint8_t, 32> m_sequencer_key_mapping{16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31,
-                                                  0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  10, 11, 12, 13, 14, 15};
+  // This begins on the upper row and ends on the lower row, sweeping left to right (see board::first_played_row)
+  static constexpr std::array<uint8_t, board::step_count> m_sequencer_key_mapping = board::make_sweep_order();
+  static_assert((m_sequencer_key_mapping.size() & (m_sequencer_key_mapping.size() - 1)) == 0,
+                "key_at() wraps positions with a mask");
+
+  /// @brief Get the step map index of the key for a track position. The mask keeps any position on a key.
+  uint8_t key_at(uint8_t position) const { return m_sequencer_key_mapping[position & (m_sequencer_key_mapping.size() - 1)]; }
 
   /// @brief Registers Timer ISR handler class with InterruptManager for STM32G0
   struct TempoTimerIntHandler : public stm32::isr::InterruptManagerStm32Base<STM32G0_ISR>
@@ -169,9 +425,33 @@ private:
   /// @brief setup tempo timer callback to allow pattern sequence update
   TempoTimerIntHandler m_sequencer_tempo_timer_isr_handler{this};
 
-  /// @brief SequenceManager callback for timer interrupt
+  /// @brief SequenceManager callback for timer interrupt (top half). The update and CC1 compare interrupts of the timer
+  /// share it, so it clears the flags that are set and calls tempo_update_isr() and ratchet_compare_isr()
   void tempo_timer_isr();
 
+  /// @brief Timer update. Loads the reload value of the next period from m_swing_engine and defers the update's actions
+  /// to tempo_timer_deferred() and tempo_step_deferred()
+  void tempo_update_isr();
+
+  /// @brief Timer CC1 compare. Defers the retriggers that are due to ratchet_gate_deferred()
+  void ratchet_compare_isr();
+
+  /// @brief Bottom half of a clock update of the timer, run from PendSV. Sends the MIDI clock
+  /// @param context The SequenceManager instance
+  /// @param timestamp_us The time the timer interrupt was taken
+  static void tempo_timer_deferred(void *context, uint32_t timestamp_us);
+
+  /// @brief Bottom half of a step update of the timer, run from PendSV. Posts EventType::StepAdvance
+  /// @param context The SequenceManager instance
+  /// @param timestamp_us The time the timer interrupt was taken
+  static void tempo_step_deferred(void *context, uint32_t timestamp_us);
+
+  /// @brief Bottom half of a ratchet retrigger, run from PendSV. Writes the gates queued by m_ratchet_scheduler to the
+  /// ADG2188
+  /// @param context The SequenceManager instance
+  /// @param timestamp_us The time the timer interrupt was taken
+  static void ratchet_gate_deferred(void *context, uint32_t timestamp_us);
+
   /// @brief Registers EXTI ISR handler class with InterruptManager for STM32G0
   struct RotarySwExtIntHandler : public stm32::isr::InterruptManagerStm32Base<STM32G0_ISR>
   {
@@ -192,8 +472,13 @@ private:
   // @brief setup rotary encoder switch callback
   RotarySwExtIntHandler m_rotary_sw_exti_handler{this};
 
-  /// @brief SequenceManager callback for exti15 interrupt
+  /// @brief SequenceManager callback for exti15 interrupt (top half). Defers the debounce to rotary_sw_exti_deferred()
   void rotary_sw_exti_isr();
+
+  /// @brief Bottom half of the exti15 interrupt, run from PendSV. Debounces and posts EventType::ModeToggle
+  /// @param context The SequenceManager instance
+  /// @param timestamp_us The time the exti15 interrupt was taken
+  static void rotary_sw_exti_deferred(void *context, uint32_t timestamp_us);
 };
 
 } // namespace bass_station
@@ -0,0 +1,138 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __SONG_PLAYER_HPP__
+#define __SONG_PLAYER_HPP__
+
+#include <pattern_bank.hpp>
+
+namespace bass_station
+{
+
+/// @brief One entry of a song: a pattern id and how many times it is played
+struct SongEntry
+{
+  /// @brief The PatternBank slot of the pattern (0 to PatternBank::slot_count - 1), also in songs kept in the
+  /// PatternLibrary, whose own pattern slots are not used by songs
+  uint8_t m_pattern;
+  /// @brief Number of times the pattern is played, zero is treated as one
+  uint8_t m_repeats;
+};
+
+/// @brief A chain of patterns, played in order and looped
+struct Song
+{
+  static constexpr std::size_t max_entries{64};
+  uint16_t m_length{0};
+  std::array<SongEntry, max_entries> m_entries{};
+
+  /// @brief Check the length and that every entry is a PatternBank slot
+  bool valid() const;
+};
+
+/// @brief Plays a Song by swapping between two step maps.
+/// While a pattern plays from the live map, prefetch() decodes the pattern of the next song entry into the shadow map
+/// from the main loop. When the sequence position wraps, advance() moves on to the next entry and says whether the
+/// caller should flip its live/shadow map pointers. The flip is the only work done at the bar boundary, so the first
+/// step of the new pattern is played with the same latency as any other step.
+class SongPlayer
+{
+public:
+  /// @brief Reads a pattern and its length by its PatternBank slot
+  /// @return false if there is no such pattern
+  using PatternLoader = bool (*)(void *context, std::size_t pattern_id, PackedPattern &pattern, uint8_t &length);
+
+  /// @brief Construct a new SongPlayer
+  /// @param loader Reads the patterns of the song
+  /// @param context Passed to loader
+  SongPlayer(PatternLoader loader, void *context);
+
+  /// @brief Start a song from its first entry. The first pattern is loaded straight into the live map.
+  /// @param song The song, copied
+  /// @param live_map The map the sequencer is playing
+  /// @return false if the song is empty or not valid()
+  bool start(const Song &song, SequencerStepMap &live_map);
+
+  /// @brief Go back to the first entry of the song, e.g. when the sequencer is reset
+  /// @param live_map The map the sequencer is playing
+  void restart(SequencerStepMap &live_map);
+
+  /// @brief Stop following the song. The live map keeps the pattern it has.
+  void stop() { m_playing = false; }
+
+  /// @brief Check if a song is playing
+  bool playing() const { return m_playing; }
+
+  /// @brief Check if prefetch() has work to do
+  bool prefetch_pending() const;
+
+  /// @brief Decode the pattern that follows the current one into the shadow map, if it has not been done yet.
+  /// Call from the main loop while the current pattern is playing.
+  /// @param shadow_map The map that is not playing
+  void prefetch(SequencerStepMap &shadow_map);
+
+  /// @brief Move on at the end of the pattern, when the sequence position wraps
+  /// @return true if the shadow map holds the next pattern and the caller must swap it in
+  bool advance();
+
+  /// @brief Get the index of the song entry that is playing
+  std::size_t entry() const { return m_entry; }
+
+  /// @brief Get the length of the pattern in the live map. Changes after start(), restart() and a flip.
+  uint8_t pattern_length() const { return m_live_length; }
+
+  /// @brief Get the number of bar boundaries where the next pattern was not ready, so the current one played again
+  uint32_t late_prefetches() const { return m_late_prefetches; }
+
+private:
+  PatternLoader m_loader;
+  void *m_context;
+
+  Song m_song;
+  bool m_playing{false};
+  std::size_t m_entry{0};
+  /// @brief How many times the current entry has been played through, not counting the current pass
+  uint8_t m_repeat{0};
+
+  /// @brief The lengths of the patterns in the live and shadow maps
+  uint8_t m_live_length{default_pattern_length};
+  uint8_t m_shadow_length{default_pattern_length};
+
+  /// @brief The shadow map holds the pattern of the next entry
+  bool m_shadow_ready{false};
+  /// @brief The pattern of the next entry could not be loaded, the current pattern carries on
+  bool m_prefetch_failed{false};
+  uint32_t m_late_prefetches{0};
+
+  /// @brief Check if the current pass is the last one of the entry
+  bool last_repeat() const;
+  /// @brief Get the entry after the current one, the song loops
+  std::size_t next_entry() const;
+  /// @brief Check if moving to the next entry changes the pattern
+  bool next_needs_decode() const;
+  /// @brief Load a pattern into a map
+  bool load(std::size_t pattern_id, SequencerStepMap &sequencer_map, uint8_t &length);
+};
+
+} // namespace bass_station
+
+#endif // __SONG_PLAYER_HPP__
@@ -47,7 +47,7 @@ enum class SequencerRow
 
 // @brief Basic state for keys
 // Not enum class so it can be used as boolean
-enum StepState
+enum StepState : uint8_t
 {
   ON,
   OFF,
@@ -58,6 +58,32 @@ constexpr tlc5955::LedColour user_select_colour{tlc5955::LedColour::blue};
 constexpr tlc5955::LedColour beat_colour_off{tlc5955::LedColour::white};
 constexpr tlc5955::LedColour beat_colour_on{tlc5955::LedColour::red};
 
+// @brief The number of times a step's note is played within the step (1 is a single trigger, no ratchet)
+constexpr uint8_t max_ratchet{4};
+
+// @brief The number of trigger probability levels of a step, 0 (always) to probability_levels - 1. See TrigEngine.
+constexpr uint8_t probability_levels{8};
+
+// @brief When a step plays, checked before its probability. "A of B" plays on loop A of every B loops of the pattern.
+enum class TrigCondition : uint8_t
+{
+  ALWAYS,
+  FILL,      // @brief only while fill is on
+  NOT_FILL,  // @brief only while fill is off
+  FIRST,     // @brief only on the first loop after the sequencer is started
+  NOT_FIRST, // @brief every loop except the first
+  LOOP_1_OF_2,
+  LOOP_2_OF_2,
+  LOOP_1_OF_3,
+  LOOP_2_OF_3,
+  LOOP_3_OF_3,
+  LOOP_1_OF_4,
+  LOOP_2_OF_4,
+  LOOP_3_OF_4,
+  LOOP_4_OF_4,
+  count
+};
+
 // @brief Values associated with a single step button in the sequence
 struct Step
 {
@@ -65,16 +91,13 @@ struct Step
   // @brief Construct a new Step object
   // @param key_state ON or OFF
   // @param colour The colour when ON
-  // @param logical_mapping_index Maps this step to a position index in one of two 16 position arrays.
-  // @param physical_mapping_index Maps this step to the physical wiring pin index of the TLC5955 chip on the PCB
   // @param sequence_mapping_index Maps this step to a position index in the sequence execution order.
-  Step(StepState state, Note note, tlc5955::LedColour colour, int logical_mapping_index, int physical_mapping_index, int array_index)
+  // The key and LED wiring of the step is not copied here, it stays in flash (board_description.hpp)
+  constexpr Step(StepState state, Note note, tlc5955::LedColour colour, uint8_t array_index)
 
       : m_state(state),
         m_note(note),
         m_colour(colour),
-        m_logical_mapping_index(logical_mapping_index),
-        m_tlc5955_pin_index(physical_mapping_index),
         m_sequence_abs_pos_index(array_index)
   {
     // nothing else to do here
@@ -88,15 +111,18 @@ struct Step
   // @brief The colour of the key when it is ON
   tlc5955::LedColour m_colour;
 
-  // @brief Maps this step to a position index in one of two 16 position arrays.
-  int m_logical_mapping_index;
-
-  // @brief Maps this step to the physical wiring pin index of the TLC5955 chip on the PCB
-  int m_tlc5955_pin_index;
-
   // @brief Maps this step to the absolute position index in the *entire* sequence.
   // This begins on the left of the upper row and ends on the right of lower row
-  int m_sequence_abs_pos_index;
+  uint8_t m_sequence_abs_pos_index;
+
+  // @brief Triggers of the note within the step, 1 to max_ratchet. The retriggers are played by RatchetScheduler.
+  uint8_t m_ratchet{1};
+
+  // @brief Chance of the step playing when it is ON, 0 (always) to probability_levels - 1. Decided by TrigEngine.
+  uint8_t m_probability{0};
+
+  // @brief Condition for the step playing when it is ON. Decided by TrigEngine.
+  TrigCondition m_condition{TrigCondition::ALWAYS};
 };
 
 } // namespace bass_station
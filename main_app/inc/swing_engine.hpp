@@ -0,0 +1,164 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __SWING_ENGINE_HPP__
+#define __SWING_ENGINE_HPP__
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace bass_station
+{
+
+/// @brief Swing for the tempo timer (TIM3). The timer updates of a step pair are precomputed into a table of reload
+/// (ARR) values and actions. The tempo timer ISR takes the next entry on each update and writes its reload value, so
+/// the second step of each pair is delayed without any busy waiting.
+/// Without swing a step is 12 MIDI clock updates followed by the step update, all one full timer period apart. Swing
+/// only moves the step update of the second step, the MIDI clock updates stay on that grid.
+class SwingEngine
+{
+public:
+  /// @brief 50% is straight time, 75% plays the second step of a pair three quarters of the way through it
+  static constexpr uint8_t min_percent{50};
+  static constexpr uint8_t max_percent{75};
+
+  /// @brief Timer updates per step: 12 MIDI clocks and the step update
+  static constexpr uint32_t updates_per_step{13};
+  /// @brief Timer counts per update without swing (TIM3 ARR is 65535, the tempo is set by PSC)
+  static constexpr uint32_t counts_per_update{65536};
+  static constexpr uint32_t counts_per_pair{2 * updates_per_step * counts_per_update};
+
+  /// @brief A moved step update closer than this to a grid update is merged into it, so no timer period is so short
+  /// that the counter is already past ARR when the ISR writes it
+  static constexpr uint32_t min_update_counts{256};
+
+  /// @brief What the tempo timer ISR does on an update, a bit mask
+  enum Action : uint8_t
+  {
+    NONE  = 0,
+    CLOCK = 1, // @brief send a MIDI clock
+    STEP  = 2, // @brief advance the step
+  };
+
+  /// @brief One timer period. m_actions are done by the update at its end.
+  struct Update
+  {
+    uint16_t m_arr;
+    uint8_t m_actions;
+  };
+
+  /// @brief the grid updates of a pair and the moved step update
+  static constexpr std::size_t max_updates{2 * updates_per_step + 1};
+
+  SwingEngine();
+
+  /// @brief Set the swing. Called from the main loop, the ISR changes over to the new table at the next pair.
+  /// @param percent min_percent to max_percent
+  /// @return false if the swing is out of range
+  bool set_swing(uint8_t percent);
+
+  /// @brief Get the swing
+  uint8_t swing() const { return m_percent; }
+
+  /// @brief Go back to the start of a pair. Call with the tempo timer stopped, then load reload() into ARR.
+  void reset();
+
+  /// @brief Take the update that has just happened and move on to the next period. Called from the tempo timer ISR.
+  /// @return The Action mask of the update
+  uint8_t tick();
+
+  /// @brief Get the ARR value of the current period
+  uint16_t reload() const { return active_table().m_updates[m_update_idx].m_arr; }
+
+  /// @brief Get the length of the step started by the last step update (or by reset()), in timer counts
+  uint32_t step_counts() const { return m_step_counts; }
+
+  /// @brief Get the number of timer updates in a pair, 2 * updates_per_step without swing
+  std::size_t update_count() const { return active_table().m_count; }
+
+  /// @brief Get an update of the table being played
+  const Update &update(std::size_t idx) const { return active_table().m_updates[idx]; }
+
+  /// @brief The tempo timer clock. The tempo is set by the timer prescaler (PSC).
+  static constexpr uint32_t timer_clock_hz{64000000};
+
+  /// @brief Work out the prescaler that plays a beat (a pair of steps, 24 MIDI clocks) in a given time
+  /// @param beat_us The length of the beat
+  /// @return The PSC value, to the nearest. A count of PSC is a coarse step, about 8% of the tempo at 180 BPM.
+  static uint16_t prescaler(uint32_t beat_us);
+
+  /// @brief Change the prescaler at the next step update. Called from the main loop.
+  void set_prescaler(uint16_t prescaler);
+
+  /// @brief Is a prescaler from set_prescaler() waiting for a step update
+  bool prescaler_pending() const { return m_pending_prescaler.load(std::memory_order_relaxed) != no_prescaler; }
+
+  /// @brief Take the prescaler from set_prescaler() if the update at the end of the current period is a step update.
+  /// Called from the tempo timer ISR after tick(). PSC is preloaded, so written now it takes over at that update: the
+  /// step starts on time and plays at the new tempo.
+  /// @return false if there is none to take in this period
+  bool take_prescaler(uint16_t &prescaler);
+
+  /// @brief Take the prescaler from set_prescaler() whatever the period. Call with the tempo timer stopped.
+  /// @return false if there is none
+  bool flush_prescaler(uint16_t &prescaler);
+
+private:
+  struct Table
+  {
+    std::array<Update, max_updates> m_updates;
+    std::size_t m_count;
+    /// @brief the length of the first step of the pair, the second step has the rest of it
+    uint32_t m_first_step_counts;
+  };
+
+  const Table &active_table() const { return m_tables[m_active_table.load(std::memory_order_relaxed)]; }
+
+  /// @brief Build the table of a pair
+  static void build(uint8_t percent, Table &table);
+
+  /// @brief The table being played and the one set_swing() builds into. Only tick() and reset() change m_active_table.
+  std::array<Table, 2> m_tables;
+  std::atomic<uint8_t> m_active_table{0};
+
+  static constexpr uint8_t no_table{0xFF};
+  /// @brief A table waiting for the start of the next pair, or no_table. Written by set_swing(), taken by tick().
+  std::atomic<uint8_t> m_pending_table{no_table};
+
+  /// @brief The current period. Only accessed from the ISR, or by reset() with the timer stopped.
+  std::size_t m_update_idx{0};
+
+  static constexpr uint32_t no_prescaler{0xFFFFFFFF};
+  /// @brief A prescaler waiting for a step update, or no_prescaler. Written by set_prescaler(), taken by the ISR.
+  std::atomic<uint32_t> m_pending_prescaler{no_prescaler};
+
+  /// @brief See step_counts(). Written by the ISR.
+  volatile uint32_t m_step_counts{counts_per_pair / 2};
+
+  uint8_t m_percent{min_percent};
+};
+
+} // namespace bass_station
+
+#endif // __SWING_ENGINE_HPP__
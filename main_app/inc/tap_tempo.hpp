@@ -0,0 +1,94 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __TAP_TEMPO_HPP__
+#define __TAP_TEMPO_HPP__
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace bass_station
+{
+
+/// @brief Works out a beat length from taps of a button. The estimate is the median of the last few intervals between
+/// taps, so one late or early tap barely moves it. An interval too far from the median is an outlier and left out,
+/// unless several come in a row: then the tempo has changed and the estimate starts again from them.
+/// All integer arithmetic (microseconds, with the tolerance in Q8). Only used from the main loop.
+class TapTempo
+{
+public:
+  /// @brief Number of intervals in the median
+  static constexpr std::size_t window{5};
+
+  /// @brief A tap sooner than this after the last one is a bounce or a double press, and ignored (400 BPM)
+  static constexpr uint32_t min_interval_us{150000};
+
+  /// @brief A tap later than this after the last one starts a new run of taps (30 BPM)
+  static constexpr uint32_t max_interval_us{2000000};
+
+  /// @brief An interval further than this fraction of the median from it is an outlier, in Q8 (25%)
+  static constexpr uint32_t tolerance_q8{64};
+
+  /// @brief This many outliers in a row are a new tempo
+  static constexpr uint8_t max_outliers{3};
+
+  /// @brief Forget the taps
+  void reset();
+
+  /// @brief Take a tap
+  /// @param timestamp_us The time of the tap
+  /// @return true if the estimate has been updated
+  bool tap(uint32_t timestamp_us);
+
+  /// @brief Get the estimated beat length, 0 until two intervals have been taken
+  uint32_t beat_us() const { return m_beat_us; }
+
+  /// @brief Get the estimated tempo in tenths of BPM, 0 until two intervals have been taken
+  uint16_t bpm_x10() const;
+
+  /// @brief Get the number of intervals in the median
+  std::size_t interval_count() const { return m_count; }
+
+private:
+  /// @brief Add an interval to the window, replacing the oldest
+  void push(uint32_t interval_us);
+
+  /// @brief The median of the intervals in the window
+  uint32_t median() const;
+
+  std::array<uint32_t, window> m_intervals{};
+  std::size_t m_count{0};
+  std::size_t m_next{0};
+
+  bool m_tapped{false};
+  uint32_t m_last_tap_us{0};
+
+  uint8_t m_outliers{0};
+  uint32_t m_last_outlier_us{0};
+
+  uint32_t m_beat_us{0};
+};
+
+} // namespace bass_station
+
+#endif // __TAP_TEMPO_HPP__
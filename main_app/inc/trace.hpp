@@ -0,0 +1,70 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __TRACE_HPP__
+#define __TRACE_HPP__
+
+#include <trace_record.hpp>
+
+namespace bass_station
+{
+
+/// @brief Binary trace channel. Each trace point writes one fixed-size TraceRecord to the FlightRecorder ring and, in
+/// Debug ARM builds (USE_RTT), to RTT up-buffer 1, which can be captured with the J-Link RTT logger (channel 1) and
+/// converted to CSV with tools/trace_decode. RTT records are dropped whole when the buffer is full, so tracing never blocks.
+class Trace
+{
+public:
+  /// @brief The RTT up-buffer used for the trace records. Buffer 0 is the text terminal.
+  static constexpr unsigned m_rtt_channel{1};
+
+  /// @brief Set up the RTT trace buffer. Call once at startup, before any trace point is hit.
+  static void initialise();
+
+  /// @brief Write a trace record. Safe to call from any interrupt priority.
+  /// @param id The trace point
+  /// @param arg0 first argument, see TraceId
+  /// @param arg1 second argument, see TraceId
+  static void emit(TraceId id, uint16_t arg0 = 0, uint32_t arg1 = 0);
+
+#if defined(X86_UNIT_TESTING_ONLY)
+  /// @brief Receives each trace record on the host
+  using HostSink = void (*)(void *context, const TraceRecord &record);
+
+  /// @brief Pass every trace record to a function as well (host builds only)
+  /// @param sink The function, or nullptr to stop
+  /// @param context passed to the sink
+  static void set_host_sink(HostSink sink, void *context)
+  {
+    m_host_sink         = sink;
+    m_host_sink_context = context;
+  }
+
+private:
+  static inline HostSink m_host_sink{nullptr};
+  static inline void *m_host_sink_context{nullptr};
+#endif
+};
+
+} // namespace bass_station
+
+#endif // __TRACE_HPP__
@@ -0,0 +1,93 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __TRACE_RECORD_HPP__
+#define __TRACE_RECORD_HPP__
+
+#include <cstdint>
+
+// This header is shared with the host-side decoder (tools/trace_decode), so it must not include any target headers
+
+namespace bass_station
+{
+
+/// @brief The trace points. Don't renumber these, the decoder relies on the values in old captures.
+enum class TraceId : uint16_t
+{
+  TEMPO_ISR    = 1,  // @brief tempo timer interrupt taken. arg0: unused, arg1: unused
+  STEP_ADVANCE = 2,  // @brief main loop moved the pattern cursor. arg0: new sequence position, arg1: unused
+  KEY_EVENT    = 3,  // @brief ADP5587 key event read. arg0: KeyEventIndex, arg1: 1 if accepted by the debounce (or recorded in record mode, or a tempo tap), else 0
+  SWITCH_WRITE = 4,  // @brief ADG2188 switch written. arg0: Pole, arg1: 1 for close, 0 for open
+  SWITCH_CLEAR = 5,  // @brief all ADG2188 switches opened. arg0: unused, arg1: unused
+  LED_LATCH    = 6,  // @brief TLC5955 greyscale data latched. arg0: TraceLedLatch, arg1: see TraceLedLatch
+  MIDI_BYTE    = 7,  // @brief MIDI realtime byte sent. arg0: status byte, arg1: MIDI pulse count
+  MODE_TOGGLE  = 8,  // @brief encoder switch accepted. arg0: encoder count, arg1: unused
+  MIDI_NOTE    = 9,  // @brief MIDI note message sent by a track. arg0: status byte (note on/off and channel), arg1: note
+  RECORD_NOTE  = 10, // @brief step key recorded in record mode. arg0: step position << 8 | Note, arg1: KeyLatency correction in us
+  TAP_TEMPO    = 11, // @brief tapped tempo estimate changed. arg0: tempo timer prescaler, arg1: tempo in tenths of BPM
+  RATCHET_GATE = 12, // @brief ADG2188 switch written by a ratchet retrigger. arg0: Pole, arg1: 1 for close, 0 for open
+};
+
+/// @brief arg0 of TraceId::LED_LATCH
+enum class TraceLedLatch : uint16_t
+{
+  BOTH_ROWS = 0, // @brief LedManager::set_both_rows_with_step_sequence_mapping(). arg1: checksum of the lit steps and colours
+  ALL_LEDS  = 1, // @brief LedManager::set_all_leds_both_rows(). arg1: unused
+  ONE_LED   = 2, // @brief LedManager::set_one_led_at(). arg1: led position
+};
+
+/// @brief MIDI realtime status bytes, as written by midi_stm32::Driver
+enum class TraceMidiByte : uint16_t
+{
+  CLOCK    = 0xF8,
+  START    = 0xFA,
+  CONTINUE = 0xFB,
+  STOP     = 0xFC,
+};
+
+/// @brief The inputs logged by the InputRecorder, in the m_id of a TraceRecord. Don't renumber these either, old input
+/// logs are replayed by the host tests.
+enum class InputId : uint16_t
+{
+  TEMPO_TICK      = 1, // @brief tempo timer interrupts taken. arg0: 1 if the interrupt started a step, arg1: number of interrupts, see InputRecorder::record_at()
+  KEY_EVENT       = 2, // @brief ADP5587 key event read. arg0: KeyEventIndex, arg1: debounce timer count
+  ENCODER         = 3, // @brief rotary encoder count changed. arg0: encoder count, arg1: encoder timer CR1 (DIR bit)
+  ENCODER_SWITCH  = 4, // @brief encoder switch interrupt handled. arg0: encoder count, arg1: debounce timer count
+  KEY_PRESS_TIME  = 5, // @brief time of the press of the KEY_EVENT that follows, for a recorded note or a tempo tap. arg0: KeyEventIndex, arg1: press time in us
+  RATCHET_COMPARE = 6, // @brief tempo timer CC1 compare interrupt taken. arg0: unused, arg1: tempo timer count
+};
+
+/// @brief One trace record, written little-endian as-is to the RTT trace channel
+struct TraceRecord
+{
+  /// @brief UsecClock::now() when the trace point was hit
+  uint32_t m_timestamp_us;
+  /// @brief TraceId
+  uint16_t m_id;
+  uint16_t m_arg0;
+  uint32_t m_arg1;
+};
+static_assert(sizeof(TraceRecord) == 12, "TraceRecord layout is part of the capture format");
+
+} // namespace bass_station
+
+#endif // __TRACE_RECORD_HPP__
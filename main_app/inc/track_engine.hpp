@@ -0,0 +1,106 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __TRACK_ENGINE_HPP__
+#define __TRACK_ENGINE_HPP__
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace bass_station
+{
+
+/// @brief Step positions of several tracks with their own lengths and clock dividers, driven by one tick counter.
+/// Each tick costs one countdown decrement per track and a compare for the wrap, there are no divisions, so the tracks
+/// drift against each other in polymeters (e.g. 32 steps against 24) without any per-step arithmetic.
+class TrackEngine
+{
+public:
+  /// @brief Track 0 drives the crosspoint synth, the others send MIDI notes
+  static constexpr std::size_t track_count{4};
+  /// @brief One step for each key, no track is longer than the pattern it plays
+  static constexpr uint8_t max_length{32};
+  static constexpr uint8_t max_divider{16};
+
+  /// @brief What a tick did, one bit per track
+  struct Tick
+  {
+    /// @brief the track moved on to its next step
+    uint8_t m_stepped;
+    /// @brief the track went back to step 0
+    uint8_t m_wrapped;
+  };
+
+  TrackEngine();
+
+  /// @brief Set the length of a track. A position past the new length wraps at the next step.
+  /// @param track The track
+  /// @param length 1 to max_length steps
+  /// @return false if the track or length is out of range
+  bool set_length(std::size_t track, uint8_t length);
+
+  /// @brief Set how many ticks each step of a track lasts
+  /// @param track The track
+  /// @param divider 1 to max_divider ticks
+  /// @return false if the track or divider is out of range
+  bool set_divider(std::size_t track, uint8_t divider);
+
+  /// @brief Disabled tracks do not move
+  void set_enabled(std::size_t track, bool enabled);
+
+  /// @brief Put every track back on step 0 and clear the tick counter
+  void reset();
+
+  /// @brief Advance every enabled track by one tick. O(track_count).
+  Tick tick();
+
+  /// @brief Get the step a track is on
+  /// @note don't use std::array.at(), this will force exception handling to bloat the linked .elf
+  uint8_t position(std::size_t track) const { return m_tracks[track].m_position; }
+
+  /// @brief Get the settings of a track
+  uint8_t length(std::size_t track) const { return m_tracks[track].m_length; }
+  uint8_t divider(std::size_t track) const { return m_tracks[track].m_divider; }
+  bool enabled(std::size_t track) const { return m_tracks[track].m_enabled; }
+
+  /// @brief Get the number of ticks since reset()
+  uint32_t ticks() const { return m_ticks; }
+
+private:
+  struct Track
+  {
+    uint8_t m_length;
+    uint8_t m_divider;
+    uint8_t m_position;
+    /// @brief ticks left until the next step
+    uint8_t m_countdown;
+    bool m_enabled;
+  };
+
+  std::array<Track, track_count> m_tracks;
+  uint32_t m_ticks{0};
+};
+
+} // namespace bass_station
+
+#endif // __TRACK_ENGINE_HPP__
@@ -0,0 +1,120 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __TRIG_ENGINE_HPP__
+#define __TRIG_ENGINE_HPP__
+
+#include <array>
+#include <cstdint>
+#include <step.hpp>
+
+namespace bass_station
+{
+
+/// @brief Decides whether an ON step plays, from its TrigCondition and probability. The conditions that are met are
+/// worked out into a bit mask once per loop (or when fill changes), and each probability level is a precomputed
+/// threshold for a xorshift32 draw, so the decision for a step is a shift, a table load and a compare.
+/// Called from the main loop when a step starts, never from an interrupt. The draws start again from the seed whenever
+/// the sequencer starts from the first step, so a replayed session makes the same decisions.
+class TrigEngine
+{
+public:
+  /// @brief The seed at power on
+  static constexpr uint32_t default_seed{0x2545F491};
+
+  /// @brief The upper 16 bits of a draw play the step if they are below the threshold of its probability level:
+  /// 100%, 88%, 75%, 63%, 50%, 38%, 25%, 13%
+  static constexpr std::array<uint32_t, probability_levels> thresholds{65536, 57344, 49152, 40960, 32768, 24576, 16384, 8192};
+  static_assert((probability_levels & (probability_levels - 1)) == 0, "fire() wraps the probability with a mask");
+
+  /// @brief Construct a new Trig Engine
+  /// @param seed The seed of the draws. Zero is replaced by default_seed, xorshift would only ever draw zero.
+  explicit TrigEngine(uint32_t seed = default_seed);
+
+  /// @brief Change the seed. Takes effect at the next reset().
+  void set_seed(uint32_t seed);
+
+  /// @brief Start the draws again from the seed, and go back to the first loop. Called when the sequencer starts from
+  /// the first step.
+  void reset();
+
+  /// @brief A new loop of the pattern has started
+  void loop_started();
+
+  /// @brief Get the loop of the pattern, 0 for the first loop after reset()
+  uint32_t loop() const { return m_loop; }
+
+  /// @brief Turn fill on or off
+  void set_fill(bool fill);
+
+  /// @brief Get the fill
+  bool fill() const { return m_fill; }
+
+  /// @brief Decide whether a step plays. Takes one draw whatever the step, so the later decisions don't depend on it.
+  /// @param step The step. An OFF step never plays.
+  /// @return true if the step's condition is met and it wins its probability
+  bool fire(const Step &step);
+
+  /// @brief Get the percentage of a probability level, rounded
+  static uint8_t probability_percent(uint8_t probability);
+
+  /// @brief Move a step on to the next trig setting, for editing with one button: the probability levels from 100%
+  /// down, then each TrigCondition (at 100%), then back to 100% with no condition
+  static void cycle(Step &step);
+
+  /// @brief Advance a xorshift32 (Marsaglia) state by one draw. Never returns to zero from a non-zero state.
+  /// @param state The state, updated to the draw
+  /// @return The draw
+  static uint32_t xorshift32(uint32_t &state)
+  {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+  }
+
+private:
+  /// @brief The next xorshift32 draw
+  uint32_t next();
+
+  /// @brief Work out which conditions are met on this loop and fill, bit n for TrigCondition n
+  void update_condition_mask();
+
+  /// @brief The loop divisor and remainder of each TrigCondition::LOOP_A_OF_B, from LOOP_1_OF_2 on
+  struct LoopCondition
+  {
+    uint8_t m_divisor;
+    uint8_t m_remainder;
+  };
+  static constexpr std::array<LoopCondition, static_cast<std::size_t>(TrigCondition::count) - static_cast<std::size_t>(TrigCondition::LOOP_1_OF_2)>
+      m_loop_conditions{{{2, 0}, {2, 1}, {3, 0}, {3, 1}, {3, 2}, {4, 0}, {4, 1}, {4, 2}, {4, 3}}};
+
+  uint32_t m_seed;
+  uint32_t m_state;
+  uint32_t m_loop{0};
+  bool m_fill{false};
+  uint16_t m_condition_mask{0};
+};
+
+} // namespace bass_station
+
+#endif // __TRIG_ENGINE_HPP__
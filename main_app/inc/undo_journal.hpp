@@ -0,0 +1,147 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __UNDO_JOURNAL_HPP__
+#define __UNDO_JOURNAL_HPP__
+
+#include <array>
+#include <cstdint>
+#include <pattern_bank.hpp>
+
+namespace bass_station
+{
+
+/// @brief Undo and redo of the edits of the active pattern. Each edit is journaled as the fields of the steps it
+/// changed, one 3 byte delta per field: the step index and field, the old value and the new value. The deltas are kept
+/// in a fixed RAM ring, and the oldest edits are dropped whole to make room for new ones.
+///
+/// An edit changes at most the five fields of one step, so undo() and redo() apply a bounded number of deltas. An edit
+/// of every step (a randomise) is journaled as one delta and a packed copy of the pattern from before it, which undo()
+/// and redo() swap with the pattern. Those copies are kept in a few fixed slots: reusing the oldest drops the history
+/// back to the edit that had it, so the journal never takes more than ring_bytes.
+///
+/// Only used from the main loop. The deltas refer to steps of the pattern by index, so the journal is cleared whenever
+/// another pattern is loaded into the map.
+class UndoJournal
+{
+public:
+  /// @brief The journaled fields of a Step, and PATTERN for an edit of every step
+  enum class Field : uint8_t
+  {
+    STATE,
+    NOTE,
+    RATCHET,
+    PROBABILITY,
+    CONDITION,
+    PATTERN,
+  };
+
+  /// @brief Number of deltas in the ring, a power of two
+  static constexpr std::size_t delta_count{128};
+  static_assert((delta_count & (delta_count - 1)) == 0, "the ring is indexed with a mask");
+
+  /// @brief Number of copies of the pattern for the edits of every step
+  static constexpr std::size_t snapshot_count{2};
+
+  /// @brief The RAM used for the history
+  static constexpr std::size_t ring_bytes{delta_count * 3 + snapshot_count * sizeof(PackedPattern)};
+
+  /// @brief Forget every edit
+  void clear();
+
+  /// @brief Journal an edit of one step as a new undo step. Nothing is journaled if no field changed.
+  /// @param before The step before the edit
+  /// @param after The step after the edit, m_sequence_abs_pos_index is its index in the SequencerStepMap
+  /// @param merge Merge a change of note into the last edit, if that only changed the note of the same step. A turn of
+  /// the encoder moves the note one key at a time, this makes the whole turn one undo step.
+  void record_step(const Step &before, const Step &after, bool merge = false);
+
+  /// @brief Journal an edit of every step as a new undo step. Call before the edit.
+  /// @param sequencer_map The pattern before the edit
+  void record_pattern(const SequencerStepMap &sequencer_map);
+
+  /// @brief Undo the last edit
+  /// @param sequencer_map The pattern the edit was made to
+  /// @return false if there is no edit to undo
+  bool undo(SequencerStepMap &sequencer_map);
+
+  /// @brief Redo the last undone edit. Any new edit drops the undone ones.
+  /// @param sequencer_map The pattern the edit was made to
+  /// @return false if there is no edit to redo
+  bool redo(SequencerStepMap &sequencer_map);
+
+  /// @brief Get the number of deltas in the journal, done and undone
+  std::size_t size() const { return static_cast<uint16_t>(m_end - m_begin); }
+
+  bool can_undo() const { return m_cursor != m_begin; }
+  bool can_redo() const { return m_cursor != m_end; }
+
+private:
+  /// @brief One changed field of a step. bits 0-4 of m_target are the step index (the snapshot slot for
+  /// Field::PATTERN) and bits 5-7 the Field. Bit 7 of m_old is set on the first delta of each edit.
+  struct Delta
+  {
+    uint8_t m_target;
+    uint8_t m_old;
+    uint8_t m_new;
+  };
+  static_assert(sizeof(Delta) == 3, "the deltas are packed into 3 bytes");
+
+  static constexpr uint8_t index_mask{0x1F};
+  static constexpr uint8_t field_shift{5};
+  static constexpr uint8_t first_bit{0x80};
+  static constexpr uint8_t value_mask{0x7F};
+
+  /// @brief Start a new edit: drop the undone edits, and make room for a delta
+  void begin_edit();
+
+  /// @brief Add a delta to the ring, after begin_edit()
+  void push(uint8_t index, Field field, uint8_t old_value, uint8_t new_value, bool first);
+
+  /// @brief Drop the oldest edit. There are no undone edits when it is called.
+  void drop_oldest();
+
+  /// @brief Set a field of a step to its old or new value
+  void apply(SequencerStepMap &sequencer_map, const Delta &delta, bool undo);
+
+  /// @brief Swap the pattern with a snapshot
+  void swap_snapshot(SequencerStepMap &sequencer_map, uint8_t slot);
+
+  Delta &at(uint16_t sequence) { return m_deltas[sequence & (delta_count - 1)]; }
+
+  /// @brief The deltas. The sequence numbers count up and wrap, m_begin is the oldest delta, m_cursor the first undone
+  /// one (or m_end) and m_end the next to be written.
+  std::array<Delta, delta_count> m_deltas{};
+  uint16_t m_begin{0};
+  uint16_t m_cursor{0};
+  uint16_t m_end{0};
+
+  /// @brief The pattern copies, and the sequence number of the delta that owns each one
+  std::array<PackedPattern, snapshot_count> m_snapshots{};
+  std::array<uint16_t, snapshot_count> m_snapshot_owners{};
+  std::array<bool, snapshot_count> m_snapshot_used{};
+  uint8_t m_next_snapshot{0};
+};
+
+} // namespace bass_station
+
+#endif // __UNDO_JOURNAL_HPP__
@@ -0,0 +1,76 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef __USEC_CLOCK_HPP__
+#define __USEC_CLOCK_HPP__
+
+#include <cstdint>
+
+#if defined(X86_UNIT_TESTING_ONLY)
+  // only used when unit testing on x86
+  #include <mock_cmsis.hpp>
+#endif
+
+namespace bass_station
+{
+
+/// @brief 32-bit microsecond timestamps from the free running 16-bit TIM6 counter (set up by stm32::TimerManager).
+/// The upper 16 bits are extended in software each time the counter is seen to wrap,
+/// so now() must be called at least once every 65ms (the main loop does this).
+class UsecClock
+{
+public:
+  /// @brief Set the timer to read. Call after stm32::TimerManager::initialise()
+  /// @param timer The microsecond timer. Host builds use the simulated clock when this is nullptr.
+  static void initialise(TIM_TypeDef *timer);
+
+  /// @brief Get the current timestamp. Safe to call from any context.
+  /// @return uint32_t microseconds since initialise(), wraps after ~71 minutes
+  static uint32_t now();
+
+  /// @brief Get the time elapsed since an earlier timestamp
+  /// @param since_us The earlier timestamp from now()
+  /// @return uint32_t microseconds
+  static uint32_t elapsed(uint32_t since_us) { return now() - since_us; }
+
+#if defined(X86_UNIT_TESTING_ONLY)
+  /// @brief Move the simulated clock forward (host builds only)
+  /// @param delta_us microseconds to add
+  static void advance(uint32_t delta_us) { m_host_time_us += delta_us; }
+#endif
+
+private:
+  /// @brief The microsecond timer peripheral
+  static inline TIM_TypeDef *m_timer{nullptr};
+  /// @brief The counter value at the previous call to now()
+  static inline uint16_t m_last_count{0};
+  /// @brief The software extended upper bits
+  static inline uint32_t m_wrap_count{0};
+
+#if defined(X86_UNIT_TESTING_ONLY)
+  static inline uint32_t m_host_time_us{0};
+#endif
+};
+
+} // namespace bass_station
+
+#endif // __USEC_CLOCK_HPP__
@@ -0,0 +1,93 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <critical_section.hpp>
+#include <deferred_work.hpp>
+#include <mainapp.hpp>
+#include <usec_clock.hpp>
+
+namespace bass_station
+{
+
+void DeferredWork::initialise()
+{
+#if not defined(X86_UNIT_TESTING_ONLY)
+  NVIC_SetPriority(PendSV_IRQn, (1UL << __NVIC_PRIO_BITS) - 1UL);
+#endif
+}
+
+bool DeferredWork::schedule(Handler handler, void *context, uint32_t timestamp_us)
+{
+  bool queued{false};
+  {
+    CriticalSection critical_section;
+    queued = m_work_queue.push(WorkItem{handler, context, timestamp_us});
+  }
+
+  const uint32_t top_half_us = UsecClock::elapsed(timestamp_us);
+  if (top_half_us > m_stats.m_max_top_half_us)
+  {
+    m_stats.m_max_top_half_us = top_half_us;
+  }
+
+#if not defined(X86_UNIT_TESTING_ONLY)
+  // PendSV runs once every higher priority interrupt has returned
+  SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+#endif
+  return queued;
+}
+
+void DeferredWork::run_pending()
+{
+  WorkItem item;
+  while (m_work_queue.pop(item))
+  {
+    const uint32_t start_us            = UsecClock::now();
+    m_stats.m_last_dispatch_latency_us = start_us - item.m_timestamp_us;
+    if (m_stats.m_last_dispatch_latency_us > m_stats.m_max_dispatch_latency_us)
+    {
+      m_stats.m_max_dispatch_latency_us = m_stats.m_last_dispatch_latency_us;
+    }
+
+    item.m_handler(item.m_context, item.m_timestamp_us);
+
+    const uint32_t bottom_half_us = UsecClock::elapsed(start_us);
+    if (bottom_half_us > m_stats.m_max_bottom_half_us)
+    {
+      m_stats.m_max_bottom_half_us = bottom_half_us;
+    }
+    m_stats.m_run_count++;
+  }
+}
+
+} // namespace bass_station
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  void deferred_work_pendsv_handler(void) { bass_station::DeferredWork::run_pending(); }
+
+#ifdef __cplusplus
+}
+#endif
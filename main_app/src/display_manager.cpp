@@ -33,6 +33,21 @@ DisplayManager::DisplayManager(ssd1306::DriverSerialInterface<STM32G0_ISR> &disp
   m_oled.power_on_sequence();
 }
 
+void DisplayManager::set_view(View view)
+{
+  m_view = view;
+
+  // blank the whole display so nothing from the previous layout is left behind
+  noarch::containers::StaticString<20> blank_line("                   ");
+  for (uint8_t line = 0; line < 6; line++)
+  {
+    m_oled.write(blank_line, m_font, 0, line * m_cell_pitch_y, ssd1306::Colour::Black, ssd1306::Colour::White, 3, line == 5);
+  }
+
+  m_pattern_grid.invalidate();
+  m_status_line_dirty = true;
+}
+
 void DisplayManager::update_oled()
 {
 
@@ -44,4 +59,36 @@ void DisplayManager::update_oled()
   m_oled.write(m_display_line6, m_font, 0, 50, ssd1306::Colour::Black, ssd1306::Colour::White, 3, true);
 }
 
-} // namespace bass_station
\ No newline at end of file
+void DisplayManager::update_pattern_view(SequencerStepMap &sequencer_map, uint8_t cursor_idx, uint8_t selected_idx)
+{
+  uint8_t dirty_count = m_pattern_grid.update(sequencer_map, cursor_idx, selected_idx, m_dirty_cells);
+
+  // the screen buffer is only sent to the display with the last write of the frame
+  bool status_pending = m_status_line_dirty;
+  for (uint8_t idx = 0; idx < dirty_count; idx++)
+  {
+    const PatternGrid::DirtyCell &cell = m_dirty_cells[idx];
+    const uint8_t first_line = (cell.m_area == PatternGrid::Area::GRID) ? m_grid_first_line : m_roll_first_line;
+
+    const char glyph_text[2] = {cell.m_glyph, '\0'};
+    noarch::containers::StaticString<2> glyph(glyph_text);
+
+    const bool last_write = (idx == dirty_count - 1) && !status_pending;
+    m_oled.write(glyph,
+                 m_font,
+                 cell.m_column * m_cell_pitch_x,
+                 (first_line + cell.m_line) * m_cell_pitch_y,
+                 cell.m_inverted ? ssd1306::Colour::White : ssd1306::Colour::Black,
+                 cell.m_inverted ? ssd1306::Colour::Black : ssd1306::Colour::White,
+                 3,
+                 last_write);
+  }
+
+  if (status_pending)
+  {
+    m_oled.write(m_display_line6, m_font, 0, m_status_line * m_cell_pitch_y, ssd1306::Colour::Black, ssd1306::Colour::White, 3, true);
+    m_status_line_dirty = false;
+  }
+}
+
+} // namespace bass_station
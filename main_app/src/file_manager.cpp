@@ -32,35 +32,55 @@
 namespace bass_station
 {
 /// @brief Construct a new File Manager object
-/// @param dtype
 /// @param fatfs_spi_interface
 FileManager::FileManager(fatfs::DiskioProtocolSPI &fatfs_spi_interface)
     : // init the mmc diskio layer with the STM32 SPI definitions (SPI_TypeDef/GPIOs)
       m_diskio_mmc_spi(fatfs_spi_interface),
-      // init the fatfs::Driver with the mmc/spi diskio layer
-      m_fat_spi_driver(m_diskio_mmc_spi)
+      // cache the sectors read over SPI
+      m_sector_cache(m_diskio_mmc_spi),
+      // init the fatfs::Driver with the cached mmc/spi diskio layer
+      m_fat_spi_driver(m_sector_cache),
+      m_library(m_fat_spi_driver)
 {
 
   // Mount the file system. 1 = mount now
   m_last_result = m_fat_spi_driver.f_mount(&m_filesys, m_sd_path.data(), 1);
-  // while (m_last_result != fatfs::FRESULT::FR_OK);
+  if (m_last_result != fatfs::FRESULT::FR_OK)
+  {
+    // no card, or not FAT formatted. The library stays closed.
+    return;
+  }
 
-  // Open the file
-  fatfs::FIL fil;
-  m_last_result = m_fat_spi_driver.f_open(&fil, m_sd_path.data(), fatfs::FA_WRITE);
-  // while (m_last_result != fatfs::FRESULT::FR_OK);
+  // Open the pattern library, creating it on a new card
+  if (!m_library.open(m_library_path.data()))
+  {
+    m_last_result = m_library.last_result();
+  }
+}
+
+bool FileManager::save_input_log(const InputRecorder::Log &log)
+{
+  if (!ready())
+  {
+    return false;
+  }
 
-  // Read from the file
-  std::array<char, 100> read_buff;
-  fatfs::UINT bytes_read{0};
-  m_last_result = m_fat_spi_driver.f_read(&fil, read_buff.data(), read_buff.size(), &bytes_read);
-  // while (m_last_result != fatfs::FRESULT::FR_OK);
+  fatfs::FIL input_log_file;
+  m_last_result = m_fat_spi_driver.f_open(&input_log_file, m_input_log_path.data(), fatfs::FA_WRITE | fatfs::FA_CREATE_ALWAYS);
+  if (m_last_result != fatfs::FRESULT::FR_OK)
+  {
+    return false;
+  }
 
-  // Write to the file
-  std::array<char, 100> write_buff;
+  const fatfs::UINT log_bytes = static_cast<fatfs::UINT>(log.m_count * sizeof(TraceRecord));
   fatfs::UINT bytes_written{0};
-  m_last_result = m_fat_spi_driver.f_write(&fil, write_buff.data(), write_buff.size(), &bytes_written);
-  // while (m_last_result != fatfs::FRESULT::FR_OK);
+  m_last_result = m_fat_spi_driver.f_write(&input_log_file, log.m_ring.data(), log_bytes, &bytes_written);
+  const fatfs::FRESULT close_result = m_fat_spi_driver.f_close(&input_log_file);
+  if (m_last_result == fatfs::FRESULT::FR_OK)
+  {
+    m_last_result = close_result;
+  }
+  return (m_last_result == fatfs::FRESULT::FR_OK) && (bytes_written == log_bytes);
 }
 
 } // namespace bass_station
\ No newline at end of file
@@ -0,0 +1,172 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <flash_stm32g0.hpp>
+
+#if not defined(X86_UNIT_TESTING_ONLY)
+  #pragma GCC diagnostic push
+  #pragma GCC diagnostic ignored "-Wvolatile"
+  #include <stm32g0xx.h>
+  #pragma GCC diagnostic pop
+#endif
+
+namespace bass_station
+{
+
+namespace
+{
+#if not defined(X86_UNIT_TESTING_ONLY)
+// @brief FLASH_KEYR unlock sequence (RM0444 3.3.6)
+constexpr uint32_t flash_key1{0x45670123};
+constexpr uint32_t flash_key2{0xCDEF89AB};
+
+constexpr uint32_t flash_sr_errors{FLASH_SR_OPERR | FLASH_SR_PROGERR | FLASH_SR_WRPERR | FLASH_SR_PGAERR | FLASH_SR_SIZERR | FLASH_SR_PGSERR |
+                                   FLASH_SR_MISERR | FLASH_SR_FASTERR};
+#endif
+} // namespace
+
+FlashStm32g0::FlashStm32g0(std::size_t first_page, std::size_t page_count)
+    : m_first_page(first_page),
+      m_page_count((first_page + page_count <= m_bank_page_count) ? page_count : 0)
+{
+}
+
+std::size_t FlashStm32g0::page_count() const
+{
+#if defined(X86_UNIT_TESTING_ONLY)
+  // there is no flash to map on the host, use FlashMemory instead
+  return 0;
+#else
+  return m_page_count;
+#endif
+}
+
+const uint8_t *FlashStm32g0::read(std::size_t page) const
+{
+  return reinterpret_cast<const uint8_t *>(m_bank2_base + (m_first_page + page) * page_size);
+}
+
+bool FlashStm32g0::start_erase(std::size_t page [[maybe_unused]])
+{
+#if defined(X86_UNIT_TESTING_ONLY)
+  return false;
+#else
+  if ((page >= m_page_count) || m_erase_pending || !unlock())
+  {
+    return false;
+  }
+  // page erase in bank 2, this takes ~20ms but the CPU carries on running from bank 1
+  FLASH->CR       = (FLASH->CR & ~FLASH_CR_PNB) | FLASH_CR_PER | FLASH_CR_BKER | ((m_first_page + page) << FLASH_CR_PNB_Pos);
+  FLASH->CR       = FLASH->CR | FLASH_CR_STRT;
+  m_erase_pending = true;
+  return true;
+#endif
+}
+
+FlashDevice::EraseStatus FlashStm32g0::erase_status()
+{
+#if defined(X86_UNIT_TESTING_ONLY)
+  return EraseStatus::FAILED;
+#else
+  if (!m_erase_pending)
+  {
+    return EraseStatus::FAILED;
+  }
+  if (FLASH->SR & FLASH_SR_BSY2)
+  {
+    return EraseStatus::BUSY;
+  }
+  m_erase_pending = false;
+  return finish() ? EraseStatus::DONE : EraseStatus::FAILED;
+#endif
+}
+
+bool FlashStm32g0::program(std::size_t page [[maybe_unused]], std::size_t offset [[maybe_unused]], const uint8_t *data [[maybe_unused]], std::size_t length [[maybe_unused]])
+{
+#if defined(X86_UNIT_TESTING_ONLY)
+  return false;
+#else
+  if ((page >= m_page_count) || m_erase_pending || (offset % double_word_size != 0) || (length % double_word_size != 0) || (offset + length > page_size) ||
+      !unlock())
+  {
+    return false;
+  }
+
+  bool success = true;
+  volatile uint32_t *target = reinterpret_cast<volatile uint32_t *>(m_bank2_base + (m_first_page + page) * page_size + offset);
+  for (std::size_t idx = 0; (idx < length) && success; idx += double_word_size)
+  {
+    uint32_t low_word;
+    uint32_t high_word;
+    std::memcpy(&low_word, &data[idx], sizeof(low_word));
+    std::memcpy(&high_word, &data[idx + sizeof(low_word)], sizeof(high_word));
+
+    // the second word write starts the double word programming
+    FLASH->CR = FLASH->CR | FLASH_CR_PG;
+    target[0] = low_word;
+    target[1] = high_word;
+    target += 2;
+    while (FLASH->SR & FLASH_SR_BSY2)
+    {
+    }
+    success = (FLASH->SR & flash_sr_errors) == 0;
+    FLASH->CR = FLASH->CR & ~FLASH_CR_PG;
+  }
+  return finish() && success;
+#endif
+}
+
+bool FlashStm32g0::unlock()
+{
+#if defined(X86_UNIT_TESTING_ONLY)
+  return false;
+#else
+  while (FLASH->SR & (FLASH_SR_BSY1 | FLASH_SR_BSY2 | FLASH_SR_CFGBSY))
+  {
+  }
+  if (FLASH->CR & FLASH_CR_LOCK)
+  {
+    FLASH->KEYR = flash_key1;
+    FLASH->KEYR = flash_key2;
+  }
+  // clear any error left by a previous operation, the flags are write-1-to-clear
+  FLASH->SR = flash_sr_errors | FLASH_SR_EOP;
+  return (FLASH->CR & FLASH_CR_LOCK) == 0;
+#endif
+}
+
+bool FlashStm32g0::finish()
+{
+#if defined(X86_UNIT_TESTING_ONLY)
+  return false;
+#else
+  while (FLASH->SR & (FLASH_SR_BSY1 | FLASH_SR_BSY2 | FLASH_SR_CFGBSY))
+  {
+  }
+  const bool success = (FLASH->SR & flash_sr_errors) == 0;
+  FLASH->SR          = flash_sr_errors | FLASH_SR_EOP;
+  FLASH->CR          = (FLASH->CR & ~(FLASH_CR_PER | FLASH_CR_PG | FLASH_CR_BKER)) | FLASH_CR_LOCK;
+  return success;
+#endif
+}
+
+} // namespace bass_station
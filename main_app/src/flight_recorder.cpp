@@ -0,0 +1,142 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <critical_section.hpp>
+#include <flight_recorder.hpp>
+
+#if defined(USE_RTT)
+  #include <SEGGER_RTT.h>
+#endif
+
+namespace bass_station
+{
+
+// placed outside .bss by the linker script so the startup code leaves it alone
+FlightRecorder::Log FlightRecorder::m_log __attribute__((section(".noinit")));
+
+bool FlightRecorder::initialise()
+{
+  // power-on RAM contents are random, so only trust a log with the magic number and sane indices
+  const bool crashed = (m_log.m_magic == m_log_magic) && (m_log.m_cause != Cause::NONE) && (m_log.m_next < m_ring_size) &&
+                       (m_log.m_count <= m_ring_size);
+  if (crashed)
+  {
+    m_crash_log = m_log;
+  }
+
+  m_log.m_magic = m_log_magic;
+  m_log.m_cause = Cause::NONE;
+  m_log.m_fault = FaultRegisters{0, 0, 0, 0, 0, 0, 0, 0, 0};
+  m_log.m_next  = 0;
+  m_log.m_count = 0;
+  return crashed;
+}
+
+const TraceRecord &FlightRecorder::crash_record(std::size_t index)
+{
+  // the oldest record is the one that will be overwritten next
+  const std::size_t oldest = (m_crash_log.m_count < m_ring_size) ? 0 : m_crash_log.m_next;
+  /// @note don't use std::array.at(), this will force exception handling to bloat the linked .elf
+  return m_crash_log.m_ring[(oldest + index) % m_ring_size];
+}
+
+void FlightRecorder::record(const TraceRecord &record)
+{
+  CriticalSection critical_section;
+  m_log.m_ring[m_log.m_next] = record;
+  m_log.m_next               = (m_log.m_next + 1) % m_ring_size;
+  if (m_log.m_count < m_ring_size)
+  {
+    m_log.m_count++;
+  }
+}
+
+void FlightRecorder::freeze_and_reset(Cause cause, const uint32_t *exception_frame, uint32_t return_address)
+{
+#if not defined(X86_UNIT_TESTING_ONLY)
+  __disable_irq();
+#endif
+
+  m_log.m_cause = cause;
+  if (exception_frame != nullptr)
+  {
+    m_log.m_fault = FaultRegisters{exception_frame[0],
+                                   exception_frame[1],
+                                   exception_frame[2],
+                                   exception_frame[3],
+                                   exception_frame[4],
+                                   exception_frame[5],
+                                   exception_frame[6],
+                                   exception_frame[7],
+                                   static_cast<uint32_t>(reinterpret_cast<uintptr_t>(exception_frame))};
+  }
+  else
+  {
+    // not an exception, the return address taken by the caller is the best clue we have
+    m_log.m_fault      = FaultRegisters{0, 0, 0, 0, 0, 0, 0, 0, 0};
+    m_log.m_fault.m_lr = return_address;
+  }
+
+#if not defined(X86_UNIT_TESTING_ONLY)
+  NVIC_SystemReset();
+#endif
+  while (true)
+  {
+  }
+}
+
+void FlightRecorder::dump_rtt()
+{
+#if defined(USE_RTT)
+  const FaultRegisters &fault = m_crash_log.m_fault;
+  SEGGER_RTT_printf(0, "--- crash log: cause %u ---\n", static_cast<unsigned>(m_crash_log.m_cause));
+  SEGGER_RTT_printf(0, "pc %08x lr %08x xpsr %08x sp %08x\n", fault.m_pc, fault.m_lr, fault.m_xpsr, fault.m_frame_address);
+  SEGGER_RTT_printf(0, "r0 %08x r1 %08x r2 %08x r3 %08x r12 %08x\n", fault.m_r0, fault.m_r1, fault.m_r2, fault.m_r3, fault.m_r12);
+  for (std::size_t index = 0; index < m_crash_log.m_count; index++)
+  {
+    const TraceRecord &record = crash_record(index);
+    SEGGER_RTT_printf(0,
+                      "%uus id %u arg0 %u arg1 %u\n",
+                      static_cast<unsigned>(record.m_timestamp_us),
+                      static_cast<unsigned>(record.m_id),
+                      static_cast<unsigned>(record.m_arg0),
+                      static_cast<unsigned>(record.m_arg1));
+  }
+#endif
+}
+
+void FlightRecorder::format_hex(uint32_t value, std::array<char, 9> &hex_string)
+{
+  constexpr std::array<char, 16> hex_digits{'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
+  for (std::size_t digit = 0; digit < 8; digit++)
+  {
+    hex_string[7 - digit] = hex_digits[(value >> (digit * 4)) & 0xF];
+  }
+  hex_string[8] = '\0';
+}
+
+} // namespace bass_station
+
+extern "C" void flight_recorder_hard_fault(const uint32_t *exception_frame)
+{
+  bass_station::FlightRecorder::freeze_and_reset(bass_station::FlightRecorder::Cause::HARD_FAULT, exception_frame, 0);
+}
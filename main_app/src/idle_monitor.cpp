@@ -0,0 +1,54 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <idle_monitor.hpp>
+
+namespace bass_station
+{
+
+void IdleMonitor::initialise()
+{
+#if not defined(X86_UNIT_TESTING_ONLY)
+  // SysTick is already counting for LL_mDelay(), only the interrupt needs enabling. SysTick_Handler() does nothing.
+  SysTick->CTRL = SysTick->CTRL | SysTick_CTRL_TICKINT_Msk;
+#endif
+  m_window_start_us  = UsecClock::now();
+  m_window_asleep_us = 0;
+}
+
+void IdleMonitor::update_window()
+{
+  const uint32_t window_elapsed_us = UsecClock::elapsed(m_window_start_us);
+  if (window_elapsed_us < m_window_us)
+  {
+    return;
+  }
+
+  // one division per window. The asleep time can't exceed the window so the multiply can't overflow for a 1s window.
+  const uint32_t asleep_percent = (m_window_asleep_us * 100U) / window_elapsed_us;
+  m_cpu_load_percent            = static_cast<uint8_t>(100U - ((asleep_percent > 100U) ? 100U : asleep_percent));
+
+  m_window_start_us += window_elapsed_us;
+  m_window_asleep_us = 0;
+}
+
+} // namespace bass_station
@@ -0,0 +1,88 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include <critical_section.hpp>
+#include <input_recorder.hpp>
+
+#if defined(USE_RTT)
+  #include <SEGGER_RTT.h>
+#endif
+
+namespace bass_station
+{
+
+#if defined(USE_RTT)
+namespace
+{
+/// @brief RTT up-buffer for the input channel, 64 records. Inputs are far less frequent than trace records.
+char input_buffer[sizeof(TraceRecord) * 64];
+} // namespace
+#endif
+
+// placed outside .bss by the linker script so the startup code leaves it alone
+InputRecorder::Log InputRecorder::m_log __attribute__((section(".noinit")));
+
+bool InputRecorder::initialise()
+{
+#if defined(USE_RTT)
+  SEGGER_RTT_ConfigUpBuffer(m_rtt_channel, "inputs", input_buffer, sizeof(input_buffer), SEGGER_RTT_MODE_NO_BLOCK_SKIP);
+#endif
+  // power-on RAM contents are random, so only trust a log with the magic number and a sane count
+  return (m_log.m_magic == m_log_magic) && (m_log.m_count <= m_ring_size);
+}
+
+void InputRecorder::start()
+{
+  CriticalSection critical_section;
+  m_log.m_magic   = m_log_magic;
+  m_log.m_count   = 0;
+  m_log.m_dropped = 0;
+}
+
+void InputRecorder::record_at(uint32_t timestamp_us, InputId id, uint16_t arg0, uint32_t arg1)
+{
+  const TraceRecord record{timestamp_us, static_cast<uint16_t>(id), arg0, arg1};
+  {
+    CriticalSection critical_section;
+    /// @note don't use std::array.at(), this will force exception handling to bloat the linked .elf
+    TraceRecord *last_record = (m_log.m_count > 0) ? &m_log.m_ring[m_log.m_count - 1] : nullptr;
+    if ((id == InputId::TEMPO_TICK) && (arg0 == 0) && (last_record != nullptr) && (last_record->m_id == record.m_id) && (last_record->m_arg0 == 0))
+    {
+      last_record->m_arg1 += arg1;
+    }
+    else if (m_log.m_count < m_ring_size)
+    {
+      m_log.m_ring[m_log.m_count] = record;
+      m_log.m_count++;
+    }
+    else
+    {
+      m_log.m_dropped++;
+    }
+  }
+
+#if defined(USE_RTT)
+  // SEGGER_RTT_Write() masks interrupts while it copies, and in skip mode writes all of the record or none of it
+  SEGGER_RTT_Write(m_rtt_channel, &record, sizeof(record));
+#endif
+}
+
+} // namespace bass_station
@@ -20,7 +20,12 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
+#include <input_recorder.hpp>
 #include <keypad_manager.hpp>
+#include <trace.hpp>
+#include <trig_engine.hpp>
+#include <undo_journal.hpp>
+#include <usec_clock.hpp>
 
 namespace bass_station
 {
@@ -57,13 +62,24 @@ KeypadManager::KeypadManager(I2C_TypeDef *i2c_handle, TIM_TypeDef *debounce_time
 #endif
 }
 
-SequencerState KeypadManager::update_sequencer_map(SequencerStepMap &sequencer_map)
+SequencerState KeypadManager::update_sequencer_map(SequencerStepMap &sequencer_map, UndoJournal &undo_journal)
 {
   SequencerState running_status{SequencerState::IDLE};
 
   // get the key events FIFO list from the ADP5587 driver
   std::array<SequencerKeyEventIndex, 10U> key_events_list;
+  const uint32_t read_start_us = UsecClock::now();
   get_key_events(key_events_list);
+  key_latency.read_done(read_start_us, UsecClock::now());
+  uint32_t press_time_us = key_latency.press_time_us();
+#if defined(X86_UNIT_TESTING_ONLY)
+  // a replay gives the press time logged on the device, the host main loop doesn't poll the FIFO as the device did
+  if (m_injected_press_time_valid)
+  {
+    press_time_us               = m_injected_press_time_us;
+    m_injected_press_time_valid = false;
+  }
+#endif
 
   // process each key event in turn (if any)
   for (SequencerKeyEventIndex key_event : key_events_list)
@@ -72,8 +88,44 @@ SequencerState KeypadManager::update_sequencer_map(SequencerStepMap &sequencer_m
     // strict debounce control on the pattern step button presses.
     // if threshold is too short the button will toggle states before user releases the button (annoying)
     // if threshold is too long the button will not be responsive enough.
+    // unused FIFO entries are zero, skip them so they don't restart the debounce period of the next real press
+    if (static_cast<uint8_t>(key_event) == 0)
+    {
+      continue;
+    }
     uint32_t timer_count_ms = m_debounce_timer.CNT;
-    if (timer_count_ms - m_last_pattern_debounce_count_ms > m_pattern_debounce_threshold_ms)
+    // find the key event that matches the sequence step. In record mode the step keys play notes rather than switch
+    // the steps, so a second press can't undo the first and they are taken without the debounce.
+    // The taps of user button 3 are closer together than the debounce at fast tempos, TapTempo filters them instead.
+    Step *step           = sequencer_map.find_key(key_event);
+    const bool recorded  = record_mode && (step != nullptr);
+    const bool tapped    = (static_cast<int>(key_event) == UserBtn3ID);
+    const bool debounced = !recorded && !tapped && (timer_count_ms - m_last_pattern_debounce_count_ms > m_pattern_debounce_threshold_ms);
+    // the debounce decision depends on the timer count, and the recorded notes and the tapped tempo on the press time,
+    // so the replay needs them too
+    if (recorded || tapped)
+    {
+      InputRecorder::record(InputId::KEY_PRESS_TIME, static_cast<uint16_t>(key_event), press_time_us);
+    }
+    InputRecorder::record(InputId::KEY_EVENT, static_cast<uint16_t>(key_event), timer_count_ms);
+    Trace::emit(TraceId::KEY_EVENT, static_cast<uint16_t>(key_event), (debounced || recorded || tapped) ? 1U : 0U);
+    if (tapped)
+    {
+      // timed from the press, not from when the FIFO was read
+      tempo_tapped = tap_tempo.tap(press_time_us) || tempo_tapped;
+      continue;
+    }
+    if (recorded)
+    {
+      if (recorded_press_count < recorded_presses.size())
+      {
+        /// @note don't use std::array.at(), this will force exception handling to bloat the linked .elf
+        recorded_presses[recorded_press_count] = RecordedPress{step->m_sequence_abs_pos_index, press_time_us};
+        recorded_press_count++;
+      }
+      continue;
+    }
+    if (debounced)
     {
 
       // update the running status of the overall sequencer if start/stop buttons pressed
@@ -86,15 +138,55 @@ SequencerState KeypadManager::update_sequencer_map(SequencerStepMap &sequencer_m
         running_status = SequencerState::RUNNING;
       }
 
-      // find the key event that matches the sequence step
-      Step *step = sequencer_map.find_key(key_event);
+      // user button 2 cycles the ratchet of the selected step: 1, 2, 3, 4, 1... In pitch mode it steps the root of the
+      // scale instead.
+      if ((static_cast<int>(key_event) == UserBtn2ID) && pitch_mode)
+      {
+        next_root_requested = true;
+      }
+      else if (static_cast<int>(key_event) == UserBtn2ID)
+      {
+        /// @note don't use std::array.at(), this will force exception handling to bloat the linked .elf
+        Step &selected     = sequencer_map.data[last_user_selected_key_idx].second;
+        const Step before  = selected;
+        selected.m_ratchet = (selected.m_ratchet >= max_ratchet) ? 1U : static_cast<uint8_t>(selected.m_ratchet + 1U);
+        undo_journal.record_step(before, selected);
+        pattern_changed = true;
+      }
+
+      // user button 1 cycles the probability and condition of the selected step, see TrigEngine::cycle(). In undo
+      // mode it asks for a randomise of the pattern instead, and in pitch mode it steps the scale.
+      if ((static_cast<int>(key_event) == UserBtn1ID) && undo_mode)
+      {
+        randomise_requested = true;
+        randomise_seed      = timer_count_ms;
+      }
+      else if ((static_cast<int>(key_event) == UserBtn1ID) && pitch_mode)
+      {
+        next_scale_requested = true;
+      }
+      else if (static_cast<int>(key_event) == UserBtn1ID)
+      {
+        /// @note don't use std::array.at(), this will force exception handling to bloat the linked .elf
+        Step &selected    = sequencer_map.data[last_user_selected_key_idx].second;
+        const Step before = selected;
+        TrigEngine::cycle(selected);
+        undo_journal.record_step(before, selected);
+        pattern_changed = true;
+      }
+
+      // user button 6 turns fill on and off
+      if (static_cast<int>(key_event) == UserBtn6ID)
+      {
+        fill = !fill;
+      }
+
       if (step == nullptr)
       { /* no match found in map */
       }
       else
       {
-#if not defined(X86_UNIT_TESTING_ONLY)
-
+        const Step before = *step;
         if (step->m_state == StepState::ON)
         {
           if (step->m_colour == default_colour)
@@ -115,18 +207,23 @@ SequencerState KeypadManager::update_sequencer_map(SequencerStepMap &sequencer_m
           step->m_colour = user_select_colour;
           step->m_state  = StepState::ON;
         }
+        // only a change of state is journaled, the highlight follows the selection
+        undo_journal.record_step(before, *step);
 
         // de-highlight the previously highlighted key...unless we just selected the same key again, then skip
-        if (last_user_selected_key_idx != step->m_sequence_abs_pos_index)
+        if ((last_user_selected_key_idx != step->m_sequence_abs_pos_index) && (last_user_selected_key_idx < sequencer_map.data.size()))
         {
           /// @note don't use std::array.at(), this will force exception handling to bloat the linked .elf
           sequencer_map.data[last_user_selected_key_idx].second.m_colour = default_colour;
         }
+        pattern_changed = true;
 
-#endif
-
-        // store the index position of the user selected step for next key interrupt
-        last_user_selected_key_idx = step->m_sequence_abs_pos_index;
+        // store the index position of the user selected step for next key interrupt.
+        // SequenceManager indexes the step maps with it unchecked, so only an index inside the map is stored
+        if (step->m_sequence_abs_pos_index < sequencer_map.data.size())
+        {
+          last_user_selected_key_idx = step->m_sequence_abs_pos_index;
+        }
       }
       m_last_pattern_debounce_count_ms = timer_count_ms;
     }
@@ -135,6 +232,35 @@ SequencerState KeypadManager::update_sequencer_map(SequencerStepMap &sequencer_m
   return running_status;
 }
 
-void KeypadManager::get_key_events(std::array<SequencerKeyEventIndex, 10> &key_events_list) { m_keypad_driver.get_key_events(key_events_list); }
+void KeypadManager::get_key_events(std::array<SequencerKeyEventIndex, 10> &key_events_list)
+{
+#if defined(X86_UNIT_TESTING_ONLY)
+  // there is no ADP5587 on the host, read back the injected events instead
+  key_events_list = m_injected_key_events;
+  m_injected_key_events.fill(static_cast<SequencerKeyEventIndex>(0));
+  m_injected_key_event_count = 0;
+#else
+  m_keypad_driver.get_key_events(key_events_list);
+#endif
+}
+
+#if defined(X86_UNIT_TESTING_ONLY)
+bool KeypadManager::inject_key_event(SequencerKeyEventIndex key_event)
+{
+  if (m_injected_key_event_count >= m_injected_key_events.size())
+  {
+    return false;
+  }
+  m_injected_key_events[m_injected_key_event_count] = key_event;
+  m_injected_key_event_count++;
+  return true;
+}
+
+void KeypadManager::inject_press_time(uint32_t press_time_us)
+{
+  m_injected_press_time_us    = press_time_us;
+  m_injected_press_time_valid = true;
+}
+#endif
 
 } // namespace bass_station
\ No newline at end of file
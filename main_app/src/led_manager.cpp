@@ -107,6 +107,7 @@ void LedManager::set_all_leds_both_rows(uint16_t greyscale_pwm, const tlc5955::L
   // send a first bit as 0 to notify chip this is  greyscale data
   m_tlc5955_driver.send_first_bit(tlc5955::Driver::DataLatchType::data);
   m_tlc5955_driver.send_spi_bytes(tlc5955::Driver::LatchPinOption::latch_after_send);
+  Trace::emit(TraceId::LED_LATCH, static_cast<uint16_t>(TraceLedLatch::ALL_LEDS));
 }
 
 void LedManager::set_one_led_at(
@@ -180,6 +181,7 @@ void LedManager::set_one_led_at(
   if (latch_option == LatchOption::enable)
   {
     m_tlc5955_driver.send_spi_bytes(tlc5955::Driver::LatchPinOption::latch_after_send);
+    Trace::emit(TraceId::LED_LATCH, static_cast<uint16_t>(TraceLedLatch::ONE_LED), led_position);
   }
   else
   {
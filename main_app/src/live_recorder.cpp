@@ -0,0 +1,101 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <live_recorder.hpp>
+
+#if defined(USE_RTT)
+  #include <SEGGER_RTT.h>
+#endif
+
+namespace bass_station
+{
+
+void KeyLatency::read_done(uint32_t read_start_us, uint32_t read_end_us)
+{
+  m_read_us     = read_end_us - read_start_us;
+  m_max_read_us = (m_read_us > m_max_read_us) ? m_read_us : m_max_read_us;
+
+  // the FIFO was empty at the end of the previous read, so nothing waits longer than the time since then
+  m_poll_interval_us     = m_first_read ? 0U : (read_start_us - m_read_end_us);
+  m_max_poll_interval_us = (m_poll_interval_us > m_max_poll_interval_us) ? m_poll_interval_us : m_max_poll_interval_us;
+  m_read_end_us          = read_end_us;
+  m_first_read           = false;
+}
+
+void KeyLatency::dump_rtt() const
+{
+#if defined(USE_RTT)
+  SEGGER_RTT_printf(0,
+                    "key latency: i2c read %uus max %uus, fifo wait %uus max %uus\n",
+                    static_cast<unsigned>(m_read_us),
+                    static_cast<unsigned>(m_max_read_us),
+                    static_cast<unsigned>(fifo_wait_us()),
+                    static_cast<unsigned>(m_max_poll_interval_us));
+#endif
+}
+
+void LiveRecorder::reset() { m_steps = 0; }
+
+void LiveRecorder::step_started(uint32_t timestamp_us, uint32_t step_counts)
+{
+  m_previous_step_us     = m_step_start_us;
+  m_previous_step_counts = m_step_counts;
+  m_step_start_us        = timestamp_us;
+  m_step_counts          = step_counts;
+  m_steps                = (m_steps < 2) ? static_cast<uint8_t>(m_steps + 1U) : m_steps;
+}
+
+uint32_t LiveRecorder::step_us() const
+{
+  if ((m_steps < 2) || (m_previous_step_counts == 0))
+  {
+    return 0;
+  }
+  // scale the length of the previous step by the timer counts of the two, the tempo doesn't change much in one step
+  const uint64_t previous_step_us = m_step_start_us - m_previous_step_us;
+  return static_cast<uint32_t>((previous_step_us * m_step_counts + (m_previous_step_counts / 2U)) / m_previous_step_counts);
+}
+
+bool LiveRecorder::quantise(uint32_t press_us, int8_t &step_offset) const
+{
+  if (m_steps == 0)
+  {
+    return false;
+  }
+
+  // a press corrected back past the start of the step playing is early for it, or late for the one before
+  const int32_t offset_us = static_cast<int32_t>(press_us - m_step_start_us);
+  if (offset_us < 0)
+  {
+    // before the first step there is no step before, the press is early for the first one
+    const uint32_t previous_step_us = m_step_start_us - m_previous_step_us;
+    step_offset = ((m_steps >= 2) && (static_cast<uint32_t>(-offset_us) * 2U > previous_step_us)) ? -1 : 0;
+    return true;
+  }
+
+  // until the length of a step is known, the press goes on the step playing
+  const uint32_t length_us = step_us();
+  step_offset              = ((length_us != 0) && (static_cast<uint32_t>(offset_us) * 2U >= length_us)) ? 1 : 0;
+  return true;
+}
+
+} // namespace bass_station
@@ -22,53 +22,99 @@
 
 #include "mainapp.hpp"
 #include <adp5587.hpp>
+#include <deferred_work.hpp>
 #include <file_manager.hpp>
+#include <flight_recorder.hpp>
+#include <input_recorder.hpp>
 #include <sequence_manager.hpp>
 #include <timer_manager.hpp>
+#include <trace.hpp>
+#include <usec_clock.hpp>
 
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
-#define ENABLE_FATFS 0
+// uSD card pattern library. Off by default: the card shares SPI2 and the PB7 (MOSI) and PB8 (SCK) pins with the
+// TLC5955 LED driver, and nothing arbitrates the bus. When it is enabled, every card access is made at startup, before
+// the TLC5955 interface is constructed and reconfigures SPI2. The card must not be used after that.
+#if not defined(ENABLE_FATFS)
+  #define ENABLE_FATFS 0
+#endif
 
-  void error_handler()
+  // not inlined, so the return address is the failing call site
+  __attribute__((noinline)) void error_handler()
   {
-    while (true)
-    {
-    }
+    // keep the recent trace for the next boot, rather than spinning here forever
+    const uint32_t call_site = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(__builtin_return_address(0)));
+    bass_station::FlightRecorder::freeze_and_reset(bass_station::FlightRecorder::Cause::ERROR_HANDLER, nullptr, call_site);
   }
 
   void mainapp()
   {
+    // pick up the post-mortem log if the last run ended in a fault, before any trace point overwrites it
+    const bool previous_run_crashed = bass_station::FlightRecorder::initialise();
 
     // initialise the timer used for system wide microsecond timeout
     if (stm32::TimerManager::initialise(TIM6) == false)
     {
       error_handler();
     }
+    // timestamps for the interrupt bottom halves and instrumentation are taken from the same timer
+    bass_station::UsecClock::initialise(TIM6);
+
+    // interrupt bottom halves run from PendSV at the lowest priority
+    bass_station::DeferredWork::initialise();
+
+    // binary trace records on RTT channel 1 (Debug builds only)
+    bass_station::Trace::initialise();
+    if (previous_run_crashed)
+    {
+      bass_station::FlightRecorder::dump_rtt();
+    }
+
+    // the inputs of the previous run are still in RAM after a reset, keep them until they have been saved
+    [[maybe_unused]] const bool previous_inputs_valid = bass_station::InputRecorder::initialise();
+
+    // The objects below are used until the main loop ends, which it doesn't. They are static, not in this frame, so the
+    // linker map counts them in .bss and the stack budget is only for the call frames. They are still constructed
+    // here, in this order (the build has -fno-threadsafe-statics, so each only costs a guard flag).
 
 #if ENABLE_FATFS
     // setup fatfs support for uSDCard
-    fatfs::DiskioProtocolSPI fatfs_spi_interface(SPI2,
-                                                 std::make_pair(GPIOB, GPIO_BSRR_BS8), // sck  - PB8
-                                                 std::make_pair(GPIOB, GPIO_BSRR_BS7), // mosi - PB7
-                                                 std::make_pair(GPIOD, GPIO_BSRR_BS3), // miso - PD3
-                                                 std::make_pair(GPIOD, GPIO_BSRR_BS2), // cs  	- PD2
-                                                 RCC_APBENR1_SPI2EN);
+    static fatfs::DiskioProtocolSPI fatfs_spi_interface(SPI2,
+                                                        std::make_pair(GPIOB, GPIO_BSRR_BS8), // sck  - PB8
+                                                        std::make_pair(GPIOB, GPIO_BSRR_BS7), // mosi - PB7
+                                                        std::make_pair(GPIOD, GPIO_BSRR_BS3), // miso - PD3
+                                                        std::make_pair(GPIOD, GPIO_BSRR_BS2), // cs  	- PD2
+                                                        RCC_APBENR1_SPI2EN);
+
+    // mounts the card and opens the pattern library, if a card is present
+    static bass_station::FileManager spi_fm(fatfs_spi_interface);
+
+    // save the inputs that led up to the crash, they can be replayed on the host to reproduce it
+    if (previous_run_crashed && previous_inputs_valid)
+    {
+      spi_fm.save_input_log(bass_station::InputRecorder::log());
+    }
+
+    // read song slot 0 of the library now, while SPI2 is still set up for the card
+    bass_station::Song song;
+    const bool song_loaded = spi_fm.ready() && spi_fm.library().load_song(0, song);
 #endif
 
-    // bass_station::FileManager spi_fm(fatfs_spi_interface);
+    // log the inputs of this run (RTT channel 2 in Debug builds)
+    bass_station::InputRecorder::start();
 
     // Timer peripheral for sequencer manager rotary encoder control
     TIM_TypeDef *sequencer_encoder_timer = TIM1;
 
     // SPI peripheral for SSD1306 display driver serial communication
-    ssd1306::DriverSerialInterface<STM32G0_ISR> ssd1306_spi_interface(SPI1,
-                                                                      std::make_pair(GPIOA, GPIO_BSRR_BS0), // PA0 - DC
-                                                                      std::make_pair(GPIOA, GPIO_BSRR_BS3), // PA3 - Reset
-                                                                      STM32G0_ISR::dma1_ch2);
+    static ssd1306::DriverSerialInterface<STM32G0_ISR> ssd1306_spi_interface(SPI1,
+                                                                             std::make_pair(GPIOA, GPIO_BSRR_BS0), // PA0 - DC
+                                                                             std::make_pair(GPIOA, GPIO_BSRR_BS3), // PA3 - Reset
+                                                                             STM32G0_ISR::dma1_ch2);
 
     // I2C peripheral for keypad manager serial communication
     I2C_TypeDef *ad5587_keypad_i2c = I2C3;
@@ -82,28 +128,37 @@ extern "C"
     // std::pair<GPIO_TypeDef*, uint16_t> test (GPIOB, GPIO_BSRR_BS9);
 
     // SPI peripheral for TLC5955 LED driver serial communication
-    tlc5955::DriverSerialInterface tlc5955_spi_interface(SPI2,
-                                                         std::make_pair(GPIOB, GPIO_BSRR_BS9), // latch port+pin
-                                                         std::make_pair(GPIOB, GPIO_BSRR_BS7), // mosi port+pin
-                                                         std::make_pair(GPIOB, GPIO_BSRR_BS8), // sck port+pin
-                                                         std::make_pair(TIM4, TIM_CCER_CC1E),  // gsclk timer+channel
-                                                         RCC_IOPENR_GPIOBEN,                   // for enabling GPIOB clock
-                                                         RCC_APBENR1_SPI2EN                    // for enabling SPI2 clock
+    static tlc5955::DriverSerialInterface tlc5955_spi_interface(SPI2,
+                                                                std::make_pair(GPIOB, GPIO_BSRR_BS9), // latch port+pin
+                                                                std::make_pair(GPIOB, GPIO_BSRR_BS7), // mosi port+pin
+                                                                std::make_pair(GPIOB, GPIO_BSRR_BS8), // sck port+pin
+                                                                std::make_pair(TIM4, TIM_CCER_CC1E),  // gsclk timer+channel
+                                                                RCC_IOPENR_GPIOBEN,                   // for enabling GPIOB clock
+                                                                RCC_APBENR1_SPI2EN                    // for enabling SPI2 clock
     );
 
     // The USART and Timer used to send the MIDI heartbeat
-    midi_stm32::DeviceInterface<STM32G0_ISR> midi_usart_interface(USART5, STM32G0_ISR::usart5);
+    static midi_stm32::DeviceInterface<STM32G0_ISR> midi_usart_interface(USART5, STM32G0_ISR::usart5);
 
     // initialise the sequencer
     // auto timer_isr_pair = std::make_pair(*TIM3, STM32G0_ISR::tim3);
-    bass_station::SequenceManager sequencer(std::make_pair(TIM3, STM32G0_ISR::tim3), // Timer peripheral for sequencer manager tempo control
-                                            sequencer_encoder_timer,
-                                            ssd1306_spi_interface,
-                                            ad5587_keypad_i2c,
-                                            general_purpose_debounce_timer,
-                                            adg2188_control_sw_i2c,
-                                            tlc5955_spi_interface,
-                                            midi_usart_interface);
+    static bass_station::SequenceManager sequencer(std::make_pair(TIM3, STM32G0_ISR::tim3), // Timer peripheral for sequencer manager tempo control
+                                                   sequencer_encoder_timer,
+                                                   ssd1306_spi_interface,
+                                                   ad5587_keypad_i2c,
+                                                   general_purpose_debounce_timer,
+                                                   adg2188_control_sw_i2c,
+                                                   tlc5955_spi_interface,
+                                                   midi_usart_interface,
+                                                   USART5);
+
+#if ENABLE_FATFS
+    // chain the bank patterns listed in song slot 0 of the library, if the card has one
+    if (song_loaded)
+    {
+      sequencer.play_song(song);
+    }
+#endif
 
     sequencer.main_loop();
     // we should never get past here
@@ -0,0 +1,69 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <critical_section.hpp>
+#include <midi_note_output.hpp>
+#include <trace.hpp>
+
+namespace bass_station
+{
+
+MidiNoteOutput::MidiNoteOutput(USART_TypeDef *usart)
+    : m_usart(*usart)
+{
+}
+
+void MidiNoteOutput::note_on(uint8_t channel, uint8_t note, uint8_t velocity)
+{
+  const uint8_t status = static_cast<uint8_t>(note_on_status | (channel & 0x0F));
+  Trace::emit(TraceId::MIDI_NOTE, status, note);
+  send_byte(status);
+  send_byte(note & 0x7F);
+  send_byte(velocity & 0x7F);
+}
+
+void MidiNoteOutput::note_off(uint8_t channel, uint8_t note)
+{
+  const uint8_t status = static_cast<uint8_t>(note_off_status | (channel & 0x0F));
+  Trace::emit(TraceId::MIDI_NOTE, status, note);
+  send_byte(status);
+  send_byte(note & 0x7F);
+  send_byte(0);
+}
+
+void MidiNoteOutput::send_byte([[maybe_unused]] uint8_t byte)
+{
+#if not defined(X86_UNIT_TESTING_ONLY)
+  while (true)
+  {
+    // check and write together, so the MIDI clock from PendSV can't take the empty TDR in between
+    CriticalSection critical_section;
+    if (m_usart.ISR & USART_ISR_TXE_TXFNF)
+    {
+      m_usart.TDR = byte;
+      return;
+    }
+  }
+#endif
+}
+
+} // namespace bass_station
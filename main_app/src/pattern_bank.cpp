@@ -0,0 +1,412 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <cstddef>
+#include <pattern_bank.hpp>
+
+namespace bass_station
+{
+
+uint16_t PackedStep::pack(const Step &step)
+{
+  uint16_t packed = static_cast<uint16_t>(step.m_note) & note_mask;
+  if (step.m_state == StepState::ON)
+  {
+    packed |= on_bit;
+  }
+  if (step.m_colour == user_select_colour)
+  {
+    packed |= selected_bit;
+  }
+  if ((step.m_ratchet > 1) && (step.m_ratchet <= max_ratchet))
+  {
+    packed |= static_cast<uint16_t>((step.m_ratchet - 1U) << ratchet_shift);
+  }
+  if (step.m_probability < probability_levels)
+  {
+    packed |= static_cast<uint16_t>(step.m_probability << probability_shift);
+  }
+  if (step.m_condition < TrigCondition::count)
+  {
+    packed |= static_cast<uint16_t>(static_cast<uint16_t>(step.m_condition) << condition_shift);
+  }
+  return packed;
+}
+
+void PackedStep::unpack(uint16_t packed, Step &step)
+{
+  const uint16_t note      = packed & note_mask;
+  const uint16_t condition = (packed & condition_mask) >> condition_shift;
+  step.m_note              = (note < static_cast<uint16_t>(Note::none)) ? static_cast<Note>(note) : Note::none;
+  step.m_state             = (packed & on_bit) ? StepState::ON : StepState::OFF;
+  step.m_colour            = (packed & selected_bit) ? user_select_colour : default_colour;
+  step.m_ratchet           = static_cast<uint8_t>(((packed & ratchet_mask) >> ratchet_shift) + 1U);
+  step.m_probability       = static_cast<uint8_t>((packed & probability_mask) >> probability_shift);
+  step.m_condition = (condition < static_cast<uint16_t>(TrigCondition::count)) ? static_cast<TrigCondition>(condition) : TrigCondition::ALWAYS;
+}
+
+void pack_pattern(const SequencerStepMap &sequencer_map, PackedPattern &pattern)
+{
+  /// @note don't use std::array.at(), this will force exception handling to bloat the linked .elf
+  for (std::size_t idx = 0; idx < pattern.size(); idx++)
+  {
+    pattern[idx] = PackedStep::pack(sequencer_map.data[idx].second);
+  }
+}
+
+void unpack_pattern(const PackedPattern &pattern, SequencerStepMap &sequencer_map)
+{
+  for (std::size_t idx = 0; idx < pattern.size(); idx++)
+  {
+    PackedStep::unpack(pattern[idx], sequencer_map.data[idx].second);
+  }
+}
+
+PatternBank::PatternBank(FlashDevice &flash)
+    : m_flash(flash)
+{
+  m_index.fill(Location{no_page, 0});
+}
+
+bool PatternBank::initialise()
+{
+  const std::size_t page_count = m_flash.page_count();
+  if (page_count < 3)
+  {
+    return false;
+  }
+
+  // find the newest record of each slot, and the page holding the newest record overall
+  m_index.fill(Location{no_page, 0});
+  std::array<uint32_t, slot_count> newest_sequence{};
+  uint32_t newest_overall{0};
+  m_active_page   = 0;
+  m_next_record   = 0;
+  m_next_sequence = 1;
+
+  for (std::size_t page = 0; page < page_count; page++)
+  {
+    if (read_header(page).m_magic != page_magic)
+    {
+      // blank, or the erase of this page was interrupted
+      if (!format_page(page))
+      {
+        return false;
+      }
+      continue;
+    }
+
+    for (std::size_t record_idx = 0; record_idx < records_per_page; record_idx++)
+    {
+      const Record record = read_record(page, record_idx);
+      if (record.m_tag == erased_tag)
+      {
+        break;
+      }
+      if (!record_valid(record))
+      {
+        // torn by a power loss
+        continue;
+      }
+      if (record.m_sequence >= newest_sequence[record.m_slot])
+      {
+        newest_sequence[record.m_slot] = record.m_sequence;
+        m_index[record.m_slot]         = Location{static_cast<uint16_t>(page), static_cast<uint16_t>(record_idx)};
+      }
+      if (record.m_sequence >= newest_overall)
+      {
+        newest_overall  = record.m_sequence;
+        m_active_page   = page;
+        m_next_sequence = record.m_sequence + 1;
+      }
+    }
+  }
+
+  // the end of the log in the active page
+  m_next_record = 0;
+  while ((m_next_record < records_per_page) && (read_record(m_active_page, m_next_record).m_tag != erased_tag))
+  {
+    m_next_record++;
+  }
+
+  // the page after the active page must be empty, finish a reclaim that was interrupted by a reset
+  const std::size_t spare_page = (m_active_page + 1) % page_count;
+  if (read_record(spare_page, 0).m_tag != erased_tag)
+  {
+    start_reclaim(spare_page);
+    return finish_job();
+  }
+  return true;
+}
+
+bool PatternBank::save(std::size_t slot, const PackedPattern &pattern, uint8_t length)
+{
+  return begin_save(slot, pattern, length) && finish_job();
+}
+
+bool PatternBank::begin_save(std::size_t slot, const PackedPattern &pattern, uint8_t length)
+{
+  if (saving() || (slot >= slot_count) || (length == 0) || (length > max_pattern_length) || (m_flash.page_count() < 3))
+  {
+    return false;
+  }
+
+  m_new_record         = Record{record_tag, static_cast<uint8_t>(slot), length, 0, pattern, 0, 0};
+  m_new_record_pending = true;
+  m_job_succeeded      = true;
+
+  if (m_next_record >= records_per_page)
+  {
+    // move the log on to the spare page, then reclaim the page after it to be the new spare
+    m_active_page = (m_active_page + 1) % m_flash.page_count();
+    m_next_record = 0;
+    start_reclaim((m_active_page + 1) % m_flash.page_count());
+  }
+  else
+  {
+    m_new_record_pending = false;
+    stage_record(m_new_record, JobState::IDLE);
+  }
+  return true;
+}
+
+bool PatternBank::service()
+{
+  switch (m_job_state)
+  {
+    case JobState::IDLE:
+      break;
+
+    case JobState::COPY_FORWARD:
+      while ((m_reclaim_slot < slot_count) && (m_index[m_reclaim_slot].m_page != m_reclaim_page))
+      {
+        m_reclaim_slot++;
+      }
+      if (m_reclaim_slot < slot_count)
+      {
+        // copy forward with a new sequence number, so after a reset part way through the copies win and the page is
+        // reclaimed again
+        stage_record(read_record(m_reclaim_page, m_index[m_reclaim_slot].m_record), JobState::COPY_FORWARD);
+        m_reclaim_slot++;
+      }
+      else
+      {
+        m_job_state = JobState::START_ERASE;
+      }
+      break;
+
+    case JobState::START_ERASE:
+      m_reclaim_header = next_header(m_reclaim_page);
+      if (page_blank(m_reclaim_page))
+      {
+        m_job_state = JobState::WRITE_HEADER;
+      }
+      else if (m_flash.start_erase(m_reclaim_page))
+      {
+        m_job_state = JobState::WAIT_ERASE;
+      }
+      else
+      {
+        fail_job();
+      }
+      break;
+
+    case JobState::WAIT_ERASE:
+      switch (m_flash.erase_status())
+      {
+        case FlashDevice::EraseStatus::BUSY:
+          break;
+        case FlashDevice::EraseStatus::DONE:
+          m_job_state = JobState::WRITE_HEADER;
+          break;
+        case FlashDevice::EraseStatus::FAILED:
+          fail_job();
+          break;
+      }
+      break;
+
+    case JobState::WRITE_HEADER:
+      if (!m_flash.program(m_reclaim_page, 0, reinterpret_cast<const uint8_t *>(&m_reclaim_header), sizeof(m_reclaim_header)))
+      {
+        fail_job();
+      }
+      else if (m_new_record_pending)
+      {
+        m_new_record_pending = false;
+        stage_record(m_new_record, JobState::IDLE);
+      }
+      else
+      {
+        m_job_state = JobState::IDLE;
+      }
+      break;
+
+    case JobState::WRITE_RECORD:
+      // the record space is used even if programming fails part way, the scan skips it by its checksum
+      if (!m_flash.program(m_active_page,
+                           sizeof(PageHeader) + m_staged_record_idx * sizeof(Record) + m_staged_offset,
+                           reinterpret_cast<const uint8_t *>(&m_staged_record) + m_staged_offset,
+                           FlashDevice::double_word_size))
+      {
+        fail_job();
+        break;
+      }
+      m_staged_offset += FlashDevice::double_word_size;
+      if (m_staged_offset == sizeof(Record))
+      {
+        // only point the index at the record once all of it is written
+        m_index[m_staged_record.m_slot] = Location{static_cast<uint16_t>(m_active_page), static_cast<uint16_t>(m_staged_record_idx)};
+        m_job_state = m_after_record;
+      }
+      break;
+  }
+  return saving();
+}
+
+bool PatternBank::load(std::size_t slot, PackedPattern &pattern) const
+{
+  if (!contains(slot))
+  {
+    return false;
+  }
+  const Location &location = m_index[slot];
+  std::memcpy(pattern.data(),
+              m_flash.read(location.m_page) + sizeof(PageHeader) + location.m_record * sizeof(Record) + offsetof(Record, m_steps),
+              sizeof(PackedPattern));
+  return true;
+}
+
+bool PatternBank::load(std::size_t slot, PackedPattern &pattern, uint8_t &length) const
+{
+  if (!load(slot, pattern))
+  {
+    return false;
+  }
+  const Location &location = m_index[slot];
+  length = m_flash.read(location.m_page)[sizeof(PageHeader) + location.m_record * sizeof(Record) + offsetof(Record, m_step_count)];
+  return true;
+}
+
+bool PatternBank::contains(std::size_t slot) const { return (slot < slot_count) && (m_index[slot].m_page != no_page); }
+
+uint32_t PatternBank::erase_count(std::size_t page) const
+{
+  const PageHeader header = read_header(page);
+  return (header.m_magic == page_magic) ? header.m_erase_count : 0;
+}
+
+PatternBank::PageHeader PatternBank::read_header(std::size_t page) const
+{
+  PageHeader header;
+  std::memcpy(&header, m_flash.read(page), sizeof(header));
+  return header;
+}
+
+PatternBank::Record PatternBank::read_record(std::size_t page, std::size_t record_idx) const
+{
+  Record record;
+  std::memcpy(&record, m_flash.read(page) + sizeof(PageHeader) + record_idx * sizeof(Record), sizeof(record));
+  return record;
+}
+
+bool PatternBank::record_valid(const Record &record)
+{
+  return (record.m_tag == record_tag) && (record.m_slot < slot_count) && (record.m_step_count != 0) && (record.m_step_count <= max_pattern_length) &&
+         (record.m_checksum == checksum(record));
+}
+
+uint32_t PatternBank::checksum(const Record &record)
+{
+  // FNV-1a over everything before m_checksum
+  uint32_t hash = 2166136261U;
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&record);
+  for (std::size_t idx = 0; idx < offsetof(Record, m_checksum); idx++)
+  {
+    hash = (hash ^ bytes[idx]) * 16777619U;
+  }
+  return hash;
+}
+
+bool PatternBank::page_blank(std::size_t page) const
+{
+  const uint8_t *bytes = m_flash.read(page);
+  for (std::size_t idx = 0; idx < FlashDevice::page_size; idx++)
+  {
+    if (bytes[idx] != FlashDevice::erased_byte)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool PatternBank::format_page(std::size_t page)
+{
+  const PageHeader new_header = next_header(page);
+  if (!page_blank(page) && !m_flash.erase(page))
+  {
+    return false;
+  }
+  return m_flash.program(page, 0, reinterpret_cast<const uint8_t *>(&new_header), sizeof(new_header));
+}
+
+PatternBank::PageHeader PatternBank::next_header(std::size_t page) const
+{
+  // carry the erase count over, it is lost if the previous erase was interrupted
+  const PageHeader old_header = read_header(page);
+  return PageHeader{page_magic, (old_header.m_magic == page_magic) ? old_header.m_erase_count + 1 : 1};
+}
+
+void PatternBank::stage_record(const Record &record, JobState after_record)
+{
+  m_staged_record            = record;
+  m_staged_record.m_sequence = m_next_sequence++;
+  m_staged_record.m_checksum = checksum(m_staged_record);
+  m_staged_record_idx        = m_next_record++;
+  m_staged_offset            = 0;
+  m_after_record             = after_record;
+  m_job_state                = JobState::WRITE_RECORD;
+}
+
+void PatternBank::start_reclaim(std::size_t page)
+{
+  m_reclaim_page = page;
+  m_reclaim_slot = 0;
+  m_job_state    = JobState::COPY_FORWARD;
+}
+
+void PatternBank::fail_job()
+{
+  m_job_succeeded      = false;
+  m_new_record_pending = false;
+  m_job_state          = JobState::IDLE;
+}
+
+bool PatternBank::finish_job()
+{
+  while (service())
+  {
+  }
+  return m_job_succeeded;
+}
+
+} // namespace bass_station
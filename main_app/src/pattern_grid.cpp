@@ -0,0 +1,152 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <pattern_grid.hpp>
+
+namespace bass_station
+{
+
+namespace
+{
+/// @brief The note band of each of the 25 notes, precomputed so update() needs no division per cell
+constexpr std::array<uint8_t, Note::none> note_band_table = []() {
+  std::array<uint8_t, Note::none> table{};
+  for (uint8_t note = 0; note < table.size(); note++)
+  {
+    table[note] = static_cast<uint8_t>(note * PatternGrid::roll_bands / table.size());
+  }
+  return table;
+}();
+
+/// @brief Glyphs with increasing vertical position in the Font5x7 character cell
+constexpr std::array<char, PatternGrid::roll_levels_per_line> roll_level_glyphs{'_', '-', '\''};
+
+/// @brief Piano roll frame value for a column that has not been drawn since invalidate()
+constexpr uint8_t roll_unknown{0xFF};
+} // namespace
+
+void PatternGrid::invalidate()
+{
+  m_grid_frame.fill(cell_invalid);
+  m_roll_frame.fill(roll_unknown);
+}
+
+char PatternGrid::grid_glyph(uint8_t cell)
+{
+  if (cell & cell_selected)
+  {
+    return (cell & cell_on) ? '@' : 'o';
+  }
+  return (cell & cell_on) ? '#' : '.';
+}
+
+uint8_t PatternGrid::update(SequencerStepMap &sequencer_map,
+                            uint8_t cursor_idx,
+                            uint8_t selected_idx,
+                            std::array<DirtyCell, max_dirty_cells> &dirty_cells)
+{
+  uint8_t dirty_count{0};
+
+  // grid: the upper row (step map 16-31) is drawn on the first line, the lower row (step map 0-15) on the second line
+  for (uint8_t idx = 0; idx < m_grid_frame.size(); idx++)
+  {
+    /// @note don't use std::array.at(), this will force exception handling to bloat the linked .elf
+    const Step &step = sequencer_map.data[idx].second;
+
+    uint8_t cell{0};
+    if (step.m_state == StepState::ON)
+    {
+      cell |= cell_on;
+    }
+    if (idx == cursor_idx)
+    {
+      cell |= cell_cursor;
+    }
+    if (idx == selected_idx)
+    {
+      cell |= cell_selected;
+    }
+
+    if (cell != m_grid_frame[idx])
+    {
+      m_grid_frame[idx]           = cell;
+      dirty_cells[dirty_count++] = DirtyCell{Area::GRID,
+                                             static_cast<uint8_t>((idx < grid_columns) ? 1 : 0),
+                                             static_cast<uint8_t>(idx % grid_columns),
+                                             grid_glyph(cell),
+                                             static_cast<bool>(cell & cell_cursor)};
+    }
+  }
+
+  // piano roll: show the note height of each step in the row holding the cursor
+  const uint8_t roll_row_base = (cursor_idx < grid_columns) ? 0 : grid_columns;
+  for (uint8_t column = 0; column < grid_columns; column++)
+  {
+    /// @note don't use std::array.at(), this will force exception handling to bloat the linked .elf
+    const Step &step = sequencer_map.data[roll_row_base + column].second;
+
+    uint8_t roll{0};
+    if ((step.m_state == StepState::ON) && (step.m_note < Note::none))
+    {
+      roll = static_cast<uint8_t>(note_band_table[step.m_note] + 1);
+    }
+
+    const uint8_t previous_roll = m_roll_frame[column];
+    if (roll == previous_roll)
+    {
+      continue;
+    }
+    m_roll_frame[column] = roll;
+
+    // the top band is drawn on the first roll line
+    const uint8_t new_line = (roll == 0) ? roll_lines : static_cast<uint8_t>(roll_lines - 1 - (roll - 1) / roll_levels_per_line);
+
+    if (previous_roll == roll_unknown)
+    {
+      // screen content is unknown so redraw every line of the column
+      for (uint8_t line = 0; line < roll_lines; line++)
+      {
+        const char glyph = (line == new_line) ? roll_level_glyphs[(roll - 1) % roll_levels_per_line] : ' ';
+        dirty_cells[dirty_count++] = DirtyCell{Area::ROLL, line, column, glyph, false};
+      }
+      continue;
+    }
+
+    if (previous_roll != 0)
+    {
+      const uint8_t old_line = static_cast<uint8_t>(roll_lines - 1 - (previous_roll - 1) / roll_levels_per_line);
+      if (old_line != new_line)
+      {
+        // erase the glyph from the line it was drawn on
+        dirty_cells[dirty_count++] = DirtyCell{Area::ROLL, old_line, column, ' ', false};
+      }
+    }
+    if (roll != 0)
+    {
+      dirty_cells[dirty_count++] = DirtyCell{Area::ROLL, new_line, column, roll_level_glyphs[(roll - 1) % roll_levels_per_line], false};
+    }
+  }
+
+  return dirty_count;
+}
+
+} // namespace bass_station
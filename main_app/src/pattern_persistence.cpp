@@ -0,0 +1,84 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <pattern_persistence.hpp>
+#include <usec_clock.hpp>
+
+namespace bass_station
+{
+
+PatternPersistence::PatternPersistence(PatternStore &store, std::size_t slot)
+    : m_store(store),
+      m_slot(slot)
+{
+}
+
+void PatternPersistence::mark_dirty()
+{
+  m_dirty          = true;
+  m_dirty_since_us = UsecClock::now();
+}
+
+void PatternPersistence::service(const SequencerStepMap &sequencer_map, uint8_t length)
+{
+  if (m_dirty && !m_store.saving() && (UsecClock::elapsed(m_dirty_since_us) >= m_settle_time_us))
+  {
+    // snapshot; edits made while it is written mark the pattern dirty again for the next save
+    PackedPattern snapshot;
+    pack_pattern(sequencer_map, snapshot);
+    m_save_running = m_store.begin_save(m_slot, snapshot, length);
+    m_dirty        = false;
+    if (!m_save_running)
+    {
+      // the store refused the save (e.g. the flash region is unavailable), so retrying every loop would only keep
+      // the main loop from sleeping. Count it, the next edit tries again.
+      m_failed_saves++;
+    }
+  }
+
+  const uint32_t slice_start_us = UsecClock::now();
+  while (m_store.saving() && !m_store.erasing() && (UsecClock::elapsed(slice_start_us) < m_slice_budget_us))
+  {
+    m_store.service();
+  }
+  if (m_store.erasing())
+  {
+    // one poll per call, the erase carries on by itself
+    m_store.service();
+  }
+
+  if (m_save_running && !m_store.saving())
+  {
+    m_save_running = false;
+    if (!m_store.last_save_succeeded())
+    {
+      m_failed_saves++;
+    }
+  }
+}
+
+bool PatternPersistence::work_pending() const
+{
+  return m_store.saving() || (m_dirty && (UsecClock::elapsed(m_dirty_since_us) >= m_settle_time_us));
+}
+
+} // namespace bass_station
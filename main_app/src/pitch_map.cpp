@@ -0,0 +1,128 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <pitch_map.hpp>
+
+namespace bass_station
+{
+
+namespace
+{
+constexpr int semitones_per_octave{12};
+constexpr int top_key{static_cast<int>(Note::c2)};
+} // namespace
+
+PitchMap::PitchMap(const std::array<NoteData, Note::none> &note_data)
+    : m_note_data(note_data)
+{
+  build();
+}
+
+bool PitchMap::set(Scale scale, uint8_t root, int8_t transpose)
+{
+  if ((scale >= Scale::count) || (root >= semitones_per_octave) || (transpose < -max_transpose) || (transpose > max_transpose))
+  {
+    return false;
+  }
+  m_scale     = scale;
+  m_root      = root;
+  m_transpose = transpose;
+  build();
+  return true;
+}
+
+bool PitchMap::in_scale(Note note) const { return (note < Note::none) && in_scale(static_cast<int>(note)); }
+
+bool PitchMap::in_scale(int key) const
+{
+  const int degree = (key - m_root + semitones_per_octave) % semitones_per_octave;
+  /// @note don't use std::array.at(), this will force exception handling to bloat the linked .elf
+  return ((m_scale_masks[static_cast<std::size_t>(m_scale)] >> degree) & 1U) != 0;
+}
+
+Note PitchMap::next_note(Note note) const
+{
+  const int from = (note >= Note::none) ? -1 : static_cast<int>(note);
+  for (int key = from + 1; key <= top_key; key++)
+  {
+    if (in_scale(key))
+    {
+      return static_cast<Note>(key);
+    }
+  }
+  return note;
+}
+
+Note PitchMap::previous_note(Note note) const
+{
+  if (note >= Note::none)
+  {
+    return Note::none;
+  }
+  for (int key = static_cast<int>(note) - 1; key >= 0; key--)
+  {
+    if (in_scale(key))
+    {
+      return static_cast<Note>(key);
+    }
+  }
+  return note;
+}
+
+void PitchMap::build()
+{
+  for (int note = 0; note <= top_key; note++)
+  {
+    // transpose, folding back onto the keyboard by octaves
+    int key = note + m_transpose;
+    while (key < 0)
+    {
+      key += semitones_per_octave;
+    }
+    while (key > top_key)
+    {
+      key -= semitones_per_octave;
+    }
+
+    // then the nearest key in the scale, the lower one first. Every scale has a note in each octave.
+    int played = key;
+    for (int distance = 0; distance < semitones_per_octave; distance++)
+    {
+      if ((key - distance >= 0) && in_scale(key - distance))
+      {
+        played = key - distance;
+        break;
+      }
+      if ((key + distance <= top_key) && in_scale(key + distance))
+      {
+        played = key + distance;
+        break;
+      }
+    }
+
+    /// @note don't use std::array.at(), this will force exception handling to bloat the linked .elf
+    m_notes[static_cast<std::size_t>(note)] = static_cast<Note>(played);
+    m_poles[static_cast<std::size_t>(note)] = m_note_data[static_cast<std::size_t>(played)].m_sw;
+  }
+}
+
+} // namespace bass_station
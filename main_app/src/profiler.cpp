@@ -0,0 +1,95 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <critical_section.hpp>
+#include <profiler.hpp>
+
+#if defined(USE_RTT)
+  #include <SEGGER_RTT.h>
+#endif
+
+namespace bass_station
+{
+
+namespace
+{
+/// @brief Zone names for the RTT dump, in ProfileZone order
+constexpr std::array<const char *, static_cast<std::size_t>(ProfileZone::COUNT)> zone_names{
+    "display", "keypad", "sequencer", "tempo_isr", "tempo_deferred", "encoder_isr", "encoder_deferred"};
+} // namespace
+
+void Profiler::record(ProfileZone zone, uint32_t elapsed_us)
+{
+  /// @note don't use std::array.at(), this will force exception handling to bloat the linked .elf
+  Slot &slot = m_slots[static_cast<std::size_t>(zone)];
+  slot.m_total_us += elapsed_us;
+  slot.m_count++;
+  if (elapsed_us > slot.m_max_us)
+  {
+    slot.m_max_us = elapsed_us;
+  }
+}
+
+bool Profiler::update_window()
+{
+  const uint32_t window_us = UsecClock::elapsed(m_window_start_us);
+  if (window_us < m_window_length_us)
+  {
+    return false;
+  }
+
+  {
+    // the ISR zones are written from interrupt context, take them and restart them together
+    CriticalSection critical_section;
+    m_report.m_slots = m_slots;
+    m_slots.fill(Slot{0, 0, 0});
+  }
+  m_window_start_us += window_us;
+  m_report.m_window_us = window_us;
+
+  for (std::size_t zone = 0; zone < m_report.m_slots.size(); zone++)
+  {
+    const uint32_t percent        = (m_report.m_slots[zone].m_total_us * 100U) / window_us;
+    m_report.m_load_percent[zone] = static_cast<uint8_t>((percent > 100U) ? 100U : percent);
+  }
+  return true;
+}
+
+void Profiler::dump_rtt(uint8_t cpu_load_percent [[maybe_unused]])
+{
+#if defined(USE_RTT)
+  SEGGER_RTT_printf(0, "--- window %uus cpu %u%% ---\n", static_cast<unsigned>(m_report.m_window_us), static_cast<unsigned>(cpu_load_percent));
+  for (std::size_t zone = 0; zone < m_report.m_slots.size(); zone++)
+  {
+    const Slot &slot = m_report.m_slots[zone];
+    SEGGER_RTT_printf(0,
+                      "%s: %u%% total %uus max %uus count %u\n",
+                      zone_names[zone],
+                      static_cast<unsigned>(m_report.m_load_percent[zone]),
+                      static_cast<unsigned>(slot.m_total_us),
+                      static_cast<unsigned>(slot.m_max_us),
+                      static_cast<unsigned>(slot.m_count));
+  }
+#endif
+}
+
+} // namespace bass_station
@@ -0,0 +1,146 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <critical_section.hpp>
+#include <ratchet_scheduler.hpp>
+
+namespace bass_station
+{
+
+RatchetScheduler::RatchetScheduler(TIM_TypeDef &tempo_timer)
+    : m_timer(tempo_timer)
+{
+}
+
+void RatchetScheduler::reset(uint32_t step_counts)
+{
+  cancel();
+  m_period_start_counts = 0;
+  m_period_counts       = m_timer.ARR + 1U;
+  m_step_counts         = step_counts;
+  m_steps_started       = 0;
+}
+
+bool RatchetScheduler::schedule(uint16_t step_number, adg2188::Driver::Pole pole, uint8_t ratchet)
+{
+  if ((ratchet < 2) || (ratchet > max_ratchet))
+  {
+    return false;
+  }
+
+  CriticalSection critical_section;
+  if (step_number != steps_started())
+  {
+    // the main loop is late, the next step has already started
+    return false;
+  }
+
+  // trigger n of the step is at n/ratchet of it, the note is released a little before each one
+  const uint32_t sub_step_counts = m_step_counts / ratchet;
+  const uint32_t release_counts  = sub_step_counts / release_divisor;
+  std::size_t event_count        = 0;
+  for (uint32_t trigger = 1; trigger < ratchet; trigger++)
+  {
+    m_events[event_count++] = Event{(trigger * sub_step_counts) - release_counts, false};
+    m_events[event_count++] = Event{trigger * sub_step_counts, true};
+  }
+  m_pole = pole;
+
+  // drop the events that have already passed. The interrupt is masked, so the counter is read against the current
+  // period
+  const uint32_t now_counts = m_period_start_counts + m_timer.CNT;
+  std::size_t next_event    = 0;
+  while ((next_event < event_count) && (m_events[next_event].m_counts <= now_counts))
+  {
+    next_event++;
+  }
+  m_event_count = event_count;
+  m_next_event  = next_event;
+  arm();
+  return m_next_event < m_event_count;
+}
+
+void RatchetScheduler::cancel()
+{
+  CriticalSection critical_section;
+  m_event_count = 0;
+  m_next_event  = 0;
+  arm();
+}
+
+bool RatchetScheduler::timer_update(bool step_started, uint32_t step_counts)
+{
+  if (step_started)
+  {
+    m_period_start_counts = 0;
+    m_step_counts         = step_counts;
+    m_steps_started       = m_steps_started + 1;
+    m_event_count         = 0;
+    m_next_event          = 0;
+  }
+  else
+  {
+    m_period_start_counts = m_period_start_counts + m_period_counts;
+  }
+  m_period_counts = m_timer.ARR + 1U;
+
+  // an event missed at the end of the last period (CCR1 written just too late) is played now
+  const bool fired = fire_due(m_period_start_counts);
+  arm();
+  return fired;
+}
+
+bool RatchetScheduler::timer_compare()
+{
+  const bool fired = fire_due(m_period_start_counts + m_timer.CNT);
+  arm();
+  return fired;
+}
+
+bool RatchetScheduler::fire_due(uint32_t now_counts)
+{
+  bool fired = false;
+  while ((m_next_event < m_event_count) && (m_events[m_next_event].m_counts <= now_counts))
+  {
+    m_fired_gates.push(Gate{m_pole, m_events[m_next_event].m_close});
+    m_next_event = m_next_event + 1;
+    fired        = true;
+  }
+  return fired;
+}
+
+void RatchetScheduler::arm()
+{
+  if ((m_next_event < m_event_count) && (m_events[m_next_event].m_counts < m_period_start_counts + m_period_counts))
+  {
+    m_timer.CCR1 = m_events[m_next_event].m_counts - m_period_start_counts;
+    // CC1IF is set on every match, even with the interrupt disabled. Clear it (rc_w0) so only this match interrupts.
+    m_timer.SR   = static_cast<uint32_t>(~TIM_SR_CC1IF);
+    m_timer.DIER = m_timer.DIER | TIM_DIER_CC1IE;
+  }
+  else
+  {
+    m_timer.DIER = m_timer.DIER & ~TIM_DIER_CC1IE;
+  }
+}
+
+} // namespace bass_station
@@ -20,15 +20,43 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
+#include <deferred_work.hpp>
+#include <flight_recorder.hpp>
+#include <input_recorder.hpp>
 #include <limits>
+#include <profiler.hpp>
+#if not defined(X86_UNIT_TESTING_ONLY)
+  // used for the ADP5587 INT pin definition
+  #pragma GCC diagnostic push
+  #pragma GCC diagnostic ignored "-Wvolatile"
+  #include <main.h>
+  #pragma GCC diagnostic pop
+#endif
 #include <sequence_manager.hpp>
 #include <timer_manager.hpp>
 #include <tlc5955.hpp>
+#include <trace.hpp>
+#include <usec_clock.hpp>
 
 /// @brief Cycle sequencer LEDs through primary/secondary colours. Warning, this will replace normal sequencer function.
 #define LED_TEST 0
 /// @brief Automatically start the sequencer on startup. No user input required.
 #define SEQUENCER_AUTOSTART_ON_BOOT 0
+/// @brief Show the graphical 32-step pattern view on the OLED instead of the text view
+#define DISPLAY_PATTERN_VIEW 1
+/// @brief Sleep (WFI) at the end of each main loop iteration until there is new work
+#define SLEEP_ON_IDLE 1
+// @brief Show the per-subsystem load from the Profiler on the bottom OLED line instead of the status/CPU line
+#define PROFILER_OVERLAY 0
+/// @brief Play the live pattern polymetrically on the MIDI tracks (see SequenceManager::m_midi_tracks) as well
+#define MIDI_NOTE_TRACKS 0
+/// @brief The swing at power on, 50 (straight) to 75 percent. See SwingEngine.
+#define SWING_PERCENT 50
+/// @brief The scale (a PitchMap::Scale), its root (0 is C) and the transpose in semitones at power on. PITCH mode
+/// changes them.
+#define QUANTISE_SCALE CHROMATIC
+#define SCALE_ROOT 0
+#define TRANSPOSE 0
 
 namespace bass_station
 {
@@ -40,7 +68,8 @@ SequenceManager::SequenceManager(tempo_timer_pair_t tempo_timer_pair,
                                  TIM_TypeDef *debounce_timer,
                                  I2C_TypeDef *adg2188_control_sw_i2c,
                                  tlc5955::DriverSerialInterface &led_spi_interface,
-                                 midi_stm32::DeviceInterface<STM32G0_ISR> &midi_usart_interface)
+                                 midi_stm32::DeviceInterface<STM32G0_ISR> &midi_usart_interface,
+                                 USART_TypeDef *midi_note_usart)
 
     : m_tempo_timer_device(*tempo_timer_pair.first),
       m_tempo_timer_isr(tempo_timer_pair.second),
@@ -50,8 +79,21 @@ SequenceManager::SequenceManager(tempo_timer_pair_t tempo_timer_pair,
       m_synth_control_switch(adg2188::Driver(adg2188_control_sw_i2c)),
       m_led_manager(bass_station::LedManager(led_spi_interface)),
       m_midi_driver(midi_usart_interface),
+      m_midi_note_output(midi_note_usart),
       m_debounce_timer(*debounce_timer)
 {
+  m_midi_playing_notes.fill(no_midi_note);
+  for (std::size_t track = 1; track < TrackEngine::track_count; track++)
+  {
+    /// @note don't use std::array.at(), this will force exception handling to bloat the linked .elf
+    m_track_engine.set_length(track, m_midi_tracks[track - 1].m_length);
+    m_track_engine.set_divider(track, m_midi_tracks[track - 1].m_divider);
+#if MIDI_NOTE_TRACKS
+    m_track_engine.set_enabled(track, true);
+#endif
+  }
+  m_swing_engine.set_swing(SWING_PERCENT);
+  m_pitch_map.set(PitchMap::Scale::QUANTISE_SCALE, SCALE_ROOT, TRANSPOSE);
 
 #if not defined(X86_UNIT_TESTING_ONLY)
 
@@ -64,6 +106,28 @@ SequenceManager::SequenceManager(tempo_timer_pair_t tempo_timer_pair,
   // execute_next_sequence_step())
   m_led_manager.set_both_rows_with_step_sequence_mapping(m_sequencer_step_map);
 
+#endif
+
+  show_crash_log();
+
+  // restore the pattern saved in slot 0, if there is one
+  if (m_pattern_bank.initialise())
+  {
+    PackedPattern saved_pattern;
+    uint8_t saved_length;
+    if (m_pattern_bank.load(0, saved_pattern, saved_length))
+    {
+      unpack_pattern(saved_pattern, m_sequencer_step_map);
+      m_track_engine.set_length(synth_track, saved_length);
+    }
+  }
+
+#if DISPLAY_PATTERN_VIEW
+  m_ssd1306_display_spi.set_view(DisplayManager::View::PATTERN);
+#endif
+
+#if SLEEP_ON_IDLE
+  m_idle_monitor.initialise();
 #endif
 }
 
@@ -74,6 +138,16 @@ void SequenceManager::main_loop()
 #endif
 #if SEQUENCER_AUTOSTART_ON_BOOT
 
+  // start the tempo timer at the beginning of a swing pair
+  m_swing_engine.reset();
+  m_tempo_timer_device.ARR = m_swing_engine.reload();
+  m_ratchet_scheduler.reset(m_swing_engine.step_counts());
+  m_step_started = true;
+  m_trig_engine.reset();
+  decide_step_trig();
+  m_live_recorder.reset();
+  m_live_recorder.step_started(UsecClock::now(), m_swing_engine.step_counts());
+
   // enable the tempo timer with update interrupt
   m_tempo_timer_device.DIER = m_tempo_timer_device.DIER | TIM_DIER_UIE;
   m_tempo_timer_device.CR1  = m_tempo_timer_device.CR1 | TIM_CR1_CEN;
@@ -83,6 +157,7 @@ void SequenceManager::main_loop()
 
   // start the midi device early so that it synchronizes correctly
   m_midi_driver.send_realtime_start_msg();
+  Trace::emit(TraceId::MIDI_BYTE, static_cast<uint16_t>(TraceMidiByte::START), m_midi_driver.get_midi_pulse_cnt());
 
 #endif
 
@@ -90,137 +165,623 @@ void SequenceManager::main_loop()
   /// @return never
   while (true)
   {
-    // probably needs its own timer callback as this will become less responsive at slower tempos
+    main_loop_iteration();
+
+#if SLEEP_ON_IDLE
+    // nothing changes until an interrupt arrives, so sleep rather than redraw the same frame again
+    m_idle_monitor.sleep_while_idle([this]() { return work_pending(); });
+#endif
+  }
+}
+
+void SequenceManager::main_loop_iteration()
+{
+  // apply the step advances and mode changes posted by the ISRs since the last iteration
+  process_events();
+
+  // probably needs its own timer callback as this will become less responsive at slower tempos
+  {
+    Profiler::Scope zone(ProfileZone::DISPLAY);
     update_display_and_tempo();
+  }
 
-    // get latest key events from adp5587 (the sequencer pattern button presses (m_sequencer_step_map) and the user
-    // start/stop buttons (return))
-    SequencerState current_sequencer_state = m_adp5587_keypad_i2c.update_sequencer_map(m_sequencer_step_map);
+  // the step keys play notes into the pattern while the sequencer runs in RECORD mode
+  m_live_recording                 = (m_current_mode == Mode::RECORD) && (m_sequencer_state == SequencerState::RUNNING);
+  m_adp5587_keypad_i2c.record_mode = m_live_recording;
+  m_adp5587_keypad_i2c.undo_mode   = (m_current_mode == Mode::UNDO);
+  m_adp5587_keypad_i2c.pitch_mode  = (m_current_mode == Mode::PITCH);
 
-    // update the midi running state/heartbeat
-    switch (current_sequencer_state)
-    {
-      case SequencerState::RUNNING:
+  // get latest key events from adp5587 (the sequencer pattern button presses (m_sequencer_step_map) and the user
+  // start/stop buttons (return))
+  SequencerState current_sequencer_state;
+  {
+    Profiler::Scope zone(ProfileZone::KEYPAD);
+    current_sequencer_state = m_adp5587_keypad_i2c.update_sequencer_map(*m_active_step_map, m_undo_journal);
+  }
+  if (m_adp5587_keypad_i2c.pattern_changed)
+  {
+    m_adp5587_keypad_i2c.pattern_changed = false;
+    mark_pattern_dirty();
+  }
+  if (m_adp5587_keypad_i2c.randomise_requested)
+  {
+    m_adp5587_keypad_i2c.randomise_requested = false;
+    randomise_pattern(m_adp5587_keypad_i2c.randomise_seed);
+  }
+  if (m_adp5587_keypad_i2c.next_scale_requested)
+  {
+    m_adp5587_keypad_i2c.next_scale_requested = false;
+    const auto next_scale = (static_cast<std::size_t>(m_pitch_map.scale()) + 1U) % static_cast<std::size_t>(PitchMap::Scale::count);
+    set_scale(static_cast<PitchMap::Scale>(next_scale), m_pitch_map.root());
+  }
+  if (m_adp5587_keypad_i2c.next_root_requested)
+  {
+    m_adp5587_keypad_i2c.next_root_requested = false;
+    set_scale(m_pitch_map.scale(), static_cast<uint8_t>((m_pitch_map.root() + 1U) % m_root_names.size()));
+  }
+  if (m_adp5587_keypad_i2c.fill != m_trig_engine.fill())
+  {
+    m_trig_engine.set_fill(m_adp5587_keypad_i2c.fill);
+  }
+  for (std::size_t idx = 0; idx < m_adp5587_keypad_i2c.recorded_press_count; idx++)
+  {
+    /// @note don't use std::array.at(), this will force exception handling to bloat the linked .elf
+    record_note(m_adp5587_keypad_i2c.recorded_presses[idx]);
+  }
+  m_adp5587_keypad_i2c.recorded_press_count = 0;
+  if (m_adp5587_keypad_i2c.tempo_tapped)
+  {
+    m_adp5587_keypad_i2c.tempo_tapped = false;
+    apply_tapped_tempo();
+  }
 
-        // either recently booted or user reset the position with stop button
-        if (m_sequence_position == 0)
-        {
-          // reset the 1/12 MIDI heartbeat count
-          m_midi_driver.reset_midi_pulse_cnt();
+  // update the midi running state/heartbeat
+  switch (current_sequencer_state)
+  {
+    case SequencerState::RUNNING:
 
-          // tell MIDI slave device to start its pattern from beginning (restart)
-          m_midi_driver.send_realtime_start_msg();
+      // either recently booted or user reset the position with stop button
+      if (m_track_engine.ticks() == 0)
+      {
+        // reset the 1/12 MIDI heartbeat count
+        m_midi_driver.reset_midi_pulse_cnt();
+
+        // the first step plays straight, the swing pair starts with it
+        m_swing_engine.reset();
+        m_tempo_timer_device.ARR = m_swing_engine.reload();
+        m_ratchet_scheduler.reset(m_swing_engine.step_counts());
+        m_step_number  = 0;
+        m_step_started = true;
+
+        // the trig draws start again from the seed, so a replayed session makes the same decisions
+        m_trig_engine.reset();
+        decide_step_trig();
+
+        // the first step starts with the timer
+        m_live_recorder.reset();
+        m_live_recorder.step_started(UsecClock::now(), m_swing_engine.step_counts());
+
+        // tell MIDI slave device to start its pattern from beginning (restart)
+        m_midi_driver.send_realtime_start_msg();
+        Trace::emit(TraceId::MIDI_BYTE, static_cast<uint16_t>(TraceMidiByte::START), m_midi_driver.get_midi_pulse_cnt());
+
+        // enable the timer with update interrupt
+        m_tempo_timer_device.DIER = m_tempo_timer_device.DIER | TIM_DIER_UIE;
+        m_tempo_timer_device.CR1  = m_tempo_timer_device.CR1 | TIM_CR1_CEN;
+
+        m_midi_state      = SequencerState::RUNNING;
+        m_sequencer_state = SequencerState::RUNNING;
+      }
+      else // resume/continue
+      {
+        // NOTE: to avoid MIDI/Sequencer sync issues, we don't reset the 1/12 MIDI heartbeat count on
+        // continue/resume
 
-          // enable the timer with update interrupt
-          m_tempo_timer_device.DIER = m_tempo_timer_device.DIER | TIM_DIER_UIE;
-          m_tempo_timer_device.CR1  = m_tempo_timer_device.CR1 | TIM_CR1_CEN;
+        // tell MIDI slave device to continue its pattern from where it was stopped (resume)
+        m_midi_driver.send_realtime_continue_msg();
+        Trace::emit(TraceId::MIDI_BYTE, static_cast<uint16_t>(TraceMidiByte::CONTINUE), m_midi_driver.get_midi_pulse_cnt());
 
-          m_midi_state      = SequencerState::RUNNING;
-          m_sequencer_state = SequencerState::RUNNING;
-        }
-        else // resume/continue
-        {
-          // NOTE: to avoid MIDI/Sequencer sync issues, we don't reset the 1/12 MIDI heartbeat count on
-          // continue/resume
+        // enable the timer with update interrupt
+        m_tempo_timer_device.DIER = m_tempo_timer_device.DIER | TIM_DIER_UIE;
+        m_tempo_timer_device.CR1  = m_tempo_timer_device.CR1 | TIM_CR1_CEN;
 
-          // tell MIDI slave device to continue its pattern from where it was stopped (resume)
-          m_midi_driver.send_realtime_continue_msg();
+        m_midi_state      = SequencerState::RUNNING;
+        m_sequencer_state = SequencerState::RUNNING;
+      }
 
-          // enable the timer with update interrupt
-          m_tempo_timer_device.DIER = m_tempo_timer_device.DIER | TIM_DIER_UIE;
-          m_tempo_timer_device.CR1  = m_tempo_timer_device.CR1 | TIM_CR1_CEN;
+      break;
+    case SequencerState::STOPPED:
+
+      // disable the timer with update interrupt
+      m_tempo_timer_device.DIER = m_tempo_timer_device.DIER & ~TIM_DIER_UIE;
+      m_tempo_timer_device.CR1  = m_tempo_timer_device.CR1 & ~TIM_CR1_CEN;
+
+      // Tell the MIDI slave device to pause
+      m_midi_driver.send_realtime_stop_msg();
+      Trace::emit(TraceId::MIDI_BYTE, static_cast<uint16_t>(TraceMidiByte::STOP), m_midi_driver.get_midi_pulse_cnt());
+
+      // silence any synth key/notes that are still sounding, once the retriggers can't close them again
+      m_ratchet_scheduler.cancel();
+      m_ratchets_playing = false;
+      m_synth_control_switch.clear_all();
+      Trace::emit(TraceId::SWITCH_CLEAR);
+      silence_midi_tracks();
+
+      // a tapped tempo that was waiting for the next step takes over now
+      uint16_t tapped_prescaler;
+      if (m_swing_engine.flush_prescaler(tapped_prescaler))
+      {
+        m_tempo_timer_device.PSC = tapped_prescaler;
+      }
 
-          m_midi_state      = SequencerState::RUNNING;
-          m_sequencer_state = SequencerState::RUNNING;
+      // before state update, if sequencer state is already stopped reset pattern position
+      if (m_sequencer_state == SequencerState::STOPPED)
+      {
+        m_track_engine.reset();
+        m_sequence_position = 0;
+        // and the song goes back to its first pattern
+        if (m_song_player.playing())
+        {
+          m_song_player.restart(*m_active_step_map);
+          m_track_engine.set_length(synth_track, m_song_player.pattern_length());
+          m_undo_journal.clear();
         }
+      }
 
-        break;
-      case SequencerState::STOPPED:
+      // now update the states
+      m_midi_state      = SequencerState::STOPPED;
+      m_sequencer_state = SequencerState::STOPPED;
+
+      break;
+    case SequencerState::IDLE:
+      // do nothing
+      break;
+  }
+
+  // update the pattern LEDs and trigger synth key/note if running
+  {
+    Profiler::Scope zone(ProfileZone::SEQUENCER);
+    increment_sequencer();
+  }
+
+  // write a slice of any pattern save, after the step has been played
+  m_pattern_persistence.service(*m_active_step_map, m_track_engine.length(synth_track));
+
+  // get the next pattern of the song ready in the shadow map before the bar ends
+  m_song_player.prefetch(*m_shadow_step_map);
+
+  // report the time spent in each subsystem and the key latency once a second
+  if (Profiler::update_window())
+  {
+#if PROFILER_OVERLAY
+    noarch::containers::StaticString<20> overlay_line("                   ");
+    Profiler::format_overlay(overlay_line);
+    m_ssd1306_display_spi.set_display_line(DisplayManager::DisplayLine::LINE_SIX, overlay_line);
+#endif
+    Profiler::dump_rtt(m_idle_monitor.cpu_load_percent());
+    m_adp5587_keypad_i2c.key_latency.dump_rtt();
+  }
+}
+
+bool SequenceManager::work_pending()
+{
+  // step advances and mode changes from the interrupt bottom halves
+  if (!m_event_queue.empty())
+  {
+    return true;
+  }
+
+  // a pattern save is waiting to start or part way through
+  if (m_pattern_persistence.work_pending())
+  {
+    return true;
+  }
+
+  // the next pattern of the song has not been decoded yet
+  if (m_song_player.prefetch_pending())
+  {
+    return true;
+  }
+
+  // the encoder has no interrupt, SysTick wakes the core to poll it
+  if (m_sequencer_encoder_timer.CNT != m_idle_encoder_count)
+  {
+    return true;
+  }
+
+#if not defined(X86_UNIT_TESTING_ONLY)
+  // the ADP5587 holds INT low until its key event FIFO has been read
+  if ((I2C3_INT_GPIO_Port->IDR & I2C3_INT_Pin) == 0)
+  {
+    return true;
+  }
+#endif
+
+  return false;
+}
+
+void SequenceManager::tempo_timer_isr()
+{
+#if not defined(X86_UNIT_TESTING_ONLY)
+  // the flags are rc_w0: clear just the ones being handled, so an update or match that happens meanwhile isn't lost
+  const uint32_t pending = m_tempo_timer_device.SR & m_tempo_timer_device.DIER;
+  if (pending & TIM_SR_CC1IF)
+  {
+    m_tempo_timer_device.SR = static_cast<uint32_t>(~TIM_SR_CC1IF);
+    ratchet_compare_isr();
+  }
+  if ((pending & TIM_SR_UIF) == 0)
+  {
+    return;
+  }
+  // reset the UIF bit to re-enable interrupts
+  m_tempo_timer_device.SR = static_cast<uint32_t>(~TIM_SR_UIF);
+#endif
+  tempo_update_isr();
+}
 
-        // disable the timer with update interrupt
-        m_tempo_timer_device.DIER = m_tempo_timer_device.DIER & ~TIM_DIER_UIE;
-        m_tempo_timer_device.CR1  = m_tempo_timer_device.CR1 & ~TIM_CR1_CEN;
+void SequenceManager::tempo_update_isr()
+{
+  const uint32_t timestamp_us = UsecClock::now();
+  Profiler::Scope zone(ProfileZone::TEMPO_ISR);
+  Trace::emit(TraceId::TEMPO_ISR);
+
+  // the counter has just restarted, set the length of the period it is in now (ARR preload is off). The table was
+  // worked out by the main loop, so swing costs a table read here.
+  const uint8_t actions    = m_swing_engine.tick();
+  m_tempo_timer_device.ARR = m_swing_engine.reload();
+  InputRecorder::record_at(timestamp_us, InputId::TEMPO_TICK, ((actions & SwingEngine::STEP) != 0) ? 1U : 0U, 1);
+
+  // a tapped tempo takes over at the step update that ends this period, PSC is preloaded
+  uint16_t prescaler;
+  if (m_swing_engine.take_prescaler(prescaler))
+  {
+    m_tempo_timer_device.PSC = prescaler;
+  }
+
+  // the MIDI UART write is done at PendSV priority so it doesn't hold off the other interrupts
+  if (actions & SwingEngine::CLOCK)
+  {
+    DeferredWork::schedule(&SequenceManager::tempo_timer_deferred, this, timestamp_us);
+  }
+  if (actions & SwingEngine::STEP)
+  {
+    DeferredWork::schedule(&SequenceManager::tempo_step_deferred, this, timestamp_us);
+  }
 
-        // Tell the MIDI slave device to pause
-        m_midi_driver.send_realtime_stop_msg();
+  // move the retrigger times on to the new period, a retrigger due at the update is played now
+  if (m_ratchet_scheduler.timer_update((actions & SwingEngine::STEP) != 0, m_swing_engine.step_counts()))
+  {
+    DeferredWork::schedule(&SequenceManager::ratchet_gate_deferred, this, timestamp_us);
+  }
+}
 
-        // silence any synth key/notes that are still sounding
-        m_synth_control_switch.clear_all();
+void SequenceManager::ratchet_compare_isr()
+{
+  Profiler::Scope zone(ProfileZone::TEMPO_ISR);
+  InputRecorder::record(InputId::RATCHET_COMPARE, 0, m_tempo_timer_device.CNT);
+  // the I2C write to the ADG2188 is too long for the interrupt, the bottom half does it
+  if (m_ratchet_scheduler.timer_compare())
+  {
+    DeferredWork::schedule(&SequenceManager::ratchet_gate_deferred, this, UsecClock::now());
+  }
+}
 
-        // before state update, if sequencer state is already stopped reset pattern position
-        if (m_sequencer_state == SequencerState::STOPPED)
+void SequenceManager::tempo_timer_deferred(void *context, uint32_t timestamp_us [[maybe_unused]])
+{
+  Profiler::Scope zone(ProfileZone::TEMPO_DEFERRED);
+  SequenceManager &self = *static_cast<SequenceManager *>(context);
+
+  // send the heartbeat clock signal to the MIDI OUT port
+  self.m_midi_driver.send_realtime_clock_msg();
+  Trace::emit(TraceId::MIDI_BYTE, static_cast<uint16_t>(TraceMidiByte::CLOCK), self.m_midi_driver.get_midi_pulse_cnt());
+  self.m_midi_driver.increment_midi_pulse_cnt();
+}
+
+void SequenceManager::tempo_step_deferred(void *context, uint32_t timestamp_us [[maybe_unused]])
+{
+  Profiler::Scope zone(ProfileZone::TEMPO_DEFERRED);
+  SequenceManager &self = *static_cast<SequenceManager *>(context);
+
+  // the pattern cursor moves on once every 12 MIDI clock messages, later for the swung step of a pair
+  self.m_midi_driver.reset_midi_pulse_cnt();
+  // tell the main loop to increment the step position in the pattern
+  // the step number lets the main loop tell whether its retriggers can still be scheduled, and the time lets it
+  // quantise recorded key presses
+  self.m_step_times.push(StepTime{timestamp_us, self.m_swing_engine.step_counts()});
+  self.m_event_queue.push(Event{EventType::StepAdvance, 0, self.m_ratchet_scheduler.steps_started()});
+}
+
+void SequenceManager::ratchet_gate_deferred(void *context, uint32_t timestamp_us [[maybe_unused]])
+{
+  Profiler::Scope zone(ProfileZone::TEMPO_DEFERRED);
+  SequenceManager &self = *static_cast<SequenceManager *>(context);
+
+  RatchetScheduler::Gate gate;
+  while (self.m_ratchet_scheduler.pop_gate(gate))
+  {
+    self.m_synth_control_switch.write_switch(gate.m_close ? adg2188::Driver::Throw::close : adg2188::Driver::Throw::open, gate.m_pole,
+                                             adg2188::Driver::Latch::set);
+    Trace::emit(TraceId::RATCHET_GATE, static_cast<uint16_t>(gate.m_pole), gate.m_close ? 1U : 0U);
+  }
+}
+
+void SequenceManager::rotary_sw_exti_isr()
+{
+  Profiler::Scope zone(ProfileZone::ENCODER_ISR);
+  DeferredWork::schedule(&SequenceManager::rotary_sw_exti_deferred, this, UsecClock::now());
+}
+
+void SequenceManager::rotary_sw_exti_deferred(void *context, uint32_t timestamp_us [[maybe_unused]])
+{
+  Profiler::Scope zone(ProfileZone::ENCODER_DEFERRED);
+  SequenceManager &self = *static_cast<SequenceManager *>(context);
+
+  uint32_t timer_count_ms       = self.m_debounce_timer.CNT;
+  const uint16_t encoder_count = static_cast<uint16_t>(self.m_sequencer_encoder_timer.CNT);
+  InputRecorder::record(InputId::ENCODER_SWITCH, encoder_count, timer_count_ms);
+  if (timer_count_ms - self.m_last_mode_debounce_count_ms > self.m_mode_debounce_threshold_ms)
+  {
+    // capture the encoder count at the time of the press, the main loop does the mode change
+    self.m_event_queue.push(Event{EventType::ModeToggle, 0, encoder_count});
+  }
+  self.m_last_mode_debounce_count_ms = timer_count_ms;
+}
+
+void SequenceManager::process_events()
+{
+  Event event;
+  while (m_event_queue.pop(event))
+  {
+    switch (event.m_type)
+    {
+      case EventType::StepAdvance:
+      {
+        // move every track on, the synth track gives the step position in the pattern
+        const TrackEngine::Tick tick = m_track_engine.tick();
+        m_sequence_position          = m_track_engine.position(synth_track);
+        if (tick.m_wrapped & (1U << synth_track))
         {
-          m_sequence_position = 0;
+          // at the bar boundary the song may move on to a pattern prefetched into the shadow map: swap it in
+          if (m_song_player.advance())
+          {
+            std::swap(m_active_step_map, m_shadow_step_map);
+            m_track_engine.set_length(synth_track, m_song_player.pattern_length());
+            m_undo_journal.clear();
+          }
+          m_trig_engine.loop_started();
         }
+        Trace::emit(TraceId::STEP_ADVANCE, m_sequence_position);
+        decide_step_trig();
+        play_midi_tracks(tick.m_stepped);
+        StepTime step_time;
+        if (m_step_times.pop(step_time))
+        {
+          m_live_recorder.step_started(step_time.m_timestamp_us, step_time.m_counts);
+        }
+        // the retriggers of the last step were dropped when this one started
+        m_step_number      = event.m_data16;
+        m_step_started     = true;
+        m_ratchets_playing = false;
+        break;
+      }
 
-        // now update the states
-        m_midi_state      = SequencerState::STOPPED;
-        m_sequencer_state = SequencerState::STOPPED;
-
+      case EventType::ModeToggle:
+        Trace::emit(TraceId::MODE_TOGGLE, event.m_data16);
+        // the switch steps through the modes: TEMPO_ADJUST, NOTE_SELECT, RECORD, UNDO, PITCH and back to TEMPO_ADJUST
+        if (m_current_mode == Mode::TEMPO_ADJUST)
+        {
+          m_current_mode = Mode::NOTE_SELECT;
+          // save the tempo value the encoder had when the switch was pressed, whilst we are out of TEMPO_ADJUST mode
+          m_saved_tempo_setting = event.m_data16;
+          // only the turns from here on move the note
+          m_last_encoder_value = static_cast<uint16_t>(m_sequencer_encoder_timer.CNT);
+        }
+        else if (m_current_mode == Mode::NOTE_SELECT)
+        {
+          m_current_mode = Mode::RECORD;
+        }
+        else if (m_current_mode == Mode::RECORD)
+        {
+          m_current_mode = Mode::UNDO;
+          // only the turns from here on undo or redo
+          m_last_encoder_value = static_cast<uint16_t>(m_sequencer_encoder_timer.CNT);
+        }
+        else if (m_current_mode == Mode::UNDO)
+        {
+          m_current_mode = Mode::PITCH;
+          // only the turns from here on transpose
+          m_last_encoder_value = static_cast<uint16_t>(m_sequencer_encoder_timer.CNT);
+        }
+        else
+        {
+          m_current_mode = Mode::TEMPO_ADJUST;
+          // restore the saved tempo value now we return to TEMPO_ADJUST mode
+          m_sequencer_encoder_timer.CNT = m_saved_tempo_setting;
+        }
         break;
-      case SequencerState::IDLE:
-        // do nothing
+
+      case EventType::KeyEvent:
+      case EventType::MidiByte:
+        // keypad events are read from the ADP5587 FIFO in the main loop and MIDI IN is not enabled yet
         break;
     }
+  }
+}
 
-    // update the pattern LEDs and trigger synth key/note if running
-    increment_sequencer();
+bool SequenceManager::play_song(const Song &song)
+{
+  if (!m_song_player.start(song, *m_active_step_map))
+  {
+    return false;
   }
+  m_track_engine.reset();
+  m_track_engine.set_length(synth_track, m_song_player.pattern_length());
+  m_sequence_position = 0;
+  m_undo_journal.clear();
+  return true;
 }
 
-void SequenceManager::tempo_timer_isr()
+bool SequenceManager::undo()
 {
-  // update the pattern cursor once every 12 MIDI clock messages
-  switch (m_midi_driver.get_midi_pulse_cnt())
+  if (!m_undo_journal.undo(*m_active_step_map))
   {
-    default:
-      // send the heartbeat clock signal to the MIDI OUT port
-      m_midi_driver.send_realtime_clock_msg();
-      m_midi_driver.increment_midi_pulse_cnt();
-      break;
-    case 12:
-      m_midi_driver.reset_midi_pulse_cnt();
-      // increment the step position in the pattern
-      (m_sequence_position >= m_sequencer_key_mapping.size() - 1) ? m_sequence_position = 0 : m_sequence_position++;
-      break;
+    return false;
   }
+  mark_pattern_dirty();
+  return true;
+}
 
-// reset the UIF bit to re-enable interrupts
-#if not defined(X86_UNIT_TESTING_ONLY)
-  m_tempo_timer_device.SR = m_tempo_timer_device.SR & ~TIM_SR_UIF;
-  // LL_TIM_ClearFlag_UPDATE(m_tempo_timer_device.first);
-#endif
+bool SequenceManager::redo()
+{
+  if (!m_undo_journal.redo(*m_active_step_map))
+  {
+    return false;
+  }
+  mark_pattern_dirty();
+  return true;
 }
 
-void SequenceManager::rotary_sw_exti_isr()
+void SequenceManager::randomise_pattern(uint32_t seed)
+{
+  // one journal entry and a copy of the pattern, however many steps change
+  m_undo_journal.record_pattern(*m_active_step_map);
+
+  uint32_t draw = (seed != 0) ? seed : TrigEngine::default_seed;
+  for (std::pair<SequencerKeyEventIndex, Step> &entry : m_active_step_map->data)
+  {
+    TrigEngine::xorshift32(draw);
+    entry.second.m_state = ((draw & 1U) != 0) ? StepState::ON : StepState::OFF;
+    entry.second.m_note  = static_cast<Note>((draw >> 8) % Note::none);
+  }
+  mark_pattern_dirty();
+}
+
+void SequenceManager::decide_step_trig()
 {
-  uint32_t timer_count_ms = m_debounce_timer.CNT;
-  if (timer_count_ms - m_last_mode_debounce_count_ms > m_mode_debounce_threshold_ms)
+  // one draw for every step, ON or not, so the decisions that follow don't depend on the pattern
+  const Step &step = m_active_step_map->data[key_at(m_sequence_position)].second;
+  const bool fired = m_trig_engine.fire(step);
+  m_step_skipped   = (step.m_state == StepState::ON) && !fired;
+}
+
+void SequenceManager::apply_tapped_tempo()
+{
+  const TapTempo &tap_tempo = m_adp5587_keypad_i2c.tap_tempo;
+  const uint16_t prescaler  = SwingEngine::prescaler(tap_tempo.beat_us());
+  if (m_sequencer_state == SequencerState::RUNNING)
+  {
+    // the tempo timer ISR changes over at the next step update, so the steps keep their phase
+    m_swing_engine.set_prescaler(prescaler);
+  }
+  else
+  {
+    m_tempo_timer_device.PSC = prescaler;
+  }
+
+  // the encoder carries on from the tapped tempo
+  if (m_current_mode == Mode::TEMPO_ADJUST)
   {
-    if (m_current_mode == bass_station::SequenceManager::Mode::NOTE_SELECT)
+    m_sequencer_encoder_timer.CNT = prescaler;
+  }
+  else
+  {
+    m_saved_tempo_setting = prescaler;
+  }
+  Trace::emit(TraceId::TAP_TEMPO, prescaler, tap_tempo.bpm_x10());
+}
+
+void SequenceManager::record_note(const KeypadManager::RecordedPress &press)
+{
+  // the first 25 step keys are the keys of the synth, from c0. The others don't play a note.
+  int8_t step_offset;
+  if ((press.m_key_idx >= Note::none) || !m_live_recorder.quantise(press.m_press_us, step_offset))
+  {
+    return;
+  }
+
+  const uint8_t length   = m_track_engine.length(synth_track);
+  const uint8_t position = static_cast<uint8_t>((m_sequence_position + length + step_offset) % length);
+  Step &step             = m_active_step_map->data[key_at(position)].second;
+  const Step before      = step;
+  step.m_state           = StepState::ON;
+  step.m_note            = static_cast<Note>(press.m_key_idx);
+  m_undo_journal.record_step(before, step);
+  mark_pattern_dirty();
+  Trace::emit(TraceId::RECORD_NOTE, static_cast<uint16_t>((position << 8) | press.m_key_idx), m_adp5587_keypad_i2c.key_latency.correction_us());
+}
+
+void SequenceManager::play_midi_tracks(uint8_t stepped)
+{
+  for (std::size_t track = 1; track < TrackEngine::track_count; track++)
+  {
+    if ((stepped & (1U << track)) == 0)
+    {
+      continue;
+    }
+    /// @note don't use std::array.at(), this will force exception handling to bloat the linked .elf
+    const MidiTrack &midi_track = m_midi_tracks[track - 1];
+    uint8_t &playing_note       = m_midi_playing_notes[track];
+    if (playing_note != no_midi_note)
+    {
+      m_midi_note_output.note_off(midi_track.m_channel, playing_note);
+      playing_note = no_midi_note;
+    }
+
+    const Step &step = m_active_step_map->data[key_at(m_track_engine.position(track))].second;
+    if ((step.m_state == StepState::ON) && (step.m_note != Note::none))
     {
-      m_current_mode = bass_station::SequenceManager::Mode::TEMPO_ADJUST;
-      // restore the saved tempo value now we return to TEMPO_ADJUST mode
-      m_sequencer_encoder_timer.CNT = m_saved_tempo_setting;
+      playing_note = MidiNoteOutput::midi_note(m_pitch_map.note(step.m_note));
+      m_midi_note_output.note_on(midi_track.m_channel, playing_note, m_midi_velocity);
     }
-    else
+  }
+}
+
+void SequenceManager::silence_midi_tracks()
+{
+  for (std::size_t track = 1; track < TrackEngine::track_count; track++)
+  {
+    if (m_midi_playing_notes[track] != no_midi_note)
     {
-      m_current_mode = bass_station::SequenceManager::Mode::NOTE_SELECT;
-      // save the current tempo value whilst we are in NOTE_SELECT mode
-      m_saved_tempo_setting = m_sequencer_encoder_timer.CNT;
+      m_midi_note_output.note_off(m_midi_tracks[track - 1].m_channel, m_midi_playing_notes[track]);
+      m_midi_playing_notes[track] = no_midi_note;
     }
   }
-  m_last_mode_debounce_count_ms = timer_count_ms;
+}
+
+void SequenceManager::mark_pattern_dirty()
+{
+  // the patterns of a song are played from the bank as they are, edits to them are not saved over slot 0
+  if (!m_song_player.playing())
+  {
+    m_pattern_persistence.mark_dirty();
+  }
+}
+
+bool SequenceManager::load_bank_pattern(void *context, std::size_t pattern_id, PackedPattern &pattern, uint8_t &length)
+{
+  return static_cast<SequenceManager *>(context)->m_pattern_bank.load(pattern_id, pattern, length);
 }
 
 void SequenceManager::update_display_and_tempo()
 {
+  // remember the count this frame was drawn with, see work_pending()
+  const uint32_t encoder_count = m_sequencer_encoder_timer.CNT;
+  if (encoder_count != m_idle_encoder_count)
+  {
+    // the encoder has no interrupt, so a turn is logged when it is first seen here
+    InputRecorder::record(InputId::ENCODER, static_cast<uint16_t>(encoder_count), m_sequencer_encoder_timer.CR1);
+  }
+  m_idle_encoder_count = encoder_count;
 
   if (m_current_mode == Mode::TEMPO_ADJUST)
   {
-    // update the sequencer tempo (prescaler)
+    // update the sequencer tempo (prescaler), unless a tapped tempo is waiting for the next step
     // TODO rotary encoder is backwards: Should be CW = increase tempo, CCW = decrease tempo
-    m_tempo_timer_device.PSC = m_sequencer_encoder_timer.CNT;
+    if (!m_swing_engine.prescaler_pending())
+    {
+      m_tempo_timer_device.PSC = m_sequencer_encoder_timer.CNT;
+    }
 
     noarch::containers::StaticString<20> mode_string("TEMPO MODE         ");
 
@@ -233,45 +794,105 @@ void SequenceManager::update_display_and_tempo()
 
     m_ssd1306_display_spi.set_display_line(DisplayManager::DisplayLine::LINE_THREE, mode_string);
 
-    // lookup the step position using the index of the last user selected key
+    // lookup the step position using the index of the last user selected key (always in range, see KeypadManager)
     /// @note don't use std::array.at(), this will force exception handling to bloat the linked .elf
-    Step last_selected_step      = m_sequencer_step_map.data[m_adp5587_keypad_i2c.last_user_selected_key_idx].second;
-    Note last_selected_step_note = last_selected_step.m_note;
+    Note &last_selected_step_note = m_active_step_map->data[m_adp5587_keypad_i2c.last_user_selected_key_idx].second.m_note;
 
-    // get the direction from the encoder and increment/decrement the note in the step of the last user selected key
+    // get the direction from the encoder and move the note in the step of the last user selected key up or down the
+    // scale, within the 25 keys of the synth
 
     if (m_last_encoder_value != m_sequencer_encoder_timer.CNT)
     {
-#if not defined(X86_UNIT_TESTING_ONLY)
+      const Step before                 = m_active_step_map->data[m_adp5587_keypad_i2c.last_user_selected_key_idx].second;
+      const Note previous_selected_note = last_selected_step_note;
       if (m_sequencer_encoder_timer.CR1 & TIM_CR1_DIR)
       // if (LL_TIM_GetDirection(m_sequencer_encoder_timer))
       {
         m_display_direction.concat(0, "up  ");
-        /// @note don't use std::array.at(), this will force exception handling to bloat the linked .elf
-        m_sequencer_step_map.data[m_adp5587_keypad_i2c.last_user_selected_key_idx].second.m_note = static_cast<Note>(last_selected_step_note + 1);
+        last_selected_step_note = m_pitch_map.next_note(last_selected_step_note);
       }
       else
       {
 
         m_display_direction.concat(0, "down");
 
-        /// @note don't use std::array.at(), this will force exception handling to bloat the linked .elf
-        m_sequencer_step_map.data[m_adp5587_keypad_i2c.last_user_selected_key_idx].second.m_note = static_cast<Note>(last_selected_step_note - 1);
+        last_selected_step_note = m_pitch_map.previous_note(last_selected_step_note);
+      }
+      if (last_selected_step_note != previous_selected_note)
+      {
+        // a turn of the encoder is one edit, however many keys it moves the note
+        m_undo_journal.record_step(before, m_active_step_map->data[m_adp5587_keypad_i2c.last_user_selected_key_idx].second, true);
+        mark_pattern_dirty();
+      }
+    }
+    m_ssd1306_display_spi.set_display_line(DisplayManager::DisplayLine::LINE_FOUR, m_display_direction);
+    m_last_encoder_value = m_sequencer_encoder_timer.CNT;
+  }
+  else if (m_current_mode == Mode::RECORD)
+  {
+
+    noarch::containers::StaticString<20> mode_string("RECORD MODE        ");
+
+    m_ssd1306_display_spi.set_display_line(DisplayManager::DisplayLine::LINE_THREE, mode_string);
+  }
+  else if (m_current_mode == Mode::UNDO)
+  {
+
+    noarch::containers::StaticString<20> mode_string("UNDO MODE          ");
+
+    m_ssd1306_display_spi.set_display_line(DisplayManager::DisplayLine::LINE_THREE, mode_string);
+
+    // each turn of the encoder seen steps one edit back or forward through the journal, in the same direction as
+    // NOTE_SELECT moves the note
+    if (m_last_encoder_value != m_sequencer_encoder_timer.CNT)
+    {
+      if (m_sequencer_encoder_timer.CR1 & TIM_CR1_DIR)
+      {
+        m_display_direction.concat(0, redo() ? "redo" : "----");
+      }
+      else
+      {
+        m_display_direction.concat(0, undo() ? "undo" : "----");
       }
-#endif
     }
     m_ssd1306_display_spi.set_display_line(DisplayManager::DisplayLine::LINE_FOUR, m_display_direction);
     m_last_encoder_value = m_sequencer_encoder_timer.CNT;
   }
+  else if (m_current_mode == Mode::PITCH)
+  {
+
+    noarch::containers::StaticString<20> mode_string("PITCH MODE         ");
+
+    m_ssd1306_display_spi.set_display_line(DisplayManager::DisplayLine::LINE_THREE, mode_string);
+
+    // each turn of the encoder seen transposes one semitone, in the same direction as NOTE_SELECT moves the note. The
+    // transpose stops at PitchMap::max_transpose, set_transpose() refuses to go further.
+    if (m_last_encoder_value != m_sequencer_encoder_timer.CNT)
+    {
+      const int8_t transpose = m_pitch_map.transpose();
+      set_transpose(static_cast<int8_t>((m_sequencer_encoder_timer.CR1 & TIM_CR1_DIR) ? transpose + 1 : transpose - 1));
+    }
+    m_last_encoder_value = m_sequencer_encoder_timer.CNT;
+
+    // "<scale> <root> <transpose>"
+    /// @note don't use std::array.at(), this will force exception handling to bloat the linked .elf
+    const int8_t transpose = m_pitch_map.transpose();
+    noarch::containers::StaticString<20> pitch_text("                   ");
+    pitch_text.concat(0, m_scale_names[static_cast<std::size_t>(m_pitch_map.scale())]);
+    pitch_text.concat(11, m_root_names[m_pitch_map.root()]);
+    pitch_text.concat(14, (transpose < 0) ? "-" : "+");
+    pitch_text.concat_int(15, (transpose < 0) ? -transpose : transpose);
+    m_ssd1306_display_spi.set_display_line(DisplayManager::DisplayLine::LINE_FOUR, pitch_text);
+  }
 
   // now read back the updated note from the step to get the note string value
   /// @note don't use std::array.at(), this will force exception handling to bloat the linked .elf
-  NoteData *lookup_note_data = m_note_switch_map.find_key(m_sequencer_step_map.data[m_adp5587_keypad_i2c.last_user_selected_key_idx].second.m_note);
+  const NoteData *lookup_note_data = find_note_data(m_active_step_map->data[m_adp5587_keypad_i2c.last_user_selected_key_idx].second.m_note);
 
   if (lookup_note_data != nullptr)
   {
-
-    m_ssd1306_display_spi.set_display_line(DisplayManager::DisplayLine::LINE_FIVE, lookup_note_data->m_note_static_string);
+    noarch::containers::StaticString<4> note_text(lookup_note_data->m_note_name);
+    m_ssd1306_display_spi.set_display_line(DisplayManager::DisplayLine::LINE_FIVE, note_text);
   }
   else
   {
@@ -303,8 +924,68 @@ void SequenceManager::update_display_and_tempo()
   // tempo_string += std::to_string(tempo_timer_bpm) + "   ";
   // m_ssd1306_display_spi.set_display_line(DisplayManager::DisplayLine::LINE_THREE, tempo_string);
 
+#if DISPLAY_PATTERN_VIEW
+  // only rebuild the status line when something on it has changed, the pattern view redraws it when set
+  const uint8_t selected_key_idx = m_adp5587_keypad_i2c.last_user_selected_key_idx;
+  const Note selected_note       = m_active_step_map->data[selected_key_idx].second.m_note;
+  if ((m_status_line_tempo != m_tempo_timer_device.PSC) || (m_status_line_note != selected_note) || (m_status_line_mode != m_current_mode) ||
+      (m_status_line_cpu_load != m_idle_monitor.cpu_load_percent()) || (m_status_line_recording != m_live_recording))
+  {
+    m_status_line_tempo     = m_tempo_timer_device.PSC;
+    m_status_line_note      = selected_note;
+    m_status_line_mode      = m_current_mode;
+    m_status_line_cpu_load  = m_idle_monitor.cpu_load_percent();
+    m_status_line_recording = m_live_recording;
+
+    // "T:<tempo> <note> <mode><* when recording> <cpu load>%"
+    noarch::containers::StaticString<20> status_line("T:                 ");
+    status_line.concat_int(2, m_status_line_tempo);
+    if (lookup_note_data != nullptr)
+    {
+      status_line.concat(8, lookup_note_data->m_note_name);
+    }
+    const char *mode_letter = "T";
+    if (m_current_mode == Mode::NOTE_SELECT)
+    {
+      mode_letter = "N";
+    }
+    else if (m_current_mode == Mode::RECORD)
+    {
+      mode_letter = "R";
+    }
+    else if (m_current_mode == Mode::UNDO)
+    {
+      mode_letter = "U";
+    }
+    else if (m_current_mode == Mode::PITCH)
+    {
+      mode_letter = "P";
+    }
+    status_line.concat(12, mode_letter);
+    if (m_live_recording)
+    {
+      status_line.concat(13, "*");
+    }
+    status_line.concat_int(14, m_status_line_cpu_load);
+    status_line.concat((m_status_line_cpu_load < 10) ? 15 : ((m_status_line_cpu_load < 100) ? 16 : 17), "%");
+#if not PROFILER_OVERLAY
+    m_ssd1306_display_spi.set_display_line(DisplayManager::DisplayLine::LINE_SIX, status_line);
+#endif
+  }
+
+  // redraw the cells of the pattern view that changed since the last frame
+  m_ssd1306_display_spi.update_pattern_view(*m_active_step_map, key_at(m_sequence_position), selected_key_idx);
+#else
+  // show the CPU load measured by the idle monitor
+  noarch::containers::StaticString<20> cpu_load("CPU:               ");
+  cpu_load.concat_int(5, m_idle_monitor.cpu_load_percent());
+#if not PROFILER_OVERLAY
+  m_ssd1306_display_spi.set_display_line(DisplayManager::DisplayLine::LINE_SIX, cpu_load);
+#endif
+
   // redraw the display contents
   m_ssd1306_display_spi.update_oled();
+#endif
 }
 
 void SequenceManager::increment_sequencer()
@@ -312,41 +993,51 @@ void SequenceManager::increment_sequencer()
 
   // get the current sequence position Step object from the map
   // and save its current colour/state so it can be restored later
-  Step &current_step = m_sequencer_step_map.data[m_sequencer_key_mapping[m_sequence_position]].second;
+  Step &current_step = m_active_step_map->data[key_at(m_sequence_position)].second;
 
   tlc5955::LedColour previous_colour = current_step.m_colour;
   StepState previous_step_state      = current_step.m_state;
 
-  // find the note for the enabled step so we can trigger the key/note on the synth
-  if (current_step.m_state == StepState::ON)
+  // find the note for the enabled step so we can trigger the key/note on the synth. A step skipped by its probability or
+  // condition is played as if it was OFF, a step switched on after it started plays straight away.
+  if ((current_step.m_state == StepState::ON) && !m_step_skipped)
   {
     // update LED colour to show the sequencer IS at this position in the pattern
     current_step.m_colour = beat_colour_on;
 
-    NoteData *found_note_data = m_note_switch_map.find_key(current_step.m_note);
-
-    // turn on/off the note sound from the previous step but only if sequencer is running
-    if (m_sequencer_state == SequencerState::RUNNING)
+    // turn on/off the note sound from the previous step but only if sequencer is running. While the retriggers of a
+    // ratcheted step are playing, ratchet_gate_deferred() has the switch.
+    if ((m_sequencer_state == SequencerState::RUNNING) && !m_ratchets_playing)
     {
-      //   first, turn off the synth key / note that we enabled on the previous pattern step if (m_previous_enabled_note
-      if (m_previous_enabled_note != nullptr)
+      //   first, turn off the synth key / note that we enabled on the previous pattern step
+      if (m_previous_note_enabled)
       {
-        m_synth_control_switch.write_switch(adg2188::Driver::Throw::open, m_previous_enabled_note->m_sw, adg2188::Driver::Latch::set);
+        m_synth_control_switch.write_switch(adg2188::Driver::Throw::open, m_previous_enabled_pole, adg2188::Driver::Latch::set);
+        Trace::emit(TraceId::SWITCH_WRITE, static_cast<uint16_t>(m_previous_enabled_pole), 0U);
       }
 
-      // second, turn on the synth key/note for the current step
-      if (current_step.m_note != Note::none)
+      // second, turn on the synth key/note for the current step, transposed and quantised to the scale
+      if (current_step.m_note < Note::none)
       {
-        if (found_note_data != nullptr)
+        const adg2188::Driver::Pole pole = m_pitch_map.pole(current_step.m_note);
+        m_synth_control_switch.write_switch(adg2188::Driver::Throw::close, pole, adg2188::Driver::Latch::set);
+        Trace::emit(TraceId::SWITCH_WRITE, static_cast<uint16_t>(pole), 1U);
+
+        // that was the first trigger of the step, the interrupt plays the others
+        if (m_step_started && (current_step.m_ratchet > 1))
         {
-          m_synth_control_switch.write_switch(adg2188::Driver::Throw::close, found_note_data->m_sw, adg2188::Driver::Latch::set);
+          m_ratchets_playing = m_ratchet_scheduler.schedule(m_step_number, pole, current_step.m_ratchet);
         }
       }
     }
 
-    // retain the synth key/note we enabled for this Step
-    // so we can turn it off when we get to the next Step
-    m_previous_enabled_note = found_note_data;
+    // retain the synth key/note we enabled for this Step so we can turn it off when we get to the next Step. The pole is
+    // kept rather than the note, the transpose may change before then.
+    m_previous_note_enabled = (current_step.m_note < Note::none);
+    if (m_previous_note_enabled)
+    {
+      m_previous_enabled_pole = m_pitch_map.pole(current_step.m_note);
+    }
   }
   else // the current pattern Step is disabled. Disable the previous LED and synth key/note
   {
@@ -354,9 +1045,10 @@ void SequenceManager::increment_sequencer()
     current_step.m_colour = beat_colour_off;
 
     // turn off the note sound from the previous step
-    if (m_previous_enabled_note != nullptr)
+    if (m_previous_note_enabled && !m_ratchets_playing)
     {
-      m_synth_control_switch.write_switch(adg2188::Driver::Throw::open, m_previous_enabled_note->m_sw, adg2188::Driver::Latch::set);
+      m_synth_control_switch.write_switch(adg2188::Driver::Throw::open, m_previous_enabled_pole, adg2188::Driver::Latch::set);
+      Trace::emit(TraceId::SWITCH_WRITE, static_cast<uint16_t>(m_previous_enabled_pole), 0U);
     }
   }
 
@@ -364,82 +1056,106 @@ void SequenceManager::increment_sequencer()
   current_step.m_state = StepState::ON;
 
   // send the updated LED sequence map to the TL5955 driver
-  m_led_manager.set_both_rows_with_step_sequence_mapping(m_sequencer_step_map);
+  m_led_manager.set_both_rows_with_step_sequence_mapping(*m_active_step_map);
 
   // restore the state of the current step (so it is cleared on the next iteration)
   current_step.m_colour = previous_colour;
   current_step.m_state  = previous_step_state;
+
+  m_step_started = false;
 }
 
+namespace
+{
 // clang-format off
-std::array< std::pair< Note, NoteData>, 25> SequenceManager::m_note_switch_data = {{
-    { Note::c0,       NoteData("C0 ", adg2188::Driver::Pole::x4_to_y0) },
-    { Note::c0_sharp, NoteData("C0#", adg2188::Driver::Pole::x5_to_y0) },
-    { Note::d0,       NoteData("D0 ", adg2188::Driver::Pole::x6_to_y0) },
-    { Note::d0_sharp, NoteData("D0#", adg2188::Driver::Pole::x7_to_y0) },
-    { Note::e0,       NoteData("E0 ", adg2188::Driver::Pole::x0_to_y2) },
-    { Note::f0,       NoteData("F0 ", adg2188::Driver::Pole::x1_to_y2) },
-    { Note::f0_sharp, NoteData("F0#", adg2188::Driver::Pole::x2_to_y2) },
-    { Note::g0,       NoteData("G0 ", adg2188::Driver::Pole::x3_to_y2) },
-    { Note::g0_sharp, NoteData("G0#", adg2188::Driver::Pole::x4_to_y2) },
-    { Note::a1,       NoteData("A1 ", adg2188::Driver::Pole::x5_to_y2) },
-    { Note::a1_sharp, NoteData("A1#", adg2188::Driver::Pole::x6_to_y2) },
-    { Note::b1,       NoteData("B1 ", adg2188::Driver::Pole::x7_to_y2) },
-    { Note::c1,       NoteData("C1 ", adg2188::Driver::Pole::x0_to_y4) },  // Middle C
-    { Note::c1_sharp, NoteData("C1#", adg2188::Driver::Pole::x1_to_y4) },
-    { Note::d1,       NoteData("D1 ", adg2188::Driver::Pole::x2_to_y4) },
-    { Note::d1_sharp, NoteData("D1#", adg2188::Driver::Pole::x3_to_y4) },
-    { Note::e1,       NoteData("E1 ", adg2188::Driver::Pole::x4_to_y4) },
-    { Note::f1,       NoteData("F1 ", adg2188::Driver::Pole::x5_to_y4) },
-    { Note::f1_sharp, NoteData("F1#", adg2188::Driver::Pole::x6_to_y4) },
-    { Note::g1,       NoteData("G1 ", adg2188::Driver::Pole::x7_to_y4) },
-    { Note::g1_sharp, NoteData("G1#", adg2188::Driver::Pole::x0_to_y6) },
-    { Note::a2,       NoteData("A2 ", adg2188::Driver::Pole::x1_to_y6) },
-    { Note::a2_sharp, NoteData("A2#", adg2188::Driver::Pole::x2_to_y6) },
-    { Note::b2,       NoteData("B2 ", adg2188::Driver::Pole::x3_to_y6) },
-    { Note::c2,       NoteData("C2 ", adg2188::Driver::Pole::x4_to_y6) }
-}};
-
-// Size: 2K
-// The default sequencer pattern, stored in SequencerManager::m_sequencer_step_map (noarch::containers::StaticMap)
-std::array< std::pair< SequencerKeyEventIndex, Step >, 32 > SequenceManager::m_sequencer_step_data = {{
-    {SequencerKeyEventIndex::A0_OFF | SequencerKeyEventIndex::ON, Step(StepState::ON,  Note::c0, default_colour,         0,   4,  0)},
-    {SequencerKeyEventIndex::A1_OFF | SequencerKeyEventIndex::ON, Step(StepState::OFF, Note::c0_sharp, default_colour,   1,   0,  1)},
-    {SequencerKeyEventIndex::A2_OFF | SequencerKeyEventIndex::ON, Step(StepState::OFF, Note::d0, default_colour,         2,   5,  2)},
-    {SequencerKeyEventIndex::A3_OFF | SequencerKeyEventIndex::ON, Step(StepState::OFF, Note::d0_sharp, default_colour,   3,   1,  3)},
-    {SequencerKeyEventIndex::A4_OFF | SequencerKeyEventIndex::ON, Step(StepState::OFF, Note::e0, default_colour,         4,   2,  4)},
-    {SequencerKeyEventIndex::A5_OFF | SequencerKeyEventIndex::ON, Step(StepState::OFF, Note::f0, default_colour,         5,   6,  5)},
-    {SequencerKeyEventIndex::A6_OFF | SequencerKeyEventIndex::ON, Step(StepState::OFF, Note::f0_sharp, default_colour,   6,   3,  6)},
-    {SequencerKeyEventIndex::A7_OFF | SequencerKeyEventIndex::ON, Step(StepState::OFF, Note::g0, default_colour,         7,   7,  7)},
-
-    {SequencerKeyEventIndex::B0_OFF | SequencerKeyEventIndex::ON, Step(StepState::ON, Note::e1, default_colour,         8,   11, 8)},
-    {SequencerKeyEventIndex::B1_OFF | SequencerKeyEventIndex::ON, Step(StepState::ON, Note::c1, default_colour,         9,   15, 9)},
-    {SequencerKeyEventIndex::B2_OFF | SequencerKeyEventIndex::ON, Step(StepState::ON, Note::c0, default_colour,         10,  10, 10)},
-    {SequencerKeyEventIndex::B3_OFF | SequencerKeyEventIndex::ON, Step(StepState::ON, Note::c1, default_colour,         11,  14, 11)},
-    {SequencerKeyEventIndex::B4_OFF | SequencerKeyEventIndex::ON, Step(StepState::ON, Note::c2, default_colour,         12,  13, 12)},
-    {SequencerKeyEventIndex::B5_OFF | SequencerKeyEventIndex::ON, Step(StepState::ON, Note::c1, default_colour,         13,  9,  13)},
-    {SequencerKeyEventIndex::B6_OFF | SequencerKeyEventIndex::ON, Step(StepState::ON, Note::c0, default_colour,         14,  12, 14)},
-    {SequencerKeyEventIndex::B7_OFF | SequencerKeyEventIndex::ON, Step(StepState::ON, Note::c1, default_colour,         15,  8,  15)}, 
-
-    {SequencerKeyEventIndex::C0_OFF | SequencerKeyEventIndex::ON, Step(StepState::ON, Note::e0, default_colour,          0,   7,  16)},
-    {SequencerKeyEventIndex::C1_OFF | SequencerKeyEventIndex::ON, Step(StepState::OFF, Note::f1, default_colour,         1,   3,  17)},
-    {SequencerKeyEventIndex::C2_OFF | SequencerKeyEventIndex::ON, Step(StepState::OFF, Note::f1_sharp, default_colour,   2,   6,  18)},
-    {SequencerKeyEventIndex::C3_OFF | SequencerKeyEventIndex::ON, Step(StepState::OFF, Note::g1, default_colour,         3,   2,  19)},
-    {SequencerKeyEventIndex::C4_OFF | SequencerKeyEventIndex::ON, Step(StepState::OFF, Note::g1_sharp, default_colour,   4,   1,  20)},
-    {SequencerKeyEventIndex::C5_OFF | SequencerKeyEventIndex::ON, Step(StepState::OFF, Note::a2, default_colour,         5,   5,  21)},
-    {SequencerKeyEventIndex::C6_OFF | SequencerKeyEventIndex::ON, Step(StepState::OFF, Note::a2_sharp, default_colour,   6,   0,  22)},
-    {SequencerKeyEventIndex::C7_OFF | SequencerKeyEventIndex::ON, Step(StepState::OFF, Note::b2, default_colour,         7,   4,  23)},  
-
-    {SequencerKeyEventIndex::D0_OFF | SequencerKeyEventIndex::ON, Step(StepState::ON, Note::c2, default_colour,         8,   8,  24)},
-    {SequencerKeyEventIndex::D1_OFF | SequencerKeyEventIndex::ON, Step(StepState::ON, Note::c1, default_colour,         9,   12, 25)},
-    {SequencerKeyEventIndex::D2_OFF | SequencerKeyEventIndex::ON, Step(StepState::ON, Note::c0, default_colour,         10,  9,  26)},
-    {SequencerKeyEventIndex::D3_OFF | SequencerKeyEventIndex::ON, Step(StepState::ON, Note::c1, default_colour,         11,  13, 27)},
-    {SequencerKeyEventIndex::D4_OFF | SequencerKeyEventIndex::ON, Step(StepState::ON, Note::c2, default_colour,         12,  14, 28)},
-    {SequencerKeyEventIndex::D5_OFF | SequencerKeyEventIndex::ON, Step(StepState::ON, Note::c1, default_colour,         13,  10, 29)},
-    {SequencerKeyEventIndex::D6_OFF | SequencerKeyEventIndex::ON, Step(StepState::ON, Note::c0, default_colour,         14,  15, 30)},
-    {SequencerKeyEventIndex::D7_OFF | SequencerKeyEventIndex::ON, Step(StepState::ON, Note::c1, default_colour,         15,  11, 31)},       
+// The default sequencer pattern, in step map order. The key events and LED wiring of each step come from board_description.hpp
+constexpr board::DefaultPattern default_pattern{{
+    {StepState::ON,  Note::c0},
+    {StepState::OFF, Note::c0_sharp},
+    {StepState::OFF, Note::d0},
+    {StepState::OFF, Note::d0_sharp},
+    {StepState::OFF, Note::e0},
+    {StepState::OFF, Note::f0},
+    {StepState::OFF, Note::f0_sharp},
+    {StepState::OFF, Note::g0},
+
+    {StepState::ON,  Note::e1},
+    {StepState::ON,  Note::c1},
+    {StepState::ON,  Note::c0},
+    {StepState::ON,  Note::c1},
+    {StepState::ON,  Note::c2},
+    {StepState::ON,  Note::c1},
+    {StepState::ON,  Note::c0},
+    {StepState::ON,  Note::c1},
+
+    {StepState::ON,  Note::e0},
+    {StepState::OFF, Note::f1},
+    {StepState::OFF, Note::f1_sharp},
+    {StepState::OFF, Note::g1},
+    {StepState::OFF, Note::g1_sharp},
+    {StepState::OFF, Note::a2},
+    {StepState::OFF, Note::a2_sharp},
+    {StepState::OFF, Note::b2},
+
+    {StepState::ON,  Note::c2},
+    {StepState::ON,  Note::c1},
+    {StepState::ON,  Note::c0},
+    {StepState::ON,  Note::c1},
+    {StepState::ON,  Note::c2},
+    {StepState::ON,  Note::c1},
+    {StepState::ON,  Note::c0},
+    {StepState::ON,  Note::c1},
 }};
 // clang-format on
+} // namespace
+
+// Size: 2K, in flash
+const std::array<std::pair<SequencerKeyEventIndex, Step>, board::step_count> SequenceManager::m_sequencer_step_data = board::make_step_data(default_pattern);
+
+void SequenceManager::show_crash_log()
+{
+  const FlightRecorder::Log &crash_log = FlightRecorder::crash_log();
+  if (crash_log.m_cause == FlightRecorder::Cause::NONE)
+  {
+    return;
+  }
+
+  std::array<char, 9> hex_string;
+  noarch::containers::StaticString<20> line((crash_log.m_cause == FlightRecorder::Cause::HARD_FAULT) ? "CRASH: HARDFAULT   "
+                                                                                                     : "CRASH: ERROR       ");
+  m_ssd1306_display_spi.set_display_line(DisplayManager::DisplayLine::LINE_ONE, line);
+
+  FlightRecorder::format_hex(crash_log.m_fault.m_pc, hex_string);
+  line.concat(0, "PC:                ");
+  line.concat(4, hex_string.data());
+  m_ssd1306_display_spi.set_display_line(DisplayManager::DisplayLine::LINE_TWO, line);
+
+  FlightRecorder::format_hex(crash_log.m_fault.m_lr, hex_string);
+  line.concat(0, "LR:                ");
+  line.concat(4, hex_string.data());
+  m_ssd1306_display_spi.set_display_line(DisplayManager::DisplayLine::LINE_THREE, line);
+
+  // the last three trace records before the fault, newest at the bottom: "<id> <arg0> <arg1>"
+  const std::array<DisplayManager::DisplayLine, 3> record_lines{
+      DisplayManager::DisplayLine::LINE_FOUR, DisplayManager::DisplayLine::LINE_FIVE, DisplayManager::DisplayLine::LINE_SIX};
+  for (std::size_t line_idx = 0; line_idx < record_lines.size(); line_idx++)
+  {
+    line.concat(0, "                   ");
+    const std::size_t missing_records = record_lines.size() - std::min<std::size_t>(crash_log.m_count, record_lines.size());
+    if (line_idx >= missing_records)
+    {
+      const TraceRecord &record = FlightRecorder::crash_record(crash_log.m_count + line_idx - record_lines.size());
+      line.concat(0, "E");
+      line.concat_int(1, record.m_id);
+      line.concat_int(4, record.m_arg0);
+      line.concat_int(10, record.m_arg1);
+    }
+    m_ssd1306_display_spi.set_display_line(record_lines[line_idx], line);
+  }
+
+  m_ssd1306_display_spi.update_oled();
+  stm32::delay_millisecond(m_crash_log_display_ms);
+}
 
 void SequenceManager::led_demo()
 {
@@ -601,4 +1317,69 @@ void SequenceManager::led_demo()
   }
 }
 
+#if not defined(X86_UNIT_TESTING_ONLY)
+
+/// @brief An array the size of SequenceManager, and one the size of each of its larger members, each in a section of
+/// the .size_table in STM32G0B1KETXN_FLASH.ld. The map file only has the whole SequenceManager (a static of mainapp(),
+/// in the .bss of mainapp.cpp), so map_report.py reads the size of its members from the section sizes. The table takes
+/// no memory.
+struct SequenceManagerSizes
+{
+  static const std::array<uint8_t, sizeof(SequenceManager)> sequence_manager;
+  static const std::array<uint8_t, sizeof(SequenceManager::m_sequencer_step_map)> m_sequencer_step_map;
+  static const std::array<uint8_t, sizeof(SequenceManager::m_second_step_map)> m_second_step_map;
+  static const std::array<uint8_t, sizeof(SequenceManager::m_pattern_bank)> m_pattern_bank;
+  static const std::array<uint8_t, sizeof(SequenceManager::m_pattern_persistence)> m_pattern_persistence;
+  static const std::array<uint8_t, sizeof(SequenceManager::m_song_player)> m_song_player;
+  static const std::array<uint8_t, sizeof(SequenceManager::m_undo_journal)> m_undo_journal;
+  static const std::array<uint8_t, sizeof(SequenceManager::m_pitch_map)> m_pitch_map;
+  static const std::array<uint8_t, sizeof(SequenceManager::m_swing_engine)> m_swing_engine;
+  static const std::array<uint8_t, sizeof(SequenceManager::m_ratchet_scheduler)> m_ratchet_scheduler;
+  static const std::array<uint8_t, sizeof(SequenceManager::m_trig_engine)> m_trig_engine;
+  static const std::array<uint8_t, sizeof(SequenceManager::m_live_recorder)> m_live_recorder;
+  static const std::array<uint8_t, sizeof(SequenceManager::m_step_times)> m_step_times;
+  static const std::array<uint8_t, sizeof(SequenceManager::m_ssd1306_display_spi)> m_ssd1306_display_spi;
+  static const std::array<uint8_t, sizeof(SequenceManager::m_adp5587_keypad_i2c)> m_adp5587_keypad_i2c;
+  static const std::array<uint8_t, sizeof(SequenceManager::m_synth_control_switch)> m_synth_control_switch;
+  static const std::array<uint8_t, sizeof(SequenceManager::m_led_manager)> m_led_manager;
+  static const std::array<uint8_t, sizeof(SequenceManager::m_midi_driver)> m_midi_driver;
+  static const std::array<uint8_t, sizeof(SequenceManager::m_midi_note_output)> m_midi_note_output;
+  static const std::array<uint8_t, sizeof(SequenceManager::m_track_engine)> m_track_engine;
+  static const std::array<uint8_t, sizeof(SequenceManager::m_event_queue)> m_event_queue;
+  static const std::array<uint8_t, sizeof(SequenceManager::m_idle_monitor)> m_idle_monitor;
+};
+
+[[gnu::used, gnu::section(".size_table.SequenceManager")]] const std::array<uint8_t, sizeof(SequenceManager)>
+    SequenceManagerSizes::sequence_manager{};
+
+/// @brief Define the array of a member of SequenceManager, in the section .size_table.SequenceManager.<member>
+#define SIZE_TABLE_ENTRY(member)                                                                                       \
+  [[gnu::used, gnu::section(".size_table.SequenceManager." #member)]]                                                  \
+  const std::array<uint8_t, sizeof(SequenceManager::member)> SequenceManagerSizes::member{}
+
+SIZE_TABLE_ENTRY(m_sequencer_step_map);
+SIZE_TABLE_ENTRY(m_second_step_map);
+SIZE_TABLE_ENTRY(m_pattern_bank);
+SIZE_TABLE_ENTRY(m_pattern_persistence);
+SIZE_TABLE_ENTRY(m_song_player);
+SIZE_TABLE_ENTRY(m_undo_journal);
+SIZE_TABLE_ENTRY(m_pitch_map);
+SIZE_TABLE_ENTRY(m_swing_engine);
+SIZE_TABLE_ENTRY(m_ratchet_scheduler);
+SIZE_TABLE_ENTRY(m_trig_engine);
+SIZE_TABLE_ENTRY(m_live_recorder);
+SIZE_TABLE_ENTRY(m_step_times);
+SIZE_TABLE_ENTRY(m_ssd1306_display_spi);
+SIZE_TABLE_ENTRY(m_adp5587_keypad_i2c);
+SIZE_TABLE_ENTRY(m_synth_control_switch);
+SIZE_TABLE_ENTRY(m_led_manager);
+SIZE_TABLE_ENTRY(m_midi_driver);
+SIZE_TABLE_ENTRY(m_midi_note_output);
+SIZE_TABLE_ENTRY(m_track_engine);
+SIZE_TABLE_ENTRY(m_event_queue);
+SIZE_TABLE_ENTRY(m_idle_monitor);
+#undef SIZE_TABLE_ENTRY
+
+#endif
+
 } // namespace bass_station
\ No newline at end of file
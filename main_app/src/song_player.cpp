@@ -0,0 +1,144 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <song_player.hpp>
+
+namespace bass_station
+{
+
+bool Song::valid() const
+{
+  if ((m_length == 0) || (m_length > max_entries))
+  {
+    return false;
+  }
+  for (std::size_t idx = 0; idx < m_length; idx++)
+  {
+    /// @note don't use std::array.at(), this will force exception handling to bloat the linked .elf
+    if (m_entries[idx].m_pattern >= PatternBank::slot_count)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+SongPlayer::SongPlayer(PatternLoader loader, void *context)
+    : m_loader(loader),
+      m_context(context)
+{
+}
+
+bool SongPlayer::start(const Song &song, SequencerStepMap &live_map)
+{
+  if (!song.valid())
+  {
+    m_playing = false;
+    return false;
+  }
+  m_song    = song;
+  m_playing = true;
+  restart(live_map);
+  return true;
+}
+
+void SongPlayer::restart(SequencerStepMap &live_map)
+{
+  m_entry           = 0;
+  m_repeat          = 0;
+  m_shadow_ready    = false;
+  m_prefetch_failed = false;
+  // not at a bar boundary, so the load can take as long as it takes
+  load(m_song.m_entries[0].m_pattern, live_map, m_live_length);
+}
+
+bool SongPlayer::prefetch_pending() const { return m_playing && last_repeat() && next_needs_decode() && !m_shadow_ready && !m_prefetch_failed; }
+
+void SongPlayer::prefetch(SequencerStepMap &shadow_map)
+{
+  if (!prefetch_pending())
+  {
+    return;
+  }
+  if (load(m_song.m_entries[next_entry()].m_pattern, shadow_map, m_shadow_length))
+  {
+    m_shadow_ready = true;
+  }
+  else
+  {
+    m_prefetch_failed = true;
+  }
+}
+
+bool SongPlayer::advance()
+{
+  if (!m_playing)
+  {
+    return false;
+  }
+  if (!last_repeat())
+  {
+    m_repeat++;
+    return false;
+  }
+
+  const bool flip = m_shadow_ready;
+  if (flip)
+  {
+    m_live_length = m_shadow_length;
+  }
+  if (next_needs_decode() && !m_shadow_ready && !m_prefetch_failed)
+  {
+    m_late_prefetches++;
+  }
+  m_entry           = next_entry();
+  m_repeat          = 0;
+  m_shadow_ready    = false;
+  m_prefetch_failed = false;
+  return flip;
+}
+
+bool SongPlayer::last_repeat() const
+{
+  /// @note don't use std::array.at(), this will force exception handling to bloat the linked .elf
+  const uint8_t repeats = m_song.m_entries[m_entry].m_repeats;
+  return m_repeat + 1 >= ((repeats == 0) ? 1 : repeats);
+}
+
+std::size_t SongPlayer::next_entry() const { return (m_entry + 1 >= m_song.m_length) ? 0 : m_entry + 1; }
+
+bool SongPlayer::next_needs_decode() const { return m_song.m_entries[next_entry()].m_pattern != m_song.m_entries[m_entry].m_pattern; }
+
+bool SongPlayer::load(std::size_t pattern_id, SequencerStepMap &sequencer_map, uint8_t &length)
+{
+  PackedPattern pattern;
+  uint8_t loaded_length;
+  if (!m_loader(m_context, pattern_id, pattern, loaded_length))
+  {
+    return false;
+  }
+  unpack_pattern(pattern, sequencer_map);
+  length = loaded_length;
+  return true;
+}
+
+} // namespace bass_station
@@ -0,0 +1,174 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <swing_engine.hpp>
+
+namespace bass_station
+{
+
+SwingEngine::SwingEngine()
+{
+  build(min_percent, m_tables[0]);
+}
+
+bool SwingEngine::set_swing(uint8_t percent)
+{
+  if ((percent < min_percent) || (percent > max_percent))
+  {
+    return false;
+  }
+  // withdraw any table the ISR hasn't taken yet, so the one being built can't be taken half written
+  // and only then read the active table, the ISR can't change it after that
+  m_pending_table.store(no_table);
+  const uint8_t next_table = static_cast<uint8_t>(1U - m_active_table.load());
+  build(percent, m_tables[next_table]);
+  m_pending_table.store(next_table, std::memory_order_release);
+  m_percent = percent;
+  return true;
+}
+
+void SwingEngine::reset()
+{
+  // the timer is stopped, so nothing else can take the pending table
+  const uint8_t pending_table = m_pending_table.load(std::memory_order_acquire);
+  if (pending_table != no_table)
+  {
+    m_active_table.store(pending_table, std::memory_order_relaxed);
+    m_pending_table.store(no_table, std::memory_order_relaxed);
+  }
+  m_update_idx  = 0;
+  m_step_counts = active_table().m_first_step_counts;
+}
+
+uint8_t SwingEngine::tick()
+{
+  const Table *table    = &m_tables[m_active_table.load(std::memory_order_relaxed)];
+  const uint8_t actions = table->m_updates[m_update_idx].m_actions;
+  const bool pair_ended = (++m_update_idx >= table->m_count);
+  if (pair_ended)
+  {
+    m_update_idx = 0;
+    // a new swing setting starts with a pair. The main loop can't run between the load and the store (no exchange,
+    // Cortex-M0+ has no LDREX/STREX)
+    const uint8_t pending_table = m_pending_table.load(std::memory_order_acquire);
+    if (pending_table != no_table)
+    {
+      m_active_table.store(pending_table, std::memory_order_relaxed);
+      m_pending_table.store(no_table, std::memory_order_relaxed);
+    }
+  }
+  if (actions & Action::STEP)
+  {
+    // the step update at the end of a pair starts the first step of the next one
+    const uint32_t first_step_counts = active_table().m_first_step_counts;
+    m_step_counts                    = pair_ended ? first_step_counts : (counts_per_pair - first_step_counts);
+  }
+  return actions;
+}
+
+uint16_t SwingEngine::prescaler(uint32_t beat_us)
+{
+  // a beat is counts_per_pair counts of (PSC + 1) timer clocks
+  const uint64_t clocks    = static_cast<uint64_t>(beat_us) * (timer_clock_hz / 1000000U);
+  const uint64_t divisions = (clocks + (counts_per_pair / 2U)) / counts_per_pair;
+  if (divisions == 0)
+  {
+    return 0;
+  }
+  return (divisions > 0x10000U) ? 0xFFFFU : static_cast<uint16_t>(divisions - 1U);
+}
+
+void SwingEngine::set_prescaler(uint16_t prescaler) { m_pending_prescaler.store(prescaler, std::memory_order_relaxed); }
+
+bool SwingEngine::take_prescaler(uint16_t &prescaler)
+{
+  if ((active_table().m_updates[m_update_idx].m_actions & Action::STEP) == 0)
+  {
+    return false;
+  }
+  return flush_prescaler(prescaler);
+}
+
+bool SwingEngine::flush_prescaler(uint16_t &prescaler)
+{
+  // the main loop can't run between the load and the store, see tick()
+  const uint32_t pending_prescaler = m_pending_prescaler.load(std::memory_order_relaxed);
+  if (pending_prescaler == no_prescaler)
+  {
+    return false;
+  }
+  m_pending_prescaler.store(no_prescaler, std::memory_order_relaxed);
+  prescaler = static_cast<uint16_t>(pending_prescaler);
+  return true;
+}
+
+void SwingEngine::build(uint8_t percent, Table &table)
+{
+  // the step update of the first step of the pair ends it, and starts the step that is swung
+  const uint32_t delay_counts = (counts_per_pair * static_cast<uint32_t>(percent - min_percent)) / 100U;
+  const uint32_t swung_counts = (updates_per_step * counts_per_update) + delay_counts;
+  bool step_placed            = (delay_counts < min_update_counts);
+  table.m_first_step_counts   = updates_per_step * counts_per_update;
+
+  table.m_count          = 0;
+  uint32_t previous_counts = 0;
+  auto append            = [&table, &previous_counts](uint32_t counts, uint8_t actions) {
+    table.m_updates[table.m_count] = Update{static_cast<uint16_t>(counts - previous_counts - 1U), actions};
+    table.m_count++;
+    previous_counts = counts;
+  };
+
+  for (uint32_t grid_idx = 0; grid_idx < 2 * updates_per_step; grid_idx++)
+  {
+    const uint32_t grid_counts = (grid_idx + 1U) * counts_per_update;
+    uint8_t actions            = ((grid_idx % updates_per_step) == (updates_per_step - 1U)) ? Action::STEP : Action::CLOCK;
+    if ((grid_idx == updates_per_step - 1U) && !step_placed)
+    {
+      // the step has moved later, the timer still updates here so no period is longer than ARR allows
+      actions = Action::NONE;
+    }
+    if (!step_placed && (swung_counts < grid_counts + min_update_counts))
+    {
+      if (swung_counts + min_update_counts > grid_counts)
+      {
+        // close enough to share this update
+        actions                   = static_cast<uint8_t>(actions | Action::STEP);
+        table.m_first_step_counts = grid_counts;
+      }
+      else if (swung_counts < previous_counts + min_update_counts)
+      {
+        // close enough to share the previous update
+        table.m_updates[table.m_count - 1].m_actions = static_cast<uint8_t>(table.m_updates[table.m_count - 1].m_actions | Action::STEP);
+        table.m_first_step_counts                    = previous_counts;
+      }
+      else
+      {
+        append(swung_counts, Action::STEP);
+        table.m_first_step_counts = swung_counts;
+      }
+      step_placed = true;
+    }
+    append(grid_counts, actions);
+  }
+}
+
+} // namespace bass_station
@@ -0,0 +1,121 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <tap_tempo.hpp>
+
+namespace bass_station
+{
+
+void TapTempo::reset()
+{
+  m_count    = 0;
+  m_next     = 0;
+  m_tapped   = false;
+  m_outliers = 0;
+  m_beat_us  = 0;
+}
+
+bool TapTempo::tap(uint32_t timestamp_us)
+{
+  const uint32_t interval_us = timestamp_us - m_last_tap_us;
+  if (!m_tapped || (interval_us > max_interval_us))
+  {
+    // the first tap of a run, the estimate is kept until a new one is made
+    m_count       = 0;
+    m_next        = 0;
+    m_outliers    = 0;
+    m_tapped      = true;
+    m_last_tap_us = timestamp_us;
+    return false;
+  }
+  if (interval_us < min_interval_us)
+  {
+    return false;
+  }
+  m_last_tap_us = timestamp_us;
+
+  if (m_count != 0)
+  {
+    const uint32_t median_us    = median();
+    const uint32_t deviation_us = (interval_us > median_us) ? (interval_us - median_us) : (median_us - interval_us);
+    if ((static_cast<uint64_t>(deviation_us) << 8) > static_cast<uint64_t>(median_us) * tolerance_q8)
+    {
+      m_outliers++;
+      if (m_outliers < max_outliers)
+      {
+        m_last_outlier_us = interval_us;
+        return false;
+      }
+      // the tempo has changed: start again from the last two intervals
+      m_count = 0;
+      m_next  = 0;
+      push(m_last_outlier_us);
+    }
+  }
+  m_outliers = 0;
+  push(interval_us);
+  if (m_count < 2)
+  {
+    return false;
+  }
+  m_beat_us = median();
+  return true;
+}
+
+uint16_t TapTempo::bpm_x10() const
+{
+  if (m_beat_us == 0)
+  {
+    return 0;
+  }
+  return static_cast<uint16_t>((600000000U + (m_beat_us / 2U)) / m_beat_us);
+}
+
+void TapTempo::push(uint32_t interval_us)
+{
+  /// @note don't use std::array.at(), this will force exception handling to bloat the linked .elf
+  m_intervals[m_next] = interval_us;
+  m_next              = (m_next + 1) % window;
+  m_count             = (m_count < window) ? (m_count + 1) : window;
+}
+
+uint32_t TapTempo::median() const
+{
+  // insertion sort of a copy, the window is only a few intervals
+  std::array<uint32_t, window> sorted{};
+  for (std::size_t idx = 0; idx < m_count; idx++)
+  {
+    const uint32_t interval_us = m_intervals[(m_next + window - m_count + idx) % window];
+    std::size_t slot           = idx;
+    while ((slot > 0) && (sorted[slot - 1] > interval_us))
+    {
+      sorted[slot] = sorted[slot - 1];
+      slot--;
+    }
+    sorted[slot] = interval_us;
+  }
+  // an even count takes the mean of the middle two
+  const std::size_t middle = m_count / 2;
+  return ((m_count % 2) != 0) ? sorted[middle] : ((sorted[middle - 1] + sorted[middle] + 1U) / 2U);
+}
+
+} // namespace bass_station
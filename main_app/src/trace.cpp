@@ -0,0 +1,69 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <flight_recorder.hpp>
+#include <trace.hpp>
+#include <usec_clock.hpp>
+
+#if defined(USE_RTT)
+  #include <SEGGER_RTT.h>
+#endif
+
+namespace bass_station
+{
+
+#if defined(USE_RTT)
+namespace
+{
+/// @brief RTT up-buffer for the trace channel, 256 records. Size it so a slow J-Link poll doesn't drop records.
+char trace_buffer[sizeof(TraceRecord) * 256];
+} // namespace
+#endif
+
+void Trace::initialise()
+{
+#if defined(USE_RTT)
+  SEGGER_RTT_ConfigUpBuffer(m_rtt_channel, "trace", trace_buffer, sizeof(trace_buffer), SEGGER_RTT_MODE_NO_BLOCK_SKIP);
+#endif
+}
+
+void Trace::emit(TraceId id, uint16_t arg0, uint32_t arg1)
+{
+  const TraceRecord record{UsecClock::now(), static_cast<uint16_t>(id), arg0, arg1};
+
+  // always keep the most recent records for the post-mortem log
+  FlightRecorder::record(record);
+
+#if defined(USE_RTT)
+  // SEGGER_RTT_Write() masks interrupts while it copies, and in skip mode writes all of the record or none of it
+  SEGGER_RTT_Write(m_rtt_channel, &record, sizeof(record));
+#endif
+
+#if defined(X86_UNIT_TESTING_ONLY)
+  if (m_host_sink != nullptr)
+  {
+    m_host_sink(m_host_sink_context, record);
+  }
+#endif
+}
+
+} // namespace bass_station
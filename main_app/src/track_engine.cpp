@@ -0,0 +1,103 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <track_engine.hpp>
+
+namespace bass_station
+{
+
+TrackEngine::TrackEngine()
+{
+  for (Track &track : m_tracks)
+  {
+    track = Track{32, 1, 0, 1, false};
+  }
+  // the synth track always plays
+  m_tracks[0].m_enabled = true;
+}
+
+bool TrackEngine::set_length(std::size_t track, uint8_t length)
+{
+  if ((track >= track_count) || (length == 0) || (length > max_length))
+  {
+    return false;
+  }
+  m_tracks[track].m_length = length;
+  return true;
+}
+
+bool TrackEngine::set_divider(std::size_t track, uint8_t divider)
+{
+  if ((track >= track_count) || (divider == 0) || (divider > max_divider))
+  {
+    return false;
+  }
+  m_tracks[track].m_divider = divider;
+  // don't leave a long countdown from the old divider running
+  if (m_tracks[track].m_countdown > divider)
+  {
+    m_tracks[track].m_countdown = divider;
+  }
+  return true;
+}
+
+void TrackEngine::set_enabled(std::size_t track, bool enabled)
+{
+  if (track < track_count)
+  {
+    m_tracks[track].m_enabled = enabled;
+  }
+}
+
+void TrackEngine::reset()
+{
+  for (Track &track : m_tracks)
+  {
+    track.m_position  = 0;
+    track.m_countdown = track.m_divider;
+  }
+  m_ticks = 0;
+}
+
+TrackEngine::Tick TrackEngine::tick()
+{
+  Tick result{0, 0};
+  m_ticks++;
+  for (std::size_t idx = 0; idx < track_count; idx++)
+  {
+    Track &track = m_tracks[idx];
+    if (!track.m_enabled || (--track.m_countdown != 0))
+    {
+      continue;
+    }
+    track.m_countdown = track.m_divider;
+    result.m_stepped |= static_cast<uint8_t>(1U << idx);
+    if (++track.m_position >= track.m_length)
+    {
+      track.m_position = 0;
+      result.m_wrapped |= static_cast<uint8_t>(1U << idx);
+    }
+  }
+  return result;
+}
+
+} // namespace bass_station
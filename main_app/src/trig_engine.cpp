@@ -0,0 +1,109 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <trig_engine.hpp>
+
+namespace bass_station
+{
+
+static_assert(static_cast<std::size_t>(TrigCondition::count) <= 16, "the conditions are bits of a 16 bit mask");
+
+TrigEngine::TrigEngine(uint32_t seed)
+{
+  set_seed(seed);
+  reset();
+}
+
+void TrigEngine::set_seed(uint32_t seed) { m_seed = (seed != 0) ? seed : default_seed; }
+
+void TrigEngine::reset()
+{
+  m_state = m_seed;
+  m_loop  = 0;
+  update_condition_mask();
+}
+
+void TrigEngine::loop_started()
+{
+  m_loop++;
+  update_condition_mask();
+}
+
+void TrigEngine::set_fill(bool fill)
+{
+  m_fill = fill;
+  update_condition_mask();
+}
+
+bool TrigEngine::fire(const Step &step)
+{
+  const uint32_t draw = next();
+  /// @note don't use std::array.at(), this will force exception handling to bloat the linked .elf
+  const bool chance    = (draw >> 16) < thresholds[step.m_probability & (probability_levels - 1U)];
+  const bool condition = ((m_condition_mask >> (static_cast<uint8_t>(step.m_condition) & 0x0FU)) & 1U) != 0;
+  return (step.m_state == StepState::ON) & chance & condition;
+}
+
+uint8_t TrigEngine::probability_percent(uint8_t probability)
+{
+  return static_cast<uint8_t>(((thresholds[probability & (probability_levels - 1U)] * 100U) + 32768U) >> 16);
+}
+
+void TrigEngine::cycle(Step &step)
+{
+  if (step.m_condition != TrigCondition::ALWAYS)
+  {
+    const uint8_t next_condition = static_cast<uint8_t>(static_cast<uint8_t>(step.m_condition) + 1U);
+    step.m_probability           = 0;
+    step.m_condition = (next_condition < static_cast<uint8_t>(TrigCondition::count)) ? static_cast<TrigCondition>(next_condition) : TrigCondition::ALWAYS;
+  }
+  else if (step.m_probability + 1U < probability_levels)
+  {
+    step.m_probability++;
+  }
+  else
+  {
+    step.m_probability = 0;
+    step.m_condition   = TrigCondition::FILL;
+  }
+}
+
+uint32_t TrigEngine::next() { return xorshift32(m_state); }
+
+void TrigEngine::update_condition_mask()
+{
+  uint16_t mask = 1U << static_cast<uint8_t>(TrigCondition::ALWAYS);
+  mask |= static_cast<uint16_t>((m_fill ? 1U : 0U) << static_cast<uint8_t>(TrigCondition::FILL));
+  mask |= static_cast<uint16_t>((m_fill ? 0U : 1U) << static_cast<uint8_t>(TrigCondition::NOT_FILL));
+  mask |= static_cast<uint16_t>(((m_loop == 0) ? 1U : 0U) << static_cast<uint8_t>(TrigCondition::FIRST));
+  mask |= static_cast<uint16_t>(((m_loop != 0) ? 1U : 0U) << static_cast<uint8_t>(TrigCondition::NOT_FIRST));
+  for (std::size_t idx = 0; idx < m_loop_conditions.size(); idx++)
+  {
+    if ((m_loop % m_loop_conditions[idx].m_divisor) == m_loop_conditions[idx].m_remainder)
+    {
+      mask |= static_cast<uint16_t>(1U << (static_cast<uint8_t>(TrigCondition::LOOP_1_OF_2) + idx));
+    }
+  }
+  m_condition_mask = mask;
+}
+
+} // namespace bass_station
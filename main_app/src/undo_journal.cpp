@@ -0,0 +1,227 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <undo_journal.hpp>
+
+namespace bass_station
+{
+
+void UndoJournal::clear()
+{
+  m_begin  = 0;
+  m_cursor = 0;
+  m_end    = 0;
+  m_snapshot_used.fill(false);
+  m_next_snapshot = 0;
+}
+
+void UndoJournal::record_step(const Step &before, const Step &after, bool merge)
+{
+  const uint8_t index = after.m_sequence_abs_pos_index & index_mask;
+  struct Change
+  {
+    Field m_field;
+    uint8_t m_old;
+    uint8_t m_new;
+  };
+  const std::array<Change, 5> fields{{
+      {Field::STATE, static_cast<uint8_t>(before.m_state), static_cast<uint8_t>(after.m_state)},
+      {Field::NOTE, static_cast<uint8_t>(before.m_note), static_cast<uint8_t>(after.m_note)},
+      {Field::RATCHET, before.m_ratchet, after.m_ratchet},
+      {Field::PROBABILITY, before.m_probability, after.m_probability},
+      {Field::CONDITION, static_cast<uint8_t>(before.m_condition), static_cast<uint8_t>(after.m_condition)},
+  }};
+
+  std::size_t changed_count{0};
+  for (const Change &field : fields)
+  {
+    changed_count += (field.m_old != field.m_new) ? 1U : 0U;
+  }
+  if (changed_count == 0)
+  {
+    return;
+  }
+
+  // a note change merges into the last edit if that was a note change of the same step, and nothing has been undone
+  const uint8_t note_target = static_cast<uint8_t>(index | (static_cast<uint8_t>(Field::NOTE) << field_shift));
+  if (merge && (changed_count == 1) && (fields[1].m_old != fields[1].m_new) && (m_cursor == m_end) && (m_end != m_begin))
+  {
+    Delta &last = at(static_cast<uint16_t>(m_end - 1));
+    if ((last.m_target == note_target) && ((last.m_old & first_bit) != 0))
+    {
+      last.m_new = fields[1].m_new;
+      if ((last.m_old & value_mask) == last.m_new)
+      {
+        // back where it started, the edit is gone
+        m_end--;
+        m_cursor--;
+      }
+      return;
+    }
+  }
+
+  begin_edit();
+  bool first{true};
+  for (const Change &field : fields)
+  {
+    if (field.m_old != field.m_new)
+    {
+      push(index, field.m_field, field.m_old, field.m_new, first);
+      first = false;
+    }
+  }
+}
+
+void UndoJournal::record_pattern(const SequencerStepMap &sequencer_map)
+{
+  begin_edit();
+
+  // the next slot is the oldest in use, if any: its edit and the ones before it go
+  const uint8_t slot = m_next_snapshot;
+  while (m_snapshot_used[slot])
+  {
+    drop_oldest();
+  }
+  m_next_snapshot = static_cast<uint8_t>((slot + 1U) % snapshot_count);
+
+  /// @note don't use std::array.at(), this will force exception handling to bloat the linked .elf
+  pack_pattern(sequencer_map, m_snapshots[slot]);
+  m_snapshot_owners[slot] = m_end;
+  m_snapshot_used[slot]   = true;
+  push(slot, Field::PATTERN, 0, 0, true);
+}
+
+bool UndoJournal::undo(SequencerStepMap &sequencer_map)
+{
+  if (!can_undo())
+  {
+    return false;
+  }
+  // back to the first delta of the edit
+  bool first{false};
+  while (!first)
+  {
+    m_cursor           = static_cast<uint16_t>(m_cursor - 1);
+    const Delta &delta = at(m_cursor);
+    first              = (delta.m_old & first_bit) != 0;
+    apply(sequencer_map, delta, true);
+  }
+  return true;
+}
+
+bool UndoJournal::redo(SequencerStepMap &sequencer_map)
+{
+  if (!can_redo())
+  {
+    return false;
+  }
+  // on to the first delta of the next edit
+  do
+  {
+    apply(sequencer_map, at(m_cursor), false);
+    m_cursor = static_cast<uint16_t>(m_cursor + 1);
+  } while ((m_cursor != m_end) && ((at(m_cursor).m_old & first_bit) == 0));
+  return true;
+}
+
+void UndoJournal::begin_edit()
+{
+  // the undone edits can't be redone after a new edit, free their pattern copies
+  for (std::size_t slot = 0; slot < snapshot_count; slot++)
+  {
+    /// @note don't use std::array.at(), this will force exception handling to bloat the linked .elf
+    if (m_snapshot_used[slot] && (static_cast<uint16_t>(m_snapshot_owners[slot] - m_cursor) < static_cast<uint16_t>(m_end - m_cursor)))
+    {
+      m_snapshot_used[slot] = false;
+    }
+  }
+  m_end = m_cursor;
+}
+
+void UndoJournal::push(uint8_t index, Field field, uint8_t old_value, uint8_t new_value, bool first)
+{
+  if (size() == delta_count)
+  {
+    drop_oldest();
+  }
+  at(m_end) = Delta{static_cast<uint8_t>((index & index_mask) | (static_cast<uint8_t>(field) << field_shift)),
+                    static_cast<uint8_t>((old_value & value_mask) | (first ? first_bit : 0U)),
+                    new_value};
+  m_end     = static_cast<uint16_t>(m_end + 1);
+  m_cursor  = m_end;
+}
+
+void UndoJournal::drop_oldest()
+{
+  // the first delta, and the rest of its edit
+  do
+  {
+    const Delta &delta = at(m_begin);
+    if (static_cast<Field>(delta.m_target >> field_shift) == Field::PATTERN)
+    {
+      /// @note don't use std::array.at(), this will force exception handling to bloat the linked .elf
+      m_snapshot_used[(delta.m_target & index_mask) % snapshot_count] = false;
+    }
+    m_begin = static_cast<uint16_t>(m_begin + 1);
+  } while ((m_begin != m_end) && ((at(m_begin).m_old & first_bit) == 0));
+}
+
+void UndoJournal::apply(SequencerStepMap &sequencer_map, const Delta &delta, bool undo)
+{
+  const uint8_t index = delta.m_target & index_mask;
+  const uint8_t value = undo ? static_cast<uint8_t>(delta.m_old & value_mask) : delta.m_new;
+  /// @note don't use std::array.at(), this will force exception handling to bloat the linked .elf
+  Step &step = sequencer_map.data[index].second;
+  switch (static_cast<Field>(delta.m_target >> field_shift))
+  {
+    case Field::STATE:
+      step.m_state = static_cast<StepState>(value);
+      break;
+    case Field::NOTE:
+      step.m_note = static_cast<Note>(value);
+      break;
+    case Field::RATCHET:
+      step.m_ratchet = value;
+      break;
+    case Field::PROBABILITY:
+      step.m_probability = value;
+      break;
+    case Field::CONDITION:
+      step.m_condition = static_cast<TrigCondition>(value);
+      break;
+    case Field::PATTERN:
+      swap_snapshot(sequencer_map, index);
+      break;
+  }
+}
+
+void UndoJournal::swap_snapshot(SequencerStepMap &sequencer_map, uint8_t slot)
+{
+  // the copy holds the pattern from before the edit when it is done, and from after it when it is undone
+  PackedPattern current;
+  pack_pattern(sequencer_map, current);
+  /// @note don't use std::array.at(), this will force exception handling to bloat the linked .elf
+  unpack_pattern(m_snapshots[slot % snapshot_count], sequencer_map);
+  m_snapshots[slot % snapshot_count] = current;
+}
+
+} // namespace bass_station
@@ -0,0 +1,56 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <critical_section.hpp>
+#include <usec_clock.hpp>
+
+namespace bass_station
+{
+
+void UsecClock::initialise(TIM_TypeDef *timer)
+{
+  m_timer      = timer;
+  m_wrap_count = 0;
+  m_last_count = (m_timer == nullptr) ? 0 : static_cast<uint16_t>(m_timer->CNT);
+}
+
+uint32_t UsecClock::now()
+{
+#if defined(X86_UNIT_TESTING_ONLY)
+  // host tests that have not given a mock timer use the simulated clock
+  if (m_timer == nullptr)
+  {
+    return m_host_time_us;
+  }
+#endif
+  // the read and the wrap update must not be split by another caller
+  CriticalSection critical_section;
+  const uint16_t count = static_cast<uint16_t>(m_timer->CNT);
+  if (count < m_last_count)
+  {
+    m_wrap_count = m_wrap_count + 1;
+  }
+  m_last_count = count;
+  return (m_wrap_count << 16) | count;
+}
+
+} // namespace bass_station
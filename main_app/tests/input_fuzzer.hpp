@@ -0,0 +1,98 @@
+#ifndef __INPUT_FUZZER_HPP__
+#define __INPUT_FUZZER_HPP__
+
+#include <algorithm>
+#include <input_replayer.hpp>
+
+// Decodes fuzzer bytes into the inputs of a SimulatedSequencer: bursts of raw key events, encoder turns, encoder switch
+// presses and tempo ticks, each followed by one pass of the main loop. The state the inputs can reach is checked after
+// every input. Used by the host tests and by the libFuzzer target in tools/fuzz_input_path.
+
+namespace bass_station
+{
+
+/// @brief Check the sequencer state that the input path must keep in range whatever the inputs
+/// @param sequencer The sequencer
+/// @return false if an invariant is broken
+inline bool input_path_invariants_hold(const SequenceManager &sequencer)
+{
+  const SequencerStepMap &step_map = sequencer.active_step_map();
+  if (sequencer.selected_step_index() >= step_map.data.size())
+  {
+    return false;
+  }
+  for (std::size_t index = 0; index < step_map.data.size(); index++)
+  {
+    const Step &step = step_map.data[index].second;
+    if ((step.m_note > Note::none) || ((step.m_state != StepState::ON) && (step.m_state != StepState::OFF)) || (step.m_sequence_abs_pos_index != index))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// @brief Run the inputs encoded in the bytes. Each input is an operation byte and an argument byte:
+/// - 0: a burst of (argument % 10) + 1 raw key events taken from the following bytes, as one read of the ADP5587 FIFO.
+///   The debounce timer moves on 400ms first, or (argument & 0x3F)ms if bit 7 of the argument is set (a bouncing key)
+/// - 1: the encoder turned by the argument as a signed count, the direction bit is set when it counts down
+/// - 2: the encoder switch pressed, the debounce timer moves on 4 * argument ms first
+/// - 3: (argument % 32) + 1 tempo ticks
+/// @param data The bytes
+/// @param size The number of bytes
+/// @return false if an invariant was broken, see input_path_invariants_hold()
+inline bool fuzz_input_path(const uint8_t *data, std::size_t size)
+{
+  SimulatedSequencer simulation;
+  std::size_t index = 0;
+  while (index + 1 < size)
+  {
+    const uint8_t operation = data[index] % 4;
+    const uint8_t argument  = data[index + 1];
+    index += 2;
+    switch (operation)
+    {
+      case 0:
+      {
+        simulation.m_debounce_timer.CNT = simulation.m_debounce_timer.CNT + (((argument & 0x80U) != 0) ? (argument & 0x3FU) : 400U);
+        const std::size_t burst_end = std::min(size, index + (argument % 10U) + 1U);
+        for (; index < burst_end; index++)
+        {
+          simulation.sequencer().simulate_key_event(static_cast<SequencerKeyEventIndex>(data[index]));
+        }
+        break;
+      }
+      case 1:
+      {
+        const int8_t delta             = static_cast<int8_t>(argument);
+        simulation.m_encoder_timer.CNT = (simulation.m_encoder_timer.CNT + static_cast<uint32_t>(delta)) & 0xFFFFU;
+        simulation.m_encoder_timer.CR1 = (delta < 0) ? TIM_CR1_DIR : 0U;
+        break;
+      }
+      case 2:
+        simulation.m_debounce_timer.CNT = simulation.m_debounce_timer.CNT + (4U * argument);
+        simulation.sequencer().simulate_encoder_switch_interrupt();
+        DeferredWork::run_pending();
+        break;
+      default:
+        for (uint8_t tick = 0; tick < (argument % 32U) + 1U; tick++)
+        {
+          UsecClock::advance(1736);
+          simulation.sequencer().simulate_tempo_interrupt();
+          DeferredWork::run_pending();
+          simulation.sequencer().run_main_loop_iteration();
+        }
+        break;
+    }
+    simulation.sequencer().run_main_loop_iteration();
+    if (!input_path_invariants_hold(simulation.sequencer()))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace bass_station
+
+#endif // __INPUT_FUZZER_HPP__
@@ -0,0 +1,243 @@
+#ifndef __INPUT_REPLAYER_HPP__
+#define __INPUT_REPLAYER_HPP__
+
+#include <deferred_work.hpp>
+#include <fstream>
+#include <input_recorder.hpp>
+#include <memory>
+#include <sequence_manager.hpp>
+#include <string>
+#include <trace.hpp>
+#include <usec_clock.hpp>
+#include <vector>
+
+// Replays an InputRecorder log into a SequenceManager running on the host and collects the trace records it outputs.
+// The inputs are applied in order, each followed by one pass of the main loop, as the device does when an input wakes
+// it from sleep.
+
+namespace bass_station
+{
+
+/// @brief A SequenceManager with its peripheral registers in host memory
+class SimulatedSequencer
+{
+public:
+  SimulatedSequencer()
+  {
+    // the replay starts from the power on state of the encoder, see the SequenceManager constructor
+    m_encoder_timer.CNT = 16;
+    m_sequencer        = std::make_unique<SequenceManager>(std::make_pair(&m_tempo_timer, STM32G0_ISR::tim3),
+                                                    &m_encoder_timer,
+                                                    m_display_spi_interface,
+                                                    &m_keypad_i2c,
+                                                    &m_debounce_timer,
+                                                    &m_switch_i2c,
+                                                    m_led_spi_interface,
+                                                    m_midi_usart_interface,
+                                                    &m_midi_usart);
+    Trace::set_host_sink(&SimulatedSequencer::collect_output, this);
+    InputRecorder::start();
+  }
+
+  ~SimulatedSequencer() { Trace::set_host_sink(nullptr, nullptr); }
+
+  SimulatedSequencer(const SimulatedSequencer &)            = delete;
+  SimulatedSequencer &operator=(const SimulatedSequencer &) = delete;
+
+  /// @brief Apply one input and run one pass of the main loop, or one pass per tick for a run of tempo ticks. A press
+  /// time is kept for the key event that follows it, without a pass.
+  /// @param input An InputRecorder record
+  void apply(const TraceRecord &input)
+  {
+    switch (static_cast<InputId>(input.m_id))
+    {
+      case InputId::TEMPO_TICK:
+        // a run of ticks, each one is followed by a pass. The counter restarts at each update.
+        for (uint32_t tick = 1; tick < input.m_arg1; tick++)
+        {
+          m_tempo_timer.CNT = 0;
+          m_sequencer->simulate_tempo_interrupt();
+          DeferredWork::run_pending();
+          m_sequencer->run_main_loop_iteration();
+        }
+        m_tempo_timer.CNT = 0;
+        m_sequencer->simulate_tempo_interrupt();
+        DeferredWork::run_pending();
+        break;
+      case InputId::KEY_PRESS_TIME:
+        m_sequencer->simulate_key_press_time(input.m_arg1);
+        return;
+      case InputId::RATCHET_COMPARE:
+        m_tempo_timer.CNT = input.m_arg1;
+        m_sequencer->simulate_ratchet_compare_interrupt();
+        DeferredWork::run_pending();
+        break;
+      case InputId::KEY_EVENT:
+        m_debounce_timer.CNT = input.m_arg1;
+        m_sequencer->simulate_key_event(static_cast<SequencerKeyEventIndex>(input.m_arg0));
+        break;
+      case InputId::ENCODER:
+        m_encoder_timer.CNT = input.m_arg0;
+        m_encoder_timer.CR1 = input.m_arg1;
+        break;
+      case InputId::ENCODER_SWITCH:
+        m_encoder_timer.CNT  = input.m_arg0;
+        m_debounce_timer.CNT = input.m_arg1;
+        m_sequencer->simulate_encoder_switch_interrupt();
+        DeferredWork::run_pending();
+        break;
+    }
+    m_sequencer->run_main_loop_iteration();
+  }
+
+  /// @brief Replay a log, with the clock at the time of each record. The logged press times and step times are then on
+  /// the same clock as the replay.
+  /// @param inputs The records, oldest first
+  void replay(const std::vector<TraceRecord> &inputs)
+  {
+    for (const TraceRecord &input : inputs)
+    {
+      UsecClock::advance(input.m_timestamp_us - UsecClock::now());
+      apply(input);
+    }
+  }
+
+  /// @brief Get the trace records output since construction
+  const std::vector<TraceRecord> &outputs() const { return m_outputs; }
+
+  SequenceManager &sequencer() { return *m_sequencer; }
+
+  /// @brief The registers the inputs are read from. A test can change them as the hardware would.
+  TIM_TypeDef m_tempo_timer{};
+  TIM_TypeDef m_encoder_timer{};
+  TIM_TypeDef m_debounce_timer{};
+
+private:
+  static void collect_output(void *context, const TraceRecord &record) { static_cast<SimulatedSequencer *>(context)->m_outputs.push_back(record); }
+
+  SPI_TypeDef m_display_spi{};
+  SPI_TypeDef m_led_spi{};
+  GPIO_TypeDef m_display_gpio{};
+  GPIO_TypeDef m_led_gpio{};
+  I2C_TypeDef m_keypad_i2c{};
+  I2C_TypeDef m_switch_i2c{};
+  TIM_TypeDef m_gsclk_timer{};
+  USART_TypeDef m_midi_usart{};
+
+  ssd1306::DriverSerialInterface<STM32G0_ISR> m_display_spi_interface{&m_display_spi,
+                                                                      std::make_pair(&m_display_gpio, GPIO_BSRR_BS0),
+                                                                      std::make_pair(&m_display_gpio, GPIO_BSRR_BS3),
+                                                                      STM32G0_ISR::dma1_ch2};
+  tlc5955::DriverSerialInterface m_led_spi_interface{&m_led_spi,
+                                                     std::make_pair(&m_led_gpio, GPIO_BSRR_BS9),
+                                                     std::make_pair(&m_led_gpio, GPIO_BSRR_BS7),
+                                                     std::make_pair(&m_led_gpio, GPIO_BSRR_BS8),
+                                                     std::make_pair(&m_gsclk_timer, TIM_CCER_CC1E),
+                                                     RCC_IOPENR_GPIOBEN,
+                                                     RCC_APBENR1_SPI2EN};
+  midi_stm32::DeviceInterface<STM32G0_ISR> m_midi_usart_interface{&m_midi_usart, STM32G0_ISR::usart5};
+
+  std::unique_ptr<SequenceManager> m_sequencer;
+  std::vector<TraceRecord> m_outputs;
+};
+
+/// @brief Reduce a trace to the switch, MIDI and LED output stream, in a form that does not depend on how many main
+/// loop passes there were between the inputs:
+/// - timestamps are zeroed
+/// - an LED frame is dropped if it is the same as the previous one
+/// - a switch opened and closed again straight away (the note of a step played again by the next pass) is dropped, as
+///   is a switch write that doesn't change the switch. The retriggers of a ratcheted step (TraceId::RATCHET_GATE) are
+///   kept, they are played by the interrupts rather than the passes.
+/// @param trace The trace records, oldest first
+/// @return The output records
+inline std::vector<TraceRecord> output_stream(const std::vector<TraceRecord> &trace)
+{
+  std::vector<TraceRecord> outputs;
+  for (const TraceRecord &record : trace)
+  {
+    switch (static_cast<TraceId>(record.m_id))
+    {
+      case TraceId::SWITCH_WRITE:
+      case TraceId::SWITCH_CLEAR:
+      case TraceId::RATCHET_GATE:
+      case TraceId::MIDI_BYTE:
+      case TraceId::MIDI_NOTE:
+      case TraceId::LED_LATCH:
+        outputs.push_back(TraceRecord{0, record.m_id, record.m_arg0, record.m_arg1});
+        break;
+      default:
+        break;
+    }
+  }
+
+  std::vector<TraceRecord> stream;
+  std::array<bool, 64> switch_closed{};
+  const TraceRecord *previous_frame{nullptr};
+  for (std::size_t index = 0; index < outputs.size(); index++)
+  {
+    const TraceRecord &record = outputs[index];
+    switch (static_cast<TraceId>(record.m_id))
+    {
+      case TraceId::SWITCH_WRITE:
+      {
+        const bool close = (record.m_arg1 != 0);
+        if (!close && (index + 1 < outputs.size()) && (outputs[index + 1].m_id == record.m_id) && (outputs[index + 1].m_arg0 == record.m_arg0) &&
+            (outputs[index + 1].m_arg1 != 0) && switch_closed[record.m_arg0 % switch_closed.size()])
+        {
+          index++;
+          break;
+        }
+        if (switch_closed[record.m_arg0 % switch_closed.size()] != close)
+        {
+          switch_closed[record.m_arg0 % switch_closed.size()] = close;
+          stream.push_back(record);
+        }
+        break;
+      }
+      case TraceId::RATCHET_GATE:
+        switch_closed[record.m_arg0 % switch_closed.size()] = (record.m_arg1 != 0);
+        stream.push_back(record);
+        break;
+      case TraceId::SWITCH_CLEAR:
+        switch_closed.fill(false);
+        stream.push_back(record);
+        break;
+      case TraceId::LED_LATCH:
+        if ((previous_frame == nullptr) || (previous_frame->m_arg0 != record.m_arg0) || (previous_frame->m_arg1 != record.m_arg1))
+        {
+          previous_frame = &record;
+          stream.push_back(record);
+        }
+        break;
+      default:
+        stream.push_back(record);
+        break;
+    }
+  }
+  return stream;
+}
+
+/// @brief Read a binary capture of TraceRecords: an RTT logger capture of the trace (channel 1) or input (channel 2)
+/// channel, or INPUTS.BIN from the uSD card
+/// @param path The file
+/// @param records The records read
+/// @return false if the file can't be opened
+inline bool read_capture(const std::string &path, std::vector<TraceRecord> &records)
+{
+  std::ifstream capture(path, std::ios::binary);
+  if (!capture)
+  {
+    return false;
+  }
+  // little-endian on both sides, so the records are read as-is
+  TraceRecord record;
+  while (capture.read(reinterpret_cast<char *>(&record), sizeof(record)))
+  {
+    records.push_back(record);
+  }
+  return true;
+}
+
+} // namespace bass_station
+
+#endif // __INPUT_REPLAYER_HPP__
@@ -0,0 +1,207 @@
+#ifndef __MEMORY_DISKIO_HPP__
+#define __MEMORY_DISKIO_HPP__
+
+#include <algorithm>
+#include <catch2/catch_all.hpp>
+#include <cstdint>
+#include <cstring>
+#include <ff_driver.hpp>
+#include <usec_clock.hpp>
+#include <vector>
+
+// A FAT volume in host memory for the tests of the uSD card code, with the real FatFs driver mounted on it.
+
+namespace bass_station
+{
+
+/// @brief A diskio layer on a FAT12 volume in host memory, in place of fatfs::DiskioHardwareMMC and the card. The
+/// sectors of one file can be watched: their reads and writes are counted, and the writes can be cut off as a power
+/// loss would cut them. Each sector read or written can be made to take time on the UsecClock, as it does on the card.
+class MemoryDiskio
+{
+public:
+  static constexpr std::size_t sector_size{512};
+  // 1MB with one sector to the cluster, so the library file is a chain of 113 clusters
+  static constexpr std::size_t volume_sectors{2048};
+  static constexpr std::size_t fat_sectors{6};
+  static constexpr std::size_t root_entries{512};
+  static constexpr std::size_t root_sector{1 + 2 * fat_sectors};
+  static constexpr std::size_t data_sector{root_sector + root_entries * 32 / sector_size};
+
+  MemoryDiskio()
+      : m_image(volume_sectors * sector_size)
+  {
+    format();
+  }
+
+  fatfs::DSTATUS disk_initialize(fatfs::BYTE) { return 0; }
+  fatfs::DSTATUS disk_status(fatfs::BYTE) { return 0; }
+  fatfs::DRESULT disk_ioctl(fatfs::BYTE, fatfs::BYTE, void *) { return fatfs::DRESULT::RES_OK; }
+
+  fatfs::DRESULT disk_read(fatfs::BYTE, fatfs::BYTE *buff, fatfs::LBA_t sector, fatfs::UINT count)
+  {
+    if (sector + count > volume_sectors)
+    {
+      return fatfs::DRESULT::RES_PARERR;
+    }
+    m_file_sector_reads += watched_sectors(sector, count);
+    UsecClock::advance(static_cast<uint32_t>(count) * m_sector_access_us);
+    std::memcpy(buff, &m_image[sector * sector_size], count * sector_size);
+    return fatfs::DRESULT::RES_OK;
+  }
+
+  fatfs::DRESULT disk_write(fatfs::BYTE, const fatfs::BYTE *buff, fatfs::LBA_t sector, fatfs::UINT count)
+  {
+    if (m_file_writes_left == 0)
+    {
+      // power lost
+      return fatfs::DRESULT::RES_ERROR;
+    }
+    if (sector + count > volume_sectors)
+    {
+      return fatfs::DRESULT::RES_PARERR;
+    }
+    const std::size_t watched = watched_sectors(sector, count);
+    m_file_sector_writes += watched;
+    if ((watched != 0) && (m_file_writes_left != SIZE_MAX))
+    {
+      m_file_writes_left--;
+    }
+    UsecClock::advance(static_cast<uint32_t>(count) * m_sector_access_us);
+    std::memcpy(&m_image[sector * sector_size], buff, count * sector_size);
+    return fatfs::DRESULT::RES_OK;
+  }
+
+  /// @brief Find a file in the root directory and watch its sectors
+  /// @param name The 8.3 name as it is in the directory entry: space padded, without the dot
+  /// @return The file size, or zero if there is no such file
+  std::size_t watch_file(const char (&name)[12])
+  {
+    m_watched.clear();
+    for (std::size_t entry = 0; entry < root_entries; entry++)
+    {
+      const uint8_t *dir_entry = &m_image[root_sector * sector_size + entry * 32];
+      if (std::memcmp(dir_entry, name, 11) != 0)
+      {
+        continue;
+      }
+      // follow the cluster chain through the first FAT, clusters start at 2
+      uint32_t cluster = static_cast<uint32_t>(dir_entry[26] | (dir_entry[27] << 8));
+      while ((cluster >= 2) && (cluster < 0xFF8))
+      {
+        m_watched.push_back(data_sector + cluster - 2);
+        cluster = fat_entry(cluster);
+      }
+      return static_cast<std::size_t>(dir_entry[28] | (dir_entry[29] << 8) | (dir_entry[30] << 16) | (dir_entry[31] << 24));
+    }
+    return 0;
+  }
+
+  /// @brief Overwrite one byte of the watched file in the image, as a bad card or another firmware version would
+  void poke(std::size_t file_offset, uint8_t value)
+  {
+    REQUIRE(file_offset / sector_size < m_watched.size());
+    m_image[m_watched[file_offset / sector_size] * sector_size + file_offset % sector_size] = value;
+  }
+
+  /// @brief Let this many more writes of the watched file through, then fail every write after them
+  void fail_writes_after(std::size_t count) { m_file_writes_left = count; }
+
+  /// @brief Make each sector read or write take this long from now on
+  void set_sector_access_us(uint32_t access_us) { m_sector_access_us = access_us; }
+
+  std::size_t sector_reads() const { return m_file_sector_reads; }
+  std::size_t sector_writes() const { return m_file_sector_writes; }
+  void reset_counters()
+  {
+    m_file_sector_reads  = 0;
+    m_file_sector_writes = 0;
+  }
+
+private:
+  std::vector<uint8_t> m_image;
+  std::vector<std::size_t> m_watched;
+  std::size_t m_file_sector_reads{0};
+  std::size_t m_file_sector_writes{0};
+  std::size_t m_file_writes_left{SIZE_MAX};
+  uint32_t m_sector_access_us{0};
+
+  /// @brief Write an empty FAT12 volume: a boot sector with no partition table, two FATs and the root directory
+  void format()
+  {
+    uint8_t *boot = m_image.data();
+    const uint8_t jump[]{0xEB, 0x3C, 0x90};
+    std::memcpy(&boot[0], jump, sizeof(jump));
+    std::memcpy(&boot[3], "MSDOS5.0", 8);
+    store(&boot[11], sector_size, 2);
+    boot[13] = 1; // sectors per cluster
+    store(&boot[14], 1, 2); // reserved sectors
+    boot[16] = 2; // FATs
+    store(&boot[17], root_entries, 2);
+    store(&boot[19], volume_sectors, 2);
+    boot[21] = 0xF8; // fixed disk
+    store(&boot[22], fat_sectors, 2);
+    store(&boot[24], 32, 2); // sectors per track
+    store(&boot[26], 2, 2);  // heads
+    boot[36] = 0x80;
+    boot[38] = 0x29;
+    store(&boot[39], 0x12345678, 4);
+    std::memcpy(&boot[43], "NO NAME    FAT12   ", 19);
+    boot[510] = 0x55;
+    boot[511] = 0xAA;
+    for (std::size_t fat = 0; fat < 2; fat++)
+    {
+      // the media byte and the end of chain marker in the first two entries
+      const uint8_t reserved[]{0xF8, 0xFF, 0xFF};
+      std::memcpy(&m_image[(1 + fat * fat_sectors) * sector_size], reserved, sizeof(reserved));
+    }
+  }
+
+  static void store(uint8_t *field, std::size_t value, std::size_t bytes)
+  {
+    for (std::size_t idx = 0; idx < bytes; idx++)
+    {
+      field[idx] = static_cast<uint8_t>(value >> (idx * 8));
+    }
+  }
+
+  uint32_t fat_entry(uint32_t cluster) const
+  {
+    // 12 bits an entry, two entries in three bytes
+    const std::size_t offset = sector_size + cluster + cluster / 2;
+    const uint32_t pair      = static_cast<uint32_t>(m_image[offset] | (m_image[offset + 1] << 8));
+    return ((cluster % 2) == 0) ? (pair & 0xFFF) : (pair >> 4);
+  }
+
+  std::size_t watched_sectors(fatfs::LBA_t sector, fatfs::UINT count) const
+  {
+    return static_cast<std::size_t>(std::count_if(m_watched.begin(), m_watched.end(), [sector, count](std::size_t watched) {
+      return (watched >= sector) && (watched < sector + count);
+    }));
+  }
+};
+
+/// @brief The FatFs driver mounted on a MemoryDiskio, as FileManager mounts it on the card
+struct Volume
+{
+  MemoryDiskio m_diskio;
+  fatfs::Driver<MemoryDiskio> m_driver{m_diskio};
+  fatfs::FATFS m_filesys{};
+
+  Volume() { mount(); }
+
+  /// @brief Mount the volume again, as a power cycle would. FatFs keeps nothing from before.
+  void mount()
+  {
+    m_filesys = {};
+    REQUIRE(m_driver.f_mount(&m_filesys, "0:", 1) == fatfs::FRESULT::FR_OK);
+  }
+
+  /// @brief Watch the sectors of the library file, once it has been created
+  /// @return The file size
+  std::size_t watch_library() { return m_diskio.watch_file("PATTERNSBSL"); }
+};
+
+} // namespace bass_station
+
+#endif // __MEMORY_DISKIO_HPP__
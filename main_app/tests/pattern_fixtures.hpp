@@ -0,0 +1,39 @@
+#ifndef __PATTERN_FIXTURES_HPP__
+#define __PATTERN_FIXTURES_HPP__
+
+#include <keypad_manager.hpp>
+#include <pattern_bank.hpp>
+#include <utility>
+
+// The patterns and step maps the host tests build their cases from.
+
+namespace bass_station
+{
+
+template <std::size_t... IDX> SequencerStepMap make_step_map(std::index_sequence<IDX...>)
+{
+  return SequencerStepMap{{{std::make_pair(static_cast<SequencerKeyEventIndex>(IDX + 1),
+                                           Step(StepState::OFF, Note::c0, default_colour, IDX))...}}};
+}
+
+/// @brief A map of 32 steps, all OFF and playing c0. Step n has key event n + 1 and LED n.
+inline SequencerStepMap make_step_map() { return make_step_map(std::make_index_sequence<32>()); }
+
+/// @brief A packed pattern whose notes and ON steps follow from the seed, different seeds give different patterns
+inline PackedPattern make_pattern(uint16_t seed)
+{
+  PackedPattern pattern;
+  for (std::size_t idx = 0; idx < pattern.size(); idx++)
+  {
+    pattern[idx] = static_cast<uint16_t>((seed + idx) % Note::none);
+    if ((seed + idx) % 3 == 0)
+    {
+      pattern[idx] |= PackedStep::on_bit;
+    }
+  }
+  return pattern;
+}
+
+} // namespace bass_station
+
+#endif // __PATTERN_FIXTURES_HPP__
@@ -0,0 +1,155 @@
+#include <catch2/catch_all.hpp>
+#include <deferred_work.hpp>
+#include <usec_clock.hpp>
+#include <vector>
+
+namespace
+{
+/// @brief The order the bottom halves ran in
+struct RunLog
+{
+  std::vector<uint32_t> m_timestamps;
+  std::vector<uint32_t> m_now;
+};
+
+void log_handler(void *context, uint32_t timestamp_us)
+{
+  auto *log = static_cast<RunLog *>(context);
+  log->m_timestamps.push_back(timestamp_us);
+  log->m_now.push_back(bass_station::UsecClock::now());
+  bass_station::UsecClock::advance(10);
+}
+
+/// @brief A bottom half that queues another one, as a top half interrupting PendSV would
+void chain_handler(void *context, uint32_t timestamp_us)
+{
+  log_handler(context, timestamp_us);
+  REQUIRE(bass_station::DeferredWork::schedule(log_handler, context, timestamp_us + 1));
+}
+
+/// @brief Puts the host clock back to the simulated one, even if a REQUIRE fails
+struct MockTimerClock
+{
+  TIM_TypeDef m_timer{};
+  MockTimerClock() { bass_station::UsecClock::initialise(&m_timer); }
+  ~MockTimerClock() { bass_station::UsecClock::initialise(nullptr); }
+};
+} // namespace
+
+TEST_CASE("DeferredWork runs bottom halves in schedule order", "[deferred_work]")
+{
+  bass_station::DeferredWork::run_pending();
+  const uint32_t runs = bass_station::DeferredWork::stats().m_run_count;
+
+  RunLog log;
+  const uint32_t start_us = bass_station::UsecClock::now();
+  for (uint32_t i = 0; i < 5; i++)
+  {
+    REQUIRE(bass_station::DeferredWork::schedule(log_handler, &log, start_us + i));
+  }
+  REQUIRE(log.m_timestamps.empty());
+
+  bass_station::UsecClock::advance(100);
+  bass_station::DeferredWork::run_pending();
+  REQUIRE(log.m_timestamps == std::vector<uint32_t>{start_us, start_us + 1, start_us + 2, start_us + 3, start_us + 4});
+  REQUIRE(bass_station::DeferredWork::stats().m_run_count == runs + 5);
+
+  // the last item waited behind the four before it
+  REQUIRE(bass_station::DeferredWork::stats().m_last_dispatch_latency_us == 100 + 4 * 10 - 4);
+  REQUIRE(bass_station::DeferredWork::stats().m_max_dispatch_latency_us >= 100);
+  REQUIRE(bass_station::DeferredWork::stats().m_max_bottom_half_us >= 10);
+
+  // work queued by a bottom half runs in the same pass
+  log = RunLog{};
+  REQUIRE(bass_station::DeferredWork::schedule(chain_handler, &log, 7));
+  REQUIRE(bass_station::DeferredWork::schedule(log_handler, &log, 8));
+  bass_station::DeferredWork::run_pending();
+  REQUIRE(log.m_timestamps == std::vector<uint32_t>{7, 8, 8});
+
+  // nothing left to run
+  bass_station::DeferredWork::run_pending();
+  REQUIRE(log.m_timestamps.size() == 3);
+}
+
+TEST_CASE("DeferredWork drops work when the pending set is full", "[deferred_work]")
+{
+  bass_station::DeferredWork::run_pending();
+
+  RunLog log;
+  uint32_t queued = 0;
+  while (bass_station::DeferredWork::schedule(log_handler, &log, queued))
+  {
+    queued++;
+    REQUIRE(queued <= 16);
+  }
+  REQUIRE(queued == 16);
+
+  // the failed schedule did not replace a queued item
+  REQUIRE_FALSE(bass_station::DeferredWork::schedule(log_handler, &log, 1000));
+  bass_station::DeferredWork::run_pending();
+  REQUIRE(log.m_timestamps.size() == 16);
+  for (uint32_t i = 0; i < 16; i++)
+  {
+    REQUIRE(log.m_timestamps[i] == i);
+  }
+
+  // there is room again once PendSV has run
+  REQUIRE(bass_station::DeferredWork::schedule(log_handler, &log, 2000));
+  bass_station::DeferredWork::run_pending();
+  REQUIRE(log.m_timestamps.back() == 2000);
+}
+
+TEST_CASE("UsecClock extends the 16-bit counter", "[usec_clock]")
+{
+  MockTimerClock clock;
+  TIM_TypeDef &timer = clock.m_timer;
+
+  timer.CNT = 100;
+  REQUIRE(bass_station::UsecClock::now() == 100);
+  timer.CNT = 0xFFFF;
+  REQUIRE(bass_station::UsecClock::now() == 0xFFFF);
+  // a repeated count is not a wrap
+  REQUIRE(bass_station::UsecClock::now() == 0xFFFF);
+
+  timer.CNT = 0;
+  REQUIRE(bass_station::UsecClock::now() == 0x10000);
+  timer.CNT = 5;
+  REQUIRE(bass_station::UsecClock::elapsed(0xFFFF) == 6);
+
+  SECTION("timestamps keep counting over many wraps")
+  {
+    // readings up to just under one counter period apart, as from a busy main loop
+    uint32_t expected = bass_station::UsecClock::now();
+    uint32_t step     = 1;
+    for (uint32_t i = 0; i < 10000; i++)
+    {
+      step      = (step * 1103515245U + 12345U) & 0xFFFF;
+      expected += step;
+      timer.CNT = expected & 0xFFFF;
+      REQUIRE(bass_station::UsecClock::now() == expected);
+    }
+  }
+
+  SECTION("the upper bits wrap after 71 minutes")
+  {
+    for (uint32_t wrap = 1; wrap < 0x10000; wrap++)
+    {
+      timer.CNT = 0x8000;
+      bass_station::UsecClock::now();
+      timer.CNT = 0;
+      REQUIRE(bass_station::UsecClock::now() == (wrap + 1) << 16);
+    }
+    timer.CNT = 0x10;
+    const uint32_t before = 0xFFFF0000U;
+    REQUIRE(bass_station::UsecClock::now() == 0x10);
+    REQUIRE(bass_station::UsecClock::elapsed(before) == 0x10000 + 0x10);
+  }
+
+  SECTION("initialise takes the current count as the start")
+  {
+    timer.CNT = 0x1234;
+    bass_station::UsecClock::initialise(&timer);
+    timer.CNT = 0x1000;
+    REQUIRE(bass_station::UsecClock::now() == 0x11000);
+  }
+}
@@ -0,0 +1,87 @@
+#include <catch2/catch_all.hpp>
+#include <event_queue.hpp>
+
+TEST_CASE("SpscQueue full and empty boundaries", "[event_queue]")
+{
+  bass_station::SpscQueue<uint32_t, 4> queue;
+  uint32_t item = 0;
+
+  REQUIRE(queue.empty());
+  REQUIRE_FALSE(queue.pop(item));
+
+  for (uint32_t i = 0; i < 4; i++)
+  {
+    REQUIRE(queue.push(i));
+    REQUIRE_FALSE(queue.empty());
+  }
+  REQUIRE(queue.dropped_count() == 0);
+
+  // one slot freed, one more fits
+  REQUIRE(queue.pop(item));
+  REQUIRE(item == 0);
+  REQUIRE(queue.push(4));
+
+  for (uint32_t i = 1; i <= 4; i++)
+  {
+    REQUIRE(queue.pop(item));
+    REQUIRE(item == i);
+  }
+  REQUIRE(queue.empty());
+  REQUIRE_FALSE(queue.pop(item));
+  REQUIRE(item == 4);
+}
+
+TEST_CASE("SpscQueue drops the pushed item when full", "[event_queue]")
+{
+  bass_station::EventQueue queue;
+  for (uint16_t i = 0; i < 32; i++)
+  {
+    REQUIRE(queue.push(bass_station::Event{bass_station::EventType::KeyEvent, 0, i}));
+  }
+
+  // the new event is dropped, the queued ones are untouched
+  REQUIRE_FALSE(queue.push(bass_station::Event{bass_station::EventType::ModeToggle, 1, 1000}));
+  REQUIRE_FALSE(queue.push(bass_station::Event{bass_station::EventType::StepAdvance, 2, 2000}));
+  REQUIRE(queue.dropped_count() == 2);
+
+  bass_station::Event event{};
+  for (uint16_t i = 0; i < 32; i++)
+  {
+    REQUIRE(queue.pop(event));
+    REQUIRE(event.m_type == bass_station::EventType::KeyEvent);
+    REQUIRE(event.m_data16 == i);
+  }
+  REQUIRE_FALSE(queue.pop(event));
+
+  // room again, the count is kept
+  REQUIRE(queue.push(bass_station::Event{bass_station::EventType::MidiByte, 0xF8, 0}));
+  REQUIRE(queue.dropped_count() == 2);
+  REQUIRE(queue.pop(event));
+  REQUIRE(event.m_type == bass_station::EventType::MidiByte);
+  REQUIRE(event.m_data8 == 0xF8);
+}
+
+TEST_CASE("SpscQueue index wrap around", "[event_queue]")
+{
+  bass_station::SpscQueue<uint32_t, 8> queue;
+  uint32_t item     = 0;
+  uint32_t expected = 0;
+  uint32_t next     = 0;
+
+  // many times round the buffer at every fill level, the order is kept
+  for (uint32_t round = 0; round < 100; round++)
+  {
+    const uint32_t fill = round % 9;
+    for (uint32_t i = 0; i < fill; i++)
+    {
+      REQUIRE(queue.push(next++));
+    }
+    for (uint32_t i = 0; i < fill; i++)
+    {
+      REQUIRE(queue.pop(item));
+      REQUIRE(item == expected++);
+    }
+    REQUIRE(queue.empty());
+  }
+  REQUIRE(queue.dropped_count() == 0);
+}
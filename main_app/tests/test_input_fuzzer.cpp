@@ -0,0 +1,72 @@
+#include <catch2/catch_all.hpp>
+#include <input_fuzzer.hpp>
+#include <trig_engine.hpp>
+#include <vector>
+
+namespace
+{
+
+/// @brief The fuzzer inputs of a number of one count encoder turns
+std::vector<uint8_t> encoder_turns(int turns, int8_t delta)
+{
+  std::vector<uint8_t> inputs;
+  for (int turn = 0; turn < turns; turn++)
+  {
+    inputs.push_back(1);
+    inputs.push_back(static_cast<uint8_t>(delta));
+  }
+  return inputs;
+}
+
+/// @brief Deterministic fuzzer inputs, so a failure reproduces
+std::vector<uint8_t> random_inputs(uint32_t &seed, std::size_t size)
+{
+  std::vector<uint8_t> inputs(size);
+  for (uint8_t &input : inputs)
+  {
+    input = static_cast<uint8_t>(bass_station::TrigEngine::xorshift32(seed));
+  }
+  return inputs;
+}
+
+// select step 0 and switch to NOTE_SELECT mode
+const std::vector<uint8_t> select_step_and_note_mode{0, 0, static_cast<uint8_t>(bass_station::board::key_event(0)), 2, 100};
+
+} // namespace
+
+TEST_CASE("The encoder keeps the selected note on the keys of the synth", "[input_fuzzer]")
+{
+  SECTION("turned up past c2")
+  {
+    std::vector<uint8_t> inputs = select_step_and_note_mode;
+    const std::vector<uint8_t> turns = encoder_turns(40, -1);
+    inputs.insert(inputs.end(), turns.begin(), turns.end());
+    REQUIRE(bass_station::fuzz_input_path(inputs.data(), inputs.size()));
+  }
+  SECTION("turned down past c0")
+  {
+    std::vector<uint8_t> inputs = select_step_and_note_mode;
+    const std::vector<uint8_t> turns = encoder_turns(40, 1);
+    inputs.insert(inputs.end(), turns.begin(), turns.end());
+    REQUIRE(bass_station::fuzz_input_path(inputs.data(), inputs.size()));
+  }
+}
+
+TEST_CASE("Random input bursts keep the step state in range", "[input_fuzzer]")
+{
+  uint32_t seed{0x5EC0A5E1U};
+  for (int run = 0; run < 200; run++)
+  {
+    const std::vector<uint8_t> inputs = random_inputs(seed, 64);
+    INFO("run " << run);
+    REQUIRE(bass_station::fuzz_input_path(inputs.data(), inputs.size()));
+  }
+}
+
+// the throughput of the input path, to keep the fuzzer fast. Run with "[input_fuzzer_benchmark]"
+TEST_CASE("Input path throughput", "[.][input_fuzzer_benchmark]")
+{
+  uint32_t seed{0x5EC0A5E1U};
+  const std::vector<uint8_t> inputs = random_inputs(seed, 256);
+  BENCHMARK("256 input bytes") { return bass_station::fuzz_input_path(inputs.data(), inputs.size()); };
+}
@@ -0,0 +1,346 @@
+#include <algorithm>
+#include <catch2/catch_all.hpp>
+#include <cstdlib>
+#include <input_replayer.hpp>
+#include <iterator>
+
+namespace
+{
+
+using KeyMapping = adp5587::Driver<STM32G0_ISR>::GPIKeyMappings;
+const bass_station::SequencerKeyEventIndex start_key   = static_cast<bass_station::SequencerKeyEventIndex>(KeyMapping::C8 | KeyMapping::ON);
+const bass_station::SequencerKeyEventIndex stop_key    = static_cast<bass_station::SequencerKeyEventIndex>(KeyMapping::C7 | KeyMapping::ON);
+const bass_station::SequencerKeyEventIndex trig_key    = static_cast<bass_station::SequencerKeyEventIndex>(KeyMapping::C4 | KeyMapping::ON);
+const bass_station::SequencerKeyEventIndex ratchet_key = static_cast<bass_station::SequencerKeyEventIndex>(KeyMapping::C5 | KeyMapping::ON);
+const bass_station::SequencerKeyEventIndex tap_key     = static_cast<bass_station::SequencerKeyEventIndex>(KeyMapping::C6 | KeyMapping::ON);
+
+/// @brief Plays a session as a user would, so the inputs reach the firmware by the paths that log them. Each input is
+/// followed by one to three main loop passes, as the device may run more than one before it sleeps again. The passes
+/// take time, so a key is read later than the replay reads it.
+class Session
+{
+public:
+  explicit Session(bass_station::SimulatedSequencer &simulation)
+      : m_simulation(simulation)
+  {
+  }
+
+  void tempo_ticks(int count)
+  {
+    for (int tick = 0; tick < count; tick++)
+    {
+      bass_station::UsecClock::advance(1736);
+      m_simulation.m_tempo_timer.CNT = 0;
+      m_simulation.sequencer().simulate_tempo_interrupt();
+      bass_station::DeferredWork::run_pending();
+      passes();
+      // the retriggers of a ratcheted step due in this period
+      while ((m_simulation.m_tempo_timer.DIER & TIM_DIER_CC1IE) != 0)
+      {
+        m_simulation.m_tempo_timer.CNT = m_simulation.m_tempo_timer.CCR1;
+        m_simulation.sequencer().simulate_ratchet_compare_interrupt();
+        bass_station::DeferredWork::run_pending();
+        passes();
+      }
+    }
+  }
+
+  void press_key(bass_station::SequencerKeyEventIndex key_event)
+  {
+    debounce_time_passes();
+    REQUIRE(m_simulation.sequencer().simulate_key_event(key_event));
+    passes();
+  }
+
+  /// @brief Press a key between tempo ticks, as a note played in time or a tap
+  /// @param after_us The time since the last input
+  void play_key(bass_station::SequencerKeyEventIndex key_event, uint32_t after_us)
+  {
+    bass_station::UsecClock::advance(after_us);
+    m_simulation.m_debounce_timer.CNT = m_simulation.m_debounce_timer.CNT + (after_us / 1000);
+    REQUIRE(m_simulation.sequencer().simulate_key_event(key_event));
+    passes();
+  }
+
+  void press_encoder_switch()
+  {
+    debounce_time_passes();
+    m_simulation.sequencer().simulate_encoder_switch_interrupt();
+    bass_station::DeferredWork::run_pending();
+    passes();
+  }
+
+  void turn_encoder(uint32_t count, bool down = false)
+  {
+    bass_station::UsecClock::advance(5000);
+    m_simulation.m_encoder_timer.CR1 = down ? TIM_CR1_DIR : 0U;
+    m_simulation.m_encoder_timer.CNT = count;
+    passes();
+  }
+
+  void passes()
+  {
+    m_pass_count = (m_pass_count % 3) + 1;
+    for (int pass = 0; pass < m_pass_count; pass++)
+    {
+      bass_station::UsecClock::advance(150);
+      m_simulation.sequencer().run_main_loop_iteration();
+    }
+  }
+
+private:
+  void debounce_time_passes()
+  {
+    // the debounce timer counts milliseconds
+    bass_station::UsecClock::advance(400000);
+    m_simulation.m_debounce_timer.CNT = m_simulation.m_debounce_timer.CNT + 400;
+  }
+
+  bass_station::SimulatedSequencer &m_simulation;
+  int m_pass_count{0};
+};
+
+std::vector<bass_station::TraceRecord> recorded_inputs()
+{
+  const bass_station::InputRecorder::Log &log = bass_station::InputRecorder::log();
+  return std::vector<bass_station::TraceRecord>(log.m_ring.begin(), log.m_ring.begin() + log.m_count);
+}
+
+/// @brief Compare records, ignoring the timestamps
+bool same_records(const std::vector<bass_station::TraceRecord> &lhs, const std::vector<bass_station::TraceRecord> &rhs)
+{
+  return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](const bass_station::TraceRecord &left, const bass_station::TraceRecord &right) {
+    return (left.m_id == right.m_id) && (left.m_arg0 == right.m_arg0) && (left.m_arg1 == right.m_arg1);
+  });
+}
+
+/// @brief Get the records of one id
+template <typename ID> std::vector<bass_station::TraceRecord> records_of(const std::vector<bass_station::TraceRecord> &records, ID id)
+{
+  std::vector<bass_station::TraceRecord> selected;
+  std::copy_if(records.begin(), records.end(), std::back_inserter(selected), [id](const bass_station::TraceRecord &record) {
+    return record.m_id == static_cast<uint16_t>(id);
+  });
+  return selected;
+}
+
+template <typename ID> std::size_t count_of(const std::vector<bass_station::TraceRecord> &records, ID id)
+{
+  return static_cast<std::size_t>(
+      std::count_if(records.begin(), records.end(), [id](const bass_station::TraceRecord &record) { return record.m_id == static_cast<uint16_t>(id); }));
+}
+
+} // namespace
+
+TEST_CASE("InputRecorder keeps the first records", "[input_replay]")
+{
+  bass_station::InputRecorder::start();
+  for (uint16_t index = 0; index < bass_station::InputRecorder::m_ring_size + 10; index++)
+  {
+    bass_station::InputRecorder::record(bass_station::InputId::KEY_EVENT, index, 0);
+  }
+  const bass_station::InputRecorder::Log &log = bass_station::InputRecorder::log();
+  REQUIRE(log.m_count == bass_station::InputRecorder::m_ring_size);
+  REQUIRE(log.m_dropped == 10);
+  REQUIRE(log.m_ring[0].m_arg0 == 0);
+  REQUIRE(log.m_ring[bass_station::InputRecorder::m_ring_size - 1].m_arg0 == bass_station::InputRecorder::m_ring_size - 1);
+  // the log survives a reset
+  REQUIRE(bass_station::InputRecorder::initialise());
+}
+
+TEST_CASE("A recorded session replays to the same outputs", "[input_replay]")
+{
+  std::vector<bass_station::TraceRecord> inputs;
+  std::vector<bass_station::TraceRecord> recorded_outputs;
+  {
+    bass_station::SimulatedSequencer simulation;
+    Session session(simulation);
+    session.passes();
+    session.press_key(start_key);
+    session.tempo_ticks(13 * 8);
+    // switch step 3 on, then step 8 off: the first press of a lit step only selects it
+    session.press_key(bass_station::board::key_event(3));
+    session.press_key(bass_station::board::key_event(8));
+    session.press_key(bass_station::board::key_event(8));
+    session.tempo_ticks(13 * 8);
+    session.press_encoder_switch();
+    session.turn_encoder(17);
+    session.tempo_ticks(13 * 4);
+    session.press_encoder_switch();
+    session.turn_encoder(20);
+    session.tempo_ticks(13 * 4);
+    session.press_key(stop_key);
+    session.press_key(stop_key);
+    session.press_key(start_key);
+    session.tempo_ticks(13 * 2);
+
+    inputs           = recorded_inputs();
+    recorded_outputs = bass_station::output_stream(simulation.outputs());
+  }
+  REQUIRE(bass_station::InputRecorder::log().m_dropped == 0);
+  // a tick that starts a step has a record of its own, the ticks between the steps and the other inputs share one
+  uint32_t tick_count{0};
+  std::size_t shared_tick_records{0};
+  for (const bass_station::TraceRecord &input : records_of(inputs, bass_station::InputId::TEMPO_TICK))
+  {
+    tick_count += input.m_arg1;
+    REQUIRE(((input.m_arg0 == 0) || (input.m_arg1 == 1)));
+    shared_tick_records += (input.m_arg0 == 0) ? 1U : 0U;
+  }
+  REQUIRE(tick_count == 13 * 26);
+  // one for each of the 26 steps played
+  REQUIRE(count_of(inputs, bass_station::InputId::TEMPO_TICK) - shared_tick_records == 26);
+  REQUIRE(count_of(recorded_outputs, bass_station::TraceId::SWITCH_WRITE) > 0);
+  REQUIRE(count_of(recorded_outputs, bass_station::TraceId::MIDI_BYTE) > 12 * 24);
+  REQUIRE(count_of(recorded_outputs, bass_station::TraceId::SWITCH_CLEAR) == 2);
+
+  SECTION("replayed")
+  {
+    bass_station::SimulatedSequencer replay;
+    replay.replay(inputs);
+    REQUIRE(same_records(bass_station::output_stream(replay.outputs()), recorded_outputs));
+    // and the firmware logged the same inputs again
+    REQUIRE(same_records(recorded_inputs(), inputs));
+  }
+
+  SECTION("replayed without a key press")
+  {
+    std::vector<bass_station::TraceRecord> edited_inputs;
+    bool removed{false};
+    for (const bass_station::TraceRecord &input : inputs)
+    {
+      if (!removed && (input.m_id == static_cast<uint16_t>(bass_station::InputId::KEY_EVENT)) &&
+          (input.m_arg0 == static_cast<uint16_t>(bass_station::board::key_event(8))))
+      {
+        removed = true;
+        continue;
+      }
+      edited_inputs.push_back(input);
+    }
+    REQUIRE(removed);
+    bass_station::SimulatedSequencer replay;
+    replay.replay(edited_inputs);
+    REQUIRE_FALSE(same_records(bass_station::output_stream(replay.outputs()), recorded_outputs));
+  }
+}
+
+TEST_CASE("Steps with a probability replay to the same outputs", "[input_replay]")
+{
+  std::vector<bass_station::TraceRecord> inputs;
+  std::vector<bass_station::TraceRecord> recorded_outputs;
+  {
+    bass_station::SimulatedSequencer simulation;
+    Session session(simulation);
+    session.passes();
+    // select steps 9 to 12 and take each down to a 50% chance
+    for (uint8_t step = 9; step <= 12; step++)
+    {
+      session.press_key(bass_station::board::key_event(step));
+      for (int press = 0; press < 4; press++)
+      {
+        session.press_key(trig_key);
+      }
+      REQUIRE(simulation.sequencer().active_step_map().data[simulation.sequencer().selected_step_index()].second.m_probability == 4);
+    }
+    session.press_key(start_key);
+    session.tempo_ticks(13 * 32 * 3);
+
+    inputs           = recorded_inputs();
+    recorded_outputs = bass_station::output_stream(simulation.outputs());
+  }
+  REQUIRE(bass_station::InputRecorder::log().m_dropped == 0);
+
+  // the draws start from the same seed, so the replay skips the same steps
+  bass_station::SimulatedSequencer replay;
+  replay.replay(inputs);
+  REQUIRE(same_records(bass_station::output_stream(replay.outputs()), recorded_outputs));
+}
+
+TEST_CASE("Record mode, tap tempo, undo and ratchets replay to the same outputs", "[input_replay]")
+{
+  // the ticks before each played note and the time into the last tick the note is played at
+  constexpr std::array<std::pair<int, uint32_t>, 10> notes{
+      {{3, 200}, {11, 1500}, {14, 900}, {6, 40}, {20, 1200}, {9, 600}, {13, 1700}, {2, 300}, {17, 1000}, {8, 100}}};
+  std::vector<bass_station::TraceRecord> inputs;
+  std::vector<bass_station::TraceRecord> recorded_outputs;
+  std::vector<bass_station::TraceRecord> recorded_notes;
+  std::vector<bass_station::TraceRecord> tapped_tempos;
+  {
+    bass_station::SimulatedSequencer simulation;
+    Session session(simulation);
+    session.passes();
+    // ratchet step 8 twice: the first press of a lit step only selects it
+    session.press_key(bass_station::board::key_event(8));
+    session.press_key(ratchet_key);
+    session.press_key(ratchet_key);
+    // tap a faster tempo, the taps are timed from the press
+    for (int tap = 0; tap < 5; tap++)
+    {
+      session.play_key(tap_key, 300000 + static_cast<uint32_t>(tap) * 700);
+    }
+    session.press_key(start_key);
+    session.tempo_ticks(13 * 8);
+
+    // TEMPO_ADJUST, NOTE_SELECT, RECORD: the step keys play notes, put on the step nearest the press
+    session.press_encoder_switch();
+    session.press_encoder_switch();
+    for (std::size_t note = 0; note < notes.size(); note++)
+    {
+      session.tempo_ticks(notes[note].first);
+      session.play_key(bass_station::board::key_event(static_cast<uint8_t>(1 + (note * 5) % 16)), notes[note].second);
+    }
+    session.tempo_ticks(13 * 8);
+
+    // UNDO: two edits back and one forward, then randomise
+    session.press_encoder_switch();
+    const uint32_t encoder_count = simulation.m_encoder_timer.CNT;
+    session.turn_encoder(encoder_count - 1, true);
+    session.turn_encoder(encoder_count - 2, true);
+    session.turn_encoder(encoder_count - 1);
+    session.tempo_ticks(13 * 4);
+    session.press_key(trig_key);
+    session.tempo_ticks(13 * 8);
+
+    inputs           = recorded_inputs();
+    recorded_outputs = bass_station::output_stream(simulation.outputs());
+    recorded_notes   = records_of(simulation.outputs(), bass_station::TraceId::RECORD_NOTE);
+    tapped_tempos    = records_of(simulation.outputs(), bass_station::TraceId::TAP_TEMPO);
+  }
+  REQUIRE(bass_station::InputRecorder::log().m_dropped == 0);
+  REQUIRE(recorded_notes.size() == notes.size());
+  REQUIRE_FALSE(tapped_tempos.empty());
+  REQUIRE(count_of(recorded_outputs, bass_station::TraceId::RATCHET_GATE) > 0);
+  REQUIRE(count_of(inputs, bass_station::InputId::KEY_PRESS_TIME) == notes.size() + 5);
+  REQUIRE(count_of(inputs, bass_station::InputId::RATCHET_COMPARE) > 0);
+
+  // the notes land on the same steps and the taps give the same tempo, as the press times are logged
+  bass_station::SimulatedSequencer replay;
+  replay.replay(inputs);
+  // arg1 is the latency correction the replay measures on its own reads, the position and note are compared
+  const std::vector<bass_station::TraceRecord> replayed_notes = records_of(replay.outputs(), bass_station::TraceId::RECORD_NOTE);
+  REQUIRE(std::equal(replayed_notes.begin(), replayed_notes.end(), recorded_notes.begin(), recorded_notes.end(),
+                     [](const bass_station::TraceRecord &left, const bass_station::TraceRecord &right) { return left.m_arg0 == right.m_arg0; }));
+  REQUIRE(same_records(records_of(replay.outputs(), bass_station::TraceId::TAP_TEMPO), tapped_tempos));
+  REQUIRE(same_records(bass_station::output_stream(replay.outputs()), recorded_outputs));
+}
+
+// Run with INPUT_LOG (INPUTS.BIN or an RTT channel 2 capture) and, to check the outputs, TRACE_LOG (the RTT channel 1
+// capture of the same run) set
+TEST_CASE("A device input log replays to the device outputs", "[.][input_replay_device]")
+{
+  const char *input_log_path = std::getenv("INPUT_LOG");
+  REQUIRE(input_log_path != nullptr);
+  std::vector<bass_station::TraceRecord> inputs;
+  REQUIRE(bass_station::read_capture(input_log_path, inputs));
+
+  bass_station::SimulatedSequencer replay;
+  replay.replay(inputs);
+
+  const char *trace_log_path = std::getenv("TRACE_LOG");
+  if (trace_log_path != nullptr)
+  {
+    std::vector<bass_station::TraceRecord> device_trace;
+    REQUIRE(bass_station::read_capture(trace_log_path, device_trace));
+    REQUIRE(same_records(bass_station::output_stream(replay.outputs()), bass_station::output_stream(device_trace)));
+  }
+}
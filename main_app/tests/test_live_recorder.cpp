@@ -0,0 +1,295 @@
+#include <catch2/catch_all.hpp>
+#include <input_replayer.hpp>
+#include <live_recorder.hpp>
+#include <trig_engine.hpp>
+#include <vector>
+
+namespace
+{
+
+// 180 BPM: 12 MIDI clock ticks of 1736us to the step, 22568us at 58% swing for the long step of a pair
+constexpr uint32_t straight_step_us = 20833;
+constexpr uint32_t long_step_us     = 24166;
+constexpr uint32_t short_step_us    = 2 * straight_step_us - long_step_us;
+constexpr uint32_t long_step_counts = 290;
+constexpr uint32_t short_step_counts = 210;
+
+/// @brief A main loop that reads the key event FIFO every poll_us for read_us, as KeypadManager does
+struct KeyPoller
+{
+  uint32_t m_poll_us;
+  uint32_t m_read_us;
+  bass_station::KeyLatency m_latency{};
+  uint32_t m_next_read_us{0};
+
+  uint32_t m_read_end_us{0};
+
+  /// @brief Run the reads up to the one that finds a press in the FIFO
+  /// @return The time the main loop sees it, without the correction
+  uint32_t read_press(uint32_t press_us)
+  {
+    // presses close together are read together
+    if (press_us + m_read_us <= m_read_end_us)
+    {
+      return m_read_end_us;
+    }
+    while (m_next_read_us < press_us)
+    {
+      read();
+    }
+    return read();
+  }
+
+  uint32_t read()
+  {
+    m_read_end_us = m_next_read_us + m_read_us;
+    m_latency.read_done(m_next_read_us, m_read_end_us);
+    m_next_read_us = m_read_end_us + m_poll_us;
+    return m_read_end_us;
+  }
+};
+
+using KeyMapping = adp5587::Driver<STM32G0_ISR>::GPIKeyMappings;
+const bass_station::SequencerKeyEventIndex start_key = static_cast<bass_station::SequencerKeyEventIndex>(KeyMapping::C8 | KeyMapping::ON);
+const bass_station::SequencerKeyEventIndex stop_key  = static_cast<bass_station::SequencerKeyEventIndex>(KeyMapping::C7 | KeyMapping::ON);
+
+/// @brief Get the last record of a trace id in the outputs
+const bass_station::TraceRecord *last_output(const std::vector<bass_station::TraceRecord> &outputs, bass_station::TraceId id)
+{
+  for (auto record = outputs.rbegin(); record != outputs.rend(); record++)
+  {
+    if (record->m_id == static_cast<uint16_t>(id))
+    {
+      return &(*record);
+    }
+  }
+  return nullptr;
+}
+
+} // namespace
+
+TEST_CASE("KeyLatency measures the I2C read and the wait in the FIFO", "[live_recorder]")
+{
+  bass_station::KeyLatency latency;
+  latency.read_done(1000, 1300);
+  REQUIRE(latency.read_us() == 300);
+  // nothing is known of the time before the first read
+  REQUIRE(latency.poll_interval_us() == 0);
+  REQUIRE(latency.press_time_us() == 1000);
+
+  latency.read_done(5300, 5550);
+  REQUIRE(latency.read_us() == 250);
+  REQUIRE(latency.max_read_us() == 300);
+  REQUIRE(latency.poll_interval_us() == 4000);
+  REQUIRE(latency.fifo_wait_us() == 2000);
+  REQUIRE(latency.correction_us() == 2250);
+  REQUIRE(latency.press_time_us() == 3300);
+
+  latency.read_done(6550, 6950);
+  REQUIRE(latency.max_read_us() == 400);
+  REQUIRE(latency.poll_interval_us() == 1000);
+  REQUIRE(latency.max_poll_interval_us() == 4000);
+
+  // UsecClock wraps every 71 minutes
+  latency.read_done(0xFFFFFF00U, 0x00000100U);
+  REQUIRE(latency.read_us() == 0x200);
+  REQUIRE(latency.poll_interval_us() == 0xFFFFFF00U - 6950U);
+  REQUIRE(latency.press_time_us() == 0x00000100U - latency.correction_us());
+}
+
+TEST_CASE("LiveRecorder quantises a press to the nearest step", "[live_recorder]")
+{
+  bass_station::LiveRecorder recorder;
+  int8_t step_offset{0};
+  REQUIRE_FALSE(recorder.quantise(1000, step_offset));
+
+  // the first step: its length isn't known, the presses go on it
+  recorder.step_started(10000, long_step_counts);
+  REQUIRE(recorder.step_us() == 0);
+  REQUIRE(recorder.quantise(10000 + long_step_us - 1, step_offset));
+  REQUIRE(step_offset == 0);
+  REQUIRE(recorder.quantise(9000, step_offset));
+  REQUIRE(step_offset == 0);
+
+  // a swung pair: the short step is expected from the long one and the timer counts of both
+  recorder.step_started(10000 + long_step_us, short_step_counts);
+  REQUIRE(recorder.step_us() + 2 >= short_step_us);
+  REQUIRE(recorder.step_us() <= short_step_us + 2);
+  const uint32_t start_us = 10000 + long_step_us;
+  REQUIRE(recorder.quantise(start_us + short_step_us / 2 - 10, step_offset));
+  REQUIRE(step_offset == 0);
+  REQUIRE(recorder.quantise(start_us + short_step_us / 2 + 10, step_offset));
+  REQUIRE(step_offset == 1);
+  REQUIRE(recorder.quantise(start_us - long_step_us / 2 + 10, step_offset));
+  REQUIRE(step_offset == 0);
+  REQUIRE(recorder.quantise(start_us - long_step_us / 2 - 10, step_offset));
+  REQUIRE(step_offset == -1);
+
+  // starting again forgets the steps
+  recorder.reset();
+  REQUIRE_FALSE(recorder.quantise(start_us, step_offset));
+}
+
+TEST_CASE("Recorded presses land on the step played despite the key latency", "[live_recorder]")
+{
+  // a slow main loop: the display update can hold off the next read of the FIFO for a long time
+  const uint32_t poll_us = GENERATE(1000U, 4000U, 8000U);
+  const uint32_t read_us = 400;
+
+  // swung steps, one press for each
+  constexpr uint32_t step_total = 200;
+  std::vector<uint32_t> step_start_us{100000};
+  for (uint32_t step = 1; step <= step_total; step++)
+  {
+    step_start_us.push_back(step_start_us.back() + (((step % 2) == 1) ? long_step_us : short_step_us));
+  }
+
+  uint32_t seed{0x2545F491};
+  KeyPoller poller{poll_us, read_us};
+  bass_station::LiveRecorder recorder;
+  uint32_t steps_started{0};
+  uint32_t corrected_misses{0};
+  uint32_t uncorrected_misses{0};
+  // the length of the first step isn't known until the second starts, the presses from then on are checked
+  for (uint32_t step = 2; step < step_total; step++)
+  {
+    // the player is up to a quarter of the shortest step off the beat
+    const int32_t timing_error_us = static_cast<int32_t>(bass_station::TrigEngine::xorshift32(seed) % (short_step_us / 2)) - static_cast<int32_t>(short_step_us / 4);
+    const uint32_t press_us       = step_start_us[step] + static_cast<uint32_t>(timing_error_us);
+
+    // the main loop sees the press at the end of a read, by then the next step may have started
+    const uint32_t seen_us = poller.read_press(press_us);
+    while ((steps_started <= step_total) && (step_start_us[steps_started] <= seen_us))
+    {
+      recorder.step_started(step_start_us[steps_started], ((steps_started % 2) == 0) ? long_step_counts : short_step_counts);
+      steps_started++;
+    }
+    const uint32_t corrected_us = poller.m_latency.press_time_us();
+    REQUIRE(corrected_us + poll_us / 2 + read_us >= press_us);
+    REQUIRE(corrected_us <= press_us + poll_us / 2 + read_us);
+
+    int8_t step_offset{0};
+    REQUIRE(recorder.quantise(corrected_us, step_offset));
+    corrected_misses += (steps_started - 1 + static_cast<uint32_t>(step_offset) != step) ? 1U : 0U;
+    REQUIRE(recorder.quantise(seen_us, step_offset));
+    uncorrected_misses += (steps_started - 1 + static_cast<uint32_t>(step_offset) != step) ? 1U : 0U;
+  }
+  REQUIRE(corrected_misses == 0);
+  // late presses seen at the end of a long wait land on the next step
+  if (poll_us == 8000)
+  {
+    REQUIRE(uncorrected_misses > 0);
+  }
+}
+
+TEST_CASE("Record mode writes the pressed notes into the pattern", "[live_recorder]")
+{
+  bass_station::SimulatedSequencer simulation;
+  bass_station::SequenceManager &sequencer = simulation.sequencer();
+  constexpr std::array<uint8_t, bass_station::board::step_count> sweep_order = bass_station::board::make_sweep_order();
+
+  const auto press = [&](bass_station::SequencerKeyEventIndex key_event) {
+    REQUIRE(sequencer.simulate_key_event(key_event));
+    sequencer.run_main_loop_iteration();
+  };
+  const auto press_encoder_switch = [&]() {
+    // after the switch debounce time
+    simulation.m_debounce_timer.CNT = simulation.m_debounce_timer.CNT + 400;
+    sequencer.simulate_encoder_switch_interrupt();
+    bass_station::DeferredWork::run_pending();
+    sequencer.run_main_loop_iteration();
+  };
+  const auto ticks_to_next_step = [&]() {
+    const std::size_t output_count = simulation.outputs().size();
+    for (int tick = 0; tick < 13 * 2; tick++)
+    {
+      bass_station::UsecClock::advance(1736);
+      sequencer.simulate_tempo_interrupt();
+      bass_station::DeferredWork::run_pending();
+      sequencer.run_main_loop_iteration();
+      const std::vector<bass_station::TraceRecord> &outputs = simulation.outputs();
+      for (std::size_t index = output_count; index < outputs.size(); index++)
+      {
+        if (outputs[index].m_id == static_cast<uint16_t>(bass_station::TraceId::STEP_ADVANCE))
+        {
+          return outputs[index].m_arg0;
+        }
+      }
+    }
+    FAIL("no step advance");
+    return uint16_t{0};
+  };
+
+  sequencer.run_main_loop_iteration();
+  bass_station::UsecClock::advance(400000);
+  simulation.m_debounce_timer.CNT = simulation.m_debounce_timer.CNT + 400;
+  press(start_key);
+  ticks_to_next_step();
+  // the encoder switch steps through NOTE_SELECT to RECORD
+  press_encoder_switch();
+  press_encoder_switch();
+  ticks_to_next_step();
+
+  SECTION("early in a step")
+  {
+    const uint16_t position = ticks_to_next_step();
+    bass_station::UsecClock::advance(2000);
+    sequencer.run_main_loop_iteration();
+    bass_station::UsecClock::advance(2000);
+    // the same key twice within the debounce time: both are notes
+    press(bass_station::board::key_event(3));
+    press(bass_station::board::key_event(3));
+
+    const bass_station::TraceRecord *record = last_output(simulation.outputs(), bass_station::TraceId::RECORD_NOTE);
+    REQUIRE(record != nullptr);
+    REQUIRE(record->m_arg0 == ((position << 8) | bass_station::Note::d0_sharp));
+    const bass_station::Step &step = sequencer.active_step_map().data[sweep_order[position]].second;
+    REQUIRE(step.m_state == bass_station::StepState::ON);
+    REQUIRE(step.m_note == bass_station::Note::d0_sharp);
+  }
+
+  SECTION("late in a step")
+  {
+    const uint16_t position = ticks_to_next_step();
+    bass_station::UsecClock::advance(14000);
+    sequencer.run_main_loop_iteration();
+    bass_station::UsecClock::advance(2000);
+    press(bass_station::board::key_event(7));
+
+    // the press is put on the step about to play
+    const uint16_t next_position = static_cast<uint16_t>((position + 1) % bass_station::board::step_count);
+    const bass_station::TraceRecord *record = last_output(simulation.outputs(), bass_station::TraceId::RECORD_NOTE);
+    REQUIRE(record != nullptr);
+    REQUIRE(record->m_arg0 == ((next_position << 8) | bass_station::Note::g0));
+    REQUIRE(sequencer.active_step_map().data[sweep_order[next_position]].second.m_note == bass_station::Note::g0);
+  }
+
+  SECTION("record mode off")
+  {
+    // back to TEMPO_ADJUST: the step keys switch the steps again
+    press_encoder_switch();
+    ticks_to_next_step();
+    press(bass_station::board::key_event(3));
+    REQUIRE(last_output(simulation.outputs(), bass_station::TraceId::RECORD_NOTE) == nullptr);
+  }
+
+  SECTION("start pressed while playing keeps playing")
+  {
+    bass_station::UsecClock::advance(400000);
+    simulation.m_debounce_timer.CNT = simulation.m_debounce_timer.CNT + 400;
+    press(start_key);
+    ticks_to_next_step();
+    bass_station::UsecClock::advance(2000);
+    press(bass_station::board::key_event(3));
+    REQUIRE(last_output(simulation.outputs(), bass_station::TraceId::RECORD_NOTE) != nullptr);
+  }
+
+  SECTION("recording stops with the sequencer")
+  {
+    bass_station::UsecClock::advance(400000);
+    simulation.m_debounce_timer.CNT = simulation.m_debounce_timer.CNT + 400;
+    press(stop_key);
+    press(bass_station::board::key_event(3));
+    REQUIRE(last_output(simulation.outputs(), bass_station::TraceId::RECORD_NOTE) == nullptr);
+  }
+}
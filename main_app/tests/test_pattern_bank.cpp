@@ -0,0 +1,155 @@
+#include <catch2/catch_all.hpp>
+#include <pattern_bank.hpp>
+#include <pattern_fixtures.hpp>
+
+namespace
+{
+// the FlashStm32g0 region is 8 pages
+using TestFlash = bass_station::FlashMemory<8>;
+} // namespace
+
+TEST_CASE("PatternBank save and load", "[pattern_bank]")
+{
+  TestFlash flash;
+  bass_station::PatternBank bank(flash);
+  REQUIRE(bank.initialise());
+  REQUIRE_FALSE(bank.contains(0));
+
+  bass_station::PackedPattern loaded;
+  REQUIRE_FALSE(bank.load(0, loaded));
+
+  REQUIRE(bank.save(0, bass_station::make_pattern(1)));
+  REQUIRE(bank.save(5, bass_station::make_pattern(2)));
+  REQUIRE(bank.save(0, bass_station::make_pattern(3)));
+  REQUIRE_FALSE(bank.save(bass_station::PatternBank::slot_count, bass_station::make_pattern(4)));
+
+  // the newest record of a slot wins
+  REQUIRE(bank.load(0, loaded));
+  REQUIRE(loaded == bass_station::make_pattern(3));
+  REQUIRE(bank.load(5, loaded));
+  REQUIRE(loaded == bass_station::make_pattern(2));
+
+  // the index is rebuilt from flash after a reset
+  bass_station::PatternBank rebooted(flash);
+  REQUIRE(rebooted.initialise());
+  REQUIRE(rebooted.load(0, loaded));
+  REQUIRE(loaded == bass_station::make_pattern(3));
+  REQUIRE(rebooted.load(5, loaded));
+  REQUIRE(loaded == bass_station::make_pattern(2));
+  REQUIRE_FALSE(rebooted.contains(1));
+}
+
+TEST_CASE("PatternBank pattern length", "[pattern_bank]")
+{
+  TestFlash flash;
+  bass_station::PatternBank bank(flash);
+  REQUIRE(bank.initialise());
+
+  REQUIRE(bank.save(0, bass_station::make_pattern(1)));
+  REQUIRE(bank.save(1, bass_station::make_pattern(2), 1));
+  REQUIRE(bank.save(2, bass_station::make_pattern(3), bass_station::max_pattern_length));
+  REQUIRE_FALSE(bank.save(3, bass_station::make_pattern(4), 0));
+  REQUIRE_FALSE(bank.save(3, bass_station::make_pattern(4), bass_station::max_pattern_length + 1));
+  REQUIRE_FALSE(bank.contains(3));
+
+  bass_station::PatternBank rebooted(flash);
+  REQUIRE(rebooted.initialise());
+  bass_station::PackedPattern loaded;
+  uint8_t length{0};
+  REQUIRE(rebooted.load(0, loaded, length));
+  REQUIRE(length == bass_station::default_pattern_length);
+  REQUIRE(rebooted.load(1, loaded, length));
+  REQUIRE(length == 1);
+  REQUIRE(loaded == bass_station::make_pattern(2));
+  REQUIRE(rebooted.load(2, loaded, length));
+  REQUIRE(length == bass_station::max_pattern_length);
+}
+
+TEST_CASE("PatternBank wear levelling", "[pattern_bank]")
+{
+  TestFlash flash;
+  bass_station::PatternBank bank(flash);
+  REQUIRE(bank.initialise());
+
+  // enough saves to go round all the pages several times
+  for (uint16_t save = 0; save < 2000; save++)
+  {
+    REQUIRE(bank.save(save % bass_station::PatternBank::slot_count, bass_station::make_pattern(save)));
+  }
+
+  // every slot survives the reclaims
+  for (uint16_t slot = 0; slot < bass_station::PatternBank::slot_count; slot++)
+  {
+    bass_station::PackedPattern loaded;
+    REQUIRE(bank.load(slot, loaded));
+    REQUIRE(loaded == bass_station::make_pattern(static_cast<uint16_t>(2000 - bass_station::PatternBank::slot_count + slot)));
+  }
+
+  // the erases are spread evenly over the pages
+  uint32_t min_erases = flash.erase_count(0);
+  uint32_t max_erases = flash.erase_count(0);
+  for (std::size_t page = 0; page < flash.page_count(); page++)
+  {
+    min_erases = std::min(min_erases, flash.erase_count(page));
+    max_erases = std::max(max_erases, flash.erase_count(page));
+    REQUIRE(bank.erase_count(page) == flash.erase_count(page) + 1);
+  }
+  REQUIRE(min_erases > 0);
+  REQUIRE(max_erases - min_erases <= 1);
+}
+
+TEST_CASE("PatternBank skips torn records", "[pattern_bank]")
+{
+  TestFlash flash;
+  bass_station::PatternBank bank(flash);
+  REQUIRE(bank.initialise());
+  REQUIRE(bank.save(2, bass_station::make_pattern(10)));
+  REQUIRE(bank.save(2, bass_station::make_pattern(11)));
+
+  // corrupt a step of the newest record, as if the power failed while it was programmed
+  // (page header 8 bytes, 80 byte records, steps at offset 8)
+  flash.memory()[8 + 80 + 8] = 0x00;
+
+  bass_station::PatternBank rebooted(flash);
+  REQUIRE(rebooted.initialise());
+  bass_station::PackedPattern loaded;
+  REQUIRE(rebooted.load(2, loaded));
+  REQUIRE(loaded == bass_station::make_pattern(10));
+
+  // the log carries on after the torn record
+  REQUIRE(rebooted.save(2, bass_station::make_pattern(12)));
+  bass_station::PatternBank rebooted_again(flash);
+  REQUIRE(rebooted_again.initialise());
+  REQUIRE(rebooted_again.load(2, loaded));
+  REQUIRE(loaded == bass_station::make_pattern(12));
+}
+
+TEST_CASE("PackedStep encoding", "[pattern_bank]")
+{
+  bass_station::Step step(bass_station::StepState::ON, bass_station::Note::g1_sharp, bass_station::user_select_colour, 0);
+  step.m_ratchet        = 3;
+  step.m_probability    = 5;
+  step.m_condition      = bass_station::TrigCondition::LOOP_2_OF_3;
+  const uint16_t packed = bass_station::PackedStep::pack(step);
+
+  bass_station::Step unpacked(bass_station::StepState::OFF, bass_station::Note::none, bass_station::default_colour, 0);
+  bass_station::PackedStep::unpack(packed, unpacked);
+  REQUIRE(unpacked.m_state == bass_station::StepState::ON);
+  REQUIRE(unpacked.m_note == bass_station::Note::g1_sharp);
+  REQUIRE(unpacked.m_colour == bass_station::user_select_colour);
+  REQUIRE(unpacked.m_ratchet == 3);
+  REQUIRE(unpacked.m_probability == 5);
+  REQUIRE(unpacked.m_condition == bass_station::TrigCondition::LOOP_2_OF_3);
+
+  // a pattern saved before ratchets and trig conditions were added plays single triggers that always play
+  bass_station::PackedStep::unpack(bass_station::PackedStep::on_bit, unpacked);
+  REQUIRE(unpacked.m_ratchet == 1);
+  REQUIRE(unpacked.m_probability == 0);
+  REQUIRE(unpacked.m_condition == bass_station::TrigCondition::ALWAYS);
+
+  // out of range notes and conditions are dropped
+  bass_station::PackedStep::unpack(static_cast<uint16_t>(bass_station::PackedStep::condition_mask | bass_station::PackedStep::note_mask), unpacked);
+  REQUIRE(unpacked.m_state == bass_station::StepState::OFF);
+  REQUIRE(unpacked.m_note == bass_station::Note::none);
+  REQUIRE(unpacked.m_condition == bass_station::TrigCondition::ALWAYS);
+}
@@ -0,0 +1,157 @@
+#include <catch2/catch_all.hpp>
+#include <pattern_fixtures.hpp>
+#include <pattern_grid.hpp>
+
+namespace
+{
+
+using DirtyCells = std::array<bass_station::PatternGrid::DirtyCell, bass_station::PatternGrid::max_dirty_cells>;
+
+/// @brief Find the dirty cell drawn at a line and column of an area
+const bass_station::PatternGrid::DirtyCell *find_cell(const DirtyCells &dirty_cells, uint8_t count, bass_station::PatternGrid::Area area, uint8_t line, uint8_t column)
+{
+  for (uint8_t idx = 0; idx < count; idx++)
+  {
+    const bass_station::PatternGrid::DirtyCell &cell = dirty_cells[idx];
+    if ((cell.m_area == area) && (cell.m_line == line) && (cell.m_column == column))
+    {
+      return &cell;
+    }
+  }
+  return nullptr;
+}
+
+} // namespace
+
+TEST_CASE("PatternGrid draws every cell once after invalidate", "[pattern_grid]")
+{
+  bass_station::SequencerStepMap step_map = bass_station::make_step_map();
+  bass_station::PatternGrid grid;
+  DirtyCells dirty_cells;
+
+  // the first frame is the worst case: every grid cell and every line of every roll column
+  REQUIRE(grid.update(step_map, 0, 0xFF, dirty_cells) == bass_station::PatternGrid::max_dirty_cells);
+
+  // the lower row (step map 0-15) is the second grid line, the upper row (step map 16-31) the first
+  for (uint8_t idx = 0; idx < 2 * bass_station::PatternGrid::grid_columns; idx++)
+  {
+    const uint8_t line   = (idx < bass_station::PatternGrid::grid_columns) ? 1 : 0;
+    const uint8_t column = idx % bass_station::PatternGrid::grid_columns;
+    const bass_station::PatternGrid::DirtyCell *cell =
+        find_cell(dirty_cells, bass_station::PatternGrid::max_dirty_cells, bass_station::PatternGrid::Area::GRID, line, column);
+    REQUIRE(cell != nullptr);
+    REQUIRE(cell->m_glyph == '.');
+    // only the cursor is inverted
+    REQUIRE(cell->m_inverted == (idx == 0));
+  }
+  for (uint8_t line = 0; line < bass_station::PatternGrid::roll_lines; line++)
+  {
+    for (uint8_t column = 0; column < bass_station::PatternGrid::grid_columns; column++)
+    {
+      const bass_station::PatternGrid::DirtyCell *cell =
+          find_cell(dirty_cells, bass_station::PatternGrid::max_dirty_cells, bass_station::PatternGrid::Area::ROLL, line, column);
+      REQUIRE(cell != nullptr);
+      REQUIRE(cell->m_glyph == ' ');
+    }
+  }
+
+  // nothing changed, nothing to draw
+  REQUIRE(grid.update(step_map, 0, 0xFF, dirty_cells) == 0);
+
+  // until the screen is lost
+  grid.invalidate();
+  REQUIRE(grid.update(step_map, 0, 0xFF, dirty_cells) == bass_station::PatternGrid::max_dirty_cells);
+}
+
+TEST_CASE("PatternGrid only draws the cells that changed", "[pattern_grid]")
+{
+  bass_station::SequencerStepMap step_map = bass_station::make_step_map();
+  bass_station::PatternGrid grid;
+  DirtyCells dirty_cells;
+  grid.update(step_map, 0, 0xFF, dirty_cells);
+
+  // a step of the lower row goes ON: its grid cell, and its roll column as the cursor is on the lower row
+  step_map.data[5].second.m_state = bass_station::StepState::ON;
+  step_map.data[5].second.m_note  = bass_station::Note::c0;
+  REQUIRE(grid.update(step_map, 0, 0xFF, dirty_cells) == 2);
+  const bass_station::PatternGrid::DirtyCell *cell = find_cell(dirty_cells, 2, bass_station::PatternGrid::Area::GRID, 1, 5);
+  REQUIRE(cell != nullptr);
+  REQUIRE(cell->m_glyph == '#');
+  REQUIRE_FALSE(cell->m_inverted);
+  // the lowest note is the lowest glyph on the bottom roll line
+  cell = find_cell(dirty_cells, 2, bass_station::PatternGrid::Area::ROLL, bass_station::PatternGrid::roll_lines - 1, 5);
+  REQUIRE(cell != nullptr);
+  REQUIRE(cell->m_glyph == '_');
+
+  // the top note moves the glyph to the first roll line, and the old one is erased
+  step_map.data[5].second.m_note = bass_station::Note::c2;
+  REQUIRE(grid.update(step_map, 0, 0xFF, dirty_cells) == 2);
+  cell = find_cell(dirty_cells, 2, bass_station::PatternGrid::Area::ROLL, bass_station::PatternGrid::roll_lines - 1, 5);
+  REQUIRE(cell != nullptr);
+  REQUIRE(cell->m_glyph == ' ');
+  cell = find_cell(dirty_cells, 2, bass_station::PatternGrid::Area::ROLL, 0, 5);
+  REQUIRE(cell != nullptr);
+  REQUIRE(cell->m_glyph == '\'');
+
+  // a step of the upper row goes ON: only its grid cell, the roll shows the row with the cursor
+  step_map.data[16 + 3].second.m_state = bass_station::StepState::ON;
+  REQUIRE(grid.update(step_map, 0, 0xFF, dirty_cells) == 1);
+  cell = find_cell(dirty_cells, 1, bass_station::PatternGrid::Area::GRID, 0, 3);
+  REQUIRE(cell != nullptr);
+  REQUIRE(cell->m_glyph == '#');
+
+  // an ON step with no note has an empty roll column
+  step_map.data[5].second.m_note = bass_station::Note::none;
+  REQUIRE(grid.update(step_map, 0, 0xFF, dirty_cells) == 1);
+  cell = find_cell(dirty_cells, 1, bass_station::PatternGrid::Area::ROLL, 0, 5);
+  REQUIRE(cell != nullptr);
+  REQUIRE(cell->m_glyph == ' ');
+}
+
+TEST_CASE("PatternGrid cursor and selection", "[pattern_grid]")
+{
+  bass_station::SequencerStepMap step_map = bass_station::make_step_map();
+  step_map.data[16 + 2].second.m_state = bass_station::StepState::ON;
+  bass_station::PatternGrid grid;
+  DirtyCells dirty_cells;
+  grid.update(step_map, 0, 0xFF, dirty_cells);
+
+  // the cursor moves on: the old cell is drawn plain and the new one inverted
+  REQUIRE(grid.update(step_map, 1, 0xFF, dirty_cells) == 2);
+  const bass_station::PatternGrid::DirtyCell *cell = find_cell(dirty_cells, 2, bass_station::PatternGrid::Area::GRID, 1, 0);
+  REQUIRE(cell != nullptr);
+  REQUIRE_FALSE(cell->m_inverted);
+  cell = find_cell(dirty_cells, 2, bass_station::PatternGrid::Area::GRID, 1, 1);
+  REQUIRE(cell != nullptr);
+  REQUIRE(cell->m_inverted);
+
+  // the cursor moves to the upper row, and the roll follows it to show the ON step there
+  const uint8_t count = grid.update(step_map, 16, 0xFF, dirty_cells);
+  REQUIRE(count == 3);
+  cell = find_cell(dirty_cells, count, bass_station::PatternGrid::Area::GRID, 0, 0);
+  REQUIRE(cell != nullptr);
+  REQUIRE(cell->m_inverted);
+  cell = find_cell(dirty_cells, count, bass_station::PatternGrid::Area::ROLL, bass_station::PatternGrid::roll_lines - 1, 2);
+  REQUIRE(cell != nullptr);
+  REQUIRE(cell->m_glyph == '_');
+
+  // a selected step is drawn as 'o' when OFF and '@' when ON
+  REQUIRE(grid.update(step_map, 16, 3, dirty_cells) == 1);
+  REQUIRE(dirty_cells[0].m_glyph == 'o');
+  REQUIRE(grid.update(step_map, 16, 16 + 2, dirty_cells) == 2);
+  cell = find_cell(dirty_cells, 2, bass_station::PatternGrid::Area::GRID, 0, 2);
+  REQUIRE(cell != nullptr);
+  REQUIRE(cell->m_glyph == '@');
+  cell = find_cell(dirty_cells, 2, bass_station::PatternGrid::Area::GRID, 1, 3);
+  REQUIRE(cell != nullptr);
+  REQUIRE(cell->m_glyph == '.');
+
+  // a cursor or selection past the last step marks no cell
+  REQUIRE(grid.update(step_map, 0xFF, 0xFF, dirty_cells) == 2);
+  cell = find_cell(dirty_cells, 2, bass_station::PatternGrid::Area::GRID, 0, 0);
+  REQUIRE(cell != nullptr);
+  REQUIRE_FALSE(cell->m_inverted);
+  cell = find_cell(dirty_cells, 2, bass_station::PatternGrid::Area::GRID, 0, 2);
+  REQUIRE(cell != nullptr);
+  REQUIRE(cell->m_glyph == '#');
+}
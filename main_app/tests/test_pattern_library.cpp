@@ -0,0 +1,186 @@
+#include <catch2/catch_all.hpp>
+#include <cstdint>
+#include <memory_diskio.hpp>
+#include <pattern_fixtures.hpp>
+#include <pattern_library.hpp>
+
+namespace
+{
+
+using TestLibrary = bass_station::PatternLibrary<fatfs::Driver<bass_station::MemoryDiskio>>;
+constexpr fatfs::TCHAR library_path[]{"0:/PATTERNS.BSL"};
+
+} // namespace
+
+TEST_CASE("PatternLibrary creates, saves and reopens", "[pattern_library]")
+{
+  bass_station::Volume volume;
+  TestLibrary library(volume.m_driver);
+  REQUIRE(library.open(library_path));
+  REQUIRE(volume.watch_library() == bass_station::library_format::file_sectors * bass_station::library_format::sector_size);
+  REQUIRE_FALSE(library.contains_pattern(0));
+
+  bass_station::PackedPattern loaded;
+  REQUIRE_FALSE(library.load_pattern(0, loaded));
+  REQUIRE(library.save_pattern(0, bass_station::make_pattern(1)));
+  REQUIRE(library.save_pattern(47, bass_station::make_pattern(2)));
+  REQUIRE(library.save_pattern(0, bass_station::make_pattern(3)));
+  REQUIRE_FALSE(library.save_pattern(bass_station::library_format::pattern_slots, bass_station::make_pattern(4)));
+
+  bass_station::Song song;
+  song.m_length     = 3;
+  song.m_entries[0] = {0, 4};
+  song.m_entries[1] = {15, 2};
+  song.m_entries[2] = {0, 1};
+  REQUIRE(library.save_song(1, song));
+
+  // songs play from the pattern bank, so a song can only refer to bank slots
+  bass_station::Song bad_song;
+  bad_song.m_length     = 1;
+  bad_song.m_entries[0] = {static_cast<uint8_t>(bass_station::PatternBank::slot_count), 1};
+  REQUIRE_FALSE(library.save_song(2, bad_song));
+  bad_song.m_length = 0;
+  REQUIRE_FALSE(library.save_song(2, bad_song));
+  library.close();
+
+  volume.mount();
+  TestLibrary reopened(volume.m_driver);
+  REQUIRE(reopened.open(library_path));
+  REQUIRE(reopened.contains_pattern(0));
+  REQUIRE(reopened.contains_pattern(47));
+  REQUIRE_FALSE(reopened.contains_pattern(1));
+  REQUIRE(reopened.load_pattern(0, loaded));
+  REQUIRE(loaded == bass_station::make_pattern(3));
+  REQUIRE(reopened.load_pattern(47, loaded));
+  REQUIRE(loaded == bass_station::make_pattern(2));
+
+  bass_station::Song loaded_song;
+  REQUIRE(reopened.contains_song(1));
+  REQUIRE_FALSE(reopened.contains_song(2));
+  REQUIRE(reopened.load_song(1, loaded_song));
+  REQUIRE(loaded_song.m_length == 3);
+  REQUIRE(loaded_song.m_entries[1].m_pattern == 15);
+  REQUIRE(loaded_song.m_entries[1].m_repeats == 2);
+}
+
+TEST_CASE("PatternLibrary reads a pattern with one sector read", "[pattern_library]")
+{
+  bass_station::Volume volume;
+  TestLibrary library(volume.m_driver);
+  REQUIRE(library.open(library_path));
+  REQUIRE(volume.watch_library() > 0);
+  for (uint16_t slot = 0; slot < bass_station::library_format::pattern_slots; slot++)
+  {
+    REQUIRE(library.save_pattern(slot, bass_station::make_pattern(slot)));
+  }
+
+  // listing the library needs no card access
+  volume.m_diskio.reset_counters();
+  for (std::size_t slot = 0; slot < bass_station::library_format::pattern_slots; slot++)
+  {
+    REQUIRE(library.contains_pattern(slot));
+  }
+  REQUIRE(volume.m_diskio.sector_reads() == 0);
+
+  // FatFs reads a whole sector straight into the record buffer. It may read the FAT to find the cluster.
+  for (uint16_t slot = 0; slot < bass_station::library_format::pattern_slots; slot++)
+  {
+    volume.m_diskio.reset_counters();
+    bass_station::PackedPattern loaded;
+    REQUIRE(library.load_pattern(slot, loaded));
+    REQUIRE(loaded == bass_station::make_pattern(slot));
+    REQUIRE(volume.m_diskio.sector_reads() == 1);
+  }
+
+  // a save is the record sector, then the header sector
+  volume.m_diskio.reset_counters();
+  REQUIRE(library.save_pattern(5, bass_station::make_pattern(100)));
+  REQUIRE(volume.m_diskio.sector_writes() == 2);
+}
+
+TEST_CASE("PatternLibrary rejects damaged records", "[pattern_library]")
+{
+  bass_station::Volume volume;
+  TestLibrary library(volume.m_driver);
+  REQUIRE(library.open(library_path));
+  REQUIRE(volume.watch_library() > 0);
+  REQUIRE(library.save_pattern(3, bass_station::make_pattern(30)));
+  REQUIRE(library.save_pattern(4, bass_station::make_pattern(40)));
+
+  // flip a step of slot 3
+  volume.m_diskio.poke(TestLibrary::pattern_sector(3, library.pattern_copy(3)) * bass_station::library_format::sector_size +
+                           sizeof(bass_station::library_format::RecordHeader),
+                       0xAA);
+
+  bass_station::PackedPattern loaded;
+  REQUIRE_FALSE(library.load_pattern(3, loaded));
+  REQUIRE(library.load_pattern(4, loaded));
+  REQUIRE(loaded == bass_station::make_pattern(40));
+
+  // saving again repairs the slot
+  REQUIRE(library.save_pattern(3, bass_station::make_pattern(31)));
+  REQUIRE(library.load_pattern(3, loaded));
+  REQUIRE(loaded == bass_station::make_pattern(31));
+}
+
+TEST_CASE("PatternLibrary keeps the previous version of a slot if a save is cut off", "[pattern_library]")
+{
+  bass_station::Volume volume;
+  TestLibrary library(volume.m_driver);
+  REQUIRE(library.open(library_path));
+  REQUIRE(volume.watch_library() > 0);
+  REQUIRE(library.save_pattern(3, bass_station::make_pattern(30)));
+  REQUIRE(library.pattern_copy(3) == 0);
+  REQUIRE(library.save_pattern(3, bass_station::make_pattern(31)));
+  REQUIRE(library.pattern_copy(3) == 1);
+
+  // the record is written, the power goes before the directory is
+  volume.m_diskio.fail_writes_after(1);
+  REQUIRE_FALSE(library.save_pattern(3, bass_station::make_pattern(32)));
+  REQUIRE(library.pattern_copy(3) == 1);
+
+  bass_station::PackedPattern loaded;
+  REQUIRE(library.load_pattern(3, loaded));
+  REQUIRE(loaded == bass_station::make_pattern(31));
+  library.close();
+
+  // the power comes back
+  volume.m_diskio.fail_writes_after(SIZE_MAX);
+  volume.mount();
+  TestLibrary reopened(volume.m_driver);
+  REQUIRE(reopened.open(library_path));
+  REQUIRE(reopened.load_pattern(3, loaded));
+  REQUIRE(loaded == bass_station::make_pattern(31));
+
+  // the next save goes to the sector the cut off one used
+  REQUIRE(reopened.save_pattern(3, bass_station::make_pattern(33)));
+  REQUIRE(reopened.pattern_copy(3) == 0);
+  REQUIRE(reopened.load_pattern(3, loaded));
+  REQUIRE(loaded == bass_station::make_pattern(33));
+}
+
+TEST_CASE("PatternLibrary leaves a newer version of the file alone", "[pattern_library]")
+{
+  bass_station::Volume volume;
+  {
+    TestLibrary library(volume.m_driver);
+    REQUIRE(library.open(library_path));
+    REQUIRE(library.save_pattern(0, bass_station::make_pattern(7)));
+    library.close();
+  }
+
+  // bump the version in the header
+  REQUIRE(volume.watch_library() > 0);
+  volume.m_diskio.poke(offsetof(bass_station::library_format::Header, m_version), bass_station::library_format::version + 1);
+  volume.m_diskio.reset_counters();
+
+  volume.mount();
+  TestLibrary library(volume.m_driver);
+  REQUIRE_FALSE(library.open(library_path));
+  REQUIRE_FALSE(library.is_open());
+  REQUIRE(volume.m_diskio.sector_writes() == 0);
+
+  bass_station::PackedPattern loaded;
+  REQUIRE_FALSE(library.load_pattern(0, loaded));
+  REQUIRE_FALSE(library.save_pattern(0, bass_station::make_pattern(8)));
+}
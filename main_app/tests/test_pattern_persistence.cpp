@@ -0,0 +1,289 @@
+#include <catch2/catch_all.hpp>
+#include <memory_diskio.hpp>
+#include <pattern_fixtures.hpp>
+#include <pattern_library.hpp>
+#include <pattern_persistence.hpp>
+#include <usec_clock.hpp>
+#include <utility>
+
+namespace
+{
+
+// STM32G0 datasheet typical timings
+constexpr uint32_t double_word_program_us{85};
+constexpr uint32_t page_erase_us{22000};
+// one 512 byte sector over SPI at 8MHz, and the card's busy time after a write
+constexpr uint32_t card_sector_us{1000};
+
+// 16th note steps at 120 BPM
+constexpr uint32_t step_period_us{125000};
+// the display, keypad and LED work of one main loop iteration
+constexpr uint32_t main_loop_us{300};
+// how long before a step the pattern is edited
+constexpr uint32_t edit_lead_us{5000};
+
+// step lateness histogram, in 25us buckets up to 1ms (the last bucket collects everything later), so the slices of
+// PatternPersistence::m_slice_budget_us show up in it
+constexpr uint32_t bucket_us{25};
+struct StepLateness
+{
+  std::array<uint32_t, 40> m_histogram;
+  uint32_t m_worst_us;
+};
+
+/// @brief FlashMemory that takes time: programming blocks the CPU, an erase runs in the background
+class TimedFlash : public bass_station::FlashMemory<8>
+{
+public:
+  bool start_erase(std::size_t page) override
+  {
+    m_erase_done_us = bass_station::UsecClock::now() + page_erase_us;
+    return bass_station::FlashMemory<8>::start_erase(page);
+  }
+
+  EraseStatus erase_status() override
+  {
+    // reading the status register takes time too
+    bass_station::UsecClock::advance(1);
+    return (static_cast<int32_t>(bass_station::UsecClock::now() - m_erase_done_us) < 0) ? EraseStatus::BUSY : EraseStatus::DONE;
+  }
+
+  bool program(std::size_t page, std::size_t offset, const uint8_t *data, std::size_t length) override
+  {
+    bass_station::UsecClock::advance(static_cast<uint32_t>(length / double_word_size) * double_word_program_us);
+    return bass_station::FlashMemory<8>::program(page, offset, data, length);
+  }
+
+private:
+  uint32_t m_erase_done_us{0};
+};
+
+/// @brief FlashMemory whose region can be made unavailable after the bank has been initialised
+class UnavailableFlash : public bass_station::FlashMemory<8>
+{
+public:
+  std::size_t page_count() const override { return m_available ? bass_station::FlashMemory<8>::page_count() : 0; }
+
+  bool m_available{true};
+};
+
+enum class SaveMode
+{
+  NONE,
+  WRITE_BEHIND,
+  BLOCKING,
+};
+
+/// @brief Run the main loop for a number of steps, editing the pattern every edit_interval steps, and record how late
+/// each step was picked up by the main loop
+StepLateness run_simulation(SaveMode save_mode,
+                            uint32_t step_count,
+                            uint32_t edit_interval,
+                            bass_station::PatternStore &store,
+                            bass_station::SequencerStepMap &step_map,
+                            uint32_t lead_us = edit_lead_us)
+{
+  bass_station::PatternPersistence persistence(store, 0);
+
+  StepLateness lateness{};
+  uint32_t next_step_us = bass_station::UsecClock::now() + step_period_us;
+  uint32_t steps_played = 0;
+  bool edit_pending     = false;
+  uint32_t edit_due_us  = 0;
+  while (steps_played < step_count)
+  {
+    const uint32_t now_us = bass_station::UsecClock::now();
+    if (static_cast<int32_t>(now_us - next_step_us) >= 0)
+    {
+      const uint32_t lateness_us = now_us - next_step_us;
+      lateness.m_histogram[std::min<std::size_t>(lateness_us / bucket_us, lateness.m_histogram.size() - 1)]++;
+      lateness.m_worst_us = std::max(lateness.m_worst_us, lateness_us);
+      next_step_us += step_period_us;
+      steps_played++;
+
+      if (steps_played % edit_interval == 0)
+      {
+        // the user presses a key shortly before the next step
+        edit_pending = true;
+        edit_due_us  = next_step_us - lead_us;
+      }
+    }
+
+    if (edit_pending && static_cast<int32_t>(now_us - edit_due_us) >= 0)
+    {
+      edit_pending = false;
+
+      // toggle a step, as update_sequencer_map() would
+      bass_station::Step &step = step_map.data[steps_played % step_map.data.size()].second;
+      step.m_state             = (step.m_state == bass_station::StepState::ON) ? bass_station::StepState::OFF : bass_station::StepState::ON;
+      if (save_mode == SaveMode::WRITE_BEHIND)
+      {
+        persistence.mark_dirty();
+      }
+      else if (save_mode == SaveMode::BLOCKING)
+      {
+        bass_station::PackedPattern pattern;
+        bass_station::pack_pattern(step_map, pattern);
+        REQUIRE(store.begin_save(0, pattern, bass_station::default_pattern_length));
+        while (store.service())
+        {
+        }
+        REQUIRE(store.last_save_succeeded());
+      }
+    }
+
+    bass_station::UsecClock::advance(main_loop_us);
+    persistence.service(step_map);
+  }
+
+  // let the last save finish
+  for (uint32_t idle_loop = 0; idle_loop < 20000; idle_loop++)
+  {
+    bass_station::UsecClock::advance(main_loop_us);
+    persistence.service(step_map);
+  }
+  REQUIRE(persistence.failed_saves() == 0);
+  return lateness;
+}
+
+} // namespace
+
+TEST_CASE("PatternPersistence does not change step timing", "[pattern_persistence]")
+{
+  constexpr uint32_t step_count{10000};
+  // an edit every 4 seconds, so each one settles and is saved, enough to go round the flash pages several times
+  constexpr uint32_t edit_interval{32};
+
+  TimedFlash idle_flash;
+  bass_station::PatternBank idle_bank(idle_flash);
+  REQUIRE(idle_bank.initialise());
+  auto idle_map               = bass_station::make_step_map();
+  const StepLateness no_saves = run_simulation(SaveMode::NONE, step_count, edit_interval, idle_bank, idle_map);
+
+  TimedFlash write_behind_flash;
+  bass_station::PatternBank write_behind_bank(write_behind_flash);
+  REQUIRE(write_behind_bank.initialise());
+  auto write_behind_map         = bass_station::make_step_map();
+  const StepLateness with_saves = run_simulation(SaveMode::WRITE_BEHIND, step_count, edit_interval, write_behind_bank, write_behind_map);
+
+  // the saves really happened, including page reclaims
+  bass_station::PatternBank bank(write_behind_flash);
+  REQUIRE(bank.initialise());
+  bass_station::PackedPattern saved;
+  bass_station::PackedPattern live;
+  REQUIRE(bank.load(0, saved));
+  bass_station::pack_pattern(write_behind_map, live);
+  REQUIRE(saved == live);
+  for (std::size_t page = 0; page < write_behind_flash.page_count(); page++)
+  {
+    REQUIRE(write_behind_flash.erase_count(page) > 0);
+  }
+
+  // without saves a step is picked up within one main loop iteration
+  REQUIRE(no_saves.m_worst_us < main_loop_us);
+
+  // the saves make a step later by one slice at most
+  INFO("worst step lateness without saves " << no_saves.m_worst_us << "us, with saves " << with_saves.m_worst_us << "us");
+  REQUIRE(with_saves.m_worst_us > no_saves.m_worst_us);
+  REQUIRE(with_saves.m_worst_us <= no_saves.m_worst_us + bass_station::PatternPersistence::m_slice_budget_us);
+  REQUIRE(with_saves.m_histogram.back() == 0);
+
+  // whereas saving from the main loop makes a step late by most of a page erase whenever a page is reclaimed
+  TimedFlash blocking_flash;
+  bass_station::PatternBank blocking_bank(blocking_flash);
+  REQUIRE(blocking_bank.initialise());
+  auto blocking_map           = bass_station::make_step_map();
+  const StepLateness blocking = run_simulation(SaveMode::BLOCKING, step_count, edit_interval, blocking_bank, blocking_map);
+  REQUIRE(blocking.m_worst_us >= page_erase_us - edit_lead_us);
+  REQUIRE(blocking.m_histogram.back() > 0);
+}
+
+TEST_CASE("PatternPersistence saves to the uSD library one sector access at a time", "[pattern_persistence]")
+{
+  using TestLibrary = bass_station::PatternLibrary<fatfs::Driver<bass_station::MemoryDiskio>>;
+  constexpr fatfs::TCHAR library_path[]{"0:/PATTERNS.BSL"};
+  constexpr uint32_t step_count{2000};
+  constexpr uint32_t edit_interval{32};
+  // the settle time is a whole number of steps, so with this lead the first card access of each save runs across a step
+  constexpr uint32_t lead_us{card_sector_us / 2};
+  static_assert(bass_station::PatternPersistence::m_settle_time_us % step_period_us == 0);
+
+  // the card only takes time once the library has been created
+  bass_station::Volume idle_volume;
+  TestLibrary idle_library(idle_volume.m_driver);
+  REQUIRE(idle_library.open(library_path));
+  idle_volume.m_diskio.set_sector_access_us(card_sector_us);
+  auto idle_map               = bass_station::make_step_map();
+  const StepLateness no_saves = run_simulation(SaveMode::NONE, step_count, edit_interval, idle_library, idle_map, lead_us);
+
+  bass_station::Volume write_behind_volume;
+  TestLibrary write_behind_library(write_behind_volume.m_driver);
+  REQUIRE(write_behind_library.open(library_path));
+  write_behind_volume.m_diskio.set_sector_access_us(card_sector_us);
+  REQUIRE(write_behind_volume.watch_library() > 0);
+  auto write_behind_map         = bass_station::make_step_map();
+  const StepLateness with_saves = run_simulation(SaveMode::WRITE_BEHIND, step_count, edit_interval, write_behind_library, write_behind_map, lead_us);
+
+  // the saves really happened: every save is the record, the header and the sync
+  REQUIRE(write_behind_volume.m_diskio.sector_writes() >= 2 * (step_count / edit_interval));
+  bass_station::PackedPattern saved;
+  bass_station::PackedPattern live;
+  REQUIRE(write_behind_library.load_pattern(0, saved));
+  bass_station::pack_pattern(write_behind_map, live);
+  REQUIRE(saved == live);
+
+  // a card access can't be cut short, so each main loop iteration does one and a step is late by that at most
+  INFO("worst step lateness without saves " << no_saves.m_worst_us << "us, with saves " << with_saves.m_worst_us << "us");
+  REQUIRE(with_saves.m_worst_us > no_saves.m_worst_us);
+  REQUIRE(with_saves.m_worst_us <= no_saves.m_worst_us + card_sector_us);
+
+  // whereas a blocking save makes a step late by all of its card accesses
+  bass_station::Volume blocking_volume;
+  TestLibrary blocking_library(blocking_volume.m_driver);
+  REQUIRE(blocking_library.open(library_path));
+  blocking_volume.m_diskio.set_sector_access_us(card_sector_us);
+  auto blocking_map           = bass_station::make_step_map();
+  const StepLateness blocking = run_simulation(SaveMode::BLOCKING, step_count, edit_interval, blocking_library, blocking_map, lead_us);
+  REQUIRE(blocking.m_worst_us >= no_saves.m_worst_us + 2 * card_sector_us);
+}
+
+TEST_CASE("PatternPersistence gives up on a save the bank refuses", "[pattern_persistence]")
+{
+  UnavailableFlash flash;
+  bass_station::PatternBank bank(flash);
+  REQUIRE(bank.initialise());
+  bass_station::PatternPersistence persistence(bank, 0);
+  auto step_map = bass_station::make_step_map();
+
+  flash.m_available = false;
+  persistence.mark_dirty();
+  REQUIRE_FALSE(persistence.work_pending());
+  bass_station::UsecClock::advance(bass_station::PatternPersistence::m_settle_time_us);
+  REQUIRE(persistence.work_pending());
+  persistence.service(step_map);
+  REQUIRE(persistence.failed_saves() == 1);
+
+  // the main loop can sleep again, and the refused save is not retried
+  for (uint32_t loop = 0; loop < 100; loop++)
+  {
+    REQUIRE_FALSE(persistence.work_pending());
+    bass_station::UsecClock::advance(bass_station::PatternPersistence::m_settle_time_us);
+    persistence.service(step_map);
+  }
+  REQUIRE(persistence.failed_saves() == 1);
+
+  // the next edit saves once the flash is back
+  flash.m_available = true;
+  persistence.mark_dirty();
+  bass_station::UsecClock::advance(bass_station::PatternPersistence::m_settle_time_us);
+  while (persistence.work_pending())
+  {
+    persistence.service(step_map);
+  }
+  REQUIRE(persistence.failed_saves() == 1);
+  bass_station::PackedPattern saved;
+  bass_station::PackedPattern live;
+  REQUIRE(bank.load(0, saved));
+  bass_station::pack_pattern(step_map, live);
+  REQUIRE(saved == live);
+}
@@ -0,0 +1,187 @@
+#include <board_description.hpp>
+#include <catch2/catch_all.hpp>
+#include <input_replayer.hpp>
+#include <pitch_map.hpp>
+
+namespace
+{
+constexpr std::array<bass_station::NoteData, bass_station::Note::none> note_data = bass_station::board::make_note_data();
+} // namespace
+
+TEST_CASE("PitchMap chromatic", "[pitch_map]")
+{
+  bass_station::PitchMap pitch_map(note_data);
+  // every key plays itself
+  for (uint8_t note = 0; note < bass_station::Note::none; note++)
+  {
+    REQUIRE(pitch_map.note(static_cast<bass_station::Note>(note)) == note);
+    REQUIRE(pitch_map.pole(static_cast<bass_station::Note>(note)) == note_data[note].m_sw);
+  }
+}
+
+TEST_CASE("PitchMap transpose", "[pitch_map]")
+{
+  bass_station::PitchMap pitch_map(note_data);
+  REQUIRE(pitch_map.set(bass_station::PitchMap::Scale::CHROMATIC, 0, 5));
+  REQUIRE(pitch_map.note(bass_station::Note::c0) == bass_station::Note::f0);
+  REQUIRE(pitch_map.pole(bass_station::Note::c0) == note_data[bass_station::Note::f0].m_sw);
+  // off the top of the keyboard, folded back an octave
+  REQUIRE(pitch_map.note(bass_station::Note::a2) == bass_station::Note::d1);
+
+  REQUIRE(pitch_map.set(bass_station::PitchMap::Scale::CHROMATIC, 0, -12));
+  REQUIRE(pitch_map.note(bass_station::Note::c2) == bass_station::Note::c1);
+  REQUIRE(pitch_map.note(bass_station::Note::b1) == bass_station::Note::b1);
+
+  // out of range settings leave the tables as they were
+  REQUIRE_FALSE(pitch_map.set(bass_station::PitchMap::Scale::CHROMATIC, 0, 13));
+  REQUIRE_FALSE(pitch_map.set(bass_station::PitchMap::Scale::CHROMATIC, 12, 0));
+  REQUIRE_FALSE(pitch_map.set(bass_station::PitchMap::Scale::count, 0, 0));
+  REQUIRE(pitch_map.transpose() == -12);
+  REQUIRE(pitch_map.note(bass_station::Note::c2) == bass_station::Note::c1);
+}
+
+TEST_CASE("PitchMap scale quantisation", "[pitch_map]")
+{
+  bass_station::PitchMap pitch_map(note_data);
+
+  SECTION("C major")
+  {
+    REQUIRE(pitch_map.set(bass_station::PitchMap::Scale::MAJOR, 0, 0));
+    REQUIRE(pitch_map.note(bass_station::Note::c0) == bass_station::Note::c0);
+    // a sharp between two scale notes goes down
+    REQUIRE(pitch_map.note(bass_station::Note::c0_sharp) == bass_station::Note::c0);
+    REQUIRE(pitch_map.note(bass_station::Note::f1_sharp) == bass_station::Note::f1);
+    REQUIRE(pitch_map.note(bass_station::Note::b1) == bass_station::Note::b1);
+  }
+
+  SECTION("A minor pentatonic")
+  {
+    // A is 9 semitones above C: A C D E G
+    REQUIRE(pitch_map.set(bass_station::PitchMap::Scale::MINOR_PENTATONIC, 9, 0));
+    REQUIRE(pitch_map.note(bass_station::Note::c0_sharp) == bass_station::Note::c0);
+    REQUIRE(pitch_map.note(bass_station::Note::f0) == bass_station::Note::e0);
+    REQUIRE(pitch_map.note(bass_station::Note::f0_sharp) == bass_station::Note::g0);
+    REQUIRE(pitch_map.note(bass_station::Note::a1_sharp) == bass_station::Note::a1);
+  }
+
+  SECTION("every note played is in the scale")
+  {
+    const auto scale = static_cast<bass_station::PitchMap::Scale>(GENERATE(range(0, static_cast<int>(bass_station::PitchMap::Scale::count))));
+    const uint8_t root     = static_cast<uint8_t>(GENERATE(0, 4, 11));
+    const int8_t transpose = static_cast<int8_t>(GENERATE(-12, -7, 0, 3, 12));
+    REQUIRE(pitch_map.set(scale, root, transpose));
+    for (uint8_t note = 0; note < bass_station::Note::none; note++)
+    {
+      const bass_station::Note played = pitch_map.note(static_cast<bass_station::Note>(note));
+      REQUIRE(played < bass_station::Note::none);
+      REQUIRE(pitch_map.in_scale(played));
+      REQUIRE(pitch_map.pole(static_cast<bass_station::Note>(note)) == note_data[played].m_sw);
+    }
+  }
+}
+
+TEST_CASE("PitchMap note editing moves along the scale", "[pitch_map]")
+{
+  bass_station::PitchMap pitch_map(note_data);
+  REQUIRE(pitch_map.next_note(bass_station::Note::c0) == bass_station::Note::c0_sharp);
+
+  REQUIRE(pitch_map.set(bass_station::PitchMap::Scale::MAJOR_PENTATONIC, 2, 7));
+  // D E F# A B, the transpose doesn't change what is edited
+  REQUIRE(pitch_map.next_note(bass_station::Note::none) == bass_station::Note::d0);
+  REQUIRE(pitch_map.next_note(bass_station::Note::d0) == bass_station::Note::e0);
+  REQUIRE(pitch_map.next_note(bass_station::Note::e0) == bass_station::Note::f0_sharp);
+  REQUIRE(pitch_map.next_note(bass_station::Note::f0_sharp) == bass_station::Note::a1);
+  REQUIRE(pitch_map.previous_note(bass_station::Note::a1) == bass_station::Note::f0_sharp);
+  // a note outside the scale moves onto it
+  REQUIRE(pitch_map.next_note(bass_station::Note::c1) == bass_station::Note::d1);
+  REQUIRE(pitch_map.previous_note(bass_station::Note::c1) == bass_station::Note::b1);
+  // the ends of the keyboard
+  REQUIRE(pitch_map.next_note(bass_station::Note::b2) == bass_station::Note::b2);
+  REQUIRE(pitch_map.previous_note(bass_station::Note::d0) == bass_station::Note::d0);
+  REQUIRE(pitch_map.previous_note(bass_station::Note::none) == bass_station::Note::none);
+}
+
+TEST_CASE("PitchMap is set from PITCH mode", "[pitch_map]")
+{
+  using KeyMapping = adp5587::Driver<STM32G0_ISR>::GPIKeyMappings;
+  using Scale      = bass_station::PitchMap::Scale;
+  const auto user_button_1 = static_cast<bass_station::SequencerKeyEventIndex>(KeyMapping::C4 | KeyMapping::ON);
+  const auto user_button_2 = static_cast<bass_station::SequencerKeyEventIndex>(KeyMapping::C5 | KeyMapping::ON);
+
+  bass_station::SimulatedSequencer simulation;
+  bass_station::SequenceManager &sequencer = simulation.sequencer();
+  const bass_station::PitchMap &pitch_map  = sequencer.pitch_map();
+  const auto press = [&](bass_station::SequencerKeyEventIndex key_event) {
+    simulation.m_debounce_timer.CNT = simulation.m_debounce_timer.CNT + 400;
+    REQUIRE(sequencer.simulate_key_event(key_event));
+    sequencer.run_main_loop_iteration();
+  };
+  const auto press_encoder_switch = [&]() {
+    simulation.m_debounce_timer.CNT = simulation.m_debounce_timer.CNT + 400;
+    sequencer.simulate_encoder_switch_interrupt();
+    bass_station::DeferredWork::run_pending();
+    sequencer.run_main_loop_iteration();
+  };
+  const auto turn_encoder = [&](bool up) {
+    simulation.m_encoder_timer.CR1 = up ? TIM_CR1_DIR : 0U;
+    simulation.m_encoder_timer.CNT = up ? simulation.m_encoder_timer.CNT + 1 : simulation.m_encoder_timer.CNT - 1;
+    sequencer.run_main_loop_iteration();
+  };
+  const auto selected_ratchet = [&]() {
+    return sequencer.active_step_map().data[sequencer.selected_step_index()].second.m_ratchet;
+  };
+
+  sequencer.run_main_loop_iteration();
+  REQUIRE(pitch_map.scale() == Scale::CHROMATIC);
+  REQUIRE(pitch_map.root() == 0);
+  REQUIRE(pitch_map.transpose() == 0);
+
+  // TEMPO_ADJUST, NOTE_SELECT, RECORD, UNDO, PITCH
+  for (int mode = 0; mode < 4; mode++)
+  {
+    press_encoder_switch();
+  }
+  const uint8_t ratchet = selected_ratchet();
+
+  // one semitone for each turn seen, the played notes follow
+  turn_encoder(true);
+  turn_encoder(true);
+  turn_encoder(false);
+  REQUIRE(pitch_map.transpose() == 1);
+  REQUIRE(pitch_map.note(bass_station::Note::c0) == bass_station::Note::c0_sharp);
+  for (int turn = 0; turn < 2 * bass_station::PitchMap::max_transpose; turn++)
+  {
+    turn_encoder(false);
+  }
+  REQUIRE(pitch_map.transpose() == -bass_station::PitchMap::max_transpose);
+
+  // user button 1 steps the scale and user button 2 the root, the ratchet of the selected step is left alone
+  press(user_button_1);
+  REQUIRE(pitch_map.scale() == Scale::MAJOR);
+  press(user_button_2);
+  press(user_button_2);
+  REQUIRE(pitch_map.root() == 2);
+  REQUIRE(pitch_map.transpose() == -bass_station::PitchMap::max_transpose);
+  REQUIRE(selected_ratchet() == ratchet);
+  for (std::size_t scale = 1; scale < static_cast<std::size_t>(Scale::count); scale++)
+  {
+    press(user_button_1);
+  }
+  REQUIRE(pitch_map.scale() == Scale::CHROMATIC);
+  for (int root = 2; root < 12; root++)
+  {
+    press(user_button_2);
+  }
+  REQUIRE(pitch_map.root() == 0);
+
+  SECTION("back in TEMPO_ADJUST the encoder and user button 2 do what they did")
+  {
+    press_encoder_switch();
+    REQUIRE(simulation.m_encoder_timer.CNT == 16);
+    turn_encoder(true);
+    REQUIRE(pitch_map.transpose() == -bass_station::PitchMap::max_transpose);
+    press(user_button_2);
+    REQUIRE(selected_ratchet() != ratchet);
+    REQUIRE(pitch_map.root() == 0);
+  }
+}
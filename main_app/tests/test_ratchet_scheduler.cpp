@@ -0,0 +1,165 @@
+#include <catch2/catch_all.hpp>
+#include <cmath>
+#include <ratchet_scheduler.hpp>
+#include <swing_engine.hpp>
+#include <vector>
+
+namespace
+{
+
+/// @brief TIM3 counting through the SwingEngine periods, with the update and CC1 compare interrupts taken as the
+/// hardware would take them. Times are in timer counts from the start.
+class TempoTimerSimulation
+{
+public:
+  struct PlayedGate
+  {
+    uint64_t m_counts;
+    bass_station::RatchetScheduler::Gate m_gate;
+  };
+
+  explicit TempoTimerSimulation(uint8_t swing_percent)
+  {
+    REQUIRE(m_swing.set_swing(swing_percent));
+    m_swing.reset();
+    m_timer.ARR = m_swing.reload();
+    m_ratchets.reset(m_swing.step_counts());
+    m_step_starts.push_back(0);
+  }
+
+  /// @brief Run one timer period: the compare matches in it, then the update at its end
+  /// @param ratchet The ratchet of a step started by the update
+  /// @param main_loop_counts How long after the step update the main loop schedules its retriggers
+  void run_period(uint8_t ratchet, uint32_t main_loop_counts)
+  {
+    const uint32_t arr = m_timer.ARR;
+    while ((m_timer.DIER & TIM_DIER_CC1IE) && (m_timer.CCR1 <= arr))
+    {
+      m_timer.CNT = m_timer.CCR1;
+      if (m_ratchets.timer_compare())
+      {
+        bottom_half(m_period_start + m_timer.CNT);
+      }
+    }
+
+    m_period_start += arr + 1U;
+    m_timer.CNT               = 0;
+    const uint8_t actions     = m_swing.tick();
+    m_timer.ARR               = m_swing.reload();
+    const bool step_started   = (actions & bass_station::SwingEngine::STEP);
+    if (m_ratchets.timer_update(step_started, m_swing.step_counts()))
+    {
+      bottom_half(m_period_start);
+    }
+    if (step_started)
+    {
+      m_step_starts.push_back(m_period_start);
+      // the main loop has played the first trigger and queues the others
+      m_timer.CNT = main_loop_counts;
+      REQUIRE(m_ratchets.schedule(m_ratchets.steps_started(), adg2188::Driver::Pole::x0_to_y0, ratchet) == (ratchet > 1));
+      m_timer.CNT = 0;
+    }
+  }
+
+  const std::vector<uint64_t> &step_starts() const { return m_step_starts; }
+  const std::vector<PlayedGate> &gates() const { return m_gates; }
+
+  TIM_TypeDef m_timer{};
+  bass_station::SwingEngine m_swing;
+  bass_station::RatchetScheduler m_ratchets{m_timer};
+
+private:
+  void bottom_half(uint64_t counts)
+  {
+    bass_station::RatchetScheduler::Gate gate;
+    while (m_ratchets.pop_gate(gate))
+    {
+      m_gates.push_back(PlayedGate{counts, gate});
+    }
+  }
+
+  uint64_t m_period_start{0};
+  std::vector<uint64_t> m_step_starts;
+  std::vector<PlayedGate> m_gates;
+};
+
+} // namespace
+
+TEST_CASE("RatchetScheduler retrigger timing at 180 BPM", "[ratchet_scheduler]")
+{
+  // a beat is a pair of steps (24 MIDI clocks), so at 180 BPM a timer count lasts this long. On the device it is set by
+  // the tempo timer prescaler, this is PSC = 11.5
+  const double count_us = (60.0e6 / 180.0) / bass_station::SwingEngine::counts_per_pair;
+  // from the compare match to the closed switch: interrupt entry, PendSV and a 3 byte ADG2188 write at 400kHz
+  const double gate_latency_us = 5.0 + (29.0 * 2.5);
+  // the main loop plays the first trigger 2ms into the step
+  const uint32_t main_loop_counts = static_cast<uint32_t>(2000.0 / count_us);
+
+  const uint8_t swing_percent = GENERATE(50, 66, 75);
+  const uint8_t ratchet       = GENERATE(2, 3, 4);
+  CAPTURE(swing_percent, ratchet);
+  TempoTimerSimulation simulation(swing_percent);
+
+  // the step at reset is played too
+  REQUIRE(simulation.m_ratchets.schedule(0, adg2188::Driver::Pole::x0_to_y0, ratchet));
+  for (std::size_t period = 0; period < 4 * simulation.m_swing.update_count(); period++)
+  {
+    simulation.run_period(ratchet, main_loop_counts);
+  }
+  const std::vector<uint64_t> &step_starts = simulation.step_starts();
+  REQUIRE(step_starts.size() == 9);
+
+  // every step but the last (still playing) has its retriggers: an open then a close each
+  const std::vector<TempoTimerSimulation::PlayedGate> &gates = simulation.gates();
+  REQUIRE(gates.size() >= 8 * 2 * (ratchet - 1U));
+  double max_error_us = 0;
+  for (std::size_t step = 0; step < 8; step++)
+  {
+    const double step_start_us  = static_cast<double>(step_starts[step]) * count_us;
+    const double step_length_us = static_cast<double>(step_starts[step + 1] - step_starts[step]) * count_us;
+    for (uint32_t trigger = 1; trigger < ratchet; trigger++)
+    {
+      const TempoTimerSimulation::PlayedGate &close = gates[(step * 2 * (ratchet - 1U)) + (2 * trigger) - 1];
+      REQUIRE(close.m_gate.m_close);
+      REQUIRE_FALSE(gates[(step * 2 * (ratchet - 1U)) + (2 * trigger) - 2].m_gate.m_close);
+
+      const double ideal_us  = step_start_us + ((step_length_us * trigger) / ratchet);
+      const double played_us = (static_cast<double>(close.m_counts) * count_us) + gate_latency_us;
+      max_error_us           = std::max(max_error_us, std::fabs(played_us - ideal_us));
+    }
+  }
+  REQUIRE(max_error_us < 100.0);
+}
+
+TEST_CASE("RatchetScheduler drops late and stale retriggers", "[ratchet_scheduler]")
+{
+  TempoTimerSimulation simulation(50);
+
+  // a single trigger, or a step that has already been left, is not scheduled
+  REQUIRE_FALSE(simulation.m_ratchets.schedule(0, adg2188::Driver::Pole::x0_to_y0, 1));
+  REQUIRE_FALSE(simulation.m_ratchets.schedule(1, adg2188::Driver::Pole::x0_to_y0, 4));
+
+  // the first retrigger of a 4 ratchet is due in period 3, scheduling it in period 4 plays the others only
+  for (int period = 0; period < 4; period++)
+  {
+    simulation.run_period(1, 0);
+  }
+  simulation.m_timer.CNT = 10;
+  REQUIRE(simulation.m_ratchets.schedule(0, adg2188::Driver::Pole::x0_to_y0, 4));
+  simulation.m_timer.CNT = 0;
+  for (std::size_t period = 4; period < bass_station::SwingEngine::updates_per_step; period++)
+  {
+    simulation.run_period(1, 0);
+  }
+  REQUIRE(simulation.gates().size() == 4);
+
+  // the sequencer stops: nothing more is played
+  REQUIRE(simulation.m_ratchets.schedule(1, adg2188::Driver::Pole::x0_to_y0, 4));
+  simulation.m_ratchets.cancel();
+  REQUIRE((simulation.m_timer.DIER & TIM_DIER_CC1IE) == 0);
+  for (std::size_t period = 0; period < bass_station::SwingEngine::updates_per_step - 1; period++)
+  {
+    simulation.run_period(1, 0);
+  }
+  REQUIRE(simulation.gates().size() == 4);
+}
@@ -0,0 +1,189 @@
+#include <catch2/catch_all.hpp>
+#include <cstdio>
+#include <sector_cache.hpp>
+#include <vector>
+
+namespace
+{
+
+constexpr std::size_t sector_size{512};
+
+/// @brief A diskio layer on a host disk image file, counting the commands a card would get
+class ImageDiskio
+{
+public:
+  static constexpr std::size_t image_sectors{256};
+
+  ImageDiskio()
+      : m_image(std::tmpfile())
+  {
+    REQUIRE(m_image != nullptr);
+    // every byte of a sector holds the low byte of its number
+    std::array<fatfs::BYTE, sector_size> sector_data;
+    for (std::size_t sector = 0; sector < image_sectors; sector++)
+    {
+      sector_data.fill(static_cast<fatfs::BYTE>(sector));
+      REQUIRE(std::fwrite(sector_data.data(), 1, sector_data.size(), m_image) == sector_data.size());
+    }
+  }
+
+  ~ImageDiskio() { std::fclose(m_image); }
+
+  fatfs::DSTATUS disk_initialize(fatfs::BYTE) { return 0; }
+  fatfs::DSTATUS disk_status(fatfs::BYTE) { return 0; }
+  fatfs::DRESULT disk_ioctl(fatfs::BYTE, fatfs::BYTE, void *) { return fatfs::DRESULT::RES_OK; }
+
+  fatfs::DRESULT disk_read(fatfs::BYTE, fatfs::BYTE *buff, fatfs::LBA_t sector, fatfs::UINT count)
+  {
+    (count == 1) ? m_single_block_reads++ : m_multi_block_reads++;
+    if ((sector + count > image_sectors) || (std::fseek(m_image, static_cast<long>(sector * sector_size), SEEK_SET) != 0) ||
+        (std::fread(buff, sector_size, count, m_image) != count))
+    {
+      return fatfs::DRESULT::RES_PARERR;
+    }
+    return fatfs::DRESULT::RES_OK;
+  }
+
+  fatfs::DRESULT disk_write(fatfs::BYTE, const fatfs::BYTE *buff, fatfs::LBA_t sector, fatfs::UINT count)
+  {
+    (count == 1) ? m_single_block_writes++ : m_multi_block_writes++;
+    if ((sector + count > image_sectors) || (std::fseek(m_image, static_cast<long>(sector * sector_size), SEEK_SET) != 0) ||
+        (std::fwrite(buff, sector_size, count, m_image) != count))
+    {
+      return fatfs::DRESULT::RES_PARERR;
+    }
+    return fatfs::DRESULT::RES_OK;
+  }
+
+  // CMD17, CMD18, CMD24 and CMD25
+  uint32_t m_single_block_reads{0};
+  uint32_t m_multi_block_reads{0};
+  uint32_t m_single_block_writes{0};
+  uint32_t m_multi_block_writes{0};
+
+private:
+  std::FILE *m_image;
+};
+
+using TestCache = bass_station::SectorCache<ImageDiskio, 8, 4>;
+
+bool sector_holds(const fatfs::BYTE *data, fatfs::BYTE value)
+{
+  for (std::size_t idx = 0; idx < sector_size; idx++)
+  {
+    if (data[idx] != value)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+TEST_CASE("SectorCache serves repeated reads from the cache", "[sector_cache]")
+{
+  ImageDiskio image;
+  TestCache cache(image);
+  std::array<fatfs::BYTE, sector_size> buffer;
+
+  // FAT and directory sectors are read over and over while browsing
+  for (uint32_t pass = 0; pass < 10; pass++)
+  {
+    for (fatfs::LBA_t sector : {10U, 40U, 12U, 70U})
+    {
+      REQUIRE(cache.disk_read(0, buffer.data(), sector, 1) == fatfs::DRESULT::RES_OK);
+      REQUIRE(sector_holds(buffer.data(), static_cast<fatfs::BYTE>(sector)));
+    }
+  }
+  REQUIRE(cache.statistics().m_misses == 4);
+  REQUIRE(cache.statistics().m_hits == 36);
+  REQUIRE(image.m_single_block_reads == 4);
+  REQUIRE(image.m_multi_block_reads == 0);
+}
+
+TEST_CASE("SectorCache evicts the least recently used sector", "[sector_cache]")
+{
+  ImageDiskio image;
+  TestCache cache(image);
+  std::array<fatfs::BYTE, sector_size> buffer;
+
+  // fill the cache with non-sequential sectors, so there is no read-ahead
+  for (fatfs::LBA_t sector = 0; sector < 16; sector += 2)
+  {
+    REQUIRE(cache.disk_read(0, buffer.data(), sector, 1) == fatfs::DRESULT::RES_OK);
+  }
+  // use sector 0 again, so sector 2 is now the oldest
+  REQUIRE(cache.disk_read(0, buffer.data(), 0, 1) == fatfs::DRESULT::RES_OK);
+  REQUIRE(cache.disk_read(0, buffer.data(), 100, 1) == fatfs::DRESULT::RES_OK);
+
+  cache.reset_statistics();
+  REQUIRE(cache.disk_read(0, buffer.data(), 0, 1) == fatfs::DRESULT::RES_OK);
+  REQUIRE(cache.statistics().m_hits == 1);
+  REQUIRE(cache.disk_read(0, buffer.data(), 2, 1) == fatfs::DRESULT::RES_OK);
+  REQUIRE(cache.statistics().m_misses == 1);
+  REQUIRE(sector_holds(buffer.data(), 2));
+}
+
+TEST_CASE("SectorCache reads ahead of sequential reads with multi-block reads", "[sector_cache]")
+{
+  ImageDiskio image;
+  TestCache cache(image);
+  std::array<fatfs::BYTE, sector_size> buffer;
+
+  // stream 64 sectors one at a time, as f_read does through its sector window
+  for (fatfs::LBA_t sector = 100; sector < 164; sector++)
+  {
+    REQUIRE(cache.disk_read(0, buffer.data(), sector, 1) == fatfs::DRESULT::RES_OK);
+    REQUIRE(sector_holds(buffer.data(), static_cast<fatfs::BYTE>(sector)));
+  }
+  // the first read is a single block, the next one continues it and each read-ahead serves four sectors
+  REQUIRE(image.m_single_block_reads == 1);
+  REQUIRE(image.m_multi_block_reads == 16);
+  REQUIRE(cache.statistics().m_misses == 17);
+  REQUIRE(cache.statistics().m_hits == 47);
+  REQUIRE(cache.statistics().m_read_ahead_sectors == 48);
+
+  // a read-ahead past the end of the card falls back to a single block
+  REQUIRE(cache.disk_read(0, buffer.data(), ImageDiskio::image_sectors - 2, 1) == fatfs::DRESULT::RES_OK);
+  REQUIRE(cache.disk_read(0, buffer.data(), ImageDiskio::image_sectors - 1, 1) == fatfs::DRESULT::RES_OK);
+  REQUIRE(sector_holds(buffer.data(), static_cast<fatfs::BYTE>(ImageDiskio::image_sectors - 1)));
+}
+
+TEST_CASE("SectorCache passes multi-sector transfers to the card in one command", "[sector_cache]")
+{
+  ImageDiskio image;
+  TestCache cache(image);
+  std::array<fatfs::BYTE, sector_size> buffer;
+  std::vector<fatfs::BYTE> transfer(16 * sector_size);
+
+  // cache sector 24, in the middle of the next transfer
+  REQUIRE(cache.disk_read(0, buffer.data(), 24, 1) == fatfs::DRESULT::RES_OK);
+  image.m_single_block_reads = 0;
+
+  // the runs either side of the cached sector are one multi-block read each
+  REQUIRE(cache.disk_read(0, transfer.data(), 20, 16) == fatfs::DRESULT::RES_OK);
+  for (std::size_t idx = 0; idx < 16; idx++)
+  {
+    REQUIRE(sector_holds(&transfer[idx * sector_size], static_cast<fatfs::BYTE>(20 + idx)));
+  }
+  REQUIRE(image.m_multi_block_reads == 2);
+  REQUIRE(image.m_single_block_reads == 0);
+
+  // a multi-sector write is one command, and the cached copy is updated
+  std::fill(transfer.begin(), transfer.end(), 0xA5);
+  REQUIRE(cache.disk_write(0, transfer.data(), 20, 8) == fatfs::DRESULT::RES_OK);
+  REQUIRE(image.m_multi_block_writes == 1);
+  REQUIRE(image.m_single_block_writes == 0);
+
+  cache.reset_statistics();
+  REQUIRE(cache.disk_read(0, buffer.data(), 24, 1) == fatfs::DRESULT::RES_OK);
+  REQUIRE(cache.statistics().m_hits == 1);
+  REQUIRE(sector_holds(buffer.data(), 0xA5));
+
+  // and the card has the new data
+  cache.invalidate();
+  REQUIRE(cache.disk_read(0, buffer.data(), 27, 1) == fatfs::DRESULT::RES_OK);
+  REQUIRE(cache.statistics().m_misses == 1);
+  REQUIRE(sector_holds(buffer.data(), 0xA5));
+}
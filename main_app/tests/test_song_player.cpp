@@ -0,0 +1,187 @@
+#include <catch2/catch_all.hpp>
+#include <pattern_fixtures.hpp>
+#include <song_player.hpp>
+#include <utility>
+
+namespace
+{
+
+/// @brief Patterns by id, counting the loads
+struct PatternSource
+{
+  std::array<bass_station::PackedPattern, 4> m_patterns{};
+  std::array<bool, 4> m_present{};
+  uint32_t m_loads{0};
+
+  std::array<uint8_t, 4> m_lengths{};
+
+  static bool load(void *context, std::size_t pattern_id, bass_station::PackedPattern &pattern, uint8_t &length)
+  {
+    PatternSource &self = *static_cast<PatternSource *>(context);
+    self.m_loads++;
+    if ((pattern_id >= self.m_patterns.size()) || !self.m_present[pattern_id])
+    {
+      return false;
+    }
+    pattern = self.m_patterns[pattern_id];
+    length  = self.m_lengths[pattern_id];
+    return true;
+  }
+};
+
+/// @brief Pattern n has only step n switched on
+bass_station::PackedPattern single_step_pattern(std::size_t id)
+{
+  bass_station::PackedPattern pattern{};
+  pattern[id] = bass_station::PackedStep::on_bit;
+  return pattern;
+}
+
+/// @brief The id of the pattern in a map, see single_step_pattern()
+std::size_t playing_pattern(const bass_station::SequencerStepMap &sequencer_map)
+{
+  bass_station::PackedPattern pattern;
+  bass_station::pack_pattern(sequencer_map, pattern);
+  for (std::size_t id = 0; id < pattern.size(); id++)
+  {
+    if (pattern[id] & bass_station::PackedStep::on_bit)
+    {
+      return id;
+    }
+  }
+  return pattern.size();
+}
+} // namespace
+
+TEST_CASE("SongPlayer chains patterns with a map flip at the bar boundary", "[song_player]")
+{
+
+  PatternSource source;
+  for (std::size_t id = 0; id < 3; id++)
+  {
+    source.m_patterns[id] = single_step_pattern(id);
+    source.m_present[id]  = true;
+    source.m_lengths[id]  = static_cast<uint8_t>(8 * (id + 1));
+  }
+
+  // pattern 0 twice, pattern 1 once, pattern 2 three times, then round again
+  bass_station::Song song;
+  song.m_length     = 3;
+  song.m_entries[0] = {0, 2};
+  song.m_entries[1] = {1, 1};
+  song.m_entries[2] = {2, 3};
+
+  auto first_map                         = bass_station::make_step_map();
+  auto second_map                        = bass_station::make_step_map();
+  bass_station::SequencerStepMap *live   = &first_map;
+  bass_station::SequencerStepMap *shadow = &second_map;
+
+  bass_station::SongPlayer player(&PatternSource::load, &source);
+  REQUIRE(player.start(song, *live));
+  REQUIRE(playing_pattern(*live) == 0);
+
+  const std::array<std::size_t, 13> expected_bars{0, 0, 1, 2, 2, 2, 0, 0, 1, 2, 2, 2, 0};
+  for (std::size_t bar = 1; bar < expected_bars.size(); bar++)
+  {
+    // the main loop has the whole bar to prefetch
+    player.prefetch(*shadow);
+    player.prefetch(*shadow);
+
+    // nothing is loaded at the bar boundary, the next pattern is already decoded
+    const uint32_t loads_before_wrap = source.m_loads;
+    if (player.advance())
+    {
+      std::swap(live, shadow);
+    }
+    REQUIRE(source.m_loads == loads_before_wrap);
+    REQUIRE(playing_pattern(*live) == expected_bars[bar]);
+    // each pattern brings its length with it
+    REQUIRE(player.pattern_length() == 8 * (expected_bars[bar] + 1));
+  }
+  REQUIRE(player.late_prefetches() == 0);
+
+  // only a change of pattern is decoded, once per change
+  REQUIRE(source.m_loads == 1 + 6);
+}
+
+TEST_CASE("SongPlayer keeps playing when the next pattern is not ready", "[song_player]")
+{
+
+  PatternSource source;
+  source.m_patterns[0] = single_step_pattern(0);
+  source.m_present[0]  = true;
+  source.m_patterns[1] = single_step_pattern(1);
+  source.m_present[1]  = true;
+
+  // pattern 3 does not exist
+  bass_station::Song song;
+  song.m_length     = 3;
+  song.m_entries[0] = {0, 1};
+  song.m_entries[1] = {3, 1};
+  song.m_entries[2] = {1, 1};
+
+  auto first_map                         = bass_station::make_step_map();
+  auto second_map                        = bass_station::make_step_map();
+  bass_station::SequencerStepMap *live   = &first_map;
+  bass_station::SequencerStepMap *shadow = &second_map;
+
+  bass_station::SongPlayer player(&PatternSource::load, &source);
+  REQUIRE(player.start(song, *live));
+
+  // a missing pattern keeps the current one, and is not counted as late
+  player.prefetch(*shadow);
+  REQUIRE_FALSE(player.prefetch_pending());
+  REQUIRE_FALSE(player.advance());
+  REQUIRE(playing_pattern(*live) == 0);
+  REQUIRE(player.entry() == 1);
+  REQUIRE(player.late_prefetches() == 0);
+
+  // no prefetch during the bar: the current pattern plays again and the song moves on
+  REQUIRE(player.prefetch_pending());
+  REQUIRE_FALSE(player.advance());
+  REQUIRE(playing_pattern(*live) == 0);
+  REQUIRE(player.entry() == 2);
+  REQUIRE(player.late_prefetches() == 1);
+
+  // back to the first entry
+  player.prefetch(*shadow);
+  if (player.advance())
+  {
+    std::swap(live, shadow);
+  }
+  REQUIRE(playing_pattern(*live) == 0);
+  REQUIRE(player.entry() == 0);
+
+  // an empty song is refused
+  REQUIRE_FALSE(player.start(bass_station::Song{}, *live));
+  REQUIRE_FALSE(player.playing());
+  REQUIRE_FALSE(player.advance());
+}
+
+TEST_CASE("SongPlayer refuses a song outside the pattern bank", "[song_player]")
+{
+  PatternSource source;
+  source.m_patterns[0] = single_step_pattern(0);
+  source.m_present[0]  = true;
+
+  bass_station::Song song;
+  song.m_length     = 2;
+  song.m_entries[0] = {0, 1};
+  song.m_entries[1] = {static_cast<uint8_t>(bass_station::PatternBank::slot_count), 1};
+
+  auto live_map = bass_station::make_step_map();
+  bass_station::SongPlayer player(&PatternSource::load, &source);
+  REQUIRE_FALSE(song.valid());
+  REQUIRE_FALSE(player.start(song, live_map));
+  REQUIRE_FALSE(player.playing());
+  REQUIRE(source.m_loads == 0);
+
+  // the last bank slot is fine, entries past the length are not checked
+  song.m_entries[1] = {static_cast<uint8_t>(bass_station::PatternBank::slot_count - 1), 1};
+  song.m_entries[2] = {255, 1};
+  REQUIRE(song.valid());
+  REQUIRE(player.start(song, live_map));
+
+  song.m_length = 0;
+  REQUIRE_FALSE(song.valid());
+}
@@ -0,0 +1,187 @@
+#include <catch2/catch_all.hpp>
+#include <cstdlib>
+#include <swing_engine.hpp>
+#include <vector>
+
+namespace
+{
+/// @brief Play a pair and get the time (in timer counts from the start of the pair) of each update with an action
+void play_pair(bass_station::SwingEngine &engine, std::vector<uint32_t> &clock_counts, std::vector<uint32_t> &step_counts)
+{
+  uint32_t counts = 0;
+  const uint32_t first_step_counts = engine.step_counts();
+  for (std::size_t update = 0; update < engine.update_count(); update++)
+  {
+    counts += engine.reload() + 1U;
+    const uint8_t actions = engine.tick();
+    if (actions & bass_station::SwingEngine::STEP)
+    {
+      // the length of the step it starts
+      REQUIRE(engine.step_counts() == (step_counts.empty() ? bass_station::SwingEngine::counts_per_pair - counts : first_step_counts));
+    }
+    if (actions & bass_station::SwingEngine::CLOCK)
+    {
+      clock_counts.push_back(counts);
+    }
+    if (actions & bass_station::SwingEngine::STEP)
+    {
+      step_counts.push_back(counts);
+    }
+  }
+}
+} // namespace
+
+TEST_CASE("SwingEngine straight time", "[swing_engine]")
+{
+  bass_station::SwingEngine engine;
+  REQUIRE(engine.swing() == 50);
+  REQUIRE(engine.update_count() == 26);
+
+  // 12 clocks then the step update, every period is ARR 65535 as before
+  for (int step = 0; step < 4; step++)
+  {
+    for (int clock = 0; clock < 12; clock++)
+    {
+      REQUIRE(engine.reload() == 65535);
+      REQUIRE(engine.tick() == bass_station::SwingEngine::CLOCK);
+    }
+    REQUIRE(engine.reload() == 65535);
+    REQUIRE(engine.tick() == bass_station::SwingEngine::STEP);
+  }
+}
+
+TEST_CASE("SwingEngine delays the second step of a pair", "[swing_engine]")
+{
+  bass_station::SwingEngine straight;
+  std::vector<uint32_t> grid_clocks;
+  std::vector<uint32_t> grid_steps;
+  play_pair(straight, grid_clocks, grid_steps);
+  REQUIRE(grid_clocks.size() == 24);
+  REQUIRE(grid_steps == std::vector<uint32_t>{13 * 65536, 26 * 65536});
+
+  for (uint8_t percent = bass_station::SwingEngine::min_percent; percent <= bass_station::SwingEngine::max_percent; percent++)
+  {
+    bass_station::SwingEngine engine;
+    REQUIRE(engine.set_swing(percent));
+    engine.reset();
+    REQUIRE(engine.swing() == percent);
+
+    std::vector<uint32_t> clocks;
+    std::vector<uint32_t> steps;
+    play_pair(engine, clocks, steps);
+
+    // the MIDI clock stays on the grid and the pair keeps its length
+    REQUIRE(clocks == grid_clocks);
+    REQUIRE(steps.size() == 2);
+    REQUIRE(steps[1] == 26 * 65536);
+
+    // the first step lasts percent of the pair, to within the merge distance
+    const int64_t expected = (bass_station::SwingEngine::counts_per_pair * percent) / 100;
+    const int64_t error    = static_cast<int64_t>(steps[0]) - expected;
+    REQUIRE(std::abs(error) < bass_station::SwingEngine::min_update_counts);
+    REQUIRE(engine.step_counts() == steps[0]);
+
+    // no period is too short for the ISR to write ARR in time
+    for (std::size_t update = 0; update < engine.update_count(); update++)
+    {
+      REQUIRE(engine.update(update).m_arr + 1U >= bass_station::SwingEngine::min_update_counts);
+    }
+  }
+}
+
+TEST_CASE("SwingEngine changes swing at the start of a pair", "[swing_engine]")
+{
+  bass_station::SwingEngine engine;
+  REQUIRE_FALSE(engine.set_swing(49));
+  REQUIRE_FALSE(engine.set_swing(76));
+  REQUIRE(engine.swing() == 50);
+
+  // half way through a straight pair
+  for (int update = 0; update < 20; update++)
+  {
+    engine.tick();
+  }
+  REQUIRE(engine.set_swing(75));
+  REQUIRE(engine.update_count() == 26);
+  for (int update = 20; update < 26; update++)
+  {
+    engine.tick();
+  }
+  REQUIRE(engine.update_count() == 27);
+
+  // a second change before the first is taken replaces it
+  REQUIRE(engine.set_swing(60));
+  REQUIRE(engine.set_swing(50));
+  for (int update = 0; update < 27; update++)
+  {
+    engine.tick();
+  }
+  REQUIRE(engine.update_count() == 26);
+}
+
+TEST_CASE("SwingEngine changes the prescaler at a step update", "[swing_engine]")
+{
+  const uint8_t swing_percent = GENERATE(50, 66, 75);
+  CAPTURE(swing_percent);
+  bass_station::SwingEngine engine;
+  REQUIRE(engine.set_swing(swing_percent));
+  engine.reset();
+  const uint32_t first_step_counts = engine.step_counts();
+
+  // the timer: ARR preload is off, PSC is preloaded and taken at each update
+  uint32_t arr       = engine.reload();
+  uint32_t psc       = 11;
+  uint32_t psc_ahead = psc;
+  uint64_t clocks    = 0;
+  std::vector<uint64_t> step_clocks;
+  for (std::size_t update = 0; update < engine.update_count() * 2; update++)
+  {
+    clocks += static_cast<uint64_t>(arr + 1U) * (psc + 1U);
+    psc                   = psc_ahead;
+    const uint8_t actions = engine.tick();
+    arr                   = engine.reload();
+    if (actions & bass_station::SwingEngine::STEP)
+    {
+      step_clocks.push_back(clocks);
+    }
+
+    // tapped in the first step, five MIDI clocks in
+    if (update == 4)
+    {
+      engine.set_prescaler(17);
+      REQUIRE(engine.prescaler_pending());
+    }
+    uint16_t prescaler;
+    if (engine.take_prescaler(prescaler))
+    {
+      REQUIRE(step_clocks.empty());
+      psc_ahead = prescaler;
+    }
+  }
+  REQUIRE_FALSE(engine.prescaler_pending());
+
+  // the first step ends on time, the second is played at the new tempo
+  REQUIRE(step_clocks.size() == 4);
+  REQUIRE(step_clocks[0] == static_cast<uint64_t>(first_step_counts) * 12U);
+  REQUIRE(step_clocks[1] - step_clocks[0] == static_cast<uint64_t>(bass_station::SwingEngine::counts_per_pair - first_step_counts) * 18U);
+  REQUIRE(step_clocks[3] - step_clocks[1] == static_cast<uint64_t>(bass_station::SwingEngine::counts_per_pair) * 18U);
+
+  SECTION("with the timer stopped the prescaler is taken straight away")
+  {
+    engine.set_prescaler(30);
+    uint16_t prescaler;
+    REQUIRE(engine.flush_prescaler(prescaler));
+    REQUIRE(prescaler == 30);
+    REQUIRE_FALSE(engine.flush_prescaler(prescaler));
+  }
+}
+
+TEST_CASE("SwingEngine prescaler for a beat", "[swing_engine]")
+{
+  // a beat is a pair of steps: 1703936 timer counts of (PSC + 1) / 64MHz
+  REQUIRE(bass_station::SwingEngine::prescaler(500000) == 18);
+  REQUIRE(bass_station::SwingEngine::prescaler(333333) == 12);
+  REQUIRE(bass_station::SwingEngine::prescaler(319488) == 11);
+  REQUIRE(bass_station::SwingEngine::prescaler(1000) == 0);
+  REQUIRE(bass_station::SwingEngine::prescaler(0xFFFFFFFF) == 0xFFFF);
+}
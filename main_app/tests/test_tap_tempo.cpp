@@ -0,0 +1,107 @@
+#include <catch2/catch_all.hpp>
+#include <tap_tempo.hpp>
+#include <trig_engine.hpp>
+
+namespace
+{
+
+constexpr uint32_t beat_120_bpm_us = 500000;
+constexpr uint32_t beat_90_bpm_us  = 666667;
+
+/// @brief Deterministic tap jitter of up to +/- range_us, so a failure reproduces
+int32_t jitter(uint32_t &seed, uint32_t range_us)
+{
+  return static_cast<int32_t>(bass_station::TrigEngine::xorshift32(seed) % (2 * range_us + 1)) - static_cast<int32_t>(range_us);
+}
+
+/// @brief Tap a number of beats on time
+void tap_beats(bass_station::TapTempo &tap_tempo, uint32_t &time_us, uint32_t beat_us, int count)
+{
+  for (int beat = 0; beat < count; beat++)
+  {
+    time_us += beat_us;
+    tap_tempo.tap(time_us);
+  }
+}
+
+bool near(uint32_t value, uint32_t expected, uint32_t margin) { return (value + margin >= expected) && (value <= expected + margin); }
+
+} // namespace
+
+TEST_CASE("TapTempo estimates the beat from the median interval", "[tap_tempo]")
+{
+  bass_station::TapTempo tap_tempo;
+  uint32_t time_us{1000000};
+  REQUIRE_FALSE(tap_tempo.tap(time_us));
+  time_us += beat_120_bpm_us;
+  REQUIRE_FALSE(tap_tempo.tap(time_us));
+  REQUIRE(tap_tempo.beat_us() == 0);
+
+  // an estimate from the third tap on
+  time_us += beat_120_bpm_us + 10000;
+  REQUIRE(tap_tempo.tap(time_us));
+  REQUIRE(tap_tempo.beat_us() == beat_120_bpm_us + 5000);
+
+  // the taps of a player are a little early or late
+  uint32_t seed{0x2545F491};
+  for (int beat = 0; beat < 40; beat++)
+  {
+    time_us += static_cast<uint32_t>(static_cast<int32_t>(beat_120_bpm_us) + jitter(seed, 15000));
+    REQUIRE(tap_tempo.tap(time_us));
+    REQUIRE(near(tap_tempo.beat_us(), beat_120_bpm_us, 15000));
+  }
+  REQUIRE(tap_tempo.interval_count() == bass_station::TapTempo::window);
+  REQUIRE(near(tap_tempo.bpm_x10(), 1200, 40));
+}
+
+TEST_CASE("TapTempo leaves out bounces and outliers", "[tap_tempo]")
+{
+  bass_station::TapTempo tap_tempo;
+  uint32_t time_us{0};
+  tap_tempo.tap(time_us);
+  tap_beats(tap_tempo, time_us, beat_120_bpm_us, 5);
+  REQUIRE(tap_tempo.beat_us() == beat_120_bpm_us);
+
+  SECTION("a bounce is ignored")
+  {
+    REQUIRE_FALSE(tap_tempo.tap(time_us + 20000));
+    tap_beats(tap_tempo, time_us, beat_120_bpm_us, 1);
+    REQUIRE(tap_tempo.beat_us() == beat_120_bpm_us);
+  }
+
+  SECTION("a missed beat is an outlier")
+  {
+    time_us += 2 * beat_120_bpm_us;
+    REQUIRE_FALSE(tap_tempo.tap(time_us));
+    tap_beats(tap_tempo, time_us, beat_120_bpm_us, 1);
+    REQUIRE(tap_tempo.beat_us() == beat_120_bpm_us);
+  }
+
+  SECTION("an extra tap between beats is two outliers")
+  {
+    REQUIRE_FALSE(tap_tempo.tap(time_us + 200000));
+    tap_beats(tap_tempo, time_us, beat_120_bpm_us, 3);
+    REQUIRE(tap_tempo.beat_us() == beat_120_bpm_us);
+  }
+
+  SECTION("a new tempo takes over after a few taps")
+  {
+    tap_beats(tap_tempo, time_us, beat_90_bpm_us, bass_station::TapTempo::max_outliers - 1);
+    REQUIRE(tap_tempo.beat_us() == beat_120_bpm_us);
+    time_us += beat_90_bpm_us;
+    REQUIRE(tap_tempo.tap(time_us));
+    REQUIRE(tap_tempo.beat_us() == beat_90_bpm_us);
+    REQUIRE(tap_tempo.interval_count() == 2);
+  }
+
+  SECTION("a long pause starts a new run of taps")
+  {
+    time_us += bass_station::TapTempo::max_interval_us + 1;
+    REQUIRE_FALSE(tap_tempo.tap(time_us));
+    REQUIRE(tap_tempo.interval_count() == 0);
+    // the last estimate is kept until the new run makes one
+    REQUIRE(tap_tempo.beat_us() == beat_120_bpm_us);
+    tap_beats(tap_tempo, time_us, beat_90_bpm_us, 2);
+    REQUIRE(tap_tempo.beat_us() == beat_90_bpm_us);
+  }
+}
@@ -0,0 +1,96 @@
+#include <catch2/catch_all.hpp>
+#include <track_engine.hpp>
+
+TEST_CASE("TrackEngine synth track", "[track_engine]")
+{
+  bass_station::TrackEngine engine;
+  REQUIRE(engine.enabled(0));
+  REQUIRE(engine.length(0) == 32);
+
+  // steps on every tick and wraps after its length
+  for (uint8_t step = 1; step < 32; step++)
+  {
+    const bass_station::TrackEngine::Tick tick = engine.tick();
+    REQUIRE(tick.m_stepped == 0b0001);
+    REQUIRE(tick.m_wrapped == 0);
+    REQUIRE(engine.position(0) == step);
+  }
+  REQUIRE(engine.tick().m_wrapped == 0b0001);
+  REQUIRE(engine.position(0) == 0);
+  REQUIRE(engine.ticks() == 32);
+
+  // a one step pattern wraps on every tick
+  REQUIRE(engine.set_length(0, 1));
+  for (int count = 0; count < 4; count++)
+  {
+    REQUIRE(engine.tick().m_wrapped == 0b0001);
+    REQUIRE(engine.position(0) == 0);
+  }
+
+  // the longest pattern has a step for each of the 32 keys
+  REQUIRE(engine.set_length(0, bass_station::TrackEngine::max_length));
+  engine.reset();
+  REQUIRE(engine.ticks() == 0);
+  for (int count = 0; count < 31; count++)
+  {
+    engine.tick();
+  }
+  REQUIRE(engine.position(0) == 31);
+  REQUIRE(engine.tick().m_wrapped == 0b0001);
+}
+
+TEST_CASE("TrackEngine dividers and polymeters", "[track_engine]")
+{
+  bass_station::TrackEngine engine;
+  REQUIRE(engine.set_length(1, 24));
+  REQUIRE(engine.set_length(2, 16));
+  REQUIRE(engine.set_divider(2, 2));
+  REQUIRE(engine.set_length(3, 12));
+  REQUIRE(engine.set_divider(3, 4));
+  // disabled tracks do not move
+  engine.tick();
+  REQUIRE(engine.position(1) == 0);
+  for (std::size_t track = 1; track < bass_station::TrackEngine::track_count; track++)
+  {
+    engine.set_enabled(track, true);
+  }
+  engine.reset();
+
+  // 32 against 24 against 16 eighths against 12 quarters only line up again every 96 ticks
+  uint32_t synth_wraps{0};
+  for (uint32_t tick_count = 1; tick_count <= 96; tick_count++)
+  {
+    const bass_station::TrackEngine::Tick tick = engine.tick();
+    REQUIRE(((tick.m_stepped >> 2) & 1U) == ((tick_count % 2) == 0));
+    REQUIRE(((tick.m_stepped >> 3) & 1U) == ((tick_count % 4) == 0));
+    REQUIRE(((tick.m_wrapped >> 1) & 1U) == ((tick_count % 24) == 0));
+    REQUIRE(((tick.m_wrapped >> 2) & 1U) == ((tick_count % 32) == 0));
+    REQUIRE(((tick.m_wrapped >> 3) & 1U) == ((tick_count % 48) == 0));
+    synth_wraps += tick.m_wrapped & 1U;
+    if (tick_count < 96)
+    {
+      REQUIRE(tick.m_wrapped != 0b1111);
+    }
+    else
+    {
+      REQUIRE(tick.m_wrapped == 0b1111);
+    }
+  }
+  REQUIRE(synth_wraps == 3);
+  for (std::size_t track = 0; track < bass_station::TrackEngine::track_count; track++)
+  {
+    REQUIRE(engine.position(track) == 0);
+  }
+}
+
+TEST_CASE("TrackEngine rejects bad settings", "[track_engine]")
+{
+  bass_station::TrackEngine engine;
+  REQUIRE_FALSE(engine.set_length(0, 0));
+  REQUIRE_FALSE(engine.set_length(0, bass_station::TrackEngine::max_length + 1));
+  REQUIRE_FALSE(engine.set_length(bass_station::TrackEngine::track_count, 16));
+  REQUIRE_FALSE(engine.set_divider(1, 0));
+  REQUIRE_FALSE(engine.set_divider(1, bass_station::TrackEngine::max_divider + 1));
+  REQUIRE(engine.length(0) == 32);
+  REQUIRE(engine.divider(1) == 1);
+}
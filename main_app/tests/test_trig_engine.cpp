@@ -0,0 +1,181 @@
+#include <catch2/catch_all.hpp>
+#include <trig_engine.hpp>
+#include <vector>
+
+namespace
+{
+bass_station::Step make_step(uint8_t probability, bass_station::TrigCondition condition)
+{
+  bass_station::Step step(bass_station::StepState::ON, bass_station::Note::c1, bass_station::default_colour, 0);
+  step.m_probability = probability;
+  step.m_condition   = condition;
+  return step;
+}
+
+/// @brief Play loops of one step and get the loops it played on
+std::vector<uint32_t> played_loops(bass_station::TrigEngine &engine, const bass_station::Step &step, uint32_t loops)
+{
+  std::vector<uint32_t> played;
+  for (uint32_t loop = 0; loop < loops; loop++)
+  {
+    if (loop != 0)
+    {
+      engine.loop_started();
+    }
+    if (engine.fire(step))
+    {
+      played.push_back(engine.loop());
+    }
+  }
+  return played;
+}
+} // namespace
+
+TEST_CASE("TrigEngine probability", "[trig_engine]")
+{
+  bass_station::TrigEngine engine;
+  const uint8_t probability = GENERATE(range(0, static_cast<int>(bass_station::probability_levels)));
+  const bass_station::Step step = make_step(probability, bass_station::TrigCondition::ALWAYS);
+
+  uint32_t played{0};
+  const uint32_t draws{20000};
+  for (uint32_t draw = 0; draw < draws; draw++)
+  {
+    played += engine.fire(step) ? 1U : 0U;
+  }
+  const uint32_t expected = (draws * bass_station::TrigEngine::thresholds[probability]) >> 16;
+  REQUIRE(played + (draws / 50) >= expected);
+  REQUIRE(played <= expected + (draws / 50));
+  if (probability == 0)
+  {
+    REQUIRE(played == draws);
+  }
+
+  // an OFF step never plays
+  bass_station::Step off_step = step;
+  off_step.m_state            = bass_station::StepState::OFF;
+  for (uint32_t draw = 0; draw < 100; draw++)
+  {
+    REQUIRE_FALSE(engine.fire(off_step));
+  }
+}
+
+TEST_CASE("TrigEngine probability percentages", "[trig_engine]")
+{
+  REQUIRE(bass_station::TrigEngine::probability_percent(0) == 100);
+  REQUIRE(bass_station::TrigEngine::probability_percent(4) == 50);
+  REQUIRE(bass_station::TrigEngine::probability_percent(7) == 13);
+}
+
+TEST_CASE("TrigEngine draws are deterministic", "[trig_engine]")
+{
+  const bass_station::Step step = make_step(4, bass_station::TrigCondition::ALWAYS);
+  bass_station::TrigEngine engine;
+  std::vector<bool> first_run;
+  for (int draw = 0; draw < 64; draw++)
+  {
+    first_run.push_back(engine.fire(step));
+  }
+
+  // starting again from the seed makes the same decisions
+  engine.reset();
+  for (int draw = 0; draw < 64; draw++)
+  {
+    REQUIRE(engine.fire(step) == first_run[static_cast<std::size_t>(draw)]);
+  }
+
+  // and a draw is taken for every step, so a skipped step doesn't change the later decisions
+  engine.reset();
+  const bass_station::Step fill_step = make_step(0, bass_station::TrigCondition::FILL);
+  REQUIRE_FALSE(engine.fire(fill_step));
+  for (int draw = 1; draw < 64; draw++)
+  {
+    REQUIRE(engine.fire(step) == first_run[static_cast<std::size_t>(draw)]);
+  }
+
+  // another seed makes other decisions
+  engine.set_seed(1234);
+  engine.reset();
+  std::vector<bool> seeded_run;
+  for (int draw = 0; draw < 64; draw++)
+  {
+    seeded_run.push_back(engine.fire(step));
+  }
+  REQUIRE(seeded_run != first_run);
+}
+
+TEST_CASE("TrigEngine conditions", "[trig_engine]")
+{
+  bass_station::TrigEngine engine;
+
+  SECTION("every Nth loop")
+  {
+    REQUIRE(played_loops(engine, make_step(0, bass_station::TrigCondition::LOOP_1_OF_2), 6) == std::vector<uint32_t>{0, 2, 4});
+    engine.reset();
+    REQUIRE(played_loops(engine, make_step(0, bass_station::TrigCondition::LOOP_2_OF_3), 7) == std::vector<uint32_t>{1, 4});
+    engine.reset();
+    REQUIRE(played_loops(engine, make_step(0, bass_station::TrigCondition::LOOP_4_OF_4), 9) == std::vector<uint32_t>{3, 7});
+  }
+
+  SECTION("first loop")
+  {
+    REQUIRE(played_loops(engine, make_step(0, bass_station::TrigCondition::FIRST), 4) == std::vector<uint32_t>{0});
+    engine.reset();
+    REQUIRE(played_loops(engine, make_step(0, bass_station::TrigCondition::NOT_FIRST), 4) == std::vector<uint32_t>{1, 2, 3});
+  }
+
+  SECTION("fill")
+  {
+    const bass_station::Step fill_step     = make_step(0, bass_station::TrigCondition::FILL);
+    const bass_station::Step not_fill_step = make_step(0, bass_station::TrigCondition::NOT_FILL);
+    REQUIRE_FALSE(engine.fire(fill_step));
+    REQUIRE(engine.fire(not_fill_step));
+    engine.set_fill(true);
+    REQUIRE(engine.fire(fill_step));
+    REQUIRE_FALSE(engine.fire(not_fill_step));
+    // fill is held over a restart
+    engine.reset();
+    REQUIRE(engine.fill());
+    REQUIRE(engine.fire(fill_step));
+  }
+
+  SECTION("condition and probability")
+  {
+    uint32_t played{0};
+    const bass_station::Step step = make_step(4, bass_station::TrigCondition::LOOP_1_OF_2);
+    for (uint32_t loop = 0; loop < 2000; loop++)
+    {
+      if (loop != 0)
+      {
+        engine.loop_started();
+      }
+      if (engine.fire(step))
+      {
+        REQUIRE((engine.loop() % 2) == 0);
+        played++;
+      }
+    }
+    REQUIRE(played > 400);
+    REQUIRE(played < 600);
+  }
+}
+
+TEST_CASE("TrigEngine cycle", "[trig_engine]")
+{
+  bass_station::Step step = make_step(0, bass_station::TrigCondition::ALWAYS);
+  for (uint8_t probability = 1; probability < bass_station::probability_levels; probability++)
+  {
+    bass_station::TrigEngine::cycle(step);
+    REQUIRE(step.m_probability == probability);
+    REQUIRE(step.m_condition == bass_station::TrigCondition::ALWAYS);
+  }
+  for (uint8_t condition = 1; condition < static_cast<uint8_t>(bass_station::TrigCondition::count); condition++)
+  {
+    bass_station::TrigEngine::cycle(step);
+    REQUIRE(step.m_probability == 0);
+    REQUIRE(step.m_condition == static_cast<bass_station::TrigCondition>(condition));
+  }
+  bass_station::TrigEngine::cycle(step);
+  REQUIRE(step.m_probability == 0);
+  REQUIRE(step.m_condition == bass_station::TrigCondition::ALWAYS);
+}
@@ -0,0 +1,329 @@
+#include <catch2/catch_all.hpp>
+#include <input_replayer.hpp>
+#include <pattern_fixtures.hpp>
+#include <trig_engine.hpp>
+#include <undo_journal.hpp>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+bass_station::PackedPattern packed(const bass_station::SequencerStepMap &sequencer_map)
+{
+  bass_station::PackedPattern pattern;
+  bass_station::pack_pattern(sequencer_map, pattern);
+  return pattern;
+}
+
+/// @brief Switch a step on or off, as a key press does
+void toggle(bass_station::SequencerStepMap &sequencer_map, bass_station::UndoJournal &journal, std::size_t index)
+{
+  bass_station::Step &step        = sequencer_map.data[index].second;
+  const bass_station::Step before = step;
+  step.m_state                    = (step.m_state == bass_station::StepState::ON) ? bass_station::StepState::OFF : bass_station::StepState::ON;
+  journal.record_step(before, step);
+}
+
+/// @brief Give every step a new state and note, as SequenceManager::randomise_pattern() does
+void randomise(bass_station::SequencerStepMap &sequencer_map, bass_station::UndoJournal &journal, uint32_t seed)
+{
+  journal.record_pattern(sequencer_map);
+  for (std::size_t index = 0; index < sequencer_map.data.size(); index++)
+  {
+    bass_station::Step &step = sequencer_map.data[index].second;
+    step.m_state             = ((seed + index) % 2 == 0) ? bass_station::StepState::ON : bass_station::StepState::OFF;
+    step.m_note              = static_cast<bass_station::Note>((seed * 7 + index) % bass_station::Note::none);
+  }
+}
+} // namespace
+
+TEST_CASE("UndoJournal undoes and redoes step edits", "[undo_journal]")
+{
+  auto step_map = bass_station::make_step_map();
+  bass_station::UndoJournal journal;
+  REQUIRE_FALSE(journal.can_undo());
+  REQUIRE_FALSE(journal.undo(step_map));
+  REQUIRE_FALSE(journal.redo(step_map));
+
+  const bass_station::PackedPattern original = packed(step_map);
+  toggle(step_map, journal, 3);
+  toggle(step_map, journal, 17);
+  const bass_station::PackedPattern edited = packed(step_map);
+  REQUIRE(journal.size() == 2);
+
+  REQUIRE(journal.undo(step_map));
+  REQUIRE(step_map.data[17].second.m_state == bass_station::StepState::OFF);
+  REQUIRE(step_map.data[3].second.m_state == bass_station::StepState::ON);
+  REQUIRE(journal.undo(step_map));
+  REQUIRE(packed(step_map) == original);
+  REQUIRE_FALSE(journal.undo(step_map));
+
+  REQUIRE(journal.redo(step_map));
+  REQUIRE(journal.redo(step_map));
+  REQUIRE(packed(step_map) == edited);
+  REQUIRE_FALSE(journal.redo(step_map));
+
+  SECTION("a new edit drops the undone ones")
+  {
+    REQUIRE(journal.undo(step_map));
+    toggle(step_map, journal, 30);
+    REQUIRE_FALSE(journal.can_redo());
+    REQUIRE(journal.size() == 2);
+    REQUIRE(journal.undo(step_map));
+    REQUIRE(journal.undo(step_map));
+    REQUIRE(packed(step_map) == original);
+  }
+
+  SECTION("an edit that changes nothing isn't journaled")
+  {
+    const bass_station::Step step = step_map.data[5].second;
+    journal.record_step(step, step);
+    REQUIRE(journal.size() == 2);
+  }
+
+  SECTION("clear forgets the edits")
+  {
+    journal.clear();
+    REQUIRE_FALSE(journal.undo(step_map));
+    REQUIRE(packed(step_map) == edited);
+  }
+}
+
+TEST_CASE("UndoJournal undoes an edit of several fields in one step", "[undo_journal]")
+{
+  auto step_map = bass_station::make_step_map();
+  bass_station::UndoJournal journal;
+  bass_station::Step &step = step_map.data[9].second;
+
+  // from the last probability level on, a cycle changes the probability and the condition together
+  for (int cycle = 0; cycle < bass_station::probability_levels - 1; cycle++)
+  {
+    bass_station::TrigEngine::cycle(step);
+  }
+  journal.clear();
+  const bass_station::PackedPattern before_cycle = packed(step_map);
+  const bass_station::Step before                = step;
+  bass_station::TrigEngine::cycle(step);
+  journal.record_step(before, step);
+  REQUIRE(step.m_probability != before.m_probability);
+  REQUIRE(step.m_condition != before.m_condition);
+  const bass_station::PackedPattern after_cycle = packed(step_map);
+  REQUIRE(journal.size() == 2);
+
+  REQUIRE(journal.undo(step_map));
+  REQUIRE(packed(step_map) == before_cycle);
+  REQUIRE_FALSE(journal.can_undo());
+  REQUIRE(journal.redo(step_map));
+  REQUIRE(packed(step_map) == after_cycle);
+}
+
+TEST_CASE("UndoJournal merges the note changes of an encoder turn", "[undo_journal]")
+{
+  auto step_map = bass_station::make_step_map();
+  bass_station::UndoJournal journal;
+  bass_station::Step &step = step_map.data[4].second;
+
+  for (int detent = 0; detent < 12; detent++)
+  {
+    const bass_station::Step before = step;
+    step.m_note                     = static_cast<bass_station::Note>(step.m_note + 1);
+    journal.record_step(before, step, true);
+  }
+  REQUIRE(journal.size() == 1);
+  REQUIRE(journal.undo(step_map));
+  REQUIRE(step.m_note == bass_station::Note::c0);
+  REQUIRE(journal.redo(step_map));
+  REQUIRE(step.m_note == bass_station::Note::c1);
+
+  SECTION("turning back to the first note drops the edit")
+  {
+    for (int detent = 0; detent < 12; detent++)
+    {
+      const bass_station::Step before = step;
+      step.m_note                     = static_cast<bass_station::Note>(step.m_note - 1);
+      journal.record_step(before, step, true);
+    }
+    REQUIRE(journal.size() == 0);
+  }
+
+  SECTION("another step starts a new edit")
+  {
+    bass_station::Step &other       = step_map.data[5].second;
+    const bass_station::Step before = other;
+    other.m_note                    = bass_station::Note::c2;
+    journal.record_step(before, other, true);
+    REQUIRE(journal.size() == 2);
+  }
+}
+
+TEST_CASE("UndoJournal drops the oldest edits whole when the ring is full", "[undo_journal]")
+{
+  auto step_map = bass_station::make_step_map();
+  bass_station::UndoJournal journal;
+
+  // edits of two deltas each: a note is recorded on a step that was off
+  std::vector<bass_station::PackedPattern> history{packed(step_map)};
+  for (std::size_t edit = 0; edit < bass_station::UndoJournal::delta_count; edit++)
+  {
+    bass_station::Step &step        = step_map.data[edit % 32].second;
+    const bass_station::Step before = step;
+    step.m_state                    = (step.m_state == bass_station::StepState::ON) ? bass_station::StepState::OFF : bass_station::StepState::ON;
+    step.m_note                     = static_cast<bass_station::Note>((step.m_note + 5) % bass_station::Note::none);
+    journal.record_step(before, step);
+    history.push_back(packed(step_map));
+    REQUIRE(journal.size() <= bass_station::UndoJournal::delta_count);
+  }
+
+  // each undo goes back one whole edit, as far as the ring reaches
+  std::size_t undo_count{0};
+  while (journal.undo(step_map))
+  {
+    undo_count++;
+    REQUIRE(packed(step_map) == history[history.size() - 1 - undo_count]);
+  }
+  REQUIRE(undo_count == bass_station::UndoJournal::delta_count / 2);
+  while (journal.redo(step_map))
+  {
+  }
+  REQUIRE(packed(step_map) == history.back());
+}
+
+TEST_CASE("UndoJournal takes a bounded size for a randomise", "[undo_journal]")
+{
+  static_assert(bass_station::UndoJournal::ring_bytes <= 512, "the journal fits in half a kilobyte of RAM");
+  auto step_map = bass_station::make_step_map();
+  bass_station::UndoJournal journal;
+
+  const bass_station::PackedPattern original = packed(step_map);
+  toggle(step_map, journal, 0);
+  const bass_station::PackedPattern toggled = packed(step_map);
+  randomise(step_map, journal, 1);
+  const bass_station::PackedPattern first = packed(step_map);
+  REQUIRE(first != toggled);
+  // one delta, the pattern is kept in a snapshot
+  REQUIRE(journal.size() == 2);
+
+  REQUIRE(journal.undo(step_map));
+  REQUIRE(packed(step_map) == toggled);
+  REQUIRE(journal.redo(step_map));
+  REQUIRE(packed(step_map) == first);
+
+  randomise(step_map, journal, 2);
+  const bass_station::PackedPattern second = packed(step_map);
+  toggle(step_map, journal, 1);
+  REQUIRE(journal.undo(step_map));
+  REQUIRE(journal.undo(step_map));
+  REQUIRE(packed(step_map) == first);
+  REQUIRE(journal.undo(step_map));
+  REQUIRE(journal.undo(step_map));
+  REQUIRE(packed(step_map) == original);
+  REQUIRE(journal.redo(step_map));
+  REQUIRE(journal.redo(step_map));
+  REQUIRE(journal.redo(step_map));
+  REQUIRE(packed(step_map) == second);
+
+  SECTION("a third randomise reuses the oldest snapshot and drops the edits back to it")
+  {
+    REQUIRE(journal.redo(step_map));
+    randomise(step_map, journal, 3);
+    const bass_station::PackedPattern third = packed(step_map);
+    std::size_t undo_count{0};
+    while (journal.undo(step_map))
+    {
+      undo_count++;
+    }
+    // the second randomise, the toggle after it and the third randomise are left
+    REQUIRE(undo_count == 3);
+    REQUIRE(packed(step_map) == first);
+    while (journal.redo(step_map))
+    {
+    }
+    REQUIRE(packed(step_map) == third);
+  }
+
+  SECTION("undone randomises free their snapshots")
+  {
+    REQUIRE(journal.undo(step_map));
+    REQUIRE(packed(step_map) == first);
+    randomise(step_map, journal, 4);
+    randomise(step_map, journal, 5);
+    std::size_t undo_count{0};
+    while (journal.undo(step_map))
+    {
+      undo_count++;
+    }
+    // the second of these two takes the snapshot of the undone randomise, so the first of them is kept
+    REQUIRE(undo_count == 2);
+    REQUIRE(packed(step_map) == first);
+  }
+}
+
+TEST_CASE("The encoder undoes and redoes the pattern edits in UNDO mode", "[undo_journal]")
+{
+  using KeyMapping = adp5587::Driver<STM32G0_ISR>::GPIKeyMappings;
+  const auto user_button_1 = static_cast<bass_station::SequencerKeyEventIndex>(KeyMapping::C4 | KeyMapping::ON);
+  const auto user_button_2 = static_cast<bass_station::SequencerKeyEventIndex>(KeyMapping::C5 | KeyMapping::ON);
+
+  bass_station::SimulatedSequencer simulation;
+  bass_station::SequenceManager &sequencer = simulation.sequencer();
+  const auto press = [&](bass_station::SequencerKeyEventIndex key_event) {
+    simulation.m_debounce_timer.CNT = simulation.m_debounce_timer.CNT + 400;
+    REQUIRE(sequencer.simulate_key_event(key_event));
+    sequencer.run_main_loop_iteration();
+  };
+  const auto press_encoder_switch = [&]() {
+    simulation.m_debounce_timer.CNT = simulation.m_debounce_timer.CNT + 400;
+    sequencer.simulate_encoder_switch_interrupt();
+    bass_station::DeferredWork::run_pending();
+    sequencer.run_main_loop_iteration();
+  };
+  const auto turn_encoder = [&](bool down) {
+    simulation.m_encoder_timer.CR1 = down ? TIM_CR1_DIR : 0U;
+    simulation.m_encoder_timer.CNT = down ? simulation.m_encoder_timer.CNT - 1 : simulation.m_encoder_timer.CNT + 1;
+    sequencer.run_main_loop_iteration();
+  };
+
+  sequencer.run_main_loop_iteration();
+  const bass_station::PackedPattern original = packed(sequencer.active_step_map());
+  // two ratchet edits of the selected step
+  press(user_button_2);
+  press(user_button_2);
+  const bass_station::PackedPattern edited = packed(sequencer.active_step_map());
+  REQUIRE(edited != original);
+
+  // TEMPO_ADJUST, NOTE_SELECT, RECORD, UNDO
+  press_encoder_switch();
+  press_encoder_switch();
+  press_encoder_switch();
+  REQUIRE(packed(sequencer.active_step_map()) == edited);
+
+  // one edit for each turn seen, and nothing before the first
+  turn_encoder(false);
+  turn_encoder(false);
+  REQUIRE(packed(sequencer.active_step_map()) == original);
+  turn_encoder(false);
+  REQUIRE(packed(sequencer.active_step_map()) == original);
+  turn_encoder(true);
+  turn_encoder(true);
+  REQUIRE(packed(sequencer.active_step_map()) == edited);
+
+  // user button 1 randomises the pattern, and it is undone as one edit
+  press(user_button_1);
+  REQUIRE(packed(sequencer.active_step_map()) != edited);
+  turn_encoder(false);
+  REQUIRE(packed(sequencer.active_step_map()) == edited);
+
+  SECTION("user button 1 cycles the trig again out of UNDO mode")
+  {
+    // through PITCH, the encoder sets the tempo again from where it was left
+    press_encoder_switch();
+    press_encoder_switch();
+    REQUIRE(simulation.m_encoder_timer.CNT == 16);
+    press(user_button_1);
+    const bass_station::PackedPattern cycled = packed(sequencer.active_step_map());
+    REQUIRE(cycled != edited);
+    turn_encoder(false);
+    REQUIRE(packed(sequencer.active_step_map()) == cycled);
+  }
+}
@@ -23,6 +23,7 @@
 #include "stm32g0xx_it.h"
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include <mainapp.hpp>
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -47,6 +48,8 @@
 
 /* Private function prototypes -----------------------------------------------*/
 /* USER CODE BEGIN PFP */
+/* naked, so the stacked exception frame can be located before any prologue touches the stack */
+void HardFault_Handler(void) __attribute__((naked));
 
 /* USER CODE END PFP */
 
@@ -85,7 +88,22 @@ void NMI_Handler(void)
 void HardFault_Handler(void)
 {
   /* USER CODE BEGIN HardFault_IRQn 0 */
-
+  /* EXC_RETURN bit 2 says which stack the frame was pushed to, pass it to flight_recorder_hard_fault() */
+  __asm volatile(
+    "movs r0, #4                        \n"
+    "mov  r1, lr                        \n"
+    "tst  r0, r1                        \n"
+    "beq  1f                            \n"
+    "mrs  r0, psp                       \n"
+    "b    2f                            \n"
+    "1:                                 \n"
+    "mrs  r0, msp                       \n"
+    "2:                                 \n"
+    "ldr  r1, =flight_recorder_hard_fault \n"
+    "bx   r1                            \n"
+    ".ltorg                             \n");
+  /* flight_recorder_hard_fault() never returns, so the Cube spin loop below is dropped and no C code runs in the naked handler */
+  __builtin_unreachable();
   /* USER CODE END HardFault_IRQn 0 */
   while (1)
   {
@@ -113,6 +131,7 @@ void SVC_Handler(void)
 void PendSV_Handler(void)
 {
   /* USER CODE BEGIN PendSV_IRQn 0 */
+  deferred_work_pendsv_handler();
 
   /* USER CODE END PendSV_IRQn 0 */
   /* USER CODE BEGIN PendSV_IRQn 1 */
@@ -0,0 +1,41 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// libFuzzer target for the keypad and encoder input path, see tests/input_fuzzer.hpp for how the bytes are decoded:
+//
+//   fuzz_input_path [corpus dir] [-max_total_time=<seconds>]
+//
+// libFuzzer reports the throughput (exec/s) as it runs. A crash, sanitizer error or broken invariant stops it and
+// writes the input to crash-<hash>, which can be run again with "fuzz_input_path crash-<hash>".
+
+#include <cstdlib>
+#include <input_fuzzer.hpp>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, std::size_t size)
+{
+  if (!bass_station::fuzz_input_path(data, size))
+  {
+    // let libFuzzer save the input
+    std::abort();
+  }
+  return 0;
+}
@@ -0,0 +1,183 @@
+#!/usr/bin/env python3
+
+# MIT License
+
+# Copyright (c) 2022 Chris Sutton
+
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+"""Report the .data (RAM, with its startup copy in flash), .bss, .noinit (RAM, not zeroed at startup) and .rodata bytes
+of each object file in a GNU ld map, and the sizes in its .size_table.
+
+usage: map_report.py build.map [--baseline build.map.baseline]
+
+With a baseline map (e.g. a copy of build.map from before a change) each object file is shown before and after.
+
+The .size_table output section (INFO, it takes no memory) holds one array per object the map has no symbol for, e.g.
+the members of SequenceManager, its input section is named .size_table.<name> and its size is the object's size.
+"""
+
+import argparse
+import os
+import re
+import sys
+
+# output sections that are counted, input sections are grouped under the output section they were placed in
+SECTIONS = (".data", ".bss", ".noinit", ".rodata")
+
+# the output section of the sizes of the objects that are not in the map, see sequence_manager.cpp
+SIZE_TABLE = ".size_table"
+
+# the output sections in RAM
+RAM_SECTIONS = (".data", ".bss", ".noinit")
+
+# an input section line: " .data.name  0x20000000  0x10 path/to/object.o", the name may be on a line of its own
+INPUT_SECTION = re.compile(r"^ (\S+)?\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(\S.*)$")
+OUTPUT_SECTION = re.compile(r"^(\.\S+)")
+# an input section name on a line of its own, its address, size and object are on the next line
+INPUT_SECTION_NAME = re.compile(r"^ (\S+)$")
+
+
+def object_name(path):
+    """Shorten an object path to its source file, e.g. sequence_manager.cpp or libc_nano.a(lib_a-memcpy.o)"""
+    name = os.path.basename(path.strip())
+    for suffix in (".obj", ".o"):
+        if name.endswith(suffix) and "(" not in name:
+            name = name[: -len(suffix)]
+    return name
+
+
+def parse_map(path):
+    """Get {object: {section: bytes}} and the size table {name: bytes} from a map file"""
+    usage = {}
+    sizes = {}
+    in_memory_map = False
+    output_section = None
+    input_section = None
+    with open(path, encoding="utf-8", errors="replace") as map_file:
+        for line in map_file:
+            line = line.rstrip("\n")
+            if line.startswith("Linker script and memory map"):
+                in_memory_map = True
+                continue
+            if not in_memory_map:
+                continue
+
+            output_match = OUTPUT_SECTION.match(line)
+            if output_match:
+                name = output_match.group(1)
+                if name == SIZE_TABLE:
+                    output_section = SIZE_TABLE
+                else:
+                    output_section = next((section for section in SECTIONS if name == section or name.startswith(section + ".")), None)
+                continue
+            if output_section is None:
+                continue
+
+            name_match = INPUT_SECTION_NAME.match(line)
+            if name_match:
+                input_section = name_match.group(1)
+                continue
+            input_match = INPUT_SECTION.match(line)
+            if not input_match or input_match.group(4).startswith("0x"):
+                # a symbol line or a fill
+                continue
+            size = int(input_match.group(3), 16)
+            if size == 0:
+                continue
+            if output_section == SIZE_TABLE:
+                name = input_match.group(1) or input_section
+                if name and name.startswith(SIZE_TABLE + "."):
+                    sizes[name[len(SIZE_TABLE) + 1 :]] = size
+                continue
+            sections = usage.setdefault(object_name(input_match.group(4)), dict.fromkeys(SECTIONS, 0))
+            sections[output_section] += size
+    return usage, sizes
+
+
+def print_sizes(sizes, baseline):
+    """Print the size table, in the order it was linked (the object, then its members)"""
+    if not sizes and not baseline:
+        return
+    print()
+    print("size table (objects and members the map has no symbol for):")
+    for name in list(sizes) + [name for name in baseline if name not in sizes]:
+        if baseline:
+            before = baseline.get(name, 0)
+            after = sizes.get(name, 0)
+            if before == after:
+                continue
+            print("{:<60}{:>22}".format(name, "{}/{} ({:+})".format(before, after, after - before)))
+        else:
+            print("{:<60}{:>10}".format(name, sizes[name]))
+
+
+def print_report(usage, baseline):
+    objects = sorted(usage.keys() | baseline.keys(), key=lambda name: -sum(usage.get(name, {}).get(section, 0) for section in RAM_SECTIONS))
+    empty = dict.fromkeys(SECTIONS, 0)
+
+    if baseline:
+        header = "{:<40}" + "{:>22}" * len(SECTIONS)
+        print(header.format("object", *["{} before/after".format(section) for section in SECTIONS]))
+    else:
+        header = "{:<40}" + "{:>10}" * len(SECTIONS)
+        print(header.format("object", *SECTIONS))
+
+    totals = dict.fromkeys(SECTIONS, 0)
+    baseline_totals = dict.fromkeys(SECTIONS, 0)
+    for name in objects:
+        after = usage.get(name, empty)
+        before = baseline.get(name, empty)
+        for section in SECTIONS:
+            totals[section] += after[section]
+            baseline_totals[section] += before[section]
+        if baseline:
+            if after == before:
+                continue
+            cells = ["{}/{} ({:+})".format(before[section], after[section], after[section] - before[section]) for section in SECTIONS]
+            print(("{:<40}" + "{:>22}" * len(SECTIONS)).format(name, *cells))
+        else:
+            print(("{:<40}" + "{:>10}" * len(SECTIONS)).format(name, *[after[section] for section in SECTIONS]))
+
+    if baseline:
+        cells = ["{}/{} ({:+})".format(baseline_totals[section], totals[section], totals[section] - baseline_totals[section]) for section in SECTIONS]
+        print(("{:<40}" + "{:>22}" * len(SECTIONS)).format("total", *cells))
+    else:
+        print(("{:<40}" + "{:>10}" * len(SECTIONS)).format("total", *[totals[section] for section in SECTIONS]))
+    print("RAM (.data + .bss + .noinit): {} bytes, startup copy of .data: {} bytes".format(sum(totals[section] for section in RAM_SECTIONS), totals[".data"]))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("map", help="the linker map file")
+    parser.add_argument("--baseline", help="a map file to compare against, ignored if it does not exist")
+    args = parser.parse_args()
+
+    if not os.path.exists(args.map):
+        print("{}: not found".format(args.map), file=sys.stderr)
+        return 1
+    usage, sizes = parse_map(args.map)
+    baseline_usage, baseline_sizes = parse_map(args.baseline) if args.baseline and os.path.exists(args.baseline) else ({}, {})
+    print_report(usage, baseline_usage)
+    print_sizes(sizes, baseline_sizes)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
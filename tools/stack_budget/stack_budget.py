@@ -0,0 +1,257 @@
+#!/usr/bin/env python3
+
+# MIT License
+
+# Copyright (c) 2022 Chris Sutton
+
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+"""Worst case stack depth of each entry point, from the -fstack-usage (.su) files and the call graph of the linked elf.
+
+usage: stack_budget.py --objdump arm-none-eabi-objdump --elf build.elf --su-dir . \\
+           --entry bass_station::SequenceManager::main_loop=768 --isr-budget 128 --total-budget 1024
+
+The call graph comes from the direct branches (bl, b, call, jmp) in the disassembly. Indirect calls (blx rN) can't be
+followed, so each function that makes them is listed and its known targets can be added with --call CALLER=CALLEE
+(CALLER may be a wildcard pattern, e.g. "bass_station::PatternBank::*", matching the functions that make indirect calls).
+Interrupt handlers (*_IRQHandler, *_Handler) are entry points too, each with the exception frame the core stacks on
+entry. The total is the deepest entry point plus the deepest handlers nested on top of it, one per preemption level
+(Cortex-M0+ has four interrupt priority levels).
+
+Exits non-zero when a budget is exceeded, the call graph has a cycle (recursion) or a frame is dynamic (alloca/VLA).
+"""
+
+import argparse
+import fnmatch
+import os
+import re
+import subprocess
+import sys
+
+# Cortex-M0+ stacks r0-r3, r12, lr, pc and xPSR on exception entry
+EXCEPTION_FRAME_BYTES = 32
+
+FUNCTION_HEADER = re.compile(r"^[0-9a-fA-F]+ <(.+)>:$")
+BRANCH = re.compile(r"^\s*[0-9a-fA-F]+:\s+(bl|b|b[a-z]{2}|call\w*|jmp|j[a-z]{1,3})(?:\.[nw])?\s+[0-9a-fA-F]+ <(.+?)(\+0x[0-9a-fA-F]+)?>")
+INDIRECT = re.compile(r"^\s*[0-9a-fA-F]+:\s+(blx\s+r\d+|blx\s+ip|call\w*\s+\*)")
+ISR_NAME = re.compile(r"^\w+_(IRQ)?Handler$")
+
+
+def function_name(decl):
+    """Get the qualified name of a function from its declaration, without the return type and parameters"""
+    depth = 0
+    end = len(decl)
+    for idx, char in enumerate(decl):
+        if char == "<":
+            depth += 1
+        elif char == ">":
+            depth -= 1
+        elif char == "(" and depth == 0 and idx > 0:
+            end = idx
+            break
+    # the return type is separated from the name by a space outside any template argument list
+    depth = 0
+    start = 0
+    for idx in range(end - 1, -1, -1):
+        char = decl[idx]
+        if char == ">":
+            depth += 1
+        elif char == "<":
+            depth -= 1
+        elif char == " " and depth == 0:
+            start = idx + 1
+            break
+    return decl[start:end].strip()
+
+
+def read_stack_usage(su_dir):
+    """Get {function: (bytes, qualifier)} from every .su file under a directory. Overloads share the largest frame."""
+    frames = {}
+    for root, _, files in os.walk(su_dir):
+        for file_name in files:
+            if not file_name.endswith(".su"):
+                continue
+            with open(os.path.join(root, file_name), encoding="utf-8", errors="replace") as su_file:
+                for line in su_file:
+                    fields = line.rstrip("\n").split("\t")
+                    if len(fields) != 3:
+                        continue
+                    # "file:line:column:declaration"
+                    decl = fields[0].split(":", 3)[-1]
+                    name = function_name(decl)
+                    size = int(fields[1])
+                    if name not in frames or frames[name][0] < size:
+                        frames[name] = (size, fields[2])
+    return frames
+
+
+def read_call_graph(objdump, elf):
+    """Get ({function: set(callees)}, {function: indirect call count}) from the disassembly"""
+    output = subprocess.run([objdump, "-d", "-C", "--no-show-raw-insn", elf], check=True, capture_output=True, text=True).stdout
+    calls = {}
+    indirect = {}
+    current = None
+    for line in output.splitlines():
+        header = FUNCTION_HEADER.match(line)
+        if header:
+            current = function_name(header.group(1))
+            calls.setdefault(current, set())
+            continue
+        if current is None:
+            continue
+        branch = BRANCH.match(line)
+        if branch:
+            target = function_name(branch.group(2))
+            # branches inside the function are not calls
+            if target != current:
+                calls[current].add(target)
+            continue
+        if INDIRECT.match(line):
+            indirect[current] = indirect.get(current, 0) + 1
+    return calls, indirect
+
+
+class Analysis:
+    def __init__(self, frames, calls):
+        self.frames = frames
+        self.calls = calls
+        self.depth = {}
+        self.next_call = {}
+        self.cycles = []
+        self.unknown = set()
+
+    def frame(self, function):
+        if function in self.frames:
+            return self.frames[function][0]
+        self.unknown.add(function)
+        return 0
+
+    def worst(self, function, visiting=()):
+        """Worst case stack bytes from entering a function"""
+        if function in self.depth:
+            return self.depth[function]
+        if function in visiting:
+            self.cycles.append(visiting[visiting.index(function):] + (function,))
+            return 0
+        visiting = visiting + (function,)
+        deepest = 0
+        deepest_callee = None
+        for callee in sorted(self.calls.get(function, ())):
+            callee_depth = self.worst(callee, visiting)
+            if callee_depth > deepest:
+                deepest = callee_depth
+                deepest_callee = callee
+        self.depth[function] = self.frame(function) + deepest
+        self.next_call[function] = deepest_callee
+        return self.depth[function]
+
+    def path(self, function):
+        chain = []
+        while function is not None and len(chain) < 64:
+            chain.append(function)
+            function = self.next_call.get(function)
+        return chain
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--objdump", default="objdump", help="the objdump of the toolchain")
+    parser.add_argument("--elf", required=True, help="the linked executable")
+    parser.add_argument("--su-dir", required=True, help="the build directory holding the .su files")
+    parser.add_argument("--entry", action="append", default=[], metavar="FUNCTION=BYTES", help="an entry point and its budget")
+    parser.add_argument("--isr-budget", type=int, default=0, help="the budget of each interrupt handler, 0 for none")
+    parser.add_argument("--total-budget", type=int, default=0, help="the budget of the whole stack, 0 for none")
+    parser.add_argument("--nesting-levels", type=int, default=4, help="how many interrupt handlers can nest")
+    parser.add_argument("--call", action="append", default=[], metavar="CALLER=CALLEE", help="a call made through a pointer")
+    parser.add_argument("--top", type=int, default=10, help="how many of the heaviest frames to show")
+    args = parser.parse_args()
+
+    frames = read_stack_usage(args.su_dir)
+    calls, indirect = read_call_graph(args.objdump, args.elf)
+    resolved = set()
+    for edge in args.call:
+        pattern, callee = edge.split("=", 1)
+        for caller in [name for name in indirect if fnmatch.fnmatchcase(name, pattern)] or [pattern]:
+            calls.setdefault(caller, set()).add(callee)
+            resolved.add(caller)
+
+    entries = []
+    for entry in args.entry:
+        name, budget = entry.rsplit("=", 1)
+        entries.append((name, int(budget), 0))
+    for name in sorted(calls):
+        if ISR_NAME.match(name):
+            entries.append((name, args.isr_budget, EXCEPTION_FRAME_BYTES))
+
+    analysis = Analysis(frames, calls)
+    failed = False
+    thread_worst = 0
+    isr_depths = []
+    print("{:<60}{:>8}{:>8}".format("entry point", "bytes", "budget"))
+    for name, budget, exception_frame in entries:
+        if name not in calls:
+            print("{:<60}{:>8}".format(name, "missing"))
+            failed = True
+            continue
+        depth = analysis.worst(name) + exception_frame
+        over = (budget != 0) and (depth > budget)
+        failed = failed or over
+        print("{:<60}{:>8}{:>8}{}".format(name, depth, budget if budget else "-", "  OVER BUDGET" if over else ""))
+        if over or not exception_frame:
+            for function in analysis.path(name):
+                print("    {:>6}  {}".format(analysis.frame(function), function))
+        if exception_frame:
+            isr_depths.append(depth)
+        else:
+            thread_worst = max(thread_worst, depth)
+
+    total = thread_worst + sum(sorted(isr_depths, reverse=True)[: args.nesting_levels])
+    total_over = (args.total_budget != 0) and (total > args.total_budget)
+    failed = failed or total_over
+    print("{:<60}{:>8}{:>8}{}".format("total (deepest entry + nested handlers)", total, args.total_budget if args.total_budget else "-",
+                                      "  OVER BUDGET" if total_over else ""))
+
+    print("\nheaviest frames:")
+    for name, (size, qualifier) in sorted(frames.items(), key=lambda item: -item[1][0])[: args.top]:
+        print("    {:>6}  {:<8}  {}".format(size, qualifier, name))
+
+    dynamic = sorted(name for name, (_, qualifier) in frames.items() if qualifier.startswith("dynamic") and qualifier != "dynamic,bounded")
+    if dynamic:
+        failed = True
+        print("\nunbounded dynamic frames:")
+        for name in dynamic:
+            print("    " + name)
+    if analysis.cycles:
+        failed = True
+        print("\nrecursion:")
+        for cycle in analysis.cycles:
+            print("    " + " -> ".join(cycle))
+    unresolved = sorted(name for name in indirect if name not in resolved and name in analysis.depth)
+    if unresolved:
+        print("\nindirect calls not followed (add --call CALLER=CALLEE):")
+        for name in unresolved:
+            print("    {} ({})".format(name, indirect[name]))
+    if analysis.unknown:
+        print("\n{} functions on the call paths have no .su entry (library or assembly code), counted as 0 bytes".format(len(analysis.unknown)))
+
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,153 @@
+// MIT License
+
+// Copyright (c) 2022 Chris Sutton
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Converts a binary trace capture (J-Link RTT logger, channel 1) into a timeline CSV:
+//
+//   trace_decode [--inputs] <capture.bin> [output.csv]
+//
+// With --inputs the capture is an input log (RTT channel 2, or INPUTS.BIN from the uSD card) instead.
+// The CSV is written to stdout if no output file is given.
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <trace_record.hpp>
+
+namespace
+{
+
+const char *trace_id_name(uint16_t id)
+{
+  switch (static_cast<bass_station::TraceId>(id))
+  {
+    case bass_station::TraceId::TEMPO_ISR:
+      return "tempo_isr";
+    case bass_station::TraceId::STEP_ADVANCE:
+      return "step_advance";
+    case bass_station::TraceId::KEY_EVENT:
+      return "key_event";
+    case bass_station::TraceId::SWITCH_WRITE:
+      return "switch_write";
+    case bass_station::TraceId::SWITCH_CLEAR:
+      return "switch_clear";
+    case bass_station::TraceId::LED_LATCH:
+      return "led_latch";
+    case bass_station::TraceId::MIDI_BYTE:
+      return "midi_byte";
+    case bass_station::TraceId::MODE_TOGGLE:
+      return "mode_toggle";
+    case bass_station::TraceId::MIDI_NOTE:
+      return "midi_note";
+    case bass_station::TraceId::RECORD_NOTE:
+      return "record_note";
+    case bass_station::TraceId::TAP_TEMPO:
+      return "tap_tempo";
+    case bass_station::TraceId::RATCHET_GATE:
+      return "ratchet_gate";
+  }
+  return "unknown";
+}
+
+const char *input_id_name(uint16_t id)
+{
+  switch (static_cast<bass_station::InputId>(id))
+  {
+    case bass_station::InputId::TEMPO_TICK:
+      return "tempo_tick";
+    case bass_station::InputId::KEY_EVENT:
+      return "key_event";
+    case bass_station::InputId::ENCODER:
+      return "encoder";
+    case bass_station::InputId::ENCODER_SWITCH:
+      return "encoder_switch";
+    case bass_station::InputId::KEY_PRESS_TIME:
+      return "key_press_time";
+    case bass_station::InputId::RATCHET_COMPARE:
+      return "ratchet_compare";
+  }
+  return "unknown";
+}
+
+uint32_t read_le32(const unsigned char *bytes) { return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<uint32_t>(bytes[3]) << 24); }
+
+uint16_t read_le16(const unsigned char *bytes) { return static_cast<uint16_t>(bytes[0] | (bytes[1] << 8)); }
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+  const bool inputs = (argc > 1) && (std::string(argv[1]) == "--inputs");
+  const int first_arg = inputs ? 2 : 1;
+  if (argc < first_arg + 1 || argc > first_arg + 2)
+  {
+    std::cerr << "usage: " << argv[0] << " [--inputs] <capture.bin> [output.csv]" << std::endl;
+    return 1;
+  }
+
+  std::ifstream capture(argv[first_arg], std::ios::binary);
+  if (!capture)
+  {
+    std::cerr << "cannot open " << argv[first_arg] << std::endl;
+    return 1;
+  }
+
+  std::ofstream output_file;
+  if (argc == first_arg + 2)
+  {
+    output_file.open(argv[first_arg + 1]);
+    if (!output_file)
+    {
+      std::cerr << "cannot open " << argv[first_arg + 1] << std::endl;
+      return 1;
+    }
+  }
+  std::ostream &csv = (argc == first_arg + 2) ? output_file : std::cout;
+
+  csv << "index,time_us,delta_us,event,arg0,arg1" << std::endl;
+
+  // the target timestamps are 32-bit and wrap every ~71 minutes, so accumulate the deltas into a 64-bit timeline
+  unsigned char bytes[sizeof(bass_station::TraceRecord)];
+  uint64_t record_index{0};
+  uint64_t time_us{0};
+  uint32_t previous_timestamp_us{0};
+  while (capture.read(reinterpret_cast<char *>(bytes), sizeof(bytes)))
+  {
+    const uint32_t timestamp_us = read_le32(&bytes[0]);
+    const uint16_t id           = read_le16(&bytes[4]);
+    const uint16_t arg0         = read_le16(&bytes[6]);
+    const uint32_t arg1         = read_le32(&bytes[8]);
+
+    const uint32_t delta_us = (record_index == 0) ? 0 : timestamp_us - previous_timestamp_us;
+    time_us += delta_us;
+    previous_timestamp_us = timestamp_us;
+
+    csv << record_index << "," << time_us << "," << delta_us << "," << (inputs ? input_id_name(id) : trace_id_name(id)) << "," << arg0 << "," << arg1 << "\n";
+    record_index++;
+  }
+
+  if (capture.gcount() != 0)
+  {
+    std::cerr << "warning: ignored " << capture.gcount() << " trailing bytes (truncated record)" << std::endl;
+  }
+  return 0;
+}